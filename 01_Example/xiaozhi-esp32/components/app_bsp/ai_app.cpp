@@ -3,6 +3,8 @@
 #include <esp_heap_caps.h>
 #include <esp_log.h>
 #include "ai_app.h"
+#include "http_stream_reader.h"
+#include "http_pool.h"
 
 /*Volcano Engine CA Certificate*/
 extern const uint8_t ark_vol_pem_start[] asm("_binary_ark_vol_pem_start");
@@ -20,13 +22,12 @@ dither_(dither)
     //jpg_buffer       = (uint8_t *) heap_caps_malloc(500 * 1024, MALLOC_CAP_SPIRAM);         // Store the JPG data
     //floyd_buffer     = (uint8_t *) heap_caps_malloc(width * height * 3, MALLOC_CAP_SPIRAM); // Store the data after applying the RGB888 jitter algorithm
     AIModelConfig    = (BaseAIModelConfig_t *) heap_caps_malloc(sizeof(BaseAIModelConfig_t),MALLOC_CAP_SPIRAM);
-    AIresponse.buffer = (char *) heap_caps_malloc(500 * 1024,MALLOC_CAP_SPIRAM);
     assert(ark_request_body);
     assert(url_copy);
     //assert(jpg_buffer);
     //assert(floyd_buffer);
     assert(AIModelConfig);
-    assert(AIresponse.buffer);
+    strcpy(sdcard_path,"/sdcard/04_sys_ai_img/sys_ai.epd");
 }
 
 BaseAIModel::BaseAIModel(CustomSDPort *SDPort,ImgDecodeDither &dither):
@@ -46,69 +47,53 @@ void BaseAIModel::BaseAIModel_AIModelInit(const char *ai_model, const char *ai_u
 BaseAIModel::~BaseAIModel() {
 }
 
-int BaseAIModel::BaseAIModel_HttpCallbackFun(esp_http_client_event_t *evt) {
-    http_response_t *resp = (http_response_t *) evt->user_data;
-    switch (evt->event_id) {
-    case HTTP_EVENT_ON_DATA:
-        if (!esp_http_client_is_chunked_response(evt->client)) {
-            int copy_len = evt->data_len;
-            memcpy(resp->buffer + resp->buffer_len, evt->data, copy_len);
-            resp->buffer_len += copy_len;
-            resp->buffer[resp->buffer_len] = '\0';
-            //ESP_LOGW("HTTP_CALLBACK", "Received data length: %d", copy_len);
-        }
-        break;
-    default:
-        break;
-    }
-    return ESP_OK;
-}
-
 const char *BaseAIModel::BaseAIModel_GetImgURL() {
     esp_http_client_config_t config = {};
     config.url                      = url;
-    config.event_handler            = BaseAIModel_HttpCallbackFun;
-    config.user_data                = &AIresponse;
     config.cert_pem                 = (const char *) ark_vol_pem_start;
-    esp_http_client_handle_t client = esp_http_client_init(&config);
+    config.method                   = HTTP_METHOD_POST;
+    esp_http_client_handle_t client = http_pool_acquire(&config);
+    if (client == NULL) {
+        return NULL;
+    }
 
     char auth_header[128];
     snprintf(auth_header, sizeof(auth_header), "Bearer %s", apk);
     ESP_LOGW(TAG, "apk:%s", auth_header);
 
-    esp_http_client_set_method(client, HTTP_METHOD_POST);
     esp_http_client_set_header(client, "Content-Type", "application/json");
     esp_http_client_set_header(client, "Authorization", auth_header);
-    esp_http_client_set_post_field(client, ark_request_body, strlen(ark_request_body));
-
-    esp_err_t err = esp_http_client_perform(client);
-    esp_http_client_cleanup(client);
 
+    esp_err_t err = http_pool_open(client, ark_request_body, strlen(ark_request_body), NULL);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Ark request failed: %s", esp_err_to_name(err));
-        AIresponse.buffer_len = 0;
+        http_pool_release(client, false);
         return NULL;
     }
+    int status = esp_http_client_get_status_code(client);
 
+    /*响应边收边解析, 只保留图片URL和错误信息*/
+    JsonDocument filter;
+    filter["data"][0]["url"]   = true;
+    filter["error"]["message"] = true;
     JsonDocument         desDoc;
-    DeserializationError error = deserializeJson(desDoc, AIresponse.buffer);
+    HttpStreamReader     reader(client);
+    DeserializationError error = deserializeJson(desDoc, reader, DeserializationOption::Filter(filter));
+    http_pool_release(client, !error);
 
     if (error) {
-        ESP_LOGE(TAG, "JSON parse failed");
-        AIresponse.buffer_len = 0;
+        ESP_LOGE(TAG, "JSON parse failed: %s", error.c_str());
         return NULL;
     }
 
     const char *url_str = desDoc["data"][0]["url"];
     if (url_str == NULL) {
-        AIresponse.buffer_len = 0;
+        const char *msg = desDoc["error"]["message"];
+        ESP_LOGE(TAG, "Ark status %d: %s", status, msg ? msg : "no image url");
         return NULL;
     }
 
-    strcpy(url_copy, url_str);
-    url_copy[strlen(url_copy)] = 0;
-
-    AIresponse.buffer_len = 0;
+    strlcpy(url_copy, url_str, 1024);
     return url_copy;
 }
 
@@ -120,37 +105,81 @@ uint8_t *BaseAIModel::BaseAIModel_DownloadImgToPsram(const char *strurl, int *ou
     ESP_LOGW("IMG URL", "%s", strurl);
     esp_http_client_config_t config = {};
     config.url                      = strurl;
-    config.event_handler            = BaseAIModel_HttpCallbackFun;
-    config.user_data                = &AIresponse;
     config.cert_pem                 = (const char *) ark_volces_chain_pem_start; // Some URLs may be in https format.
     config.buffer_size              = 4096;                                      // The default size is 1024, which has been increased to 4 KB.
     config.buffer_size_tx           = 2048;                                      // Send buffering
     config.timeout_ms               = 10000;                                     // Set the timeout to 10 seconds.
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    esp_http_client_set_method(client, HTTP_METHOD_GET);
-
-    esp_err_t err = esp_http_client_perform(client);
-    esp_http_client_cleanup(client);
+    config.method                   = HTTP_METHOD_GET;
+    esp_http_client_handle_t client = http_pool_acquire(&config);
+    if (client == NULL) {
+        return NULL;
+    }
 
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Image download failed: %s", esp_err_to_name(err));
-        AIresponse.buffer_len = 0;
+    int64_t   content_length = 0;
+    int       status         = 0;
+    int       redirect       = 0;
+    esp_err_t err            = ESP_OK;
+    for (; redirect < 3; redirect++) {
+        err = http_pool_open(client, NULL, 0, &content_length);
+        if (err != ESP_OK) {
+            break;
+        }
+        status = esp_http_client_get_status_code(client);
+        if (status < 300 || status >= 400) {
+            break;
+        }
+        esp_http_client_set_redirection(client);   // 签名URL可能被重定向到存储节点
+        esp_http_client_close(client);
+    }
+    if (err != ESP_OK || status != 200) {
+        ESP_LOGE(TAG, "Image download failed: %s, status %d", esp_err_to_name(err), status);
+        http_pool_release(client, false);
         return NULL;
     }
 
-    //if (!jpg_buffer) {
-    //    ESP_LOGE(TAG, "PSRAM malloc failed, size=%d", AIresponse.buffer_len);
-    //    return NULL;
-    //}
+    /*有Content-Length时一次分配到位, chunked时按块扩容, 不再有固定的500KB上限*/
+    int      capacity = (content_length > 0) ? (int) content_length : 128 * 1024;
+    int      len      = 0;
+    uint8_t *buffer   = (uint8_t *) heap_caps_malloc(capacity, MALLOC_CAP_SPIRAM);
+    while (buffer != NULL) {
+        if (len == capacity) {
+            if (content_length > 0) {
+                break;
+            }
+            uint8_t *grow = (uint8_t *) heap_caps_realloc(buffer, capacity + 128 * 1024, MALLOC_CAP_SPIRAM);
+            if (grow == NULL) {
+                heap_caps_free(buffer);
+                buffer = NULL;
+                break;
+            }
+            buffer = grow;
+            capacity += 128 * 1024;
+        }
+        int n = esp_http_client_read(client, (char *) buffer + len, capacity - len);
+        if (n <= 0) {
+            if (n < 0) {
+                heap_caps_free(buffer);
+                buffer = NULL;
+            }
+            break;
+        }
+        len += n;
+    }
+    /*重定向后句柄指向了别的主机, 不再放回池里*/
+    http_pool_release(client, buffer != NULL && redirect == 0);
 
-    //memcpy(jpg_buffer, AIresponse.buffer, AIresponse.buffer_len);
+    if (buffer == NULL || len == 0 || (content_length > 0 && len != content_length)) {
+        ESP_LOGE(TAG, "Image download failed: %d of %d bytes", len, (int) content_length);
+        if (buffer != NULL) {
+            heap_caps_free(buffer);
+        }
+        return NULL;
+    }
     if (out_len != NULL) {
-        *out_len = AIresponse.buffer_len;
+        *out_len = len;
     }
-    ESP_LOGI(TAG, "Image downloaded to PSRAM, size=%d bytes", AIresponse.buffer_len);
-    //return jpg_buffer;
-    AIresponse.buffer_len = 0;
-    return (uint8_t *)AIresponse.buffer;
+    ESP_LOGI(TAG, "Image downloaded to PSRAM, size=%d bytes", len);
+    return buffer;
 }
 
 uint8_t BaseAIModel::BaseAIModel_PsramToSdcard(char *strPath, uint8_t *buffer, int len) {
@@ -176,40 +205,52 @@ void BaseAIModel::BaseAIModel_SetChat(const char *str) {
     }
 }
 
-char *BaseAIModel::BaseAIModel_GetImgName() {
+esp_err_t BaseAIModel::BaseAIModel_GenerateImg() {
     if (!is_success) {
         ESP_LOGE(TAG, "set_chat fill");
-        return NULL;
+        return ESP_ERR_INVALID_STATE;
     }
     if (BaseAIModel_GetImgURL() == NULL) {
         ESP_LOGE(TAG, "read URL fill");
-        return NULL;
+        return ESP_FAIL;
     }
 
-    int jpg_size = 0;
-    if (BaseAIModel_DownloadImgToPsram(url_copy, &jpg_size) == NULL) {
+    int      len = 0;
+    uint8_t *jpg = BaseAIModel_DownloadImgToPsram(url_copy, &len);
+    if (jpg == NULL) {
         ESP_LOGE(TAG, "http get img data fill");
-        return NULL;
+        return ESP_FAIL;
     }
-    int dec_jpg_size = 0;
-    if (dither_.ImgDecode_OneJPGPicture((uint8_t *)AIresponse.buffer, jpg_size, &jpg_dec_buffer, &dec_jpg_size) != ESP_OK) {
-        ESP_LOGE(TAG, "jpg dec fill");
-        if (jpg_dec_buffer != NULL) {
-            dither_.ImgDecode_JPGBufferFree(jpg_dec_buffer);
-        }
-        return NULL;
+    /*解码和抖动交给显示任务, 直接写入显存*/
+    if (jpg_buffer != NULL) {
+        heap_caps_free(jpg_buffer);
     }
-    floyd_buffer     = (uint8_t *) heap_caps_malloc(width_ * height_ * 3, MALLOC_CAP_SPIRAM); // Store the data after applying the RGB888 jitter algorithm
-    dither_.ImgDecode_DitherRgb888(jpg_dec_buffer, floyd_buffer, width_, height_);            //The RGB888 data has undergone the jittering algorithm.
-    dither_.ImgDecode_JPGBufferFree(jpg_dec_buffer);                                          //Release memory
-    strcpy(sdcard_path,"/sdcard/04_sys_ai_img/sys_ai.bmp");
-    if (dither_.ImgDecode_EncodingBmpToSdcard(sdcard_path, floyd_buffer, width_, height_) != ESP_OK) {
-        ESP_LOGE(TAG, "rgb888 to sdcard is bmp fill");
-        return NULL;
+    jpg_buffer = jpg;
+    jpg_len    = len;
+    return ESP_OK;
+}
+
+uint8_t *BaseAIModel::BaseAIModel_TakeImg(int *len) {
+    uint8_t *jpg = jpg_buffer;
+    *len         = jpg_len;
+    jpg_buffer   = NULL;
+    jpg_len      = 0;
+    return jpg;
+}
+
+/*FNV-1a: 提示词+模型+尺寸, 同一个key对应SD卡上同一张缓存图*/
+uint32_t BaseAIModel::BaseAIModel_PromptKey(const char *prompt) {
+    char     size[16];
+    uint32_t hash = 2166136261u;
+    snprintf(size, sizeof(size), "%dx%d", width_, height_);
+    const char *parts[3] = {prompt, model != NULL ? model : "", size};
+    for (int i = 0; i < 3; i++) {
+        for (const char *p = parts[i]; *p; p++) {
+            hash = (hash ^ (uint8_t) *p) * 16777619u;
+        }
+        hash = (hash ^ 0xff) * 16777619u;   // 分隔符, 避免拼接歧义
     }
-    heap_caps_free(floyd_buffer);
-    floyd_buffer = NULL;
-    return sdcard_path;
+    return hash;
 }
 
 BaseAIModelConfig_t* BaseAIModel::BaseAIModel_SdcardReadAIModelConfig() {
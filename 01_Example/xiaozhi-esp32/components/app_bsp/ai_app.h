@@ -6,12 +6,6 @@
 #include "ArduinoJson.h"
 
 
-/*HTTP POST callback, used to collect the JSON returned by Ark*/
-typedef struct {
-    char *buffer;
-    int buffer_len;
-} http_response_t;
-
 typedef struct 
 {
     int time;
@@ -35,15 +29,12 @@ private:
     char sdcard_path[100] = {""};       // Return the final generated SD card path
     int path_value = 0;                 // SD card identifier symbol
     bool is_success = false;            // Flag indicating whether the image was successfully generated
-    uint8_t *jpg_buffer = NULL;         // Store the JPG image data
-    uint8_t *jpg_dec_buffer = NULL;     // Store the image after decoding JPG, no need to allocate memory, automatically allocated
-    uint8_t *floyd_buffer = NULL;       // Store the data after applying the RGB888 jitter algorithm
+    uint8_t *jpg_buffer = NULL;         // Downloaded JPG, sized from Content-Length, handed over by BaseAIModel_TakeImg
+    int jpg_len = 0;
     int width_;
     int height_;
     BaseAIModelConfig_t* AIModelConfig;
-    http_response_t AIresponse = {0};
 
-    static int BaseAIModel_HttpCallbackFun(esp_http_client_event_t *evt);
     const char* BaseAIModel_GetImgURL();                                            // Obtain the URL of the generated image
     uint8_t* BaseAIModel_DownloadImgToPsram(const char *strurl, int *out_len);      // Download the JPG image from the URL and save it to the PSRAM
     uint8_t BaseAIModel_PsramToSdcard(char *strPath,uint8_t *buffer,int len);       // Copy the data from the PSRAM to the SD card
@@ -55,8 +46,10 @@ public:
     BaseAIModelConfig_t* BaseAIModel_SdcardReadAIModelConfig();
     void BaseAIModel_AIModelInit(const char *ai_model, const char *ai_url, const char *ark_api_key);
     void BaseAIModel_SetChat(const char *str);                                      // Generate chat
-    char *BaseAIModel_GetImgName();                                                 // Obtain the path of the last generated BMP file on the SDcard
-    char *Get_AiTFImgName() {return sdcard_path;}
+    esp_err_t BaseAIModel_GenerateImg();                                            // Request and download the image, keep the JPG in PSRAM
+    uint8_t *BaseAIModel_TakeImg(int *len);                                         // Take over the downloaded JPG (free with heap_caps_free), NULL if none
+    uint32_t BaseAIModel_PromptKey(const char *prompt);                            // Cache key of prompt + model + size
+    char *Get_AiTFImgName() {return sdcard_path;}                                   // Archive path of the generated image (.epd frame)
 };
 
 
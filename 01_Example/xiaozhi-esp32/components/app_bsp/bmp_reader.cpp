@@ -0,0 +1,390 @@
+#include <stdio.h>
+#include <string.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include "bmp_reader.h"
+
+#define BMP_READ_ALIGN     512         // FAT sector size, keeps every fread on a sector boundary
+#define BMP_READ_CHUNK_LEN (32 * 1024) // Multiple of BMP_READ_ALIGN
+
+const uint8_t BMP_INK_PALETTE[BMP_INK_PALETTE_LEN][3] = {
+    {0, 0, 0},       // ColorBlack
+    {255, 255, 255}, // ColorWhite
+    {255, 255, 0},   // ColorYellow
+    {255, 0, 0},     // ColorRed
+    {255, 255, 255}, // Unused by the panel
+    {0, 0, 255},     // ColorBlue
+    {0, 255, 0}      // ColorGreen
+};
+
+BmpReader::BmpReader() {
+    memset(palette_, 0, sizeof(palette_));
+}
+
+BmpReader::~BmpReader() {
+    BmpReader_Close();
+}
+
+esp_err_t BmpReader::BmpReader_Open(const char *path) {
+    BmpReader_Close();
+    fp_ = fopen(path, "rb");
+    if (fp_ == NULL) {
+        ESP_LOGE(TAG, "Cannot open BMP file: %s", path);
+        return ESP_FAIL;
+    }
+    setvbuf(fp_, NULL, _IONBF, 0);   // Reads below are already large, skip the stdio copy
+    if (BmpReader_ParseHeader() != ESP_OK || BmpReader_AllocBuffers() != ESP_OK) {
+        BmpReader_Close();
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "BMP information: %dx%d, %d bit, compression: %ld, %s%s", width_, height_, bit_count_, compression_,
+             top_down_ ? "top-down" : "bottom-up", ink_palette_ ? ", ink palette" : "");
+    return ESP_OK;
+}
+
+void BmpReader::BmpReader_Close() {
+    if (fp_ != NULL) {
+        fclose(fp_);
+        fp_ = NULL;
+    }
+    if (chunk_ != NULL) {
+        heap_caps_free(chunk_);
+        chunk_ = NULL;
+    }
+    if (row_ != NULL) {
+        heap_caps_free(row_);
+        row_ = NULL;
+    }
+}
+
+esp_err_t BmpReader::BmpReader_ParseHeader() {
+    BITMAPFILEHEADER file_header;
+    BITMAPINFOHEADER info_header;
+    if (fread(&file_header, sizeof(BITMAPFILEHEADER), 1, fp_) != 1 || file_header.bfType != 0x4D42) {
+        ESP_LOGE(TAG, "Not a valid BMP file");
+        return ESP_FAIL;
+    }
+    if (fread(&info_header, sizeof(BITMAPINFOHEADER), 1, fp_) != 1 || info_header.biSize < sizeof(BITMAPINFOHEADER)) {
+        ESP_LOGE(TAG, "Unsupported BMP info header");
+        return ESP_FAIL;
+    }
+    width_       = info_header.biWidth;
+    height_      = (info_header.biHeight < 0) ? -info_header.biHeight : info_header.biHeight;
+    top_down_    = (info_header.biHeight < 0);
+    bit_count_   = info_header.biBitCount;
+    compression_ = info_header.biCompression;
+    data_offset_ = file_header.bfOffBits;
+    if (width_ <= 0 || height_ <= 0) {
+        ESP_LOGE(TAG, "Invalid BMP size: %dx%d", width_, height_);
+        return ESP_FAIL;
+    }
+
+    bool supported = false;
+    if (compression_ == BMP_BI_RGB) {
+        supported = (bit_count_ == 1 || bit_count_ == 4 || bit_count_ == 8 || bit_count_ == 24 || bit_count_ == 32);
+    } else if (compression_ == BMP_BI_RLE8) {
+        supported = (bit_count_ == 8 && !top_down_);
+    } else if (compression_ == BMP_BI_BITFIELDS) {
+        supported = (bit_count_ == 32);
+    }
+    if (!supported) {
+        ESP_LOGE(TAG, "Unsupported BMP format! bit depth: %d, compression method: %ld", bit_count_, compression_);
+        return ESP_FAIL;
+    }
+    stride_ = ((width_ * bit_count_ + 31) / 32) * 4;
+
+    /*Colour masks follow a 40-byte header, or live inside V4/V5 headers*/
+    uint32_t extra_len = 0;
+    masks_[0] = 0x00FF0000;
+    masks_[1] = 0x0000FF00;
+    masks_[2] = 0x000000FF;
+    if (compression_ == BMP_BI_BITFIELDS) {
+        if (fread(masks_, sizeof(uint32_t), 3, fp_) != 3) {
+            ESP_LOGE(TAG, "Missing BMP bitfield masks");
+            return ESP_FAIL;
+        }
+        if (info_header.biSize == sizeof(BITMAPINFOHEADER)) {
+            extra_len = sizeof(masks_);
+        }
+    }
+    for (int i = 0; i < 3; i++) {
+        uint8_t shift = 0;
+        while (shift < 24 && ((masks_[i] >> shift) & 0x01) == 0) {
+            shift++;
+        }
+        if ((masks_[i] >> shift) != 0xFF) {
+            ESP_LOGE(TAG, "Only 8-bit colour masks are supported: 0x%08lx", masks_[i]);
+            return ESP_FAIL;
+        }
+        shifts_[i] = shift;
+    }
+
+    palette_len_ = 0;
+    if (bit_count_ <= 8) {
+        int max_len  = 1 << bit_count_;
+        palette_len_ = (info_header.biClrUsed == 0 || info_header.biClrUsed > (uint32_t) max_len) ? max_len : info_header.biClrUsed;
+        uint8_t bgrx[256 * 4];
+        fseek(fp_, sizeof(BITMAPFILEHEADER) + info_header.biSize + extra_len, SEEK_SET);
+        if (fread(bgrx, 4, palette_len_, fp_) != (size_t) palette_len_) {
+            ESP_LOGE(TAG, "Truncated BMP palette");
+            return ESP_FAIL;
+        }
+        for (int i = 0; i < palette_len_; i++) {
+            palette_[i][0] = bgrx[i * 4 + 2];
+            palette_[i][1] = bgrx[i * 4 + 1];
+            palette_[i][2] = bgrx[i * 4 + 0];
+        }
+    }
+    ink_palette_ = BmpReader_CheckInkPalette();
+    return ESP_OK;
+}
+
+bool BmpReader::BmpReader_CheckInkPalette() {
+    if (bit_count_ != 4 || compression_ != BMP_BI_RGB || palette_len_ > BMP_INK_PALETTE_LEN) {
+        return false;
+    }
+    for (int i = 0; i < palette_len_; i++) {
+        if (i == 4) {
+            continue;
+        }
+        if (memcmp(palette_[i], BMP_INK_PALETTE[i], 3) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+esp_err_t BmpReader::BmpReader_AllocBuffers() {
+    /*One stride of carry space in front of the read area holds a row split across two reads*/
+    chunk_len_ = BMP_READ_CHUNK_LEN;
+    while (chunk_len_ < stride_) {
+        chunk_len_ += BMP_READ_CHUNK_LEN;
+    }
+    int total = stride_ + chunk_len_;
+    chunk_    = (uint8_t *) heap_caps_malloc(total, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    if (chunk_ == NULL) {
+        chunk_ = (uint8_t *) heap_caps_malloc(total, MALLOC_CAP_SPIRAM);
+    }
+    row_ = (uint8_t *) heap_caps_malloc(width_ * 4, MALLOC_CAP_SPIRAM); // RGB888 row + RLE8 index row
+    if (chunk_ == NULL || row_ == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate BMP read buffers");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+void BmpReader::BmpReader_ConvertRow(const uint8_t *src, BmpRowFormat_t format) {
+    uint8_t *out = row_;
+    if (bit_count_ == 24) {
+        for (int x = 0; x < width_; x++, src += 3, out += 3) {
+            out[0] = src[2];
+            out[1] = src[1];
+            out[2] = src[0];
+        }
+        return;
+    }
+    if (bit_count_ == 32) {
+        for (int x = 0; x < width_; x++, src += 4, out += 3) {
+            uint32_t px = src[0] | (src[1] << 8) | (src[2] << 16) | ((uint32_t) src[3] << 24);
+            out[0] = (px & masks_[0]) >> shifts_[0];
+            out[1] = (px & masks_[1]) >> shifts_[1];
+            out[2] = (px & masks_[2]) >> shifts_[2];
+        }
+        return;
+    }
+    for (int x = 0; x < width_; x++) {
+        uint8_t index;
+        if (bit_count_ == 8) {
+            index = src[x];
+        } else if (bit_count_ == 4) {
+            index = (x & 1) ? (src[x >> 1] & 0x0F) : (src[x >> 1] >> 4);
+        } else {
+            index = (src[x >> 3] >> (7 - (x & 7))) & 0x01;
+        }
+        if (format == BmpRowIndex8) {
+            out[x] = index;
+        } else {
+            out[x * 3 + 0] = palette_[index][0];
+            out[x * 3 + 1] = palette_[index][1];
+            out[x * 3 + 2] = palette_[index][2];
+        }
+    }
+}
+
+esp_err_t BmpReader::BmpReader_ReadRows(BmpRowFormat_t format, BmpRowCallback_t cb, void *ctx) {
+    if (fp_ == NULL || cb == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if ((format == BmpRowIndex8 && palette_len_ == 0) || (format == BmpRowInk4 && !ink_palette_)) {
+        ESP_LOGE(TAG, "Row format %d is not available for this file", format);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (compression_ == BMP_BI_RLE8) {
+        return BmpReader_ReadRowsRLE8(format, cb, ctx);
+    }
+
+    uint32_t pos  = data_offset_ & ~(BMP_READ_ALIGN - 1);
+    int      skip = data_offset_ - pos;
+    int      have = 0;  // Bytes of a split row kept in front of the read area
+    int      row  = 0;
+    uint8_t *area = chunk_ + stride_;
+    fseek(fp_, pos, SEEK_SET);
+    while (row < height_) {
+        int      got   = fread(area, 1, chunk_len_, fp_);
+        uint8_t *p     = area - have + skip;
+        int      avail = have + got - skip;
+        skip           = 0;
+        while (avail >= stride_ && row < height_) {
+            int y = top_down_ ? row : (height_ - 1 - row);
+            if (format == BmpRowInk4) {
+                cb(y, p, ctx);
+            } else {
+                BmpReader_ConvertRow(p, format);
+                cb(y, row_, ctx);
+            }
+            p += stride_;
+            avail -= stride_;
+            row++;
+        }
+        if (got < chunk_len_ || avail < 0) {
+            break;
+        }
+        have = avail;
+        memmove(area - have, p, have);
+    }
+    if (row < height_) {
+        ESP_LOGE(TAG, "Truncated BMP pixel data (%d/%d rows)", row, height_);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t BmpReader::BmpReader_ReadRowsTopDown(BmpRowFormat_t format, BmpRowCallback_t cb, void *ctx) {
+    if (top_down_) {
+        return BmpReader_ReadRows(format, cb, ctx);
+    }
+    if (fp_ == NULL || cb == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (compression_ == BMP_BI_RLE8 || (format == BmpRowIndex8 && palette_len_ == 0) || (format == BmpRowInk4 && !ink_palette_)) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    /*Walk the bottom-up file backwards one chunk at a time*/
+    int rows_per_chunk = chunk_len_ / stride_;
+    for (int top = 0; top < height_;) {
+        int  rows = (height_ - top < rows_per_chunk) ? (height_ - top) : rows_per_chunk;
+        long pos  = data_offset_ + (long) (height_ - top - rows) * stride_;
+        if (fseek(fp_, pos, SEEK_SET) != 0 || fread(chunk_, stride_, rows, fp_) != (size_t) rows) {
+            ESP_LOGE(TAG, "Truncated BMP pixel data (%d/%d rows)", top, height_);
+            return ESP_FAIL;
+        }
+        for (int i = 0; i < rows; i++) {
+            const uint8_t *src = chunk_ + (rows - 1 - i) * stride_;
+            if (format == BmpRowInk4) {
+                cb(top + i, src, ctx);
+            } else {
+                BmpReader_ConvertRow(src, format);
+                cb(top + i, row_, ctx);
+            }
+        }
+        top += rows;
+    }
+    return ESP_OK;
+}
+
+int BmpReader::BmpReader_NextByte() {
+    if (chunk_pos_ >= chunk_fill_) {
+        chunk_fill_ = fread(chunk_, 1, chunk_len_, fp_);
+        chunk_pos_  = 0;
+        if (chunk_fill_ <= 0) {
+            return -1;
+        }
+    }
+    return chunk_[chunk_pos_++];
+}
+
+esp_err_t BmpReader::BmpReader_ReadRowsRLE8(BmpRowFormat_t format, BmpRowCallback_t cb, void *ctx) {
+    uint8_t *index_row = row_ + width_ * 3;
+    uint32_t pos       = data_offset_ & ~(BMP_READ_ALIGN - 1);
+    int      x         = 0;
+    int      row       = 0;
+    bool     done      = false;
+    fseek(fp_, pos, SEEK_SET);
+    chunk_fill_ = 0;
+    chunk_pos_  = 0;
+    for (uint32_t i = pos; i < data_offset_; i++) {
+        BmpReader_NextByte();
+    }
+    memset(index_row, 0, width_);
+
+    /*RLE8 files are always bottom-up, undefined pixels are left at index 0*/
+    auto emit_row = [&]() {
+        if (row >= height_) {
+            return;
+        }
+        if (format == BmpRowIndex8) {
+            cb(height_ - 1 - row, index_row, ctx);
+        } else {
+            for (int i = 0; i < width_; i++) {
+                memcpy(row_ + i * 3, palette_[index_row[i]], 3);
+            }
+            cb(height_ - 1 - row, row_, ctx);
+        }
+        memset(index_row, 0, width_);
+        row++;
+        x = 0;
+    };
+
+    while (!done && row < height_) {
+        int count = BmpReader_NextByte();
+        int value = BmpReader_NextByte();
+        if (count < 0 || value < 0) {
+            break;
+        }
+        if (count > 0) {
+            for (int i = 0; i < count; i++, x++) {
+                if (x < width_) {
+                    index_row[x] = value;
+                }
+            }
+            continue;
+        }
+        if (value == 0) {          // End of line
+            emit_row();
+        } else if (value == 1) {   // End of bitmap
+            done = true;
+        } else if (value == 2) {   // Delta
+            int dx = BmpReader_NextByte();
+            int dy = BmpReader_NextByte();
+            if (dx < 0 || dy < 0) {
+                break;
+            }
+            int keep_x = x + dx;
+            while (dy-- > 0) {
+                emit_row();
+            }
+            x = keep_x;
+        } else {                   // Absolute run, padded to a 16-bit boundary
+            for (int i = 0; i < value; i++, x++) {
+                int index = BmpReader_NextByte();
+                if (index < 0) {
+                    break;
+                }
+                if (x < width_) {
+                    index_row[x] = index;
+                }
+            }
+            if (value & 0x01) {
+                BmpReader_NextByte();
+            }
+        }
+    }
+    if (!done && row < height_) {
+        ESP_LOGW(TAG, "RLE8 data ended early at row %d/%d", row, height_);
+    }
+    while (row < height_) {
+        emit_row();
+    }
+    return ESP_OK;
+}
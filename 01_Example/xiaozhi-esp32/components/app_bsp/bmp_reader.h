@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdio.h>
+#include <esp_err.h>
+#include "imgdecode_app.h"
+
+#define BMP_BI_RGB       0
+#define BMP_BI_RLE8      1
+#define BMP_BI_BITFIELDS 3
+
+/*Panel ink palette, indexed by the same values as ColorSelection in display_bsp.h*/
+#define BMP_INK_PALETTE_LEN 7
+extern const uint8_t BMP_INK_PALETTE[BMP_INK_PALETTE_LEN][3];
+
+typedef enum {
+    BmpRowRGB888 = 0, // 3 bytes per pixel, R,G,B
+    BmpRowIndex8,     // 1 palette index per pixel, palettized files only
+    BmpRowInk4,       // 2 ink pixels per byte (high nibble first), ink palette files only
+} BmpRowFormat_t;
+
+/*Rows are delivered in file order, y is always the top-down row number*/
+typedef void (*BmpRowCallback_t)(int y, const uint8_t *row, void *ctx);
+
+class BmpReader
+{
+private:
+    const char *TAG = "BmpReader";
+    FILE    *fp_          = NULL;
+    uint8_t *chunk_       = NULL; // Multi-row read buffer
+    uint8_t *row_         = NULL; // Converted output row
+    int      chunk_len_   = 0;
+    int      chunk_pos_   = 0;    // RLE8 byte cursor inside chunk_
+    int      chunk_fill_  = 0;
+    uint32_t data_offset_ = 0;
+    int      width_       = 0;
+    int      height_      = 0;
+    bool     top_down_    = false;
+    uint16_t bit_count_   = 0;
+    uint32_t compression_ = 0;
+    int      stride_      = 0;    // Bytes per stored row, padding included
+    uint32_t masks_[3]    = {0};  // R,G,B masks of 32-bit files
+    uint8_t  shifts_[3]   = {0};
+    uint8_t  palette_[256][3];    // R,G,B
+    int      palette_len_ = 0;
+    bool     ink_palette_ = false;
+
+    esp_err_t BmpReader_ParseHeader();
+    esp_err_t BmpReader_AllocBuffers();
+    bool      BmpReader_CheckInkPalette();
+    void      BmpReader_ConvertRow(const uint8_t *src, BmpRowFormat_t format);
+    int       BmpReader_NextByte();
+    esp_err_t BmpReader_ReadRowsRLE8(BmpRowFormat_t format, BmpRowCallback_t cb, void *ctx);
+
+public:
+    BmpReader();
+    ~BmpReader();
+
+    esp_err_t BmpReader_Open(const char *path);
+    void      BmpReader_Close();
+    int       BmpReader_GetWidth() {return width_;}
+    int       BmpReader_GetHeight() {return height_;}
+    bool      BmpReader_IsPalettized() {return palette_len_ > 0;}
+    bool      BmpReader_IsInkPalette() {return ink_palette_;}
+    bool      BmpReader_IsCompressed() {return compression_ == BMP_BI_RLE8;}
+    int       BmpReader_GetPaletteLen() {return palette_len_;}
+    const uint8_t *BmpReader_GetPaletteColor(int index) {return palette_[index];}
+    esp_err_t BmpReader_ReadRows(BmpRowFormat_t format, BmpRowCallback_t cb, void *ctx);
+    esp_err_t BmpReader_ReadRowsTopDown(BmpRowFormat_t format, BmpRowCallback_t cb, void *ctx);  /*Uncompressed files only*/
+};
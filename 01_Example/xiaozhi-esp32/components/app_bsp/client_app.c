@@ -6,10 +6,15 @@ At present, the content of this document only supports weather acquisition in Ch
 Therefore, there are Chinese prints and Chinese annotations in this document. We apologize for any inconvenience
 If you have friendly weather and WiFi location information outside Chinese mainland, please feel free to give us your feedback
 ********************************************************/
+#include <time.h>
 #include "client_app.h"
 #include "cJSON.h"
 #include "esp_http_client.h"
 #include "esp_log.h"
+#include "esp_wifi.h"
+#include "esp_netif.h"
+#include "nvs.h"
+#include "http_pool.h"
 
 #define MIN(x, y) ((x < y) ? (x) : (y))
 
@@ -25,6 +30,18 @@ extern const char api_root_cert_pem_end[] asm("_binary_api_root_cert_pem_end");
 #define UserDateURL "http://t.weather.sojson.com/api/weather/city/101280601"
 #define AMAP_IP_URL "http://restapi.amap.com/v3/ip?key=0113a13c88697dcea6a445584d535837"
 
+/*定位结果和天气数据缓存: 小字段放NVS, 天气原文放SD卡*/
+#define WEATHER_CACHE_NVS   "wx_cache"
+#define WEATHER_CACHE_FILE  "/sdcard/01_sys_init_img/weather_cache.json"
+#define ADCODE_CACHE_TTL    (7 * 24 * 3600)   // 同一网络下定位结果的有效期
+#define WEATHER_CACHE_TTL   (30 * 60)         // 天气数据不重新请求的时间
+#define CACHE_TIME_VALID(t) ((t) > 1700000000) // 时间还没同步时不按TTL判断
+
+typedef struct {
+    char etag[64];
+    char last_modified[40];
+} weather_validators_t;
+
 /*
 HTTP_EVENT_ERROR	请求出错
 HTTP_EVENT_ON_CONNECTED	建立连接成功
@@ -48,6 +65,7 @@ esp_err_t _http_event_handler(esp_http_client_event_t *evt) {
         break;
     case HTTP_EVENT_HEADER_SENT:
         ESP_LOGI(TAG, "HTTP_EVENT_HEADER_SENT");
+        output_len = 0; // 复用的连接不会再有 ON_CONNECTED
         break;
     case HTTP_EVENT_ON_HEADER:
         ESP_LOGI(TAG, "HTTP_EVENT_ON_HEADER, key=%s, value=%s", evt->header_key, evt->header_value);
@@ -104,6 +122,8 @@ esp_err_t _http_event_handler(esp_http_client_event_t *evt) {
 const char *fetch_weather_data(void) {
 
     char                    *local_response_buffer = (char *) heap_caps_malloc(MAX_HTTP_OUTPUT_BUFFER + 1, MALLOC_CAP_SPIRAM);
+    if (!local_response_buffer)
+        return NULL;
     esp_http_client_config_t config =
         {
             .url                   = UserDateURL,
@@ -111,7 +131,12 @@ const char *fetch_weather_data(void) {
             .user_data             = local_response_buffer,
             .disable_auto_redirect = true,
         };
-    esp_http_client_handle_t client = esp_http_client_init(&config);
+    esp_http_client_handle_t client = http_pool_acquire(&config);
+    if (client == NULL) {
+        ESP_LOGE(TAG, "HTTP client unavailable");
+        heap_caps_free(local_response_buffer);
+        return NULL;
+    }
     // GET
     esp_err_t err = esp_http_client_perform(client);
     if (err == ESP_OK) {
@@ -125,7 +150,7 @@ const char *fetch_weather_data(void) {
     //printf("str:%s\n",local_response_buffer);
     //heap_caps_free(local_response_buffer);
     //local_response_buffer = NULL;
-    esp_http_client_cleanup(client);
+    http_pool_release(client, err == ESP_OK);
 
     return local_response_buffer;
 }
@@ -167,9 +192,13 @@ int fetch_adcode(char *adcode_buf, size_t buf_len) {
         .disable_auto_redirect = true,
         // .cert_pem = api_root_cert_pem_start,
     };
-    esp_http_client_handle_t client = esp_http_client_init(&config);
+    esp_http_client_handle_t client = http_pool_acquire(&config);
+    if (client == NULL) {
+        heap_caps_free(local_response_buffer);
+        return 0;
+    }
     esp_err_t                err    = esp_http_client_perform(client);
-    esp_http_client_cleanup(client);
+    http_pool_release(client, err == ESP_OK);
 
     if (err != ESP_OK) {
         heap_caps_free(local_response_buffer);
@@ -221,39 +250,152 @@ int fetch_adcode(char *adcode_buf, size_t buf_len) {
     return ret;
 }
 
+// 天气请求只关心响应头里的ETag/Last-Modified, 响应体由 weather_filter_http_stream 直接读取
+static esp_err_t _weather_header_handler(esp_http_client_event_t *evt) {
+    weather_validators_t *received = (weather_validators_t *) evt->user_data;
+    if (evt->event_id != HTTP_EVENT_ON_HEADER || received == NULL) {
+        return ESP_OK;
+    }
+    if (strcasecmp(evt->header_key, "ETag") == 0) {
+        strlcpy(received->etag, evt->header_value, sizeof(received->etag));
+    } else if (strcasecmp(evt->header_key, "Last-Modified") == 0) {
+        strlcpy(received->last_modified, evt->header_value, sizeof(received->last_modified));
+    }
+    return ESP_OK;
+}
+
 // Obtain weather data
-const char *fetch_weather_data_by_adcode(const char *adcode) {
+// validators 非空时返回新的ETag/Last-Modified, conditional 时还带上条件请求头; *status 为HTTP状态码(304表示未修改)
+// 返回的是过滤后的精简JSON(只含用到的4天字段), 304时为空字符串
+static char *fetch_weather_conditional(const char *adcode, weather_validators_t *validators, bool conditional, int *status) {
     char url[128];
     snprintf(url, sizeof(url), "http://t.weather.sojson.com/api/weather/city/%s", adcode);
     ESP_LOGI(TAG, "天气API地址: %s", url);
+    *status = 0;
 
     char *local_response_buffer = (char *) heap_caps_malloc(MAX_HTTP_OUTPUT_BUFFER + 1, MALLOC_CAP_SPIRAM);
     if (!local_response_buffer)
         return NULL;
+    local_response_buffer[0] = '\0';
 
-    esp_http_client_config_t config = {
+    weather_validators_t     received = {0};
+    esp_http_client_config_t config   = {
         .url                   = url,
-        .event_handler         = _http_event_handler,
-        .user_data             = local_response_buffer,
+        .event_handler         = _weather_header_handler,
+        .user_data             = &received,
         .disable_auto_redirect = true,
         // .cert_pem = NULL,
     };
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    esp_err_t                err    = esp_http_client_perform(client);
-
+    esp_http_client_handle_t client = http_pool_acquire(&config);
+    if (client == NULL) {
+        heap_caps_free(local_response_buffer);
+        return NULL;
+    }
+    if (validators != NULL && conditional) {
+        if (validators->etag[0]) {
+            esp_http_client_set_header(client, "If-None-Match", validators->etag);
+        }
+        if (validators->last_modified[0]) {
+            esp_http_client_set_header(client, "If-Modified-Since", validators->last_modified);
+        }
+    }
+    int64_t   content_length = 0;
+    esp_err_t err            = http_pool_open(client, NULL, 0, &content_length);
     if (err == ESP_OK) {
-        ESP_LOGI(TAG, "HTTP GET Status = %d, content_length = %" PRId64,
-                 esp_http_client_get_status_code(client),
-                 esp_http_client_get_content_length(client));
+        *status = esp_http_client_get_status_code(client);
+        ESP_LOGI(TAG, "HTTP GET Status = %d, content_length = %" PRId64, *status, content_length);
+        if (*status == 200) {
+            if (weather_filter_http_stream(client, local_response_buffer, MAX_HTTP_OUTPUT_BUFFER + 1) == 0) {
+                err = ESP_FAIL;
+            } else if (validators != NULL) {
+                *validators = received;
+            }
+        }
     } else {
         ESP_LOGE(TAG, "HTTP GET request failed: %s", esp_err_to_name(err));
     }
 
-    esp_http_client_cleanup(client);
-
+    http_pool_release(client, err == ESP_OK);
+    if (err != ESP_OK) {
+        heap_caps_free(local_response_buffer);
+        return NULL;
+    }
     return local_response_buffer;
 }
 
+const char *fetch_weather_data_by_adcode(const char *adcode) {
+    int status;
+    return fetch_weather_conditional(adcode, NULL, false, &status);
+}
+
+// 当前网络的标识: SSID + 网关地址, 不变时认为定位结果也不变
+static void weather_cache_network_key(char *key, size_t len) {
+    wifi_ap_record_t     ap      = {0};
+    esp_netif_ip_info_t  ip_info = {0};
+    esp_netif_t         *netif   = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
+    key[0]                       = '\0';
+    if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK || netif == NULL || esp_netif_get_ip_info(netif, &ip_info) != ESP_OK) {
+        return;
+    }
+    snprintf(key, len, "%s|" IPSTR, (const char *) ap.ssid, IP2STR(&ip_info.gw));
+}
+
+static int weather_cache_get_str(nvs_handle_t handle, const char *name, char *buf, size_t len) {
+    size_t size = len;
+    if (nvs_get_str(handle, name, buf, &size) != ESP_OK) {
+        buf[0] = '\0';
+        return 0;
+    }
+    return 1;
+}
+
+static int weather_cache_get_adcode(nvs_handle_t handle, const char *net_key, char *adcode, size_t len) {
+    char    cached_key[64];
+    int64_t stamp = 0;
+    time_t  now   = time(NULL);
+    if (net_key[0] == '\0' || !weather_cache_get_str(handle, "net", cached_key, sizeof(cached_key)) ||
+        strcmp(cached_key, net_key) != 0 || !weather_cache_get_str(handle, "adcode", adcode, len)) {
+        return 0;
+    }
+    nvs_get_i64(handle, "adcode_t", &stamp);
+    if (CACHE_TIME_VALID(now) && CACHE_TIME_VALID(stamp) && now - stamp > ADCODE_CACHE_TTL) {
+        return 0;
+    }
+    weather_cache_get_str(handle, "prov", province, sizeof(province));
+    weather_cache_get_str(handle, "city", city, sizeof(city));
+    return 1;
+}
+
+static char *weather_cache_read_payload(void) {
+    FILE *fp = fopen(WEATHER_CACHE_FILE, "rb");
+    if (fp == NULL) {
+        return NULL;
+    }
+    char *buf = (char *) heap_caps_malloc(MAX_HTTP_OUTPUT_BUFFER + 1, MALLOC_CAP_SPIRAM);
+    if (buf != NULL) {
+        size_t len = fread(buf, 1, MAX_HTTP_OUTPUT_BUFFER, fp);
+        buf[len]   = '\0';
+        if (len == 0) {
+            heap_caps_free(buf);
+            buf = NULL;
+        }
+    }
+    fclose(fp);
+    return buf;
+}
+
+static void weather_cache_write_payload(const char *json) {
+    FILE *fp = fopen(WEATHER_CACHE_FILE, "wb");
+    if (fp == NULL) {
+        return;
+    }
+    size_t len = strlen(json);
+    if (fwrite(json, 1, len, fp) != len) {
+        ESP_LOGE(TAG, "天气缓存写入失败");
+    }
+    fclose(fp);
+}
+
 // Automatically locate and obtain the main weather process
 void auto_get_weather(void) {
     char adcode[16] = {0};
@@ -272,22 +414,87 @@ void auto_get_weather(void) {
 }
 
 const char *auto_get_weather_json(void) {
-    char adcode[16] = {0};
-    // fetch_adcode(adcode, sizeof(adcode));
-    // const char *weather_json = fetch_weather_data();
-    // ESP_LOGI(TAG, "天气数据: %s", weather_json);
-    // return weather_json;
-    if (fetch_adcode(adcode, sizeof(adcode))) {
-        const char *weather_json = fetch_weather_data_by_adcode(adcode);
-        if (weather_json) {
-            // ESP_LOGI(TAG, "天气数据: %s", weather_json);
-            ESP_LOGI(TAG, "天气数据获取成功");
-            return weather_json;
-        } else {
-            ESP_LOGE(TAG, "天气数据获取失败");
+    char                 adcode[16]  = {0};
+    char                 net_key[64] = {0};
+    char                 cached_adcode[16];
+    weather_validators_t validators = {0};
+    nvs_handle_t         handle;
+    time_t               now = time(NULL);
+
+    if (nvs_open(WEATHER_CACHE_NVS, NVS_READWRITE, &handle) != ESP_OK) {
+        handle = 0;
+    }
+    weather_cache_network_key(net_key, sizeof(net_key));
+
+    /*网络没变就不再做IP定位*/
+    if (handle && weather_cache_get_adcode(handle, net_key, adcode, sizeof(adcode))) {
+        ESP_LOGI(TAG, "使用缓存定位: %s %s (%s)", province, city, adcode);
+    } else if (fetch_adcode(adcode, sizeof(adcode))) {
+        if (handle) {
+            nvs_set_str(handle, "net", net_key);
+            nvs_set_str(handle, "adcode", adcode);
+            nvs_set_str(handle, "prov", province);
+            nvs_set_str(handle, "city", city);
+            nvs_set_i64(handle, "adcode_t", (int64_t) now);
+            nvs_commit(handle);
         }
     } else {
         ESP_LOGE(TAG, "定位失败，无法获取 adcode");
+        if (handle) {
+            nvs_close(handle);
+        }
+        return NULL;
+    }
+
+    /*同一地点的天气缓存: 未过期直接用, 过期则带条件头重新验证*/
+    char   *cached = NULL;
+    int64_t stamp  = 0;
+    if (handle && weather_cache_get_str(handle, "wx_code", cached_adcode, sizeof(cached_adcode)) &&
+        strcmp(cached_adcode, adcode) == 0) {
+        cached = weather_cache_read_payload();
+        nvs_get_i64(handle, "wx_t", &stamp);
+        weather_cache_get_str(handle, "wx_etag", validators.etag, sizeof(validators.etag));
+        weather_cache_get_str(handle, "wx_lm", validators.last_modified, sizeof(validators.last_modified));
+    }
+    if (cached != NULL && CACHE_TIME_VALID(now) && CACHE_TIME_VALID(stamp) && now >= stamp && now - stamp < WEATHER_CACHE_TTL) {
+        ESP_LOGI(TAG, "天气数据使用缓存, %d 秒前获取", (int) (now - stamp));
+        nvs_close(handle);
+        return cached;
+    }
+
+    int   status       = 0;
+    char *weather_json = fetch_weather_conditional(adcode, &validators, cached != NULL, &status);   /*没有缓存也要记下ETag, 下次才能条件请求*/
+    if (weather_json != NULL && status == 304 && cached != NULL) {
+        ESP_LOGI(TAG, "天气数据未变化(304), 使用缓存");
+        heap_caps_free(weather_json);
+        weather_json = cached;
+        cached       = NULL;
+    } else if (weather_json != NULL && status == 200 && weather_json[0] != '\0') {
+        ESP_LOGI(TAG, "天气数据获取成功");
+        if (handle) {
+            weather_cache_write_payload(weather_json);
+            nvs_set_str(handle, "wx_code", adcode);
+            nvs_set_str(handle, "wx_etag", validators.etag);
+            nvs_set_str(handle, "wx_lm", validators.last_modified);
+        }
+    } else {
+        ESP_LOGE(TAG, "天气数据获取失败");
+        if (weather_json != NULL) {
+            heap_caps_free(weather_json);
+        }
+        weather_json = cached; // 网络失败时退回旧数据
+        cached       = NULL;
+        status       = 0;
+    }
+    if (handle) {
+        if (status == 200 || status == 304) {
+            nvs_set_i64(handle, "wx_t", (int64_t) now);
+        }
+        nvs_commit(handle);
+        nvs_close(handle);
+    }
+    if (cached != NULL) {
+        heap_caps_free(cached);
     }
-    return NULL;
+    return weather_json;
 }
@@ -1,6 +1,8 @@
 #ifndef CLIENT_BSP_H
 #define CLIENT_BSP_H
 
+#include <esp_http_client.h>
+
 
 #ifdef __cplusplus
 extern "C" {
@@ -11,6 +13,9 @@ const char *fetch_weather_data(void);
 void auto_get_weather(void);
 const char *auto_get_weather_json(void);
 
+/*从已打开的连接流式读取天气JSON, 只保留用到的字段写入out, 返回长度, 失败返回0*/
+int weather_filter_http_stream(esp_http_client_handle_t client, char *out, size_t out_len);
+
 extern char province[64];
 extern char city[64];
 
@@ -0,0 +1,94 @@
+#include <string.h>
+#include "dither_core.h"
+
+#define CLAMP(x, lo, hi) ((x) < (lo) ? (lo) : ((x) > (hi) ? (hi) : (x)))
+
+const uint8_t DITHER_CORE_TO_INK[DITHER_CORE_COLORS] = {0, 1, 3, 6, 5, 2};
+
+const uint8_t DITHER_CORE_PALETTE[DITHER_CORE_COLORS][3] = {
+    {0, 0, 0},       // Black
+    {255, 255, 255}, // White
+    {255, 0, 0},     // Red
+    {0, 255, 0},     // Green
+    {0, 0, 255},     // Blue
+    {255, 255, 0}    // Yellow
+};
+
+int dither_core_nearest(uint8_t r, uint8_t g, uint8_t b) {
+    int best      = 0;
+    int best_dist = 999999;
+
+    for (int i = 0; i < DITHER_CORE_COLORS; i++) {
+        int dr   = (int) r - DITHER_CORE_PALETTE[i][0];
+        int dg   = (int) g - DITHER_CORE_PALETTE[i][1];
+        int db   = (int) b - DITHER_CORE_PALETTE[i][2];
+        int dist = dr * dr + dg * dg + db * db;
+        if (dist < best_dist) {
+            best_dist = dist;
+            best      = i;
+        }
+    }
+    return best;
+}
+
+void dither_core_row(uint8_t *work, uint8_t *next, uint8_t *out, int w, bool has_next, DitherOutFormat_t format) {
+    if (format == DitherOutInk4) {
+        memset(out, 0, (w + 1) / 2);
+    }
+
+    for (int x = 0; x < w; x++) {
+        int     idx = x * 3;
+        uint8_t r   = work[idx + 0];
+        uint8_t g   = work[idx + 1];
+        uint8_t b   = work[idx + 2];
+
+        // Find the nearest color
+        int     ci = dither_core_nearest(r, g, b);
+        uint8_t rr = DITHER_CORE_PALETTE[ci][0];
+        uint8_t gg = DITHER_CORE_PALETTE[ci][1];
+        uint8_t bb = DITHER_CORE_PALETTE[ci][2];
+
+        // Output result
+        if (format == DitherOutInk4) {
+            out[x >> 1] |= (x & 1) ? DITHER_CORE_TO_INK[ci] : (DITHER_CORE_TO_INK[ci] << 4);
+        } else {
+            out[idx + 0] = rr;
+            out[idx + 1] = gg;
+            out[idx + 2] = bb;
+        }
+
+        // Error
+        int err_r = (int) r - rr;
+        int err_g = (int) g - gg;
+        int err_b = (int) b - bb;
+
+        // Floyd–Steinberg diffusion
+        //     *   7
+        // 3   5   1
+        if (x + 1 < w) {
+            int n       = idx + 3;
+            work[n + 0] = CLAMP(work[n + 0] + (err_r * 7) / 16, 0, 255);
+            work[n + 1] = CLAMP(work[n + 1] + (err_g * 7) / 16, 0, 255);
+            work[n + 2] = CLAMP(work[n + 2] + (err_b * 7) / 16, 0, 255);
+        }
+        if (has_next) {
+            if (x > 0) {
+                int n       = idx - 3;
+                next[n + 0] = CLAMP(next[n + 0] + (err_r * 3) / 16, 0, 255);
+                next[n + 1] = CLAMP(next[n + 1] + (err_g * 3) / 16, 0, 255);
+                next[n + 2] = CLAMP(next[n + 2] + (err_b * 3) / 16, 0, 255);
+            }
+            int n       = idx;
+            next[n + 0] = CLAMP(next[n + 0] + (err_r * 5) / 16, 0, 255);
+            next[n + 1] = CLAMP(next[n + 1] + (err_g * 5) / 16, 0, 255);
+            next[n + 2] = CLAMP(next[n + 2] + (err_b * 5) / 16, 0, 255);
+
+            if (x + 1 < w) {
+                int n2       = idx + 3;
+                next[n2 + 0] = CLAMP(next[n2 + 0] + (err_r * 1) / 16, 0, 255);
+                next[n2 + 1] = CLAMP(next[n2 + 1] + (err_g * 1) / 16, 0, 255);
+                next[n2 + 2] = CLAMP(next[n2 + 2] + (err_b * 1) / 16, 0, 255);
+            }
+        }
+    }
+}
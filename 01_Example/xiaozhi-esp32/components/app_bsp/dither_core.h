@@ -0,0 +1,39 @@
+#ifndef DITHER_CORE_H
+#define DITHER_CORE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Floyd–Steinberg 抖动核心, 只用整数运算, 不依赖 ESP-IDF.
+ * 设备端的 ImgDecodeDither 和网页端的 WebAssembly 模块(scripts/dither_wasm)
+ * 编译的是同一份代码, 两边结果逐像素一致.
+ */
+
+#define DITHER_CORE_COLORS 6
+
+typedef enum {
+    DitherOutRGB888 = 0, // Palette colours, 3 bytes per pixel
+    DitherOutInk4,       // Panel color codes (ColorSelection), 2 pixels per byte, high nibble first
+} DitherOutFormat_t;
+
+extern const uint8_t DITHER_CORE_PALETTE[DITHER_CORE_COLORS][3];   // 黑 白 红 绿 蓝 黄
+extern const uint8_t DITHER_CORE_TO_INK[DITHER_CORE_COLORS];       // 调色板序号 -> ColorSelection
+
+int dither_core_nearest(uint8_t r, uint8_t g, uint8_t b);
+
+/*
+ * 抖动一行: work 是当前行(会被改写), next 是下一行(接收扩散的误差),
+ * has_next 为 false 时是最后一行. out 按 format 输出, 至少 w*3 字节.
+ */
+void dither_core_row(uint8_t *work, uint8_t *next, uint8_t *out, int w, bool has_next, DitherOutFormat_t format);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
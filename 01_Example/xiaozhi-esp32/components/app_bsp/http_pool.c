@@ -0,0 +1,203 @@
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include "http_pool.h"
+
+static const char *TAG = "http_pool";
+
+/*按请求设置的头, 复用句柄时清掉, 避免带给同主机的下一个请求*/
+static const char *const s_request_headers[] = {"Authorization", "Content-Type", "If-None-Match", "If-Modified-Since"};
+
+typedef struct {
+    esp_http_client_handle_t client;
+    char                     key[96];    // scheme://host:port
+    http_event_handle_cb     handler;
+    bool                     busy;
+    bool                     connected;  // 上次请求后socket还开着
+    int64_t                  last_used;
+} http_pool_slot_t;
+
+static http_pool_slot_t   s_slots[HTTP_POOL_SLOTS];
+static portMUX_TYPE       s_lock       = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t s_idle_timer = NULL;
+
+static void http_pool_make_key(const char *url, char *key, size_t len) {
+    const char *host = strstr(url, "://");
+    host             = (host != NULL) ? host + 3 : url;
+    size_t n         = strcspn(host, "/?#");
+    snprintf(key, len, "%.*s%.*s", (int) (host - url), url, (int) n, host);
+}
+
+/*空闲连接到时关闭socket(释放TLS缓冲), 句柄留着以便恢复会话*/
+static void http_pool_idle_cb(void *arg) {
+    int64_t now = esp_timer_get_time();
+    for (int i = 0; i < HTTP_POOL_SLOTS; i++) {
+        esp_http_client_handle_t client = NULL;
+        taskENTER_CRITICAL(&s_lock);
+        if (s_slots[i].client != NULL && !s_slots[i].busy && s_slots[i].connected &&
+            now - s_slots[i].last_used >= HTTP_POOL_IDLE_MS * 1000LL) {
+            s_slots[i].busy = true;
+            client          = s_slots[i].client;
+        }
+        taskEXIT_CRITICAL(&s_lock);
+        if (client != NULL) {
+            esp_http_client_close(client);
+            taskENTER_CRITICAL(&s_lock);
+            s_slots[i].busy      = false;
+            s_slots[i].connected = false;
+            taskEXIT_CRITICAL(&s_lock);
+            ESP_LOGI(TAG, "Closed idle connection to %s", s_slots[i].key);
+        }
+    }
+}
+
+static void http_pool_arm_idle_timer(void) {
+    if (s_idle_timer == NULL) {
+        esp_timer_create_args_t args = {};
+        args.callback                = http_pool_idle_cb;
+        args.name                    = "http_pool_idle";
+        if (esp_timer_create(&args, &s_idle_timer) != ESP_OK) {
+            s_idle_timer = NULL;
+            return;
+        }
+    }
+    esp_timer_stop(s_idle_timer);
+    esp_timer_start_once(s_idle_timer, HTTP_POOL_IDLE_MS * 1000LL);
+}
+
+esp_http_client_handle_t http_pool_acquire(const esp_http_client_config_t *config) {
+    char key[96];
+    http_pool_make_key(config->url, key, sizeof(key));
+
+    esp_http_client_handle_t client = NULL;
+    taskENTER_CRITICAL(&s_lock);
+    for (int i = 0; i < HTTP_POOL_SLOTS; i++) {
+        if (s_slots[i].client != NULL && !s_slots[i].busy && s_slots[i].handler == config->event_handler &&
+            !strcmp(s_slots[i].key, key)) {
+            s_slots[i].busy = true;
+            client          = s_slots[i].client;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&s_lock);
+    if (client != NULL) {
+        esp_http_client_set_url(client, config->url);
+        esp_http_client_set_method(client, config->method);
+        esp_http_client_set_user_data(client, config->user_data);
+        for (int i = 0; i < sizeof(s_request_headers) / sizeof(s_request_headers[0]); i++) {
+            esp_http_client_delete_header(client, s_request_headers[i]);
+        }
+        ESP_LOGI(TAG, "Reusing connection to %s", key);
+        return client;
+    }
+
+    esp_http_client_config_t cfg = *config;
+    cfg.keep_alive_enable        = true;
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    cfg.save_client_session = true;
+#endif
+    client = esp_http_client_init(&cfg);
+    if (client == NULL) {
+        return NULL;
+    }
+
+    /*放入空位, 没有空位时替换最久未用的空闲句柄; 全部在用时不入池*/
+    esp_http_client_handle_t evicted = NULL;
+    http_pool_slot_t        *slot    = NULL;
+    taskENTER_CRITICAL(&s_lock);
+    for (int i = 0; i < HTTP_POOL_SLOTS; i++) {
+        if (s_slots[i].client == NULL) {
+            slot = &s_slots[i];
+            break;
+        }
+        if (!s_slots[i].busy && (slot == NULL || s_slots[i].last_used < slot->last_used)) {
+            slot = &s_slots[i];
+        }
+    }
+    if (slot != NULL) {
+        evicted = slot->client;
+        memset(slot, 0, sizeof(http_pool_slot_t));
+        strlcpy(slot->key, key, sizeof(slot->key));
+        slot->client  = client;
+        slot->handler = config->event_handler;
+        slot->busy    = true;
+    }
+    taskEXIT_CRITICAL(&s_lock);
+    if (evicted != NULL) {
+        esp_http_client_cleanup(evicted);
+    }
+    return client;
+}
+
+esp_err_t http_pool_open(esp_http_client_handle_t client, const char *body, int body_len, int64_t *content_length) {
+    esp_err_t err = ESP_FAIL;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (attempt > 0) {
+            esp_http_client_close(client);
+        }
+        err = esp_http_client_open(client, body_len);
+        if (err != ESP_OK) {
+            continue;
+        }
+        if (body_len > 0 && esp_http_client_write(client, body, body_len) != body_len) {
+            err = ESP_FAIL;
+            continue;
+        }
+        int64_t len = esp_http_client_fetch_headers(client);
+        if (len < 0) {
+            err = ESP_FAIL;
+            continue;
+        }
+        if (content_length != NULL) {
+            *content_length = len;
+        }
+        return ESP_OK;
+    }
+    return err;
+}
+
+void http_pool_release(esp_http_client_handle_t client, bool reusable) {
+    if (client == NULL) {
+        return;
+    }
+    if (reusable && esp_http_client_flush_response(client, NULL) != ESP_OK) {
+        reusable = false;   // 剩余响应体读不完, 连接状态不可信
+    }
+    bool pooled = false;
+    taskENTER_CRITICAL(&s_lock);
+    for (int i = 0; i < HTTP_POOL_SLOTS; i++) {
+        if (s_slots[i].client == client) {
+            if (reusable) {
+                s_slots[i].busy      = false;
+                s_slots[i].connected = true;
+                s_slots[i].last_used = esp_timer_get_time();
+                pooled               = true;
+            } else {
+                memset(&s_slots[i], 0, sizeof(http_pool_slot_t));
+            }
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&s_lock);
+    if (pooled) {
+        http_pool_arm_idle_timer();
+    } else {
+        esp_http_client_cleanup(client);
+    }
+}
+
+void http_pool_flush(void) {
+    for (int i = 0; i < HTTP_POOL_SLOTS; i++) {
+        esp_http_client_handle_t client = NULL;
+        taskENTER_CRITICAL(&s_lock);
+        if (s_slots[i].client != NULL && !s_slots[i].busy) {
+            client = s_slots[i].client;
+            memset(&s_slots[i], 0, sizeof(http_pool_slot_t));
+        }
+        taskEXIT_CRITICAL(&s_lock);
+        if (client != NULL) {
+            esp_http_client_cleanup(client);
+        }
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef HTTP_POOL_H
+#define HTTP_POOL_H
+
+#include <stdbool.h>
+#include <esp_http_client.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HTTP_POOL_SLOTS   3
+#define HTTP_POOL_IDLE_MS (30 * 1000) // 空闲超过这个时间关闭socket, 句柄和TLS会话保留
+
+/*
+ * 按 scheme://host:port + event_handler 复用 esp_http_client 句柄.
+ * 同一次唤醒内连续请求同一主机时沿用已建立的TCP/TLS连接, 连接被关闭后
+ * 重连时用句柄里保存的TLS会话票据恢复, 省掉完整握手.
+ * config 里的 url/method/user_data 每次都会重新设置, 其余字段只在首次创建时生效;
+ * 复用时会去掉上一次请求设置的 Authorization/Content-Type/条件头, 需要时每次重新设置.
+ * 池满或创建失败时返回NULL.
+ */
+esp_http_client_handle_t http_pool_acquire(const esp_http_client_config_t *config);
+
+/*open + 写请求体 + 读响应头, 复用的连接已被服务器关闭时自动重连一次*/
+esp_err_t http_pool_open(esp_http_client_handle_t client, const char *body, int body_len, int64_t *content_length);
+
+/*reusable: 本次请求正常结束, 连接可以留给下一次; 否则直接销毁句柄*/
+void http_pool_release(esp_http_client_handle_t client, bool reusable);
+
+/*关闭并销毁所有空闲句柄*/
+void http_pool_flush(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
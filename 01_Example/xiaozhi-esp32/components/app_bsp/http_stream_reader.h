@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string.h>
+#include <esp_http_client.h>
+
+/*
+ * 把 esp_http_client_read 包装成 ArduinoJson 的 Reader(read/readBytes),
+ * 响应体边接收边解析, 不需要先把整个body拷到缓冲区.
+ * 调用前须已 esp_http_client_open + esp_http_client_fetch_headers.
+ */
+class HttpStreamReader {
+  private:
+    esp_http_client_handle_t client_;
+    char buf_[512];
+    int  len_   = 0;
+    int  pos_   = 0;
+    int  total_ = 0;
+
+    bool HttpStreamReader_Fill() {
+        len_ = esp_http_client_read(client_, buf_, sizeof(buf_));
+        pos_ = 0;
+        if (len_ <= 0) {
+            len_ = 0;
+            return false;
+        }
+        total_ += len_;
+        return true;
+    }
+
+  public:
+    explicit HttpStreamReader(esp_http_client_handle_t client) : client_(client) {}
+
+    int read() {
+        if (pos_ >= len_ && !HttpStreamReader_Fill()) {
+            return -1;
+        }
+        return (unsigned char) buf_[pos_++];
+    }
+
+    size_t readBytes(char *buffer, size_t length) {
+        size_t n = 0;
+        while (n < length) {
+            if (pos_ >= len_ && !HttpStreamReader_Fill()) {
+                break;
+            }
+            size_t chunk = len_ - pos_;
+            if (chunk > length - n) {
+                chunk = length - n;
+            }
+            memcpy(buffer + n, buf_ + pos_, chunk);
+            pos_ += chunk;
+            n += chunk;
+        }
+        return n;
+    }
+
+    int HttpStreamReader_Total() const { return total_; }
+};
@@ -3,18 +3,16 @@
 #include <esp_heap_caps.h>
 #include <esp_log.h>
 #include "imgdecode_app.h"
+#include "bmp_reader.h"
+#include "qoi_reader.h"
 #include "test_decoder.h"
 
-#define CLAMP(x, lo, hi) ((x) < (lo) ? (lo) : ((x) > (hi) ? (hi) : (x)))
-
-static const uint8_t PALETTE[6][3] = {
-    {0, 0, 0},       // Black
-    {255, 255, 255}, // White
-    {255, 0, 0},     // Red
-    {0, 255, 0},     // Green
-    {0, 0, 255},     // Blue
-    {255, 255, 0}    // Yellow
-};
+typedef struct {
+    uint8_t *buffer;
+    int      width;
+    int      height;
+    int      row_bytes;
+} ImgRgbTarget_t;
 
 void ImgDecodeDither::png_read_callback(png_structp png_ptr, png_bytep data, png_size_t length) {
     FILE *fp = (FILE *)png_get_io_ptr(png_ptr);
@@ -75,21 +73,19 @@ esp_err_t ImgDecodeDither::ImgDecode_TFOneJPGPicture(const char *path,uint8_t **
     return ESP_FAIL;
 }
 
-esp_err_t ImgDecodeDither::ImgDecode_TFOnePNGPicture(const char *png_path, uint8_t **out_rgb888,int *out_width, int *out_height) {
+esp_err_t ImgDecodeDither::ImgDecode_PNGReadRows(const char *png_path, ImgHeaderCallback_t on_header, ImgRowCallback_t on_row, void *ctx) {
     FILE *fp = NULL;
     png_structp png_ptr = NULL;
     png_infop info_ptr = NULL;
     png_byte bit_depth = 0;
     png_byte color_type = 0;
-    const int block_rows = 128;
-    int total_rows = 0;
-    int remaining_rows = 0;
-    int current_y = 0;
+    int width = 0;
+    int height = 0;
+    int passes = 1;
     png_size_t row_bytes = 0;
-    png_bytep *row_pointers = NULL;
-    *out_rgb888 = NULL;
-    *out_width = 0;
-    *out_height = 0;
+    png_bytep row_buf = NULL;
+    png_bytep *row_pointers = NULL;   // Interlaced files only
+    esp_err_t ret = ESP_FAIL;
 
     fp = fopen(png_path, "rb");
     if (!fp) {
@@ -118,6 +114,7 @@ esp_err_t ImgDecodeDither::ImgDecode_TFOnePNGPicture(const char *png_path, uint8
 
     if (setjmp(png_jmpbuf(png_ptr))) {
         ESP_LOGE(TAG, "Error occurred during PNG decoding process");
+        ret = ESP_FAIL;
         goto clean_up; 
     }
 
@@ -125,98 +122,73 @@ esp_err_t ImgDecodeDither::ImgDecode_TFOnePNGPicture(const char *png_path, uint8
     png_set_sig_bytes(png_ptr, 8); 
 
     png_read_info(png_ptr, info_ptr);
-    *out_width = png_get_image_width(png_ptr, info_ptr);
-    *out_height = png_get_image_height(png_ptr, info_ptr);
+    width = png_get_image_width(png_ptr, info_ptr);
+    height = png_get_image_height(png_ptr, info_ptr);
     bit_depth = png_get_bit_depth(png_ptr, info_ptr);
     color_type = png_get_color_type(png_ptr, info_ptr);
-    ESP_LOGI(TAG, "PNG information: %dx%d, bit depth: %d, color type: %d",*out_width, *out_height, bit_depth, color_type);
+    ESP_LOGI(TAG, "PNG information: %dx%d, bit depth: %d, color type: %d",width, height, bit_depth, color_type);
 
-    if (color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8) {
-        png_set_expand_gray_1_2_4_to_8(png_ptr);
+    /*libpng直接输出RGB888,不再经过RGBA中转*/
+    if (color_type == PNG_COLOR_TYPE_PALETTE) {
+        png_set_palette_to_rgb(png_ptr);
     }
-    if (png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS)) {
-        png_set_tRNS_to_alpha(png_ptr);
+    if (color_type == PNG_COLOR_TYPE_GRAY || color_type == PNG_COLOR_TYPE_GRAY_ALPHA) {
+        if (bit_depth < 8) {
+            png_set_expand_gray_1_2_4_to_8(png_ptr);
+        }
+        png_set_gray_to_rgb(png_ptr);
     }
     if (bit_depth == 16) {
         png_set_strip_16(png_ptr);
     }
-    if (color_type == PNG_COLOR_TYPE_RGB || color_type == PNG_COLOR_TYPE_GRAY) {
-        png_set_add_alpha(png_ptr, 0xFF, PNG_FILLER_AFTER);
+    if ((color_type & PNG_COLOR_MASK_ALPHA) || png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS)) {
+        png_set_strip_alpha(png_ptr);
     }
+    passes = png_set_interlace_handling(png_ptr);
     png_read_update_info(png_ptr, info_ptr);
-
-    *out_rgb888 = (uint8_t *)heap_caps_malloc(
-        *out_width * *out_height * 3, MALLOC_CAP_SPIRAM);
-    if (!*out_rgb888) {
-        ESP_LOGE(TAG, "Failed to allocate RGB888 cache");
-        goto clean_up;
-    }
-
-    total_rows = *out_height;
-    remaining_rows = total_rows;
-    current_y = 0;
     row_bytes = png_get_rowbytes(png_ptr, info_ptr);
 
-    row_pointers = (png_bytep *)heap_caps_malloc(block_rows * sizeof(png_bytep), MALLOC_CAP_SPIRAM);
-    if (!row_pointers) {
-        ESP_LOGE(TAG, "Allocation of pointer memory failed");
+    ret = on_header(width, height, ctx);
+    if (ret != ESP_OK) {
         goto clean_up;
     }
+    ret = ESP_FAIL;
 
-    for (int i = 0; i < block_rows; i++) {
-        row_pointers[i] = (png_bytep)heap_caps_malloc(row_bytes, MALLOC_CAP_SPIRAM);
-        if (!row_pointers[i]) {
-            ESP_LOGE(TAG, "Failed to allocate memory for row data (line %d)", i);
-            for (int j = 0; j < i; j++) {
-                heap_caps_free(row_pointers[j]);
-            }
-            heap_caps_free(row_pointers);
-            row_pointers = NULL;
+    if (passes > 1) {
+        /*隔行扫描的PNG只能整图解码*/
+        row_pointers = (png_bytep *)heap_caps_calloc(height, sizeof(png_bytep), MALLOC_CAP_SPIRAM);
+        if (!row_pointers) {
+            ESP_LOGE(TAG, "Allocation of pointer memory failed");
             goto clean_up;
         }
-    }
-
-    while (remaining_rows > 0) {
-        int decode_rows = (remaining_rows >= block_rows) ? block_rows : remaining_rows;
-        png_read_rows(png_ptr, row_pointers, NULL, decode_rows);
-
-        for (int y = 0; y < decode_rows; y++) {
-            png_bytep rgba_row = row_pointers[y];
-            uint8_t *rgb888_row = *out_rgb888 + (current_y + y) * *out_width * 3;
-            for (int x = 0; x < *out_width; x++) {
-                uint8_t R = rgba_row[x*4 + 0];
-                uint8_t G = rgba_row[x*4 + 1];
-                uint8_t B = rgba_row[x*4 + 2];
-                rgb888_row[x*3 + 0] = R;
-                rgb888_row[x*3 + 1] = G;
-                rgb888_row[x*3 + 2] = B;
+        for (int i = 0; i < height; i++) {
+            row_pointers[i] = (png_bytep)heap_caps_malloc(row_bytes, MALLOC_CAP_SPIRAM);
+            if (!row_pointers[i]) {
+                ESP_LOGE(TAG, "Failed to allocate memory for row data (line %d)", i);
+                goto clean_up;
             }
         }
-
-        remaining_rows -= decode_rows;
-        current_y += decode_rows;
-    }
-
-    if (row_pointers != NULL) {
-        for (int i = 0; i < block_rows; i++) {
-            heap_caps_free(row_pointers[i]);
+        png_read_image(png_ptr, row_pointers);
+        for (int y = 0; y < height; y++) {
+            on_row(y, row_pointers[y], ctx);
+        }
+    } else {
+        row_buf = (png_bytep)heap_caps_malloc(row_bytes, MALLOC_CAP_SPIRAM);
+        if (!row_buf) {
+            ESP_LOGE(TAG, "Failed to allocate PNG row cache");
+            goto clean_up;
+        }
+        for (int y = 0; y < height; y++) {
+            png_read_row(png_ptr, row_buf, NULL);
+            on_row(y, row_buf, ctx);
         }
-        heap_caps_free(row_pointers);
-        row_pointers = NULL;
     }
-
     png_read_end(png_ptr, NULL);
-    png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-    fclose(fp);
-
-    ESP_LOGI(TAG, "PNG decoding has been completed to RGB888! Cache size: %dKB, peak PSRAM usage ≈ %dKB",
-             (*out_width * *out_height * 3) / 1024,
-             ((*out_width * *out_height * 3) + (block_rows * *out_width * 4)) / 1024);
-    return ESP_OK;
+    ret = ESP_OK;
 
 clean_up:
     if (row_pointers != NULL) {
-        for (int i = 0; i < block_rows; i++) {
+        for (int i = 0; i < height; i++) {
             if (row_pointers[i] != NULL) {
                 heap_caps_free(row_pointers[i]);
             }
@@ -225,9 +197,9 @@ clean_up:
         row_pointers = NULL;
     }
 
-    if (*out_rgb888 != NULL) {
-        heap_caps_free(*out_rgb888);
-        *out_rgb888 = NULL;
+    if (row_buf != NULL) {
+        heap_caps_free(row_buf);
+        row_buf = NULL;
     }
 
     if (png_ptr != NULL) {
@@ -237,85 +209,195 @@ clean_up:
     if (fp != NULL) {
         fclose(fp);
     }
+    return ret;
+}
 
-    ESP_LOGE(TAG, "PNG decoding failed. All caches have been cleared.");
-    return ESP_FAIL;
+static esp_err_t rgb888_alloc_callback(int width, int height, void *ctx) {
+    ImgRgbTarget_t *target = (ImgRgbTarget_t *) ctx;
+    target->width     = width;
+    target->height    = height;
+    target->row_bytes = width * 3;
+    target->buffer    = (uint8_t *)heap_caps_malloc(width * height * 3, MALLOC_CAP_SPIRAM);
+    if (!target->buffer) {
+        ESP_LOGE("ImgDecode", "Failed to allocate RGB888 cache (PSRAM needs to be enabled)");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
 }
 
-esp_err_t ImgDecodeDither::ImgDecodebmp_TFOneBMPPicture(const char *bmp_path, uint8_t **out_rgb888, int *out_width, int *out_height) {
-    FILE *fp = fopen(bmp_path, "rb");
-    if (!fp) {
-        ESP_LOGE(TAG, "Cannot open BMP file: %s", bmp_path);
+static void rgb888_row_callback(int y, const uint8_t *row, void *ctx) {
+    ImgRgbTarget_t *target = (ImgRgbTarget_t *) ctx;
+    memcpy(target->buffer + y * target->row_bytes, row, target->row_bytes);
+}
+
+esp_err_t ImgDecodeDither::ImgDecode_TFOnePNGPicture(const char *png_path, uint8_t **out_rgb888,int *out_width, int *out_height) {
+    ImgRgbTarget_t target = {};
+    *out_rgb888 = NULL;
+    *out_width = 0;
+    *out_height = 0;
+    if (ImgDecode_PNGReadRows(png_path, rgb888_alloc_callback, rgb888_row_callback, &target) != ESP_OK) {
+        if (target.buffer != NULL) {
+            heap_caps_free(target.buffer);
+        }
+        ESP_LOGE(TAG, "PNG decoding failed. All caches have been cleared.");
         return ESP_FAIL;
     }
+    *out_rgb888 = target.buffer;
+    *out_width = target.width;
+    *out_height = target.height;
+    ESP_LOGI(TAG, "PNG decoding has been completed to RGB888! Cache size: %dKB", (*out_width * *out_height * 3) / 1024);
+    return ESP_OK;
+}
 
-    BITMAPFILEHEADER file_header;
-    fread(&file_header, sizeof(BITMAPFILEHEADER), 1, fp);
-    
-    if (file_header.bfType != 0x4D42) {
-        ESP_LOGE(TAG, "Not a valid BMP file! The current bfType = 0x%04X (should be 0x4D42)", file_header.bfType);
-        fclose(fp);
+esp_err_t ImgDecodeDither::ImgDecodebmp_TFOneBMPPicture(const char *bmp_path, uint8_t **out_rgb888, int *out_width, int *out_height) {
+    BmpReader reader;
+    ImgRgbTarget_t target = {};
+    *out_rgb888 = NULL;
+    if (reader.BmpReader_Open(bmp_path) != ESP_OK) {
         return ESP_FAIL;
     }
-
-    BITMAPINFOHEADER info_header;
-    fread(&info_header, sizeof(BITMAPINFOHEADER), 1, fp);
-    
-    if (info_header.biBitCount != 24 || info_header.biCompression != 0) {
-        ESP_LOGE(TAG, "Only 24-bit uncompressed BMP is supported! Current bit depth: %d, Compression method: %d",
-                 info_header.biBitCount, info_header.biCompression);
-        fclose(fp);
+    if (rgb888_alloc_callback(reader.BmpReader_GetWidth(), reader.BmpReader_GetHeight(), &target) != ESP_OK) {
         return ESP_FAIL;
     }
-
-    *out_width = info_header.biWidth;
-    *out_height = abs(info_header.biHeight);
-    bool is_row_reverse = (info_header.biHeight > 0); 
-    ESP_LOGI(TAG, "BMP information: %dx%d, row reversed: %s", *out_width, *out_height, is_row_reverse ? "Y" : "N");
-
-    int bmp_row_bytes = ((*out_width) * 3 + 3) & ~3; 
-    int rgb888_row_bytes = *out_width * 3;
-
-    *out_rgb888 = (uint8_t *)heap_caps_malloc(
-                    *out_width * *out_height * 3, MALLOC_CAP_SPIRAM);
-    if (!*out_rgb888) {
-        ESP_LOGE(TAG, "Failed to allocate RGB888 cache (PSRAM needs to be enabled)");
-        fclose(fp);
+    if (reader.BmpReader_ReadRows(BmpRowRGB888, rgb888_row_callback, &target) != ESP_OK) {
+        heap_caps_free(target.buffer);
         return ESP_FAIL;
     }
+    *out_rgb888 = target.buffer;
+    *out_width  = target.width;
+    *out_height = target.height;
+    ESP_LOGI(TAG, "BMP decoding completed to RGB888! Cache size: %dKB", (*out_width * *out_height * 3) / 1024);
+    return ESP_OK;
+}
 
-    fseek(fp, file_header.bfOffBits, SEEK_SET);
-
-    uint8_t *bmp_row_buf = (uint8_t *)malloc(bmp_row_bytes); 
-    if (!bmp_row_buf) {
-        ESP_LOGE(TAG, "Failed to allocate BMP row cache");
-        heap_caps_free(*out_rgb888);
-        fclose(fp);
+esp_err_t ImgDecodeDither::ImgDecode_TFOneQOIPicture(const char *qoi_path, uint8_t **out_rgb888, int *out_width, int *out_height) {
+    QoiReader reader;
+    ImgRgbTarget_t target = {};
+    *out_rgb888 = NULL;
+    if (reader.QoiReader_Open(qoi_path) != ESP_OK) {
         return ESP_FAIL;
     }
+    if (rgb888_alloc_callback(reader.QoiReader_GetWidth(), reader.QoiReader_GetHeight(), &target) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    if (reader.QoiReader_ReadRows(rgb888_row_callback, &target) != ESP_OK) {
+        heap_caps_free(target.buffer);
+        return ESP_FAIL;
+    }
+    *out_rgb888 = target.buffer;
+    *out_width  = target.width;
+    *out_height = target.height;
+    ESP_LOGI(TAG, "QOI decoding completed to RGB888! Cache size: %dKB", (*out_width * *out_height * 3) / 1024);
+    return ESP_OK;
+}
 
-    for (int y = 0; y < *out_height; y++) {
-        fread(bmp_row_buf, bmp_row_bytes, 1, fp);
-
-        int rgb888_y = is_row_reverse ? (*out_height - 1 - y) : y;
-        uint8_t *rgb888_row = *out_rgb888 + rgb888_y * rgb888_row_bytes;
-
-        for (int x = 0; x < *out_width; x++) {
-            uint8_t B = bmp_row_buf[x*3 + 0]; // BMP的B通道
-            uint8_t G = bmp_row_buf[x*3 + 1]; // BMP的G通道
-            uint8_t R = bmp_row_buf[x*3 + 2]; // BMP的R通道
-
-            rgb888_row[x*3 + 0] = R;
-            rgb888_row[x*3 + 1] = G;
-            rgb888_row[x*3 + 2] = B;
+esp_err_t ImgDecodeDither::ImgDecode_TFStreamPicture(const char *path, ImgHeaderCallback_t on_header, ImgRowCallback_t on_row, void *ctx) {
+    esp_err_t ret;
+    if(strstr(path, ".png") || strstr(path, ".PNG")) {
+        return ImgDecode_PNGReadRows(path, on_header, on_row, ctx);
+    } else if(strstr(path, ".qoi") || strstr(path, ".QOI")) {
+        QoiReader reader;
+        if (reader.QoiReader_Open(path) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        ret = on_header(reader.QoiReader_GetWidth(), reader.QoiReader_GetHeight(), ctx);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        return reader.QoiReader_ReadRows(on_row, ctx);
+    } else if(strstr(path, ".bmp") || strstr(path, ".BMP")) {
+        BmpReader reader;
+        if (reader.BmpReader_Open(path) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        if (reader.BmpReader_IsCompressed()) {   /*RLE8只能自下而上解码*/
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+        ret = on_header(reader.BmpReader_GetWidth(), reader.BmpReader_GetHeight(), ctx);
+        if (ret != ESP_OK) {
+            return ret;
         }
+        return reader.BmpReader_ReadRowsTopDown(BmpRowRGB888, on_row, ctx);
+    } else if(strstr(path, ".jpg") || strstr(path, ".JPG")) {
+        FILE *fp = fopen(path, "rb");
+        if (fp == NULL) {
+            ESP_LOGE(TAG, "Failed to open file: %s", path);
+            return ESP_FAIL;
+        }
+        fseek(fp, 0, SEEK_END);
+        long file_size = ftell(fp);
+        fseek(fp, 0, SEEK_SET);
+        if (file_size <= 0) {
+            fclose(fp);
+            return ESP_FAIL;
+        }
+        uint8_t *buffer = (uint8_t *) heap_caps_malloc(file_size, MALLOC_CAP_SPIRAM);   /*解码器要整个码流在内存里, 解出的像素仍逐行输出*/
+        if (buffer == NULL) {
+            ESP_LOGE(TAG, "No PSRAM for %ld byte jpg: %s", file_size, path);
+            fclose(fp);
+            return ESP_ERR_NO_MEM;
+        }
+        size_t len = fread(buffer, 1, file_size, fp);
+        fclose(fp);
+        ret = ImgDecode_JPGReadRows(buffer, len, on_header, on_row, ctx);
+        heap_caps_free(buffer);
+        return ret;
     }
+    return ESP_ERR_NOT_SUPPORTED;
+}
 
-    free(bmp_row_buf);
-    fclose(fp);
-
-    ESP_LOGI(TAG, "BMP decoding completed to RGB888! Cache size: %dKB", (*out_width * *out_height * 3) / 1024);
-    return ESP_OK;
+esp_err_t ImgDecodeDither::ImgDecode_JPGReadRows(const uint8_t *inbuffer, int inlen, ImgHeaderCallback_t on_header, ImgRowCallback_t on_row, void *ctx) {
+    if (inbuffer == NULL || inlen <= 0) {
+        ESP_LOGE(TAG, "jpeg_decode fill inbuffer is NULL");
+        return ESP_FAIL;
+    }
+    jpeg_dec_config_t config = DEFAULT_JPEG_DEC_CONFIG();
+    config.output_type       = JPEG_PIXEL_FORMAT_RGB888;
+    config.block_enable      = true;   /*每次 jpeg_dec_process 输出一行MCU(8或16行像素)*/
+    jpeg_dec_handle_t jpeg_dec = NULL;
+    if (jpeg_dec_open(&config, &jpeg_dec) != JPEG_ERR_OK) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    jpeg_dec_io_t          io        = {};
+    jpeg_dec_header_info_t info      = {};
+    uint8_t               *block     = NULL;
+    int                    block_len = 0;
+    int                    block_cnt = 0;
+    esp_err_t              ret       = ESP_FAIL;
+    io.inbuf     = (uint8_t *) inbuffer;
+    io.inbuf_len = inlen;
+    if (jpeg_dec_parse_header(jpeg_dec, &io, &info) != JPEG_ERR_OK ||
+        jpeg_dec_get_outbuf_len(jpeg_dec, &block_len) != JPEG_ERR_OK || block_len == 0 ||
+        jpeg_dec_get_process_count(jpeg_dec, &block_cnt) != JPEG_ERR_OK || block_cnt == 0) {
+        ESP_LOGE(TAG, "JPG header fill");
+        jpeg_dec_close(jpeg_dec);
+        return ESP_FAIL;
+    }
+    ret = on_header(info.width, info.height, ctx);
+    if (ret == ESP_OK) {
+        block = (uint8_t *) jpeg_calloc_align(block_len, 16);
+        ret   = (block != NULL) ? ESP_OK : ESP_ERR_NO_MEM;
+    }
+    io.outbuf     = block;
+    int row_bytes = info.width * 3;
+    int y         = 0;
+    for (int i = 0; i < block_cnt && ret == ESP_OK; i++) {
+        if (jpeg_dec_process(jpeg_dec, &io) != JPEG_ERR_OK) {
+            ESP_LOGE(TAG, "JPG Decode fill at row %d", y);
+            ret = ESP_FAIL;
+            break;
+        }
+        int rows = io.out_size / row_bytes;
+        for (int r = 0; r < rows && y < info.height; r++, y++) {
+            on_row(y, block + r * row_bytes, ctx);
+        }
+    }
+    jpeg_dec_close(jpeg_dec);
+    if (block != NULL) {
+        jpeg_free_align(block);
+    }
+    return ret;
 }
 
 void ImgDecodeDither::ImgDecode_JPGBufferFree(uint8_t *buffer) {
@@ -339,69 +421,86 @@ void  ImgDecodeDither::ImgDecode_BMPBufferFree(uint8_t *buffer) {
     }
 }
 
-void ImgDecodeDither::ImgDecode_DitherRgb888(uint8_t *in_img, uint8_t *out_img, int w, int h) {
-    uint8_t *work = (uint8_t *) malloc(w * h * 3);
-    assert(work);
-    if (!work)
+void ImgDecodeDither::ImgDecode_QOIBufferFree(uint8_t *buffer) {
+    if (buffer != NULL) {
+        heap_caps_free(buffer);
+        buffer = NULL;
+    }
+}
+
+static uint8_t *dither_row_alloc(int len) {
+    uint8_t *row = (uint8_t *) heap_caps_malloc(len, MALLOC_CAP_INTERNAL);   // Touched 3 times per pixel, keep it out of PSRAM
+    if (row == NULL) {
+        row = (uint8_t *) heap_caps_malloc(len, MALLOC_CAP_SPIRAM);
+    }
+    return row;
+}
+
+esp_err_t ImgDecodeDither::ImgDecode_DitherStreamBegin(ImgDitherStream_t *stream, int w, int h, DitherOutFormat_t format, ImgRowCallback_t cb, void *ctx) {
+    memset(stream, 0, sizeof(ImgDitherStream_t));
+    stream->width  = w;
+    stream->height = h;
+    stream->format = format;
+    stream->cb     = cb;
+    stream->ctx    = ctx;
+    stream->cur    = dither_row_alloc(w * 3);
+    stream->next   = dither_row_alloc(w * 3);
+    stream->out    = dither_row_alloc(w * 3);
+    if (!stream->cur || !stream->next || !stream->out) {
+        ESP_LOGE(TAG, "Failed to allocate dither rows");
+        ImgDecode_DitherStreamEnd(stream);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void ImgDecodeDither::ImgDecode_DitherStreamPush(ImgDitherStream_t *stream, const uint8_t *rgb_row) {
+    if (!stream->has_row) {
+        memcpy(stream->cur, rgb_row, stream->width * 3);
+        stream->has_row = true;
         return;
-    for (int i = 0; i < w * h * 3; i++)
-        work[i] = in_img[i];
+    }
+    memcpy(stream->next, rgb_row, stream->width * 3);
+    ImgDecode_DitherStreamRow(stream, true);
+    uint8_t *tmp = stream->cur;
+    stream->cur  = stream->next;
+    stream->next = tmp;
+}
 
-    for (int y = 0; y < h; y++) {
-        for (int x = 0; x < w; x++) {
-            int     idx = (y * w + x) * 3;
-            uint8_t r   = work[idx + 0];
-            uint8_t g   = work[idx + 1];
-            uint8_t b   = work[idx + 2];
-
-            // Find the nearest color
-            int     ci = ImgDecode_NearestColor(r, g, b);
-            uint8_t rr = PALETTE[ci][0];
-            uint8_t gg = PALETTE[ci][1];
-            uint8_t bb = PALETTE[ci][2];
-
-            // Output result
-            out_img[idx + 0] = rr;
-            out_img[idx + 1] = gg;
-            out_img[idx + 2] = bb;
-
-            // Error
-            int err_r = (int) r - rr;
-            int err_g = (int) g - gg;
-            int err_b = (int) b - bb;
-
-            // Floyd–Steinberg diffusion
-            //     *   7
-            // 3   5   1
-            if (x + 1 < w) {
-                int n       = idx + 3;
-                work[n + 0] = CLAMP(work[n + 0] + (err_r * 7) / 16, 0, 255);
-                work[n + 1] = CLAMP(work[n + 1] + (err_g * 7) / 16, 0, 255);
-                work[n + 2] = CLAMP(work[n + 2] + (err_b * 7) / 16, 0, 255);
-            }
-            if (y + 1 < h) {
-                if (x > 0) {
-                    int n       = ((y + 1) * w + (x - 1)) * 3;
-                    work[n + 0] = CLAMP(work[n + 0] + (err_r * 3) / 16, 0, 255);
-                    work[n + 1] = CLAMP(work[n + 1] + (err_g * 3) / 16, 0, 255);
-                    work[n + 2] = CLAMP(work[n + 2] + (err_b * 3) / 16, 0, 255);
-                }
-                int n       = ((y + 1) * w + x) * 3;
-                work[n + 0] = CLAMP(work[n + 0] + (err_r * 5) / 16, 0, 255);
-                work[n + 1] = CLAMP(work[n + 1] + (err_g * 5) / 16, 0, 255);
-                work[n + 2] = CLAMP(work[n + 2] + (err_b * 5) / 16, 0, 255);
-
-                if (x + 1 < w) {
-                    int n2       = ((y + 1) * w + (x + 1)) * 3;
-                    work[n2 + 0] = CLAMP(work[n2 + 0] + (err_r * 1) / 16, 0, 255);
-                    work[n2 + 1] = CLAMP(work[n2 + 1] + (err_g * 1) / 16, 0, 255);
-                    work[n2 + 2] = CLAMP(work[n2 + 2] + (err_b * 1) / 16, 0, 255);
-                }
-            }
-        }
+void ImgDecodeDither::ImgDecode_DitherStreamEnd(ImgDitherStream_t *stream) {
+    if (stream->has_row && stream->cur && stream->out) {
+        ImgDecode_DitherStreamRow(stream, false);
+        stream->has_row = false;
     }
+    if (stream->cur) {
+        heap_caps_free(stream->cur);
+        stream->cur = NULL;
+    }
+    if (stream->next) {
+        heap_caps_free(stream->next);
+        stream->next = NULL;
+    }
+    if (stream->out) {
+        heap_caps_free(stream->out);
+        stream->out = NULL;
+    }
+}
 
-    free(work);
+void ImgDecodeDither::ImgDecode_DitherStreamRow(ImgDitherStream_t *stream, bool has_next) {
+    dither_core_row(stream->cur, stream->next, stream->out, stream->width, has_next, stream->format);
+    stream->cb(stream->y++, stream->out, stream->ctx);
+}
+
+void ImgDecodeDither::ImgDecode_DitherRgb888(uint8_t *in_img, uint8_t *out_img, int w, int h) {
+    ImgDitherStream_t stream;
+    ImgRgbTarget_t    target = {out_img, w, h, w * 3};
+    if (ImgDecode_DitherStreamBegin(&stream, w, h, DitherOutRGB888, rgb888_row_callback, &target) != ESP_OK) {
+        return;
+    }
+    for (int y = 0; y < h; y++) {
+        ImgDecode_DitherStreamPush(&stream, in_img + y * w * 3);
+    }
+    ImgDecode_DitherStreamEnd(&stream);
 }
 
 esp_err_t ImgDecodeDither::ImgDecode_EncodingBmpToSdcard(const char *filename, const uint8_t *inRgb, int width, int height) {
@@ -468,23 +567,6 @@ esp_err_t ImgDecodeDither::ImgDecode_EncodingBmpToSdcard(const char *filename, c
 }
 
 // Find the closest color from the palette (RGB888)
-int ImgDecodeDither::ImgDecode_NearestColor(uint8_t r, uint8_t g, uint8_t b) {
-    int best      = 0;
-    int best_dist = 999999;
-
-    for (int i = 0; i < 6; i++) {
-        int dr   = (int) r - PALETTE[i][0];
-        int dg   = (int) g - PALETTE[i][1];
-        int db   = (int) b - PALETTE[i][2];
-        int dist = dr * dr + dg * dg + db * db;
-        if (dist < best_dist) {
-            best_dist = dist;
-            best      = i;
-        }
-    }
-    return best;
-}
-
 void ImgDecodeDither::ImgDecode_ScaleRgb888Nearest(const uint8_t *src, int src_w, int src_h, uint8_t *dst, int dst_w, int dst_h) {
     // 定点数缩放比例（×1024，精度1/1024，平衡精度和速度）
     const int32_t scale_x = (src_w * 1024) / dst_w;
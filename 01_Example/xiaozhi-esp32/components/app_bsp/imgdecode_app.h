@@ -1,6 +1,7 @@
 #pragma once
 
 #include "png.h"
+#include "dither_core.h"
 
 #pragma pack(push, 1) // Ensure that the structure is aligned at 1 byte intervals.
 
@@ -35,13 +36,32 @@ typedef struct {
     uint8_t b;
 } RGB888_Pixel;
 
+/*Streaming decode: the header callback may reject the image before any row is decoded*/
+typedef esp_err_t (*ImgHeaderCallback_t)(int width, int height, void *ctx);
+typedef void (*ImgRowCallback_t)(int y, const uint8_t *row, void *ctx);
+
+/*Row-by-row Floyd–Steinberg state, keeps one row of lookahead*/
+typedef struct {
+    int               width;
+    int               height;
+    int               y;
+    bool              has_row;
+    DitherOutFormat_t format;
+    uint8_t          *cur;
+    uint8_t          *next;
+    uint8_t          *out;
+    ImgRowCallback_t  cb;
+    void             *ctx;
+} ImgDitherStream_t;
+
 class ImgDecodeDither
 {
 private:
     const char *TAG = "ImgDecode";
     
-    int ImgDecode_NearestColor(uint8_t r, uint8_t g, uint8_t b);
     static void png_read_callback(png_structp png_ptr, png_bytep data, png_size_t length);
+    esp_err_t ImgDecode_PNGReadRows(const char *png_path, ImgHeaderCallback_t on_header, ImgRowCallback_t on_row, void *ctx);
+    void ImgDecode_DitherStreamRow(ImgDitherStream_t *stream, bool has_next);
 public:
     ImgDecodeDither();
     ~ImgDecodeDither();
@@ -50,10 +70,17 @@ public:
     esp_err_t ImgDecode_TFOneJPGPicture(const char *path,uint8_t **outbuffer, int *outlen, int *s_width, int *s_height);
     esp_err_t ImgDecode_TFOnePNGPicture(const char *png_path, uint8_t **out_rgb888,int *out_width, int *out_height);
     esp_err_t ImgDecodebmp_TFOneBMPPicture(const char *bmp_path, uint8_t **out_rgb888, int *out_width, int *out_height);
+    esp_err_t ImgDecode_TFOneQOIPicture(const char *qoi_path, uint8_t **out_rgb888, int *out_width, int *out_height);
+    esp_err_t ImgDecode_TFStreamPicture(const char *path, ImgHeaderCallback_t on_header, ImgRowCallback_t on_row, void *ctx);  /*png,qoi,bmp,jpg 逐行输出RGB888,不占整图缓存; jpg要把文件整个读进PSRAM, 不够时返回ESP_ERR_NO_MEM*/
+    esp_err_t ImgDecode_JPGReadRows(const uint8_t *inbuffer, int inlen, ImgHeaderCallback_t on_header, ImgRowCallback_t on_row, void *ctx);  /*内存中的JPG按MCU行块解码*/
     void ImgDecode_JPGBufferFree(uint8_t *buffer);
     void ImgDecode_PNGBufferFree(uint8_t *buffer);
     void ImgDecode_BMPBufferFree(uint8_t *buffer);
+    void ImgDecode_QOIBufferFree(uint8_t *buffer);
     void ImgDecode_DitherRgb888(uint8_t *in_img, uint8_t *out_img, int w, int h);
+    esp_err_t ImgDecode_DitherStreamBegin(ImgDitherStream_t *stream, int w, int h, DitherOutFormat_t format, ImgRowCallback_t cb, void *ctx);
+    void ImgDecode_DitherStreamPush(ImgDitherStream_t *stream, const uint8_t *rgb_row);
+    void ImgDecode_DitherStreamEnd(ImgDitherStream_t *stream);
     esp_err_t ImgDecode_EncodingBmpToSdcard(const char *filename, const uint8_t *inRgb, int width, int height);
     /*拉伸缩放算法*/
     void ImgDecode_ScaleRgb888Nearest(const uint8_t *src, int src_w, int src_h, uint8_t *dst, int dst_w, int dst_h);
@@ -0,0 +1,933 @@
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <esp_check.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include "cJSON.h"
+#include "esp_jpeg_enc.h"
+#include "library_app.h"
+#include "server_app.h"
+#include "user_app.h"
+#include "work_pool.h"
+
+static const char *TAG = "library";
+
+#define LIBRARY_RECV_LEN   (16 * 1024)  // 上传时的接收缓冲, 边收边写SD卡
+#define LIBRARY_ORDER_FILE LIBRARY_DIR "/order.txt"
+#define LIBRARY_ORDER_MAX  (16 * 1024)
+#define LIBRARY_PAGE_MAX   100
+#define LIBRARY_THUMB_JPG  (32 * 1024)  // 160x96 的JPG通常只有几KB
+#define LIBRARY_IDLE_MS    30000        // 外接电源时, 每隔多久补一张缩略图
+#define LIBRARY_RETRY_MS   1000         // 工作池满时, 多久后重试重扫
+#define LIBRARY_THUMB_SKIP 8            // 后台记住几张生成失败的图, 原图没变就不再重试
+
+typedef char LibraryName_t[LIBRARY_NAME_LEN];
+
+typedef struct {
+    FILE *fp;
+    char  name[LIBRARY_NAME_LEN];
+    char  path[96];     // 接收中的 <name>.part, 收完再改名
+} LibraryFile_t;
+
+static esp_timer_handle_t library_idle_timer     = NULL;
+static SemaphoreHandle_t  library_thumb_lock     = NULL;   // 网页请求和后台可能同时生成同一张缩略图
+static SemaphoreHandle_t  library_frame_lock     = NULL;   // 转码存帧和上传/删除作废帧互斥
+static volatile bool      library_rescan         = true;   // 工作池满时丢了转码任务, 稍后重新扫描目录补上
+static volatile bool      library_idle_queued    = false;
+static volatile bool      library_thumbs_pending = true;
+static volatile bool      library_stopped        = false;  // 切走Network模式后不再在后台占用显存
+static volatile bool      library_scanning       = false;  // 重扫中: 一次只提交一张, 转完再找下一张
+static int                library_scan_next      = 0;      // 重扫到的位置, 只在 library_idle_job 里访问
+static bool             (*library_on_power)(void) = NULL;
+
+static void library_schedule(uint32_t delay_ms);
+static void library_idle_callback(void *arg);
+
+/*缩放到缩略图里的区域(保持比例, 四周留白), 每个目标像素是源图对应矩形的平均值*/
+typedef struct {
+    int       src_w, src_h;
+    int       x0, y0, w, h;
+    int       cur_y;        // 正在累加的目标行, -1 表示还没有
+    uint32_t *sum;          // 当前目标行 w*3 个累加值
+    uint32_t *cnt;
+    uint8_t  *rgb;          // LIBRARY_THUMB_W * LIBRARY_THUMB_H * 3
+} LibraryThumb_t;
+
+static bool library_is_image(const char *name) {
+    const char *ext = strrchr(name, '.');
+    return ext != NULL && (!strcasecmp(ext, ".bmp") || !strcasecmp(ext, ".jpg") || !strcasecmp(ext, ".png") || !strcasecmp(ext, ".qoi")) &&
+           strcmp(name, "sys_decode.bmp");
+}
+
+static bool library_valid_name(const char *name) {
+    return name[0] != '\0' && name[0] != '.' && strlen(name) < LIBRARY_NAME_LEN && strpbrk(name, "/\\") == NULL &&
+           library_is_image(name);
+}
+
+/*只保留文件名部分, FAT不允许的字符换成下划线*/
+static void library_sanitize(const char *in, char *out) {
+    const char *base = in;
+    for (const char *p = in; *p; p++) {
+        if (*p == '/' || *p == '\\') {
+            base = p + 1;
+        }
+    }
+    size_t n = 0;
+    for (; *base && n < LIBRARY_NAME_LEN - 1; base++) {
+        unsigned char c = (unsigned char) *base;
+        out[n++]        = (c < 0x20 || strchr("\"*:<>?|", c) != NULL) ? '_' : c;
+    }
+    out[n] = '\0';
+}
+
+static void library_url_decode(char *s) {
+    char *out = s;
+    for (; *s; s++) {
+        if (*s == '%' && isxdigit((unsigned char) s[1]) && isxdigit((unsigned char) s[2])) {
+            char hex[3] = {s[1], s[2], 0};
+            *out++      = (char) strtol(hex, NULL, 16);
+            s += 2;
+        } else {
+            *out++ = (*s == '+') ? ' ' : *s;
+        }
+    }
+    *out = '\0';
+}
+
+static void library_frame_of(const char *name, char *out, size_t out_len) {
+    snprintf(out, out_len, LIBRARY_FRAME_DIR "/%s.epd", name);
+}
+
+static void library_thumb_of(const char *name, char *out, size_t out_len) {
+    snprintf(out, out_len, LIBRARY_THUMB_DIR "/%s.jpg", name);
+}
+
+/*
+ * 原图换掉或删掉后作废它的帧; 先等后台写完, 否则转码中的旧帧会在之后落盘.
+ * 拿一下锁, 已通过检查的转码就都已提交存帧; 之后的转码会看到原图变了.
+ * 等待时不持锁: 存帧在 work_pool 里排队, 持锁会卡住拿着显存等锁的转码.
+ */
+static void library_frame_discard(const char *name) {
+    char frame[128];
+    library_frame_of(name, frame, sizeof(frame));
+    xSemaphoreTake(library_frame_lock, portMAX_DELAY);
+    xSemaphoreGive(library_frame_lock);
+    ePaperDisplay.EPD_SaveFrameWait();
+    remove(frame);
+}
+
+/*缓存的缩略图不比原图旧*/
+static bool library_thumb_fresh(const char *name, char *thumb, size_t thumb_len, struct stat *src) {
+    char        path[96];
+    struct stat st;
+    snprintf(path, sizeof(path), LIBRARY_DIR "/%s", name);
+    library_thumb_of(name, thumb, thumb_len);
+    return stat(path, src) == 0 && stat(thumb, &st) == 0 && st.st_mtime >= src->st_mtime;
+}
+
+static esp_err_t library_thumb_header(int width, int height, void *ctx) {
+    LibraryThumb_t *t = (LibraryThumb_t *) ctx;
+    if (width <= 0 || height <= 0) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    t->src_w = width;
+    t->src_h = height;
+    if (width * LIBRARY_THUMB_H > height * LIBRARY_THUMB_W) {
+        t->w = LIBRARY_THUMB_W;
+        t->h = height * LIBRARY_THUMB_W / width;
+    } else {
+        t->h = LIBRARY_THUMB_H;
+        t->w = width * LIBRARY_THUMB_H / height;
+    }
+    t->w     = t->w < 1 ? 1 : t->w;
+    t->h     = t->h < 1 ? 1 : t->h;
+    t->x0    = (LIBRARY_THUMB_W - t->w) / 2;
+    t->y0    = (LIBRARY_THUMB_H - t->h) / 2;
+    t->cur_y = -1;
+    return ESP_OK;
+}
+
+static void library_thumb_flush(LibraryThumb_t *t) {
+    if (t->cur_y < 0) {
+        return;
+    }
+    uint8_t *dst = t->rgb + ((t->y0 + t->cur_y) * LIBRARY_THUMB_W + t->x0) * 3;
+    for (int x = 0; x < t->w; x++) {
+        uint32_t n = t->cnt[x] ? t->cnt[x] : 1;
+        for (int c = 0; c < 3; c++) {
+            dst[x * 3 + c] = t->sum[x * 3 + c] / n;
+        }
+    }
+    memset(t->sum, 0, t->w * 3 * sizeof(uint32_t));
+    memset(t->cnt, 0, t->w * sizeof(uint32_t));
+}
+
+static void library_thumb_row(int y, const uint8_t *row, void *ctx) {
+    LibraryThumb_t *t  = (LibraryThumb_t *) ctx;
+    int             dy = y * t->h / t->src_h;
+    if (dy != t->cur_y) {
+        library_thumb_flush(t);
+        t->cur_y = dy;
+    }
+    for (int x = 0; x < t->src_w; x++) {
+        int dx = x * t->w / t->src_w;
+        t->sum[dx * 3]     += row[x * 3];
+        t->sum[dx * 3 + 1] += row[x * 3 + 1];
+        t->sum[dx * 3 + 2] += row[x * 3 + 2];
+        t->cnt[dx]++;
+    }
+}
+
+/*逐行解码原图并盒式缩小, 编码成JPG写到 thumbs/; JPG原图要整个读进PSRAM, 内存不够时返回 ESP_ERR_NO_MEM*/
+static esp_err_t library_thumb_make(const char *name) {
+    char           path[96];
+    char           thumb[128];
+    char           tmp[132];
+    LibraryThumb_t t   = {};
+    uint8_t       *jpg = NULL;
+    int            len = 0;
+    esp_err_t      ret = ESP_ERR_NO_MEM;
+    snprintf(path, sizeof(path), LIBRARY_DIR "/%s", name);
+    library_thumb_of(name, thumb, sizeof(thumb));
+    t.rgb = (uint8_t *) heap_caps_malloc(LIBRARY_THUMB_W * LIBRARY_THUMB_H * 3, MALLOC_CAP_SPIRAM);
+    t.sum = (uint32_t *) heap_caps_calloc(LIBRARY_THUMB_W * 3, sizeof(uint32_t), MALLOC_CAP_SPIRAM);
+    t.cnt = (uint32_t *) heap_caps_calloc(LIBRARY_THUMB_W, sizeof(uint32_t), MALLOC_CAP_SPIRAM);
+    jpg   = (uint8_t *) heap_caps_malloc(LIBRARY_THUMB_JPG, MALLOC_CAP_SPIRAM);
+    if (t.rgb != NULL && t.sum != NULL && t.cnt != NULL && jpg != NULL) {
+        memset(t.rgb, 0xff, LIBRARY_THUMB_W * LIBRARY_THUMB_H * 3);
+        ret = decdither.ImgDecode_TFStreamPicture(path, library_thumb_header, library_thumb_row, &t);
+        library_thumb_flush(&t);
+    }
+    if (ret == ESP_OK) {
+        jpeg_enc_config_t config = DEFAULT_JPEG_ENC_CONFIG();
+        jpeg_enc_handle_t enc    = NULL;
+        config.width             = LIBRARY_THUMB_W;
+        config.height            = LIBRARY_THUMB_H;
+        config.src_type          = JPEG_PIXEL_FORMAT_RGB888;
+        config.subsampling       = JPEG_SUBSAMPLE_420;
+        config.quality           = 70;
+        ret = ESP_FAIL;
+        if (jpeg_enc_open(&config, &enc) == JPEG_ERR_OK) {
+            if (jpeg_enc_process(enc, t.rgb, LIBRARY_THUMB_W * LIBRARY_THUMB_H * 3, jpg, LIBRARY_THUMB_JPG, &len) == JPEG_ERR_OK) {
+                ret = ESP_OK;
+            }
+            jpeg_enc_close(enc);
+        }
+    }
+    if (ret == ESP_OK) {
+        snprintf(tmp, sizeof(tmp), "%s.tmp", thumb);
+        FILE *fp = fopen(tmp, "wb");
+        ret      = (fp != NULL && fwrite(jpg, 1, len, fp) == (size_t) len) ? ESP_OK : ESP_FAIL;
+        if (fp != NULL) {
+            fclose(fp);
+        }
+        remove(thumb);
+        if (ret != ESP_OK || rename(tmp, thumb) != 0) {
+            remove(tmp);
+            ret = ESP_FAIL;
+        }
+    }
+    heap_caps_free(t.rgb);
+    heap_caps_free(t.sum);
+    heap_caps_free(t.cnt);
+    heap_caps_free(jpg);
+    ESP_LOGI(TAG, "Thumbnail %s: %d bytes, %s", name, len, esp_err_to_name(ret));
+    return ret;
+}
+
+bool Library_FramePath(const char *path, char *out, size_t out_len) {
+    const char *name = strrchr(path, '/');
+    struct stat src, frame;
+    library_frame_of(name != NULL ? name + 1 : path, out, out_len);
+    return stat(path, &src) == 0 && stat(out, &frame) == 0 && frame.st_mtime >= src.st_mtime;
+}
+
+/*目录下的图片, 先按 order.txt 的顺序, 其余按目录顺序排在后面*/
+static int library_load_names(LibraryName_t *names, int max) {
+    int  count = 0;
+    DIR *dir   = opendir(LIBRARY_DIR);
+    if (dir == NULL) {
+        return 0;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL && count < max) {
+        if (entry->d_type != DT_DIR && library_valid_name(entry->d_name)) {
+            strlcpy(names[count++], entry->d_name, LIBRARY_NAME_LEN);
+        }
+    }
+    closedir(dir);
+
+    FILE *fp = fopen(LIBRARY_ORDER_FILE, "r");
+    if (fp != NULL) {
+        char line[LIBRARY_NAME_LEN + 2];
+        int  placed = 0;
+        while (fgets(line, sizeof(line), fp) != NULL && placed < count) {
+            line[strcspn(line, "\r\n")] = 0;
+            for (int i = placed; i < count; i++) {
+                if (!strcmp(names[i], line)) {
+                    LibraryName_t tmp;
+                    memcpy(tmp, names[i], LIBRARY_NAME_LEN);
+                    memmove(names[placed + 1], names[placed], (i - placed) * LIBRARY_NAME_LEN);
+                    memcpy(names[placed++], tmp, LIBRARY_NAME_LEN);
+                    break;
+                }
+            }
+        }
+        fclose(fp);
+    }
+    return count;
+}
+
+static void library_transcode(const char *name);
+
+static void library_transcode_job(void *arg) {
+    if (library_stopped) {
+        heap_caps_free(arg);            // Library_Init 重新扫描时会补上
+        return;
+    }
+    library_transcode((const char *) arg);
+    heap_caps_free(arg);
+    library_thumbs_pending = true;
+    if (library_scanning) {
+        library_idle_callback(NULL);    // 接着找下一张, 中间排队的显示和请求可以先做
+    } else if (library_on_power != NULL) {
+        library_schedule(LIBRARY_IDLE_MS);
+    }
+}
+
+/*转码放到工作池, 和网页请求共用有限的几个工作任务*/
+static void library_enqueue(const char *name) {
+    char *item = (char *) heap_caps_malloc(LIBRARY_NAME_LEN, MALLOC_CAP_SPIRAM);
+    if (item != NULL) {
+        strlcpy(item, name, LIBRARY_NAME_LEN);
+    }
+    if (item == NULL || work_pool_submit(library_transcode_job, item, 0) != ESP_OK) {
+        heap_caps_free(item);
+        library_rescan = true;
+        library_schedule(LIBRARY_RETRY_MS);
+    }
+}
+
+/*解码抖动到显存再存成帧, 占用显存期间持有GUI锁*/
+static void library_transcode(const char *name) {
+    char path[96];
+    char frame[128];
+    struct stat st;
+    snprintf(path, sizeof(path), LIBRARY_DIR "/%s", name);
+    xSemaphoreTake(epaper_gui_semapHandle, portMAX_DELAY);   /*锁内检查, 重扫和新上传的任务可能同时转同一张*/
+    if (library_stopped || Library_FramePath(path, frame, sizeof(frame)) || stat(path, &st) != 0) {
+        xSemaphoreGive(epaper_gui_semapHandle);
+        return;     // 已停止, 已转过, 或转码前已被删除
+    }
+    esp_err_t   err = ePaperDisplay.EPD_SDcardScaleIMGShakingColor(path, 0, 0);
+    struct stat now;
+    xSemaphoreTake(library_frame_lock, portMAX_DELAY);
+    if (err == ESP_OK && (stat(path, &now) != 0 || now.st_mtime != st.st_mtime || now.st_size != st.st_size)) {
+        err = ESP_ERR_INVALID_STATE;    // 转码期间原图被重新上传, 存下来的会是旧图
+    }
+    if (err == ESP_OK) {
+        err = ePaperDisplay.EPD_SaveFrameAsync(frame);
+    } else {
+        remove(frame);                  // 解码失败时显存里是上一张图, 不能存; 旧帧也不能再用
+    }
+    xSemaphoreGive(library_frame_lock);
+    xSemaphoreGive(epaper_gui_semapHandle);
+    ESP_LOGI(TAG, "Transcode %s -> %s: %s", name, frame, esp_err_to_name(err));
+}
+
+/*加锁后再确认一次, 别人刚生成好就不用重做*/
+static esp_err_t library_thumb_update(const char *name) {
+    char        thumb[128];
+    struct stat src;
+    esp_err_t   ret = ESP_OK;
+    xSemaphoreTake(library_thumb_lock, portMAX_DELAY);
+    if (!library_thumb_fresh(name, thumb, sizeof(thumb), &src)) {
+        ret = library_thumb_make(name);
+    }
+    xSemaphoreGive(library_thumb_lock);
+    return ret;
+}
+
+typedef struct {
+    LibraryName_t name;
+    time_t        mtime;
+} LibraryThumbSkip_t;
+
+static LibraryThumbSkip_t library_thumb_skip[LIBRARY_THUMB_SKIP];   // 只在后台任务里访问
+static int                library_thumb_skip_next = 0;
+
+static bool library_thumb_skipped(const char *name, time_t mtime) {
+    for (int i = 0; i < LIBRARY_THUMB_SKIP; i++) {
+        if (library_thumb_skip[i].mtime == mtime && !strcmp(library_thumb_skip[i].name, name)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*外接电源时, 每次补一张缺的缩略图, 返回是否还有要做的; 坏图记下来跳过, 不挡住后面的*/
+static bool library_thumb_background(void) {
+    LibraryName_t *list = (LibraryName_t *) heap_caps_malloc(LIBRARY_MAX * sizeof(LibraryName_t), MALLOC_CAP_SPIRAM);
+    bool           done = false;
+    bool           more = false;
+    if (list == NULL) {
+        return false;
+    }
+    int count = library_load_names(list, LIBRARY_MAX);
+    for (int i = 0; i < count; i++) {
+        char        thumb[128];
+        struct stat src;
+        if (library_thumb_fresh(list[i], thumb, sizeof(thumb), &src) || library_thumb_skipped(list[i], src.st_mtime)) {
+            continue;
+        }
+        if (done) {
+            more = true;
+            break;
+        }
+        done          = true;
+        esp_err_t ret = library_thumb_update(list[i]);
+        if (ret == ESP_ERR_NO_MEM) {
+            more = true;                // 暂时没内存, 不算坏图, 下次再试
+            break;
+        }
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "Thumbnail failed, skipping %s", list[i]);
+            LibraryThumbSkip_t *skip = &library_thumb_skip[library_thumb_skip_next];
+            library_thumb_skip_next  = (library_thumb_skip_next + 1) % LIBRARY_THUMB_SKIP;
+            strlcpy(skip->name, list[i], sizeof(skip->name));
+            skip->mtime = src.st_mtime;
+        }
+    }
+    heap_caps_free(list);
+    return more;
+}
+
+void Library_SetPowerCheck(bool (*on_external_power)(void)) {
+    library_on_power = on_external_power;
+    library_schedule(LIBRARY_IDLE_MS);
+}
+
+/*从上次的位置往后找一张没有帧的图提交转码, 没有了返回false*/
+static bool library_scan_step(void) {
+    LibraryName_t *list = (LibraryName_t *) heap_caps_malloc(LIBRARY_MAX * sizeof(LibraryName_t), MALLOC_CAP_SPIRAM);
+    bool           queued = false;
+    if (list == NULL) {
+        return false;
+    }
+    int count = library_load_names(list, LIBRARY_MAX);
+    while (!queued && library_scan_next < count) {
+        char path[96];
+        char frame[128];
+        snprintf(path, sizeof(path), LIBRARY_DIR "/%s", list[library_scan_next]);
+        if (!Library_FramePath(path, frame, sizeof(frame))) {
+            library_enqueue(list[library_scan_next]);
+            queued = true;
+        }
+        library_scan_next++;
+    }
+    heap_caps_free(list);
+    return queued;
+}
+
+/*重扫目录补转码, 每个任务只转一张; 外接电源时补一张缩略图, 还有没做的就稍后再来*/
+static void library_idle_job(void *arg) {
+    library_idle_queued = false;
+    if (library_stopped) {
+        return;
+    }
+    if (library_rescan) {
+        library_rescan    = false;
+        library_scanning  = true;
+        library_scan_next = 0;
+    }
+    if (library_scanning) {
+        if (library_scan_step()) {
+            return;
+        }
+        library_scanning = false;
+    }
+    if (library_thumbs_pending && library_on_power != NULL && library_on_power()) {
+        library_thumbs_pending = library_thumb_background();
+        if (library_thumbs_pending) {
+            library_schedule(LIBRARY_IDLE_MS);
+        }
+    }
+}
+
+static void library_idle_callback(void *arg) {
+    if (library_idle_queued) {
+        return;
+    }
+    library_idle_queued = true;
+    if (work_pool_submit(library_idle_job, NULL, 0) != ESP_OK) {
+        library_idle_queued = false;
+        library_schedule(LIBRARY_RETRY_MS);
+    }
+}
+
+static void library_schedule(uint32_t delay_ms) {
+    if (library_idle_timer != NULL && !library_stopped && !esp_timer_is_active(library_idle_timer)) {
+        esp_timer_start_once(library_idle_timer, delay_ms * 1000ULL);
+    }
+}
+
+void Library_Init(void) {
+    if (library_idle_timer != NULL) {
+        if (library_stopped) {          /*切回Network模式: 重新扫描补转*/
+            library_stopped        = false;
+            library_rescan         = true;
+            library_thumbs_pending = true;
+            library_idle_callback(NULL);
+        }
+        return;
+    }
+    mkdir(LIBRARY_FRAME_DIR, 0775);
+    mkdir(LIBRARY_THUMB_DIR, 0775);
+    library_thumb_lock = xSemaphoreCreateMutex();
+    library_frame_lock = xSemaphoreCreateMutex();
+    work_pool_init();
+    esp_timer_create_args_t args = {};
+    args.callback                = library_idle_callback;
+    args.name                    = "library_idle";
+    ESP_ERROR_CHECK(esp_timer_create(&args, &library_idle_timer));
+    library_idle_callback(NULL);      // 补转上次没转完的
+}
+
+void Library_Stop(void) {
+    library_stopped        = true;
+    library_rescan         = false;
+    library_scanning       = false;
+    library_thumbs_pending = false;
+    library_on_power       = NULL;
+    if (library_idle_timer != NULL) {
+        esp_timer_stop(library_idle_timer);
+    }
+}
+
+static esp_err_t library_send_json(httpd_req_t *req, cJSON *root) {
+    char *str = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    if (str == NULL) {
+        return httpd_resp_send_500(req);
+    }
+    httpd_resp_set_type(req, "application/json");
+    esp_err_t ret = httpd_resp_sendstr(req, str);
+    cJSON_free(str);
+    return ret;
+}
+
+static esp_err_t library_list_handler(httpd_req_t *req) {
+    char query[64];
+    char value[12];
+    int  offset = 0;
+    int  limit  = 20;
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        if (httpd_query_key_value(query, "offset", value, sizeof(value)) == ESP_OK) {
+            offset = atoi(value);
+        }
+        if (httpd_query_key_value(query, "limit", value, sizeof(value)) == ESP_OK) {
+            limit = atoi(value);
+        }
+    }
+    offset = offset < 0 ? 0 : offset;
+    limit  = limit < 1 ? 1 : (limit > LIBRARY_PAGE_MAX ? LIBRARY_PAGE_MAX : limit);
+
+    LibraryName_t *names = (LibraryName_t *) heap_caps_malloc(LIBRARY_MAX * sizeof(LibraryName_t), MALLOC_CAP_SPIRAM);
+    if (names == NULL) {
+        return httpd_resp_send_500(req);
+    }
+    int    count = library_load_names(names, LIBRARY_MAX);
+    cJSON *root  = cJSON_CreateObject();
+    cJSON *items = cJSON_AddArrayToObject(root, "items");
+    cJSON_AddNumberToObject(root, "total", count);
+    cJSON_AddNumberToObject(root, "offset", offset);
+    for (int i = offset; i < count && i < offset + limit; i++) {
+        char        path[96];
+        char        frame[128];
+        struct stat st = {};
+        snprintf(path, sizeof(path), LIBRARY_DIR "/%s", names[i]);
+        stat(path, &st);
+        cJSON *item = cJSON_CreateObject();
+        cJSON_AddStringToObject(item, "name", names[i]);
+        cJSON_AddNumberToObject(item, "size", st.st_size);
+        cJSON_AddBoolToObject(item, "ready", Library_FramePath(path, frame, sizeof(frame)));
+        snprintf(frame, sizeof(frame), "/api/library/thumb/%s?v=%lx", names[i], (unsigned long) st.st_mtime);
+        cJSON_AddStringToObject(item, "thumb", frame);
+        cJSON_AddItemToArray(items, item);
+    }
+    heap_caps_free(names);
+    return library_send_json(req, root);
+}
+
+static bool library_file_open(LibraryFile_t *file, const char *raw_name) {
+    library_sanitize(raw_name, file->name);
+    if (!library_valid_name(file->name)) {
+        ESP_LOGW(TAG, "Skip upload: %s", raw_name);
+        return false;
+    }
+    snprintf(file->path, sizeof(file->path), LIBRARY_DIR "/%s.part", file->name);
+    file->fp = fopen(file->path, "wb");
+    if (file->fp == NULL) {
+        ESP_LOGE(TAG, "Cannot create %s", file->path);
+        return false;
+    }
+    setvbuf(file->fp, NULL, _IOFBF, 8 * 1024);
+    return true;
+}
+
+static void library_file_abort(LibraryFile_t *file) {
+    if (file->fp != NULL) {
+        fclose(file->fp);
+        file->fp = NULL;
+        remove(file->path);
+    }
+}
+
+static bool library_file_write(LibraryFile_t *file, const char *data, size_t len) {
+    return fwrite(data, 1, len, file->fp) == len;
+}
+
+/*收完一个文件: 改成正式文件名, 旧的帧作废, 排队转码; 没写完整时只删临时文件, 旧图不动*/
+static bool library_file_commit(LibraryFile_t *file, cJSON *saved) {
+    char path[96];
+    char frame[128];
+    bool ok  = fclose(file->fp) == 0;
+    file->fp = NULL;
+    if (!ok) {
+        remove(file->path);
+        return false;
+    }
+    snprintf(path, sizeof(path), LIBRARY_DIR "/%s", file->name);
+    remove(path);                       // FAT 的 rename 不能覆盖已有文件
+    bool renamed = rename(file->path, path) == 0;
+    library_frame_discard(file->name);  /*改名之后再作废, 旧图转码中的帧不会留下*/
+    library_thumb_of(file->name, frame, sizeof(frame));
+    remove(frame);
+    if (!renamed) {
+        remove(file->path);
+        return false;
+    }
+    cJSON_AddItemToArray(saved, cJSON_CreateString(file->name));
+    library_enqueue(file->name);
+    return true;
+}
+
+static int library_recv(httpd_req_t *req, char *buf, size_t len) {
+    for (int timeouts = 0; timeouts < 10; timeouts++) {
+        int ret = httpd_req_recv(req, buf, len);
+        if (ret != HTTPD_SOCK_ERR_TIMEOUT) {
+            return ret;
+        }
+    }
+    return HTTPD_SOCK_ERR_TIMEOUT;
+}
+
+static void library_consume(char *buf, size_t *len, size_t n) {
+    memmove(buf, buf + n, *len - n);
+    *len -= n;
+}
+
+/*一个part的头部, 只接收带 filename 的文件字段*/
+static bool library_part_open(LibraryFile_t *file, const char *headers) {
+    const char *fn = strstr(headers, "filename=\"");
+    if (fn == NULL) {
+        return false;
+    }
+    fn += strlen("filename=\"");
+    char   raw[96];
+    size_t n = strcspn(fn, "\"");
+    snprintf(raw, sizeof(raw), "%.*s", (int) n, fn);
+    return library_file_open(file, raw);
+}
+
+/*
+ * multipart/form-data 流式解析: 缓冲里找 "\r\n--boundary",
+ * 找不到时把除去末尾 (分隔符长度-1) 字节以外的数据写入文件, 剩下的留给下一次接收.
+ */
+static esp_err_t library_receive_multipart(httpd_req_t *req, const char *ctype, char *buf, cJSON *saved) {
+    const char *b = strstr(ctype, "boundary=");
+    if (b == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    b += strlen("boundary=");
+    if (*b == '"') {
+        b++;
+    }
+    size_t blen = strcspn(b, "\";");
+    if (blen == 0 || blen > 70) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    char   delim[80];
+    size_t dlen = snprintf(delim, sizeof(delim), "\r\n--%.*s", (int) blen, b);
+
+    enum { PartSkip, PartBody, PartDelim, PartHeader, PartEnd } state = PartSkip;
+    LibraryFile_t file      = {};
+    size_t        len       = 2;
+    size_t        remaining = req->content_len;
+    esp_err_t     ret       = ESP_OK;
+    memcpy(buf, "\r\n", 2);   // 第一个分隔符前面没有CRLF, 补上后所有分隔符一样处理
+    while (state != PartEnd && ret == ESP_OK) {
+        bool progress = false;
+        if (state == PartSkip || state == PartBody) {
+            char  *pos  = (char *) memmem(buf, len, delim, dlen);
+            size_t data = pos != NULL ? pos - buf : (len >= dlen ? len - (dlen - 1) : 0);
+            if (state == PartBody && data > 0 && !library_file_write(&file, buf, data)) {
+                ret = ESP_FAIL;
+                break;
+            }
+            library_consume(buf, &len, data + (pos != NULL ? dlen : 0));
+            if (pos != NULL) {
+                if (state == PartBody && !library_file_commit(&file, saved)) {
+                    ret = ESP_FAIL;
+                    break;
+                }
+                state    = PartDelim;
+                progress = true;
+            }
+        } else if (state == PartDelim && len >= 2) {
+            if (!memcmp(buf, "--", 2)) {
+                state = PartEnd;
+            } else if (!memcmp(buf, "\r\n", 2)) {
+                state = PartHeader;
+            } else {
+                ret = ESP_ERR_INVALID_RESPONSE;
+            }
+            library_consume(buf, &len, 2);
+            progress = true;
+        } else if (state == PartHeader) {
+            char *pos = (char *) memmem(buf, len, "\r\n\r\n", 4);
+            if (pos != NULL) {
+                *pos  = '\0';
+                state = library_part_open(&file, buf) ? PartBody : PartSkip;
+                library_consume(buf, &len, pos - buf + 4);
+                progress = true;
+            } else if (len == LIBRARY_RECV_LEN) {
+                ret = ESP_ERR_INVALID_SIZE;
+            }
+        }
+        if (progress || state == PartEnd || ret != ESP_OK) {
+            continue;
+        }
+        if (remaining == 0) {
+            ret = ESP_ERR_INVALID_SIZE;   // body 结束了还没遇到结束分隔符
+            break;
+        }
+        size_t want = LIBRARY_RECV_LEN - len;
+        int    got  = library_recv(req, buf + len, want < remaining ? want : remaining);
+        if (got <= 0) {
+            ret = ESP_FAIL;
+        } else {
+            len += got;
+            remaining -= got;
+        }
+    }
+    library_file_abort(&file);
+    return ret;
+}
+
+static esp_err_t library_receive_raw(httpd_req_t *req, const char *name, char *buf, cJSON *saved) {
+    LibraryFile_t file = {};
+    if (!library_file_open(&file, name)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    size_t remaining = req->content_len;
+    while (remaining > 0) {
+        int got = library_recv(req, buf, remaining < LIBRARY_RECV_LEN ? remaining : LIBRARY_RECV_LEN);
+        if (got <= 0 || !library_file_write(&file, buf, got)) {
+            library_file_abort(&file);
+            return ESP_FAIL;
+        }
+        remaining -= got;
+    }
+    return library_file_commit(&file, saved) ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t library_upload_handler(httpd_req_t *req) {
+    char query[80];
+    char name[96];
+    char ctype[128];
+    char *buf = (char *) heap_caps_malloc(LIBRARY_RECV_LEN, MALLOC_CAP_SPIRAM);
+    if (buf == NULL) {
+        return httpd_resp_send_500(req);
+    }
+    cJSON    *saved = cJSON_CreateArray();
+    esp_err_t ret   = ESP_ERR_INVALID_ARG;
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "name", name, sizeof(name)) == ESP_OK) {
+        library_url_decode(name);
+        ret = library_receive_raw(req, name, buf, saved);
+    } else if (httpd_req_get_hdr_value_str(req, "Content-Type", ctype, sizeof(ctype)) == ESP_OK &&
+               strstr(ctype, "multipart/form-data") != NULL) {
+        ret = library_receive_multipart(req, ctype, buf, saved);
+    }
+    heap_caps_free(buf);
+    ESP_LOGI(TAG, "Upload %d file(s): %s", cJSON_GetArraySize(saved), esp_err_to_name(ret));
+    if (ret != ESP_OK && cJSON_GetArraySize(saved) == 0) {
+        cJSON_Delete(saved);
+        return httpd_resp_send_err(req, ret == ESP_ERR_INVALID_ARG ? HTTPD_400_BAD_REQUEST : HTTPD_500_INTERNAL_SERVER_ERROR,
+                                   "Upload failed");
+    }
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddItemToObject(root, "saved", saved);
+    cJSON_AddBoolToObject(root, "complete", ret == ESP_OK);
+    return library_send_json(req, root);
+}
+
+static esp_err_t library_delete_handler(httpd_req_t *req) {
+    char name[96];
+    char path[96];
+    char frame[128];
+    snprintf(name, sizeof(name), "%s", req->uri + strlen("/api/library/"));
+    name[strcspn(name, "?")] = '\0';
+    library_url_decode(name);
+    if (!library_valid_name(name)) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid name");
+    }
+    snprintf(path, sizeof(path), LIBRARY_DIR "/%s", name);
+    if (remove(path) != 0) {
+        return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Resources do not exist");
+    }
+    library_frame_discard(name);
+    library_thumb_of(name, frame, sizeof(frame));
+    remove(frame);
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "deleted", name);
+    return library_send_json(req, root);
+}
+
+/*新顺序写到 order.txt, 没列出的图片排在后面*/
+static esp_err_t library_order_handler(httpd_req_t *req) {
+    if (req->content_len == 0 || req->content_len > LIBRARY_ORDER_MAX) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid order");
+    }
+    char  *body = (char *) heap_caps_malloc(req->content_len + 1, MALLOC_CAP_SPIRAM);
+    size_t len  = 0;
+    while (body != NULL && len < req->content_len) {
+        int got = library_recv(req, body + len, req->content_len - len);
+        if (got <= 0) {
+            break;
+        }
+        len += got;
+    }
+    cJSON *order = NULL;
+    if (body != NULL && len == req->content_len) {
+        body[len] = '\0';
+        order     = cJSON_Parse(body);
+    }
+    if (body != NULL) {
+        heap_caps_free(body);
+    }
+    if (!cJSON_IsArray(order)) {
+        cJSON_Delete(order);
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Expected a JSON array of names");
+    }
+    FILE *fp    = fopen(LIBRARY_ORDER_FILE ".tmp", "w");
+    int   count = 0;
+    if (fp != NULL) {
+        cJSON *item;
+        cJSON_ArrayForEach(item, order) {
+            if (cJSON_IsString(item) && library_valid_name(item->valuestring)) {
+                fprintf(fp, "%s\n", item->valuestring);
+                count++;
+            }
+        }
+        fclose(fp);
+        remove(LIBRARY_ORDER_FILE);
+        rename(LIBRARY_ORDER_FILE ".tmp", LIBRARY_ORDER_FILE);
+    }
+    cJSON_Delete(order);
+    if (fp == NULL) {
+        return httpd_resp_send_500(req);
+    }
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "ordered", count);
+    return library_send_json(req, root);
+}
+
+/*
+ * 缩略图: 缺失或比原图旧时当场生成. URL 带 ?v=<原图修改时间> 时内容不会变, 允许浏览器缓存一年;
+ * 不带时用 ETag 协商.
+ */
+static esp_err_t library_thumb_handler(httpd_req_t *req) {
+    char        name[96];
+    char        thumb[128];
+    char        etag[32];
+    char        match[32];
+    struct stat src;
+    snprintf(name, sizeof(name), "%s", req->uri + strlen("/api/library/thumb/"));
+    bool versioned = strstr(name, "?v=") != NULL;
+    name[strcspn(name, "?")] = '\0';
+    library_url_decode(name);
+    if (!library_valid_name(name)) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid name");
+    }
+    esp_err_t made = library_thumb_fresh(name, thumb, sizeof(thumb), &src) ? ESP_OK : library_thumb_update(name);
+    if (made == ESP_ERR_NO_MEM) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "5");
+        return httpd_resp_sendstr(req, "Out of memory");
+    }
+    if (made != ESP_OK) {
+        return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Resources do not exist");
+    }
+    snprintf(etag, sizeof(etag), "\"%lx-%lx\"", (unsigned long) src.st_mtime, (unsigned long) src.st_size);
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_hdr(req, "Cache-Control", versioned ? "public, max-age=31536000, immutable" : "no-cache");
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", match, sizeof(match)) == ESP_OK && !strcmp(match, etag)) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, NULL, 0);
+    }
+    FILE *fp  = fopen(thumb, "rb");
+    char *buf = (char *) heap_caps_malloc(4096, MALLOC_CAP_SPIRAM);
+    if (fp == NULL || buf == NULL) {
+        if (fp != NULL) {
+            fclose(fp);
+        }
+        heap_caps_free(buf);
+        return httpd_resp_send_500(req);
+    }
+    httpd_resp_set_type(req, "image/jpeg");
+    size_t    n;
+    esp_err_t ret = ESP_OK;
+    while (ret == ESP_OK && (n = fread(buf, 1, 4096, fp)) > 0) {
+        ret = httpd_resp_send_chunk(req, buf, n);
+    }
+    fclose(fp);
+    heap_caps_free(buf);
+    return ret == ESP_OK ? httpd_resp_send_chunk(req, NULL, 0) : ret;
+}
+
+/*都要读写SD卡, 全部放到工作池, httpd任务只负责分发*/
+esp_err_t Library_RegisterHandlers(httpd_handle_t server) {
+    httpd_uri_t uri_config = {};
+    uri_config.uri         = "/api/library";
+    uri_config.method      = HTTP_GET;
+    uri_config.handler     = library_list_handler;
+    ESP_RETURN_ON_ERROR(ServerPort_RegisterAsync(server, &uri_config), TAG, "list");
+
+    uri_config.method  = HTTP_POST;
+    uri_config.handler = library_upload_handler;
+    ESP_RETURN_ON_ERROR(ServerPort_RegisterAsync(server, &uri_config), TAG, "upload");
+
+    uri_config.uri     = "/api/library/order";
+    uri_config.method  = HTTP_PUT;
+    uri_config.handler = library_order_handler;
+    ESP_RETURN_ON_ERROR(ServerPort_RegisterAsync(server, &uri_config), TAG, "order");
+
+    uri_config.uri     = "/api/library/thumb/*";
+    uri_config.method  = HTTP_GET;
+    uri_config.handler = library_thumb_handler;
+    ESP_RETURN_ON_ERROR(ServerPort_RegisterAsync(server, &uri_config), TAG, "thumb");
+
+    uri_config.uri     = "/api/library/*";
+    uri_config.method  = HTTP_DELETE;
+    uri_config.handler = library_delete_handler;
+    return ServerPort_RegisterAsync(server, &uri_config);
+}
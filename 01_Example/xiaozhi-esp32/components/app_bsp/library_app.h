@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stddef.h>
+#include <esp_err.h>
+#include <esp_http_server.h>
+
+/*
+ * 图库: Basic模式轮播的目录, 网页端通过 /api/library 管理.
+ * 上传的原图在后台转成 .epd 原生帧放到 frames/ 下, 轮播时只需读一次帧.
+ *
+ *   GET    /api/library?offset=0&limit=20   分页列出(按播放顺序)
+ *   GET    /api/library/thumb/<name>?v=xx   缩略图, 第一次请求时生成, 带 v 时可长期缓存
+ *   POST   /api/library                     multipart/form-data 一次上传多张, 或 ?name=xx.jpg 直接传body
+ *   DELETE /api/library/<name>              删除原图和帧
+ *   PUT    /api/library/order               JSON数组, 新的播放顺序
+ */
+#define LIBRARY_DIR       "/sdcard/06_user_foundation_img"
+#define LIBRARY_FRAME_DIR LIBRARY_DIR "/frames"
+#define LIBRARY_THUMB_DIR LIBRARY_DIR "/thumbs"
+#define LIBRARY_THUMB_W   160
+#define LIBRARY_THUMB_H   96
+#define LIBRARY_NAME_LEN  48
+#define LIBRARY_MAX       256
+
+void      Library_Init(void);                                               /*转码在工作池里执行, 启动时补转上次没转完的*/
+void      Library_Stop(void);                                               /*停掉后台重扫/转码/缩略图, 再次 Library_Init 时恢复*/
+esp_err_t Library_RegisterHandlers(httpd_handle_t server);                  /*须在静态资源的通配符路由之前注册*/
+bool      Library_FramePath(const char *path, char *out, size_t out_len);   /*原图的转码帧存在且不比原图旧时返回true*/
+void      Library_SetPowerCheck(bool (*on_external_power)(void));          /*外接电源时后台顺便生成缩略图*/
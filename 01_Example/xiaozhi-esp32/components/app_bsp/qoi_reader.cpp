@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <string.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include "qoi_reader.h"
+
+#define QOI_READ_CHUNK_LEN (16 * 1024)
+#define QOI_HEADER_LEN     14
+#define QOI_MAX_PIXELS     (4000 * 4000)
+
+#define QOI_OP_INDEX 0x00 /* 00xxxxxx */
+#define QOI_OP_DIFF  0x40 /* 01xxxxxx */
+#define QOI_OP_LUMA  0x80 /* 10xxxxxx */
+#define QOI_OP_RUN   0xc0 /* 11xxxxxx */
+#define QOI_OP_RGB   0xfe /* 11111110 */
+#define QOI_OP_RGBA  0xff /* 11111111 */
+#define QOI_MASK_2   0xc0 /* 11000000 */
+
+#define QOI_COLOR_HASH(c) ((c)[0] * 3 + (c)[1] * 5 + (c)[2] * 7 + (c)[3] * 11)
+
+QoiReader::QoiReader() {
+}
+
+QoiReader::~QoiReader() {
+    QoiReader_Close();
+}
+
+esp_err_t QoiReader::QoiReader_Open(const char *path) {
+    uint8_t header[QOI_HEADER_LEN];
+    QoiReader_Close();
+    fp_ = fopen(path, "rb");
+    if (fp_ == NULL) {
+        ESP_LOGE(TAG, "Cannot open QOI file: %s", path);
+        return ESP_FAIL;
+    }
+    setvbuf(fp_, NULL, _IONBF, 0);
+    if (fread(header, 1, QOI_HEADER_LEN, fp_) != QOI_HEADER_LEN || memcmp(header, "qoif", 4) != 0) {
+        ESP_LOGE(TAG, "Not a valid QOI file: %s", path);
+        QoiReader_Close();
+        return ESP_FAIL;
+    }
+    width_    = (header[4] << 24) | (header[5] << 16) | (header[6] << 8) | header[7];
+    height_   = (header[8] << 24) | (header[9] << 16) | (header[10] << 8) | header[11];
+    channels_ = header[12];
+    if (width_ <= 0 || height_ <= 0 || (channels_ != 3 && channels_ != 4) || height_ > QOI_MAX_PIXELS / width_) {
+        ESP_LOGE(TAG, "Unsupported QOI image: %dx%d, channels: %d", width_, height_, channels_);
+        QoiReader_Close();
+        return ESP_FAIL;
+    }
+    chunk_ = (uint8_t *) heap_caps_malloc(QOI_READ_CHUNK_LEN, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    if (chunk_ == NULL) {
+        chunk_ = (uint8_t *) heap_caps_malloc(QOI_READ_CHUNK_LEN, MALLOC_CAP_SPIRAM);
+    }
+    row_ = (uint8_t *) heap_caps_malloc(width_ * 3, MALLOC_CAP_SPIRAM);
+    if (chunk_ == NULL || row_ == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate QOI read buffers");
+        QoiReader_Close();
+        return ESP_FAIL;
+    }
+    chunk_pos_  = 0;
+    chunk_fill_ = 0;
+    ESP_LOGI(TAG, "QOI information: %dx%d, channels: %d", width_, height_, channels_);
+    return ESP_OK;
+}
+
+void QoiReader::QoiReader_Close() {
+    if (fp_ != NULL) {
+        fclose(fp_);
+        fp_ = NULL;
+    }
+    if (chunk_ != NULL) {
+        heap_caps_free(chunk_);
+        chunk_ = NULL;
+    }
+    if (row_ != NULL) {
+        heap_caps_free(row_);
+        row_ = NULL;
+    }
+}
+
+int QoiReader::QoiReader_NextByte() {
+    if (chunk_pos_ >= chunk_fill_) {
+        chunk_fill_ = fread(chunk_, 1, QOI_READ_CHUNK_LEN, fp_);
+        chunk_pos_  = 0;
+        if (chunk_fill_ <= 0) {
+            return -1;
+        }
+    }
+    return chunk_[chunk_pos_++];
+}
+
+esp_err_t QoiReader::QoiReader_ReadRows(QoiRowCallback_t cb, void *ctx) {
+    if (fp_ == NULL || cb == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    uint8_t index[64][4];
+    uint8_t px[4] = {0, 0, 0, 255};  // R,G,B,A
+    int     run   = 0;
+    memset(index, 0, sizeof(index));
+
+    for (int y = 0; y < height_; y++) {
+        uint8_t *out = row_;
+        for (int x = 0; x < width_; x++, out += 3) {
+            if (run > 0) {
+                run--;
+            } else {
+                int b1 = QoiReader_NextByte();
+                if (b1 < 0) {
+                    ESP_LOGE(TAG, "Truncated QOI data at row %d/%d", y, height_);
+                    return ESP_FAIL;
+                }
+                if (b1 == QOI_OP_RGB) {
+                    px[0] = QoiReader_NextByte();
+                    px[1] = QoiReader_NextByte();
+                    px[2] = QoiReader_NextByte();
+                } else if (b1 == QOI_OP_RGBA) {
+                    px[0] = QoiReader_NextByte();
+                    px[1] = QoiReader_NextByte();
+                    px[2] = QoiReader_NextByte();
+                    px[3] = QoiReader_NextByte();
+                } else if ((b1 & QOI_MASK_2) == QOI_OP_INDEX) {
+                    memcpy(px, index[b1], 4);
+                } else if ((b1 & QOI_MASK_2) == QOI_OP_DIFF) {
+                    px[0] += ((b1 >> 4) & 0x03) - 2;
+                    px[1] += ((b1 >> 2) & 0x03) - 2;
+                    px[2] += (b1 & 0x03) - 2;
+                } else if ((b1 & QOI_MASK_2) == QOI_OP_LUMA) {
+                    int b2 = QoiReader_NextByte();
+                    int vg = (b1 & 0x3f) - 32;
+                    px[0] += vg - 8 + ((b2 >> 4) & 0x0f);
+                    px[1] += vg;
+                    px[2] += vg - 8 + (b2 & 0x0f);
+                } else {
+                    run = (b1 & 0x3f);
+                }
+                memcpy(index[QOI_COLOR_HASH(px) % 64], px, 4);
+            }
+            out[0] = px[0];
+            out[1] = px[1];
+            out[2] = px[2];
+        }
+        cb(y, row_, ctx);
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdio.h>
+#include <esp_err.h>
+
+/*Rows are delivered top-down as RGB888, the alpha channel is dropped*/
+typedef void (*QoiRowCallback_t)(int y, const uint8_t *row, void *ctx);
+
+class QoiReader
+{
+private:
+    const char *TAG = "QoiReader";
+    FILE    *fp_        = NULL;
+    uint8_t *chunk_     = NULL; // Compressed input buffer
+    uint8_t *row_       = NULL; // Decoded RGB888 row
+    int      chunk_pos_  = 0;
+    int      chunk_fill_ = 0;
+    int      width_      = 0;
+    int      height_     = 0;
+    uint8_t  channels_   = 0;
+
+    int  QoiReader_NextByte();
+
+public:
+    QoiReader();
+    ~QoiReader();
+
+    esp_err_t QoiReader_Open(const char *path);
+    void      QoiReader_Close();
+    int       QoiReader_GetWidth() {return width_;}
+    int       QoiReader_GetHeight() {return height_;}
+    esp_err_t QoiReader_ReadRows(QoiRowCallback_t cb, void *ctx);
+};
@@ -1,9 +1,20 @@
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <esp_attr.h>
 #include <esp_check.h>
 #include <esp_http_server.h>
 #include <esp_log.h>
 #include <esp_wifi.h>
+#include <esp_timer.h>
+#include <esp_pm.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <freertos/semphr.h>
 #include "server_app.h"
+#include "library_app.h"
+#include "work_pool.h"
 #include "sdcard_bsp.h"
 #include "button_bsp.h"
 #include "mdns.h"
@@ -20,17 +31,129 @@ static const char *TAG = "server_bsp";
 #define BSP_ESP_WIFI_CHANNEL 1
 #define BSP_MAX_STA_CONN 4
 
+#define SERVER_IDLE_MS          (3 * 60 * 1000)  // 有过请求之后, 多久没有新请求算空闲
+#define SERVER_LISTEN_INTERVAL  3                // 空闲时每3个beacon周期醒一次收DTIM
+#define SERVER_MAX_SOCKETS      10               // 浏览器对同一主机最多开6个连接, 另留给上传; 需 LWIP_MAX_SOCKETS >= 13
+#define SERVER_WS_FRAME_MAX     64               // 客户端只发短命令
+#define SERVER_WS_MSG_LEN       112              // 推给网页端的一条事件
+#define SERVER_WS_RECV_STEP     (64 * 1024)      // 上传时每收这么多推一次进度
+#define SERVER_UPLOAD_BMP       "/sdcard/02_sys_ap_img/user_send.bmp"
+#define SERVER_UPLOAD_FRAME     "/sdcard/02_sys_ap_img/user_send.epd"   // 网页端已抖动打包好的原生帧
+
+#define STA_FAST_MAGIC   0x53544146
+#define STA_FAST_LEASE_S (60 * 60)     // 上次DHCP后多久内直接沿用地址, 远小于路由器常见的租期
+#define STA_FAST_WAIT_MS 3000          // 快速连接超时, 之后退回扫描+DHCP
+
+/*深睡唤醒后免扫描免DHCP: 上次连上的AP和地址, 放RTC内存, 上电复位时清零*/
+typedef struct {
+    uint32_t            magic;
+    char                ssid[33];
+    char                password[65];
+    uint8_t             bssid[6];
+    uint8_t             channel;
+    esp_netif_ip_info_t ip_info;
+    esp_ip4_addr_t      dns;
+    time_t              lease_time;   // 拿到这个地址的时间, RTC时钟深睡时也在走
+} sta_fast_cache_t;
+
+typedef struct {
+    httpd_req_t *req;
+    esp_err_t  (*handler)(httpd_req_t *req);
+} server_async_job_t;
+
+typedef struct {
+    int  fd;                        // -1: 发给所有WebSocket连接
+    char json[SERVER_WS_MSG_LEN];
+} server_ws_msg_t;
+
 EventGroupHandle_t ServerPortGroups;
+static RTC_DATA_ATTR sta_fast_cache_t sta_fast_cache;
+static esp_netif_t *sta_netif = NULL;
+static esp_netif_t *ap_netif  = NULL;
+static esp_event_handler_instance_t server_wifi_handler = NULL;   // 停止时注销
+static esp_event_handler_instance_t server_ip_handler   = NULL;
+static bool server_mdns = false;
+static esp_timer_handle_t server_idle_timer = NULL;
+static uint64_t server_idle_us = 0;      // 当前的空闲超时
+static bool server_idle = false;
+static SemaphoreHandle_t server_idle_lock = NULL;     // httpd任务和esp_timer任务都会切换空闲状态和电源锁
+#if CONFIG_PM_ENABLE
+static esp_pm_lock_handle_t server_pm_lock = NULL;   // 处理请求期间不进light sleep
+static esp_pm_lock_handle_t server_cpu_lock = NULL;  // 处理请求期间CPU保持最高频, 上传解码抖动不降到40MHz
+#endif
 static CustomSDPort *SDPort_ = NULL;
+static SemaphoreHandle_t server_upload_lock = NULL;   // /dataUP 只有一个接收文件, 同时只允许一个上传
+static httpd_handle_t server_handle = NULL;
+static volatile bool server_cancel = false;          // 网页端通过WebSocket发来 cancel
+static int          server_async_active = 0;         // 交给工作池还没完成的请求, 停服务器前要等它们结束
+static portMUX_TYPE server_async_lock   = portMUX_INITIALIZER_UNLOCKED;
+static const char *upload_path = SERVER_UPLOAD_BMP;
 static uint8_t netMode = 0;   //Default AP mode
+static void (*server_notify)(uint32_t bits) = NULL;
 const char staresp[] = "1";
 const char apresp[] = "0";
 
+/*置位的同时通知应用层的事件循环*/
+static void server_set_bits(EventBits_t bits) {
+    xEventGroupSetBits(ServerPortGroups, bits);
+    if (server_notify != NULL) {
+        server_notify(bits);
+    }
+}
+
 /*callback fun*/
 esp_err_t static_resource_unified_handler(httpd_req_t *req);
 esp_err_t receive_data_redirect_handler(httpd_req_t *req);
 esp_err_t unknown_uri_handler(httpd_req_t *req);
 void sta_wifi_event_callback(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data);
+/*在工作任务里执行真正的handler, 返回错误时和同步handler一样关闭连接*/
+static void server_async_job(void *arg) {
+    server_async_job_t *job = (server_async_job_t *) arg;
+    if (job->handler(job->req) != ESP_OK) {
+        httpd_sess_trigger_close(job->req->handle, httpd_req_to_sockfd(job->req));
+    }
+    httpd_req_async_handler_complete(job->req);
+    heap_caps_free(job);
+    taskENTER_CRITICAL(&server_async_lock);
+    server_async_active--;
+    taskEXIT_CRITICAL(&server_async_lock);
+}
+
+/*user_ctx 里是真正的handler, 请求转给工作池后httpd任务马上回去处理其他连接*/
+static esp_err_t server_async_handler(httpd_req_t *req) {
+    server_async_job_t *job = (server_async_job_t *) heap_caps_malloc(sizeof(server_async_job_t), MALLOC_CAP_DEFAULT);
+    if (job == NULL) {
+        return httpd_resp_send_500(req);
+    }
+    job->handler = (esp_err_t (*)(httpd_req_t *)) req->user_ctx;
+    if (server_handle == NULL || httpd_req_async_handler_begin(req, &job->req) != ESP_OK) {   /*正在停服务器时不再接新任务*/
+        heap_caps_free(job);
+        return httpd_resp_send_500(req);
+    }
+    taskENTER_CRITICAL(&server_async_lock);
+    server_async_active++;
+    taskEXIT_CRITICAL(&server_async_lock);
+    if (work_pool_submit_request(server_async_job, job) != ESP_OK) {   /*不能等: httpd只有一个任务, 等待会卡住所有连接和WebSocket*/
+        taskENTER_CRITICAL(&server_async_lock);
+        server_async_active--;
+        taskEXIT_CRITICAL(&server_async_lock);
+        ESP_LOGW(TAG, "Worker pool busy, reject %s", req->uri);
+        httpd_resp_set_status(job->req, "503 Service Unavailable");
+        httpd_resp_set_hdr(job->req, "Retry-After", "1");
+        httpd_resp_sendstr(job->req, "Server busy");
+        httpd_req_async_handler_complete(job->req);
+        heap_caps_free(job);
+    }
+    return ESP_OK;
+}
+
+esp_err_t ServerPort_RegisterAsync(httpd_handle_t server, const httpd_uri_t *uri) {
+    httpd_uri_t async = *uri;
+    async.handler     = server_async_handler;
+    async.user_ctx    = (void *) uri->handler;
+    return httpd_register_uri_handler(server, &async);
+}
+
 void ap_wifi_event_callback(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data);
 
 static void customfree(char *res) {
@@ -40,11 +163,156 @@ static void customfree(char *res) {
     }
 }
 
+/*STA模式空闲时进入深度modem sleep并允许light sleep, 有请求时恢复; AP模式射频不能休眠. 调用者持有 server_idle_lock*/
+static void server_set_idle(bool idle) {
+    if (idle == server_idle) {
+        return;
+    }
+    server_idle = idle;
+    if (sta_netif != NULL) {
+        esp_wifi_set_ps(idle ? WIFI_PS_MAX_MODEM : WIFI_PS_MIN_MODEM);
+    }
+#if CONFIG_PM_ENABLE
+    if (server_pm_lock != NULL) {
+        idle ? esp_pm_lock_release(server_pm_lock) : esp_pm_lock_acquire(server_pm_lock);
+    }
+    if (server_cpu_lock != NULL) {
+        idle ? esp_pm_lock_release(server_cpu_lock) : esp_pm_lock_acquire(server_cpu_lock);
+    }
+#endif
+    ESP_LOGI(TAG, "Server %s", idle ? "idle" : "active");
+}
+
+static void server_idle_callback(void *arg) {
+    xSemaphoreTake(server_idle_lock, portMAX_DELAY);
+    bool idle = !esp_timer_is_active(server_idle_timer);    /*等锁时来了新请求, 已重新计时*/
+    if (idle) {
+        server_set_idle(true);
+    }
+    xSemaphoreGive(server_idle_lock);
+    if (idle) {
+        server_set_bits(GroupBit7);
+    }
+}
+
+/*连接/收到数据时调用, 重新开始空闲计时*/
+static void server_touch(void) {
+    if (server_idle_timer == NULL) {
+        return;
+    }
+    xSemaphoreTake(server_idle_lock, portMAX_DELAY);
+    server_set_idle(false);
+    if (server_idle_us < SERVER_IDLE_MS * 1000ULL) {
+        server_idle_us = SERVER_IDLE_MS * 1000ULL;
+    }
+    esp_timer_stop(server_idle_timer);
+    esp_timer_start_once(server_idle_timer, server_idle_us);
+    xSemaphoreGive(server_idle_lock);
+}
+
+/*与httpd默认的接收函数相同, 另外记录活动*/
+static int server_recv(httpd_handle_t hd, int sockfd, char *buf, size_t buf_len, int flags) {
+    if (buf == NULL) {
+        return HTTPD_SOCK_ERR_INVALID;
+    }
+    int ret = recv(sockfd, buf, buf_len, flags);
+    if (ret < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+    }
+    server_touch();
+    return ret;
+}
+
+static esp_err_t server_open(httpd_handle_t hd, int sockfd) {
+    server_touch();
+    return httpd_sess_set_recv_override(hd, sockfd, server_recv);
+}
+
+/*httpd任务里执行: 发给一个或所有WebSocket连接*/
+static void server_ws_send(void *arg) {
+    server_ws_msg_t *msg   = (server_ws_msg_t *) arg;
+    int              fds[SERVER_MAX_SOCKETS];
+    size_t           count = SERVER_MAX_SOCKETS;
+    httpd_ws_frame_t frame = {};
+    frame.type             = HTTPD_WS_TYPE_TEXT;
+    frame.payload          = (uint8_t *) msg->json;
+    frame.len              = strlen(msg->json);
+    httpd_handle_t server  = server_handle;
+    if (server != NULL && msg->fd >= 0) {
+        httpd_ws_send_frame_async(server, msg->fd, &frame);
+    } else if (server != NULL && httpd_get_client_list(server, &count, fds) == ESP_OK) {
+        for (size_t i = 0; i < count; i++) {
+            if (httpd_ws_get_fd_info(server, fds[i]) == HTTPD_WS_CLIENT_WEBSOCKET) {
+                httpd_ws_send_frame_async(server, fds[i], &frame);
+            }
+        }
+    }
+    heap_caps_free(msg);
+}
+
+static void server_ws_push(int fd, const char *event, int value, int total, int job) {
+    httpd_handle_t server = server_handle;
+    if (server == NULL) {       /*服务器已停*/
+        return;
+    }
+    server_ws_msg_t *msg = (server_ws_msg_t *) heap_caps_malloc(sizeof(server_ws_msg_t), MALLOC_CAP_DEFAULT);
+    if (msg == NULL) {
+        return;
+    }
+    msg->fd = fd;
+    if (job > 0) {
+        snprintf(msg->json, sizeof(msg->json), "{\"event\":\"%s\",\"value\":%d,\"total\":%d,\"job\":%d}", event, value, total, job);
+    } else {
+        snprintf(msg->json, sizeof(msg->json), "{\"event\":\"%s\",\"value\":%d,\"total\":%d}", event, value, total);
+    }
+    if (httpd_queue_work(server, server_ws_send, msg) != ESP_OK) {
+        heap_caps_free(msg);
+    }
+}
+
+void ServerPort_PushEvent(const char *event, int value, int total) {
+    server_ws_push(-1, event, value, total, 0);
+}
+
+void ServerPort_PushJobEvent(const char *event, int value, int total, int job) {
+    server_ws_push(-1, event, value, total, job);
+}
+
+const char *ServerPort_GetUploadPath(void) {
+    return upload_path;
+}
+
+bool ServerPort_IsCancelled(void) {
+    return server_cancel;
+}
+
+/*握手后给这个连接推一次当前网络模式, 网页端不用再请求 /NetWorkStatus; 之后只接收 cancel 命令*/
+static esp_err_t server_ws_handler(httpd_req_t *req) {
+    if (req->method == HTTP_GET) {
+        server_ws_push(httpd_req_to_sockfd(req), "mode", Get_CurrentlyNetworkMode(), 0, 0);
+        return ESP_OK;
+    }
+    uint8_t          buf[SERVER_WS_FRAME_MAX + 1] = {};
+    httpd_ws_frame_t frame                        = {};
+    ESP_RETURN_ON_ERROR(httpd_ws_recv_frame(req, &frame, 0), TAG, "ws len");
+    if (frame.type != HTTPD_WS_TYPE_TEXT || frame.len == 0 || frame.len > SERVER_WS_FRAME_MAX) {
+        return ESP_OK;
+    }
+    frame.payload = buf;
+    ESP_RETURN_ON_ERROR(httpd_ws_recv_frame(req, &frame, frame.len), TAG, "ws recv");
+    if (!strcmp((char *) buf, "cancel")) {
+        ESP_LOGW(TAG, "Cancel requested");
+        server_cancel = true;
+    }
+    return ESP_OK;
+}
+
 void ap_wifi_event_callback(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data) {
     if (event_id == WIFI_EVENT_AP_STACONNECTED) {
-        xEventGroupSetBits(ServerPortGroups, (0x01UL << 4));
+        server_touch();
+        server_set_bits((0x01UL << 4));
     } else if (event_id == WIFI_EVENT_AP_STADISCONNECTED) {
-        xEventGroupSetBits(ServerPortGroups, (0x01UL << 5));
+        server_set_bits((0x01UL << 5));
     } else if (event_base == IP_EVENT && event_id == IP_EVENT_AP_STAIPASSIGNED) {
     }
 }
@@ -53,10 +321,10 @@ void sta_wifi_event_callback(void *arg, esp_event_base_t event_base, int32_t eve
     if (event_id == WIFI_EVENT_STA_START) {
         ESP_ERROR_CHECK(esp_wifi_connect());
     } else if (event_id == IP_EVENT_STA_GOT_IP) {
-        xEventGroupSetBits(ServerPortGroups, GroupBit6); 
+        server_set_bits(GroupBit6); 
     } else if (event_id == WIFI_EVENT_STA_DISCONNECTED) {
         ESP_LOGE("wifi", "WiFi disconnected, trying to reconnect...");
-        xEventGroupSetBits(ServerPortGroups, GroupBit5); 
+        server_set_bits(GroupBit5); 
     }
 }
 
@@ -139,6 +407,23 @@ esp_err_t static_resource_unified_handler(httpd_req_t *req) {
                 break;
             }
         }
+    } else if(strstr(uri,"dither.wasm")) { // /dither.wasm, 可选, 没有时网页用JS抖动
+        struct stat st;
+        if (stat("/sdcard/03_sys_ap_html/dither.wasm", &st) != 0) {
+            return httpd_resp_send_404(req);
+        }
+        resp_str      = (char *) heap_caps_malloc(SEND_LEN_MAX + 1, MALLOC_CAP_SPIRAM);
+        httpd_resp_set_type(req, "application/wasm");
+        httpd_resp_set_hdr(req, "Cache-Control", "max-age=86400");
+        while(1) {
+            str_len = SDPort_->SDPort_ReadOffset("/sdcard/03_sys_ap_html/dither.wasm",resp_str,SEND_LEN_MAX,str_respLen);
+            if (str_len) {
+                httpd_resp_send_chunk(req, resp_str, str_len); 
+                str_respLen += str_len;
+            } else {
+                break;
+            }
+        }
     } else if(strstr(uri,"/NetWorkStatus")) {
         if(Get_CurrentlyNetworkMode()) {
             httpd_resp_send_chunk(req, staresp, HTTPD_RESP_USE_STRLEN);
@@ -163,45 +448,73 @@ esp_err_t receive_data_redirect_handler(httpd_req_t *req) {
     uint8_t     timeoutive = 0;      /*Expiry timeout and automatic logout*/
     bool        is_NetworkMode = 1;  /*Handling the flag bits for the ESP32 mode*/
     ESP_LOGW("TAG", "Receive url:%s,byte:%d", uri, remaining);
-    xEventGroupSetBits(ServerPortGroups, (0x1UL << 0)); 
-    SDPort_->SDPort_WriteOffset("/sdcard/02_sys_ap_img/user_send.bmp", NULL, 0, 0);
+    if (buf == NULL || xSemaphoreTake(server_upload_lock, 0) != pdTRUE) {
+        customfree(buf);
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "3");
+        return httpd_resp_sendstr(req, "Another upload is in progress");
+    }
+    server_cancel = false;
+    server_set_bits((0x1UL << 0)); 
+    size_t next_push = 0;
     while (remaining > 0) {
+        if (server_cancel) {
+            ESP_LOGW(TAG, "Upload cancelled");
+            server_set_bits((0x1UL << 1));
+            ServerPort_PushEvent("cancelled", req->content_len - remaining, req->content_len);
+            httpd_resp_set_status(req, "409 Conflict");
+            httpd_resp_sendstr(req, "Cancelled");
+            customfree(buf);
+            xSemaphoreGive(server_upload_lock);
+            return ESP_FAIL;
+        }
+        if (req->content_len - remaining >= next_push) {
+            ServerPort_PushEvent("recv", req->content_len - remaining, req->content_len);
+            next_push += SERVER_WS_RECV_STEP;
+        }
         if ((ret = httpd_req_recv(req, buf, ServerPort_MIN(remaining, READ_LEN_MAX))) <= 0) {
             if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
                 timeoutive++;
                 if(timeoutive == 10) {
                     httpd_resp_send_408(req);
                     customfree(buf);
+                    xSemaphoreGive(server_upload_lock);
                     return ESP_FAIL;
                 }
                 continue;
             }
             customfree(buf);
+            xSemaphoreGive(server_upload_lock);
             return ESP_FAIL;
         }
         size_t req_len = 0;
         if(is_NetworkMode) {
             is_NetworkMode = 0;
             netMode = buf[0];
-            req_len = SDPort_->SDPort_WriteOffset("/sdcard/02_sys_ap_img/user_send.bmp", (buf + 1), (ret - 1), 1);
+            upload_path = (ret >= 5 && !memcmp(buf + 1, "EPD4", 4)) ? SERVER_UPLOAD_FRAME : SERVER_UPLOAD_BMP;
+            SDPort_->SDPort_WriteOffset(upload_path, NULL, 0, 0);
+            req_len = SDPort_->SDPort_WriteOffset(upload_path, (buf + 1), (ret - 1), 1);
             sdcard_len += req_len; // Final comparison result
             remaining -= ret;      // Subtract the data that has already been received
         } else {
-            req_len = SDPort_->SDPort_WriteOffset("/sdcard/02_sys_ap_img/user_send.bmp", buf, ret, 1);
+            req_len = SDPort_->SDPort_WriteOffset(upload_path, buf, ret, 1);
             sdcard_len += req_len; // Final comparison result
             remaining -= ret;      // Subtract the data that has already been received
         }
     }
-    xEventGroupSetBits(ServerPortGroups, (0x1UL << 1)); 
+    server_set_bits((0x1UL << 1)); 
+    ServerPort_PushEvent("recv", req->content_len, req->content_len);
     if ((sdcard_len + 1) == req->content_len) {
         httpd_resp_send(req, "Data verification successful", strlen("Data verification successful"));
-        xEventGroupSetBits(ServerPortGroups, (0x1UL << 2));
+        server_set_bits((0x1UL << 2));
     } else {
         httpd_resp_send_408(req);
-        xEventGroupSetBits(ServerPortGroups, (0x1UL << 3));
+        ServerPort_PushEvent("error", sdcard_len + 1, req->content_len);
+        server_set_bits((0x1UL << 3));
     } 
     ESP_LOGW(TAG,"netMode:%d",netMode);
     customfree(buf);
+    xSemaphoreGive(server_upload_lock);
     return ESP_OK;
 }
 
@@ -217,10 +530,19 @@ esp_err_t unknown_uri_handler(httpd_req_t *req) {
     return ESP_OK;
 }
 
+/*热切换模式时会多次初始化, 事件组只建一次*/
+static void server_groups_init(void) {
+    if (ServerPortGroups == NULL) {
+        ServerPortGroups = xEventGroupCreate();
+    }
+    xEventGroupClearBits(ServerPortGroups, GroupSetBitsMax);
+}
+
 void ServerPort_NetworkAPInit(void) {
-    ServerPortGroups         = xEventGroupCreate();
+    server_groups_init();
     ESP_ERROR_CHECK(esp_netif_init());
-    assert(esp_netif_create_default_wifi_ap());
+    ap_netif = esp_netif_create_default_wifi_ap();
+    assert(ap_netif);
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
 
@@ -228,12 +550,12 @@ void ServerPort_NetworkAPInit(void) {
                                                         ESP_EVENT_ANY_ID,
                                                         &ap_wifi_event_callback,
                                                         NULL,
-                                                        NULL));
+                                                        &server_wifi_handler));
     ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT,
                                                         IP_EVENT_AP_STAIPASSIGNED,
                                                         &ap_wifi_event_callback,
                                                         NULL,
-                                                        NULL));
+                                                        &server_ip_handler));
 
     wifi_config_t wifi_config = {};
     snprintf((char *) wifi_config.ap.ssid, sizeof(wifi_config.ap.ssid), "%s", BSP_ESP_WIFI_SSID);
@@ -248,27 +570,112 @@ void ServerPort_NetworkAPInit(void) {
     ESP_LOGI("network", "wifi_init_softap finished. SSID:%s password:%s channel:%d", BSP_ESP_WIFI_SSID, BSP_ESP_WIFI_PASS, BSP_ESP_WIFI_CHANNEL);
 }
 
+static bool sta_fast_lease_valid(void) {
+    time_t now = time(NULL);
+    return sta_fast_cache.ip_info.ip.addr != 0 && now >= sta_fast_cache.lease_time &&
+           now - sta_fast_cache.lease_time < STA_FAST_LEASE_S;
+}
+
+/*沿用上次的地址, 连上后 esp_netif 直接发 IP_EVENT_STA_GOT_IP*/
+static void sta_fast_set_static_ip(void) {
+    esp_netif_dns_info_t dns = {};
+    esp_netif_dhcpc_stop(sta_netif);
+    esp_netif_set_ip_info(sta_netif, &sta_fast_cache.ip_info);
+    dns.ip.type           = ESP_IPADDR_TYPE_V4;
+    dns.ip.u_addr.ip4     = sta_fast_cache.dns;
+    esp_netif_set_dns_info(sta_netif, ESP_NETIF_DNS_MAIN, &dns);
+}
+
+static void sta_fast_cache_save(const wifi_credential_t *creden, bool dhcp) {
+    wifi_ap_record_t     ap;
+    esp_netif_ip_info_t  ip_info;
+    esp_netif_dns_info_t dns;
+    if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK || esp_netif_get_ip_info(sta_netif, &ip_info) != ESP_OK) {
+        sta_fast_cache.magic = 0;
+        return;
+    }
+    strlcpy(sta_fast_cache.ssid, creden->ssid, sizeof(sta_fast_cache.ssid));
+    strlcpy(sta_fast_cache.password, creden->password, sizeof(sta_fast_cache.password));
+    memcpy(sta_fast_cache.bssid, ap.bssid, sizeof(sta_fast_cache.bssid));
+    sta_fast_cache.channel = ap.primary;
+    sta_fast_cache.ip_info = ip_info;
+    if (esp_netif_get_dns_info(sta_netif, ESP_NETIF_DNS_MAIN, &dns) == ESP_OK) {
+        sta_fast_cache.dns = dns.ip.u_addr.ip4;
+    }
+    if (dhcp) {
+        sta_fast_cache.lease_time = time(NULL);   // 沿用的地址不顺延, 到期后重新走一次DHCP
+    }
+    sta_fast_cache.magic = STA_FAST_MAGIC;
+}
+
+bool ServerPort_GetCachedCredential(wifi_credential_t *creden) {
+    if (sta_fast_cache.magic != STA_FAST_MAGIC) {
+        return false;
+    }
+    strlcpy(creden->ssid, sta_fast_cache.ssid, sizeof(creden->ssid));
+    strlcpy(creden->password, sta_fast_cache.password, sizeof(creden->password));
+    creden->is_valid = true;
+    return true;
+}
+
 uint8_t ServerPort_NetworkSTAInit(wifi_credential_t creden) {
-    ServerPortGroups         = xEventGroupCreate();
+    int64_t start            = esp_timer_get_time();
+    server_groups_init();
     ESP_ERROR_CHECK(esp_netif_init());
-    assert(esp_netif_create_default_wifi_sta());
+    sta_netif = esp_netif_create_default_wifi_sta();
+    assert(sta_netif);
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
 
-    esp_event_handler_instance_t Instance_WIFI_IP;
-    esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &sta_wifi_event_callback, NULL, &Instance_WIFI_IP);
-    esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &sta_wifi_event_callback, NULL, &Instance_WIFI_IP);
+    esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &sta_wifi_event_callback, NULL, &server_wifi_handler);
+    esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &sta_wifi_event_callback, NULL, &server_ip_handler);
     
     wifi_config_t wifi_config = {};
     strcpy((char *) wifi_config.sta.ssid, creden.ssid);
     strcpy((char *) wifi_config.sta.password, creden.password);
+    wifi_config.sta.listen_interval = SERVER_LISTEN_INTERVAL;
+
+    bool fast  = sta_fast_cache.magic == STA_FAST_MAGIC && !strcmp(sta_fast_cache.ssid, creden.ssid);
+    bool lease = fast && sta_fast_lease_valid();
+    if (fast) {                                     /*指定BSSID和信道, 跳过全信道扫描*/
+        memcpy(wifi_config.sta.bssid, sta_fast_cache.bssid, sizeof(wifi_config.sta.bssid));
+        wifi_config.sta.bssid_set   = true;
+        wifi_config.sta.channel     = sta_fast_cache.channel;
+        wifi_config.sta.scan_method = WIFI_FAST_SCAN;
+        if (lease) {
+            sta_fast_set_static_ip();
+        }
+    }
     
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
     ESP_ERROR_CHECK(esp_wifi_start());
-    EventBits_t even = xEventGroupWaitBits(ServerPortGroups, (GroupBit6), pdTRUE, pdFALSE, pdMS_TO_TICKS(8000));
+    EventBits_t even = 0;
+    if (fast) {
+        even = xEventGroupWaitBits(ServerPortGroups, (GroupBit5 | GroupBit6), pdTRUE, pdFALSE, pdMS_TO_TICKS(STA_FAST_WAIT_MS));
+        if (!(even & GroupBit6)) {                  /*AP换了信道或地址不可用, 按原流程重新连接*/
+            ESP_LOGW(TAG, "Fast connect failed, fallback to full scan");
+            sta_fast_cache.magic = 0;
+            lease                = false;
+            esp_wifi_disconnect();
+            memset(wifi_config.sta.bssid, 0, sizeof(wifi_config.sta.bssid));
+            wifi_config.sta.bssid_set   = false;
+            wifi_config.sta.channel     = 0;
+            wifi_config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+            esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+            esp_netif_dhcpc_start(sta_netif);
+            xEventGroupClearBits(ServerPortGroups, GroupBit5);
+            esp_wifi_connect();
+            even = 0;
+        }
+    }
+    if (!(even & GroupBit6)) {
+        even = xEventGroupWaitBits(ServerPortGroups, (GroupBit6), pdTRUE, pdFALSE, pdMS_TO_TICKS(8000));
+    }
     if(even & GroupBit6) {
-        ESP_LOGW(TAG, "WiFi connected successfully");
+        ESP_LOGW(TAG, "WiFi connected successfully in %d ms%s", (int) ((esp_timer_get_time() - start) / 1000),
+                 fast ? (lease ? " (cached AP + lease)" : " (cached AP)") : "");
+        sta_fast_cache_save(&creden, !lease);
         return 1;
     } else {
         ESP_LOGE(TAG, "WiFi connection timed out");
@@ -283,21 +690,43 @@ void ServerPort_init(CustomSDPort *SDPort) {
     httpd_handle_t server = NULL;
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.uri_match_fn   = httpd_uri_match_wildcard; /*Wildcard enabling*/
+    config.open_fn        = server_open;
+    config.max_uri_handlers = 12;
+    config.max_open_sockets = SERVER_MAX_SOCKETS;
+    config.lru_purge_enable = true;              /*连接满时关掉最久没用的keep-alive连接, 而不是拒绝新连接*/
+    ESP_ERROR_CHECK(work_pool_init());
+    if (server_upload_lock == NULL) {
+        server_upload_lock = xSemaphoreCreateMutex();
+    }
     ESP_ERROR_CHECK(httpd_start(&server, &config));
+    server_handle = server;
+
+    Library_Init();
+    ESP_ERROR_CHECK(Library_RegisterHandlers(server));  /*先于下面的通配符注册, 否则 GET /api/... 会被静态资源接走*/
 
     /*Event callback function*/
     httpd_uri_t uri_config = {};
-    uri_config.uri         = "/*";
+    uri_config.uri         = "/NetWorkStatus";    /*很快就能回复, 直接在httpd任务里处理*/
     uri_config.method      = HTTP_GET;
     uri_config.handler     = static_resource_unified_handler;
     uri_config.user_ctx    = NULL;
     httpd_register_uri_handler(server, &uri_config);
+
+    uri_config.uri          = "/ws";              /*上传/显示进度推送, 以及取消*/
+    uri_config.handler      = server_ws_handler;
+    uri_config.is_websocket = true;
+    httpd_register_uri_handler(server, &uri_config);
+    uri_config.is_websocket = false;
+
+    uri_config.uri         = "/*";                /*读SD卡发文件, 放到工作池*/
+    uri_config.handler     = static_resource_unified_handler;
+    ServerPort_RegisterAsync(server, &uri_config);
     
     uri_config.uri         = "/dataUP";
     uri_config.method      = HTTP_POST;
     uri_config.handler     = receive_data_redirect_handler;
     uri_config.user_ctx    = NULL;
-    httpd_register_uri_handler(server, &uri_config);
+    ServerPort_RegisterAsync(server, &uri_config);
     
     uri_config.uri         = "/*"; // Match all URLs that have not been handled by other handlers
     uri_config.method      = (httpd_method_t)(HTTP_GET | HTTP_POST);
@@ -306,12 +735,127 @@ void ServerPort_init(CustomSDPort *SDPort) {
     httpd_register_uri_handler(server, &uri_config);
 }
 
+void ServerPort_StartIdleTimer(uint32_t timeout_ms) {
+    if (server_idle_lock == NULL) {
+        server_idle_lock = xSemaphoreCreateMutex();
+    }
+    if (server_idle_timer == NULL) {
+        esp_timer_create_args_t args = {};
+        args.callback                = server_idle_callback;
+        args.name                    = "server_idle";
+        ESP_ERROR_CHECK(esp_timer_create(&args, &server_idle_timer));
+#if CONFIG_PM_ENABLE
+        if (sta_netif != NULL) {
+            esp_pm_config_t pm_config    = {};
+            pm_config.max_freq_mhz       = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+            pm_config.min_freq_mhz       = 40;
+            pm_config.light_sleep_enable = true;
+            if (esp_pm_configure(&pm_config) == ESP_OK) {
+                esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "server", &server_pm_lock);
+                esp_pm_lock_acquire(server_pm_lock);
+                esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "server_cpu", &server_cpu_lock);
+                esp_pm_lock_acquire(server_cpu_lock);
+            } else {
+                ESP_LOGW(TAG, "Light sleep not available");
+            }
+        }
+#endif
+        if (sta_netif != NULL) {
+            esp_wifi_set_ps(WIFI_PS_MIN_MODEM);
+        }
+    }
+    xSemaphoreTake(server_idle_lock, portMAX_DELAY);
+    server_idle_us = timeout_ms * 1000ULL;
+    esp_timer_stop(server_idle_timer);
+    esp_timer_start_once(server_idle_timer, server_idle_us);
+    xSemaphoreGive(server_idle_lock);
+}
+
 void ServerPort_SetNetworkSleep(void) {
+    if (server_idle_timer != NULL) {
+        esp_timer_stop(server_idle_timer);
+    }
     esp_wifi_stop();
     esp_wifi_deinit();
     vTaskDelay(pdMS_TO_TICKS(500));
 }
 
+/*工作池里的请求还会调 httpd 的接口, 先打断上传并等它们都结束*/
+static void server_async_drain(void) {
+    server_cancel = true;
+    for (;;) {
+        taskENTER_CRITICAL(&server_async_lock);
+        int active = server_async_active;
+        taskEXIT_CRITICAL(&server_async_lock);
+        if (active == 0) {
+            return;
+        }
+        vTaskDelay(pdMS_TO_TICKS(20));
+    }
+}
+
+void ServerPort_Deinit(void) {
+    if (server_idle_timer != NULL) {
+        esp_timer_stop(server_idle_timer);
+    }
+    if (server_handle != NULL) {
+        httpd_handle_t server = server_handle;
+        server_handle         = NULL;   /*之后的 ServerPort_PushEvent 直接返回*/
+        server_async_drain();
+        httpd_stop(server);
+        server_cancel = false;
+    }
+    if (server_mdns) {
+        mdns_free();
+        server_mdns = false;
+    }
+    if (server_wifi_handler != NULL) {
+        esp_event_handler_instance_unregister(WIFI_EVENT, ESP_EVENT_ANY_ID, server_wifi_handler);
+        server_wifi_handler = NULL;
+    }
+    if (server_ip_handler != NULL) {
+        esp_event_handler_instance_unregister(IP_EVENT, (sta_netif != NULL) ? IP_EVENT_STA_GOT_IP : IP_EVENT_AP_STAIPASSIGNED, server_ip_handler);
+        server_ip_handler = NULL;
+    }
+    esp_wifi_stop();                     /*已经 SetNetworkSleep 过时返回错误, 不影响*/
+    esp_wifi_deinit();
+#if CONFIG_PM_ENABLE
+    if (server_pm_lock != NULL) {        /*下一个模式不一定能在light sleep里工作; 持锁, 正在执行的空闲回调不会再动电源锁*/
+        xSemaphoreTake(server_idle_lock, portMAX_DELAY);
+        if (!server_idle) {
+            esp_pm_lock_release(server_pm_lock);
+            esp_pm_lock_release(server_cpu_lock);
+        }
+        esp_pm_lock_delete(server_pm_lock);
+        esp_pm_lock_delete(server_cpu_lock);
+        server_pm_lock  = NULL;
+        server_cpu_lock = NULL;
+        xSemaphoreGive(server_idle_lock);
+        esp_pm_config_t pm_config = {};
+        pm_config.max_freq_mhz    = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+        pm_config.min_freq_mhz    = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+        esp_pm_configure(&pm_config);
+    }
+#endif
+    if (server_idle_timer != NULL) {     /*下次 StartIdleTimer 按新的网络模式重新配置省电*/
+        esp_timer_delete(server_idle_timer);
+        server_idle_timer = NULL;
+    }
+    if (sta_netif != NULL) {
+        esp_netif_destroy_default_wifi(sta_netif);
+        sta_netif = NULL;
+    }
+    if (ap_netif != NULL) {
+        esp_netif_destroy_default_wifi(ap_netif);
+        ap_netif = NULL;
+    }
+    server_idle = false;
+}
+
+void ServerPort_SetNotify(void (*notify)(uint32_t bits)) {
+    server_notify = notify;
+}
+
 uint8_t Get_NetworkMode(void) {
     return netMode;
 }
@@ -326,6 +870,7 @@ void Mdns_init_config(void) {
     mdns_hostname_set("esp32-s3-photopainter");
     mdns_instance_name_set("ESP32-S3 WebServer");
     mdns_service_add(NULL, "_http", "_tcp", 80, NULL, 0);
+    server_mdns = true;
 
     ESP_LOGW(TAG, "mDns配置完成,可通过 http://esp32-s3-photopainter.local/index.html 访问");
 }
\ No newline at end of file
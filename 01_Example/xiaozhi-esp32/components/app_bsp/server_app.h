@@ -1,6 +1,7 @@
 #pragma once
 
 #include <freertos/FreeRTOS.h>
+#include <esp_http_server.h>
 #include "sdcard_bsp.h"
 #include "traverse_nvs.h"
 
@@ -9,10 +10,19 @@ extern EventGroupHandle_t ServerPortGroups;
 
 /*Only one of them can be initialized.*/
 void ServerPort_NetworkAPInit(void);
-uint8_t ServerPort_NetworkSTAInit(wifi_credential_t creden);
+uint8_t ServerPort_NetworkSTAInit(wifi_credential_t creden);     /*深睡唤醒时优先用RTC里缓存的AP和地址快速连接*/
+bool ServerPort_GetCachedCredential(wifi_credential_t *creden);  /*唤醒后直接取上次连上的账号密码, 免去遍历NVS*/
 
 void ServerPort_init(CustomSDPort *SDPort);
+esp_err_t ServerPort_RegisterAsync(httpd_handle_t server, const httpd_uri_t *uri);   /*handler 在工作池里执行, 不阻塞其他连接; user_ctx 不可用*/
+void ServerPort_PushEvent(const char *event, int value, int total);   /*通过 /ws 推给网页端: {"event":..,"value":..,"total":..}*/
+void ServerPort_PushJobEvent(const char *event, int value, int total, int job);   /*同上, 另带 "job", 网页端只跟踪自己那次显示*/
+const char *ServerPort_GetUploadPath(void);                           /*最近一次 /dataUP 存的文件: 抖动好的BMP, 或网页端打包的 .epd 帧*/
+bool ServerPort_IsCancelled(void);                                    /*网页端发了 cancel, 下一次 /dataUP 开始时清除*/
+void ServerPort_StartIdleTimer(uint32_t timeout_ms);    /*超时内没有连接和请求时置 GroupBit7, 第一次请求后超时延长到3分钟*/
 void ServerPort_SetNetworkSleep(void);
+void ServerPort_Deinit(void);                           /*停掉httpd, mDNS和Wi-Fi, 之后可以重新走 NetworkAPInit/STAInit + init*/
+void ServerPort_SetNotify(void (*notify)(uint32_t bits));   /*ServerPortGroups 置位时同时回调, 在置位的任务里执行, 不能阻塞*/
 
 uint8_t Get_NetworkMode(void);
 void Mdns_init_config(void);
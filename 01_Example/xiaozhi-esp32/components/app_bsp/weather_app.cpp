@@ -3,6 +3,10 @@
 #include <esp_log.h>
 #include "ArduinoJson.h"
 #include "weather_app.h"
+#include "client_app.h"
+#include "http_stream_reader.h"
+
+#define WEATHER_FORECAST_DAYS 4 // 页面只显示今天起4天
 
 struct SpiRamAllocator : ArduinoJson::Allocator {
     void *allocate(size_t size) override {
@@ -21,6 +25,43 @@ struct SpiRamAllocator : ArduinoJson::Allocator {
 SpiRamAllocator allocator;
 JsonDocument    doc(&allocator);
 
+/*只保留页面用到的字段, 其余(15天预报中的notice/sunrise等)解析时直接丢弃*/
+static void weather_build_filter(JsonDocument &filter) {
+    filter["time"]          = true;
+    filter["data"]["shidu"] = true;
+    JsonObject day          = filter["data"]["forecast"].add<JsonObject>();
+    day["ymd"]              = true;
+    day["high"]             = true;
+    day["low"]              = true;
+    day["fx"]               = true;
+    day["week"]             = true;
+    day["type"]             = true;
+    day["aqi"]              = true;
+}
+
+extern "C" int weather_filter_http_stream(esp_http_client_handle_t client, char *out, size_t out_len) {
+    JsonDocument filter;
+    JsonDocument wdoc(&allocator);
+    weather_build_filter(filter);
+
+    HttpStreamReader     reader(client);
+    DeserializationError error = deserializeJson(wdoc, reader, DeserializationOption::Filter(filter));
+    if (error) {
+        ESP_LOGE("WeatherPort", "Stream parse failed: %s", error.c_str());
+        return 0;
+    }
+    JsonArray forecast = wdoc["data"]["forecast"];
+    while (forecast.size() > WEATHER_FORECAST_DAYS) {
+        forecast.remove(WEATHER_FORECAST_DAYS);
+    }
+    size_t len = serializeJson(wdoc, out, out_len);
+    if (len == 0 || len >= out_len) {
+        return 0;
+    }
+    ESP_LOGI("WeatherPort", "Weather stream %d bytes -> %d bytes", reader.HttpStreamReader_Total(), (int) len);
+    return (int) len;
+}
+
 WeatherPort::WeatherPort() {
     WeatherData = (WeatherData_t *) heap_caps_malloc(sizeof(WeatherData_t), MALLOC_CAP_SPIRAM);
     assert(WeatherData);
@@ -63,7 +104,9 @@ void WeatherPort::WeatherPort_log(void) {
 }
 
 WeatherData_t* WeatherPort::WeatherPort_DecodingSring(const char *jsonstr) {
-    DeserializationError error = deserializeJson(doc, jsonstr);
+    JsonDocument filter;
+    weather_build_filter(filter);
+    DeserializationError error = deserializeJson(doc, jsonstr, DeserializationOption::Filter(filter));
     heap_caps_free((void *) jsonstr);
     jsonstr = NULL;
     if (error) {
@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <esp_log.h>
+#include "work_pool.h"
+
+static const char *TAG = "work_pool";
+
+typedef struct {
+    work_pool_fn_t fn;
+    void          *arg;
+} work_pool_job_t;
+
+/*一组工作任务和它们共用的队列*/
+typedef struct {
+    const char   *name;
+    int           max;          // 工作任务上限
+    QueueHandle_t queue;
+    int           workers;      // 已启动的工作任务数
+    int           jobs;         // 已提交还没做完的任务, 含排队和正在执行的
+} work_pool_lane_t;
+
+static work_pool_lane_t s_background = {"work_pool", WORK_POOL_WORKERS, NULL, 0, 0};
+static work_pool_lane_t s_request    = {"work_req", WORK_POOL_REQUEST_WORKERS, NULL, 0, 0};
+static portMUX_TYPE     s_lock       = portMUX_INITIALIZER_UNLOCKED;
+
+static void work_pool_task(void *arg) {
+    work_pool_lane_t *lane = (work_pool_lane_t *) arg;
+    work_pool_job_t   job;
+    for (;;) {
+        if (xQueueReceive(lane->queue, &job, portMAX_DELAY) == pdTRUE) {
+            job.fn(job.arg);
+            taskENTER_CRITICAL(&s_lock);
+            lane->jobs--;
+            taskEXIT_CRITICAL(&s_lock);
+        }
+    }
+}
+
+/*
+ * 记上一个新任务; 未做完的任务比工作任务多且未到上限时再开一个,
+ * 连续提交的任务不会排在一个空闲任务后面等. 用不到并发的模式不用为全部的栈付出内存.
+ */
+static esp_err_t work_pool_grow(work_pool_lane_t *lane) {
+    taskENTER_CRITICAL(&s_lock);
+    lane->jobs++;
+    bool grow = (lane->jobs > lane->workers && lane->workers < lane->max);
+    int  id   = lane->workers;
+    if (grow) {
+        lane->workers++;
+    }
+    taskEXIT_CRITICAL(&s_lock);
+    if (grow) {
+        char name[16];
+        snprintf(name, sizeof(name), "%s_%d", lane->name, id);
+        if (xTaskCreate(work_pool_task, name, WORK_POOL_STACK, lane, WORK_POOL_PRIORITY, NULL) != pdPASS) {
+            ESP_LOGE(TAG, "Failed to start %s", name);
+            taskENTER_CRITICAL(&s_lock);
+            lane->workers--;
+            taskEXIT_CRITICAL(&s_lock);
+        }
+    }
+    taskENTER_CRITICAL(&s_lock);
+    bool none = (lane->workers == 0);
+    if (none) {
+        lane->jobs--;
+    }
+    taskEXIT_CRITICAL(&s_lock);
+    return none ? ESP_ERR_NO_MEM : ESP_OK;
+}
+
+static esp_err_t work_pool_send(work_pool_lane_t *lane, work_pool_fn_t fn, void *arg, TickType_t wait) {
+    work_pool_job_t job = {fn, arg};
+    if (lane->queue == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_err_t err = work_pool_grow(lane);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (xQueueSend(lane->queue, &job, wait) != pdTRUE) {
+        taskENTER_CRITICAL(&s_lock);
+        lane->jobs--;
+        taskEXIT_CRITICAL(&s_lock);
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
+
+esp_err_t work_pool_init(void) {
+    if (s_background.queue != NULL) {
+        return ESP_OK;
+    }
+    s_background.queue = xQueueCreate(WORK_POOL_QUEUE, sizeof(work_pool_job_t));
+    s_request.queue    = xQueueCreate(WORK_POOL_QUEUE, sizeof(work_pool_job_t));
+    if (s_background.queue == NULL || s_request.queue == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t work_pool_submit(work_pool_fn_t fn, void *arg, TickType_t wait) {
+    return work_pool_send(&s_background, fn, arg, wait);
+}
+
+esp_err_t work_pool_submit_request(work_pool_fn_t fn, void *arg) {
+    return work_pool_send(&s_request, fn, arg, 0);
+}
@@ -0,0 +1,38 @@
+#ifndef WORK_POOL_H
+#define WORK_POOL_H
+
+#include <freertos/FreeRTOS.h>
+#include <esp_err.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WORK_POOL_WORKERS         3      // 后台任务: 显示, 图库转码, 存帧, 切换模式
+#define WORK_POOL_REQUEST_WORKERS 2      // 网页请求另用一组, 后台任务占满时请求也不用排队或503
+#define WORK_POOL_QUEUE           8
+#define WORK_POOL_STACK           (6 * 1024)
+#define WORK_POOL_PRIORITY        4      // 低于httpd(5), 分发请求不会被耗时任务卡住
+
+typedef void (*work_pool_fn_t)(void *arg);
+
+/*
+ * 固定数量的工作任务共用一个任务队列.
+ * 网页服务器的上传/文件下载和图库转码都放到这里执行, 同时运行的耗时任务数有上限,
+ * 不会因为每个请求各开一个任务把内部RAM耗尽.
+ * 后台任务和网页请求各有一组工作任务和队列, 长时间的转码不会挡住请求.
+ * 工作任务在未做完的任务多于工作任务时按需创建, 每组最多到上限, 创建后常驻.
+ */
+esp_err_t work_pool_init(void);
+
+/*队列满时等待 wait 后返回 ESP_ERR_TIMEOUT, 此时 arg 仍归调用者*/
+esp_err_t work_pool_submit(work_pool_fn_t fn, void *arg, TickType_t wait);
+
+/*网页请求, 放到请求专用的工作任务; 不等待, 队列满返回 ESP_ERR_TIMEOUT*/
+esp_err_t work_pool_submit_request(work_pool_fn_t fn, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
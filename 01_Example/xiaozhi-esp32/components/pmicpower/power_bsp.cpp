@@ -1,6 +1,8 @@
 #include <stdio.h>
 #include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 #include <driver/gpio.h>
+#include <esp_attr.h>
 #include <esp_err.h>
 #include <esp_log.h>
 #include <esp_sleep.h>
@@ -15,6 +17,11 @@ static I2cMasterBus           *i2cbus_   = NULL;
 static i2c_master_dev_handle_t i2cPMICdev = NULL;
 static uint8_t                 i2cPMICAddress;
 
+static TaskHandle_t axp_irq_task = NULL;
+static void (*axp_notify)(uint32_t bits) = NULL;
+static volatile bool axp_vbus_in  = false;   // 由中断任务刷新, 查询时不走I2C
+static volatile bool axp_charging = false;
+
 static int AXP2101_SLAVE_Read(uint8_t devAddr, uint8_t regAddr, uint8_t *data, uint8_t len) {
     int ret;
     uint8_t count = 3;
@@ -53,6 +60,19 @@ void Custom_PmicPortGpioInit() {
     gpio_config(&io_conf);
 }
 
+/*STATUS1/STATUS2 相邻, 一次读出*/
+static void Axp2101_ReadState(void) {
+    uint8_t status[2];
+    if (i2cbus_->i2c_read_buff(i2cPMICdev, XPOWERS_AXP2101_STATUS1, status, 2) != ESP_OK) {
+        return;
+    }
+    axp_vbus_in  = (status[0] & 0x20) && !(status[1] & 0x08);
+    axp_charging = (status[1] >> 5) == 0x01;
+    static const char *const names[] = {"tri_charge", "pre_charge", "constant charge", "constant voltage", "charge done", "not charge"};
+    uint8_t charge_status = status[1] & 0x07;
+    ESP_LOGI(TAG, "vbus: %s, charger: %s", axp_vbus_in ? "YES" : "NO", (charge_status < 6) ? names[charge_status] : "unknown");
+}
+
 void Custom_PmicPortInit(I2cMasterBus *i2cbus,uint8_t dev_addr) {
     if(i2cbus_ == NULL) {
         i2cbus_ = i2cbus;
@@ -73,6 +93,7 @@ void Custom_PmicPortInit(I2cMasterBus *i2cbus,uint8_t dev_addr) {
     }
     Custom_PmicPortGpioInit();
     Custom_PmicRegisterInit();
+    Axp2101_ReadState();
 }
 
 void Custom_PmicRegisterInit(void) {
@@ -102,27 +123,103 @@ void Custom_PmicRegisterInit(void) {
     axp2101.setPrechargeCurr(XPOWERS_AXP2101_PRECHARGE_50MA);
     axp2101.setChargerConstantCurr(XPOWERS_AXP2101_CHG_CUR_200MA);
     axp2101.setChargerTerminationCurr(XPOWERS_AXP2101_CHG_ITERM_50MA);
+
+    axp2101.enableBattDetection();          // 电量计和功耗剖析要用
+    axp2101.enableBattVoltageMeasure();
+}
+
+bool Axp2101_isExternalPower(void) {
+    return axp_vbus_in;
+}
+
+bool Axp2101_ReadBattery(uint16_t *batt_mv, int *percent, bool *charging) {
+    if (i2cPMICdev == NULL) {
+        return false;
+    }
+    *batt_mv  = axp2101.getBattVoltage();
+    *percent  = axp2101.getBatteryPercent();
+    *charging = axp_charging;
+    return true;
 }
 
-void Axp2101_isChargingTask(void *arg) {
+static void IRAM_ATTR Axp2101_IrqIsr(void *arg) {
+    BaseType_t woken = pdFALSE;
+    gpio_intr_disable(AXP2101_iqr_PIN);     // 低电平触发, 读清PMIC状态前先关掉
+    vTaskNotifyGiveFromISR(axp_irq_task, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+static void Axp2101_IrqTask(void *arg) {
     for (;;) {
-        vTaskDelay(pdMS_TO_TICKS(20000));
-        ESP_LOGI(TAG, "isCharging: %s", axp2101.isCharging() ? "YES" : "NO");
-        uint8_t charge_status = axp2101.getChargerStatus();
-        if (charge_status == XPOWERS_AXP2101_CHG_TRI_STATE) {
-            ESP_LOGI(TAG, "Charger Status: tri_charge");
-        } else if (charge_status == XPOWERS_AXP2101_CHG_PRE_STATE) {
-            ESP_LOGI(TAG, "Charger Status: pre_charge");
-        } else if (charge_status == XPOWERS_AXP2101_CHG_CC_STATE) {
-            ESP_LOGI(TAG, "Charger Status: constant charge");
-        } else if (charge_status == XPOWERS_AXP2101_CHG_CV_STATE) {
-            ESP_LOGI(TAG, "Charger Status: constant voltage");
-        } else if (charge_status == XPOWERS_AXP2101_CHG_DONE_STATE) {
-            ESP_LOGI(TAG, "Charger Status: charge done");
-        } else if (charge_status == XPOWERS_AXP2101_CHG_STOP_STATE) {
-            ESP_LOGI(TAG, "Charger Status: not charge");
-        }
-        ESP_LOGI(TAG, "getBattVoltage: %dmV", axp2101.getBattVoltage());
-        ESP_LOGI(TAG, "getBatteryPercent: %d%%", axp2101.getBatteryPercent());
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        int guard = 4;
+        do {
+            uint8_t sts[XPOWERS_AXP2101_INTSTS_CNT];   /*三个中断状态寄存器连续, 一次读一次清*/
+            uint8_t clr[XPOWERS_AXP2101_INTSTS_CNT] = {0xff, 0xff, 0xff};
+            if (i2cbus_->i2c_read_buff(i2cPMICdev, XPOWERS_AXP2101_INTSTS1, sts, sizeof(sts)) != ESP_OK) {
+                break;
+            }
+            i2cbus_->i2c_write_buff(i2cPMICdev, XPOWERS_AXP2101_INTSTS1, clr, sizeof(clr));
+            uint32_t irq    = sts[0] | (sts[1] << 8) | ((uint32_t) sts[2] << 16);  // 与 xpowers_axp2101_irq_t 的位一致
+            EventBits_t bits = 0;
+            if (irq & XPOWERS_AXP2101_BAT_CHG_START_IRQ) {
+                bits |= PMIC_EVENT_CHARGE_START;
+            }
+            if (irq & (XPOWERS_AXP2101_BAT_CHG_DONE_IRQ | XPOWERS_AXP2101_VBUS_REMOVE_IRQ)) {
+                bits |= PMIC_EVENT_CHARGE_STOP;
+            }
+            if (irq & XPOWERS_AXP2101_VBUS_INSERT_IRQ) {
+                bits |= PMIC_EVENT_VBUS_INSERT;
+            }
+            if (irq & XPOWERS_AXP2101_VBUS_REMOVE_IRQ) {
+                bits |= PMIC_EVENT_VBUS_REMOVE;
+            }
+            if (irq & XPOWERS_AXP2101_WARNING_LEVEL1_IRQ) {
+                bits |= PMIC_EVENT_LOW_BATTERY;
+                ESP_LOGW(TAG, "Low battery: %d%%", axp2101.getBatteryPercent());
+            }
+            if (irq & XPOWERS_AXP2101_PKEY_SHORT_IRQ) {
+                bits |= PMIC_EVENT_PKEY_SHORT;
+            }
+            if (irq & XPOWERS_AXP2101_PKEY_LONG_IRQ) {
+                bits |= PMIC_EVENT_PKEY_LONG;
+            }
+            if (bits & (PMIC_EVENT_CHARGE_START | PMIC_EVENT_CHARGE_STOP | PMIC_EVENT_VBUS_INSERT | PMIC_EVENT_VBUS_REMOVE)) {
+                Axp2101_ReadState();
+            }
+            if (bits && axp_notify != NULL) {
+                axp_notify(bits);
+            }
+        } while (gpio_get_level(AXP2101_iqr_PIN) == 0 && --guard);
+        gpio_intr_enable(AXP2101_iqr_PIN);
+    }
+}
+
+void Axp2101_SetNotify(void (*notify)(uint32_t bits)) {
+    axp_notify = notify;
+}
+
+void Axp2101_IrqInit(void) {
+    if (axp_irq_task != NULL) {
+        return;
+    }
+    axp2101.setLowBatWarnThreshold(10);
+    axp2101.disableIRQ(XPOWERS_AXP2101_ALL_IRQ);
+    axp2101.clearIrqStatus();
+    axp2101.enableIRQ(XPOWERS_AXP2101_BAT_CHG_START_IRQ | XPOWERS_AXP2101_BAT_CHG_DONE_IRQ |
+                      XPOWERS_AXP2101_VBUS_INSERT_IRQ | XPOWERS_AXP2101_VBUS_REMOVE_IRQ |
+                      XPOWERS_AXP2101_WARNING_LEVEL1_IRQ |
+                      XPOWERS_AXP2101_PKEY_SHORT_IRQ | XPOWERS_AXP2101_PKEY_LONG_IRQ);
+    xTaskCreate(Axp2101_IrqTask, "Axp2101_IrqTask", 3 * 1024, NULL, 3, &axp_irq_task);
+
+    esp_err_t err = gpio_install_isr_service(0);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {       // 其他模块可能已经装过
+        ESP_LOGE(TAG, "isr service: %s", esp_err_to_name(err));
+        return;
     }
+    gpio_set_intr_type(AXP2101_iqr_PIN, GPIO_INTR_LOW_LEVEL);
+    gpio_isr_handler_add(AXP2101_iqr_PIN, Axp2101_IrqIsr, NULL);
+    gpio_wakeup_enable(AXP2101_iqr_PIN, GPIO_INTR_LOW_LEVEL);    // light sleep 时也能被PMIC唤醒
+    esp_sleep_enable_gpio_wakeup();
+    gpio_intr_enable(AXP2101_iqr_PIN);
 }
@@ -1,11 +1,24 @@
 #pragma once
 
+#include <freertos/FreeRTOS.h>
 #include "i2c_bsp.h"
 
 #define AXP2101_iqr_PIN             GPIO_NUM_21
 #define AXP2101_CHGLED_PIN          GPIO_NUM_3
 
+/*Axp2101_SetNotify 回调的事件位, 由PMIC的IRQ引脚触发*/
+#define PMIC_EVENT_CHARGE_START     (1 << 0)
+#define PMIC_EVENT_CHARGE_STOP      (1 << 1)    // 充满或拔掉USB
+#define PMIC_EVENT_VBUS_INSERT      (1 << 2)
+#define PMIC_EVENT_VBUS_REMOVE      (1 << 3)
+#define PMIC_EVENT_LOW_BATTERY      (1 << 4)    // 电量低于10%
+#define PMIC_EVENT_PKEY_SHORT       (1 << 5)
+#define PMIC_EVENT_PKEY_LONG        (1 << 6)
+
 void Custom_PmicPortInit(I2cMasterBus *i2cbus,uint8_t dev_addr);
 void Custom_PmicRegisterInit(void);
-void Axp2101_isChargingTask(void *arg);
+void Axp2101_IrqInit(void);               // 取代轮询任务, 事件经 Axp2101_SetNotify 的回调送出
+void Axp2101_SetNotify(void (*notify)(uint32_t bits));   // bits 为 PMIC_EVENT_*, 在中断任务里回调, 不能阻塞
+bool Axp2101_isExternalPower(void);      // 接了USB供电(充电中或已充满)
+bool Axp2101_ReadBattery(uint16_t *batt_mv, int *percent, bool *charging);   // 没有电池时电压为0, 电量为-1
 
@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <esp_attr.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include "power_bsp.h"
+#include "power_profile.h"
+
+static const char *TAG = "PowerProfile";
+
+static RTC_DATA_ATTR uint16_t power_wake_count = 0;     // 深睡后保留, 区分每次唤醒
+
+static PowerProfileRecord_t power_records[POWER_PROFILE_PER_WAKE];
+static int                  power_record_len = 0;
+static uint8_t              power_mode       = PowerModeUnknown;
+static bool                 power_started    = false;
+static portMUX_TYPE         power_lock       = portMUX_INITIALIZER_UNLOCKED;
+
+void PowerProfile_SetMode(uint8_t mode) {
+    taskENTER_CRITICAL(&power_lock);
+    power_mode = mode;
+    for (int i = 0; i < power_record_len; i++) {    /*模式在SD挂载之后才知道, 之前的记录一起补上*/
+        power_records[i].mode = mode;
+    }
+    taskEXIT_CRITICAL(&power_lock);
+}
+
+static void power_profile_mark(uint8_t stage, uint32_t arg) {
+    PowerProfileRecord_t rec = {};
+    uint16_t batt_mv  = 0;
+    int      percent  = -1;
+    bool     charging = false;
+    rec.time_ms = (uint32_t) (esp_timer_get_time() / 1000);
+    rec.stage   = stage;
+    rec.arg     = arg;
+    if (Axp2101_ReadBattery(&batt_mv, &percent, &charging)) {   /*I2C读在锁外做*/
+        rec.batt_mv = batt_mv;
+        rec.percent = (percent < 0) ? 0xff : (uint8_t) percent;
+        rec.flags   = (Axp2101_isExternalPower() ? 0x01 : 0) | (charging ? 0x02 : 0);
+    }
+    taskENTER_CRITICAL(&power_lock);
+    if (!power_started) {
+        power_started = true;
+        power_wake_count++;
+    }
+    rec.wake = power_wake_count;
+    rec.mode = power_mode;
+    bool full = (power_record_len >= POWER_PROFILE_PER_WAKE);
+    if (!full) {
+        power_records[power_record_len++] = rec;
+    }
+    taskEXIT_CRITICAL(&power_lock);
+    if (full) {
+        ESP_LOGW(TAG, "record buffer full, stage %d dropped", stage);
+    }
+}
+
+void PowerProfile_Mark(uint8_t stage) {
+    power_profile_mark(stage, 0);
+}
+
+/*文件头不对(第一次用或格式变了)就重建*/
+static FILE *power_profile_open(PowerProfileHeader_t *hdr) {
+    FILE *fp = fopen(POWER_PROFILE_PATH, "r+b");
+    if (fp != NULL) {
+        if (fread(hdr, sizeof(*hdr), 1, fp) == 1 && memcmp(hdr->magic, "PWR1", 4) == 0 &&
+            hdr->record_size == sizeof(PowerProfileRecord_t) && hdr->capacity == POWER_PROFILE_CAPACITY &&
+            hdr->next < hdr->capacity) {
+            return fp;
+        }
+        fclose(fp);
+    }
+    fp = fopen(POWER_PROFILE_PATH, "w+b");
+    if (fp == NULL) {
+        return NULL;
+    }
+    memset(hdr, 0, sizeof(*hdr));
+    memcpy(hdr->magic, "PWR1", 4);
+    hdr->record_size = sizeof(PowerProfileRecord_t);
+    hdr->capacity    = POWER_PROFILE_CAPACITY;
+    return fp;
+}
+
+void PowerProfile_Flush(void) {
+    PowerProfileRecord_t recs[POWER_PROFILE_PER_WAKE];
+    taskENTER_CRITICAL(&power_lock);
+    int len = power_record_len;
+    memcpy(recs, power_records, len * sizeof(recs[0]));
+    power_record_len = 0;
+    taskEXIT_CRITICAL(&power_lock);
+    if (len == 0) {
+        return;
+    }
+
+    PowerProfileHeader_t hdr;
+    FILE *fp = power_profile_open(&hdr);
+    if (fp == NULL) {
+        ESP_LOGE(TAG, "open %s failed", POWER_PROFILE_PATH);
+        return;
+    }
+    for (int i = 0; i < len; i++) {       /*没写满时 next 就是文件末尾, 文件自然增长到 capacity 后回绕*/
+        fseek(fp, sizeof(hdr) + (long) hdr.next * sizeof(recs[0]), SEEK_SET);
+        if (fwrite(&recs[i], sizeof(recs[0]), 1, fp) != 1) {
+            ESP_LOGE(TAG, "write failed");
+            break;
+        }
+        hdr.next = (hdr.next + 1) % hdr.capacity;
+    }
+    fseek(fp, 0, SEEK_SET);
+    fwrite(&hdr, sizeof(hdr), 1, fp);
+    fclose(fp);
+}
+
+void PowerProfile_Sleep(uint32_t seconds) {
+    power_profile_mark(PowerStageSleep, seconds);
+    PowerProfile_Flush();
+}
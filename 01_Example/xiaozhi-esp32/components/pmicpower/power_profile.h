@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * 每次唤醒的功耗剖析: 在几个关键点采一次AXP2101的电池电压/电量,
+ * 睡眠前追加到SD卡上的环形文件, 由 scripts/power_profile.py 离线估算每次刷新的mAh和续航.
+ * AXP2101没有电池电流ADC, 电流由脚本按各阶段的实测功耗换算.
+ */
+#define POWER_PROFILE_PATH     "/sdcard/power_profile.bin"
+#define POWER_PROFILE_CAPACITY 4096      // 环形文件最多保留的记录数
+#define POWER_PROFILE_PER_WAKE 24        // 一次唤醒内最多缓存的记录数
+
+enum PowerStage {
+    PowerStageBoot = 0,
+    PowerStageSdMount,
+    PowerStageDecode,
+    PowerStageRefresh,
+    PowerStageWifi,
+    PowerStageIdle,
+    PowerStageSleep,                     // arg = 计划睡眠的秒数
+};
+
+enum PowerMode {
+    PowerModeUnknown = 0,
+    PowerModeBasic,
+    PowerModeNetwork,
+    PowerModeXiaozhi,
+};
+
+/*文件格式: 16字节文件头 + CAPACITY 条16字节记录, 均为小端*/
+typedef struct {
+    char     magic[4];                   // "PWR1"
+    uint16_t record_size;
+    uint16_t reserved;
+    uint32_t capacity;
+    uint32_t next;                       // 下一条记录写入的位置, 已写满时即最旧的一条
+} PowerProfileHeader_t;
+
+typedef struct {
+    uint16_t wake;                       // 唤醒序号, 深睡不清零
+    uint8_t  mode;                       // PowerMode
+    uint8_t  stage;                      // PowerStage
+    uint32_t time_ms;                    // 自本次启动起的毫秒数
+    uint16_t batt_mv;
+    uint8_t  percent;
+    uint8_t  flags;                      // bit0 接了USB, bit1 正在充电
+    uint32_t arg;
+} PowerProfileRecord_t;
+
+void PowerProfile_SetMode(uint8_t mode);
+void PowerProfile_Mark(uint8_t stage);
+void PowerProfile_Sleep(uint32_t seconds);   /*记下睡眠阶段并写入SD, 须在SD卡卸载和深睡之前调用*/
+void PowerProfile_Flush(void);               /*常驻模式不睡眠, 定期调用把缓存写入SD*/
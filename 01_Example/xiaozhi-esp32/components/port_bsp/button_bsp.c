@@ -1,6 +1,8 @@
 #include <stdio.h>
 #include <driver/gpio.h>
 #include <esp_log.h>
+#include <esp_attr.h>
+#include <esp_sleep.h>
 #include <esp_timer.h>
 #include "button_bsp.h"
 #include "multi_button.h"
@@ -24,9 +26,19 @@ static Button PWRButton;
 #define PWR_ID 3         
 #define PWR_Active 1     
 
+static void (*button_notify)(uint8_t key, uint8_t bit) = NULL;
+
+/*置位的同时通知应用层的事件循环, 在esp_timer任务里执行*/
+static void button_set_bit(EventGroupHandle_t group, uint8_t key, uint8_t bit) {
+    xEventGroupSetBits(group, set_bit_button(bit));
+    if (button_notify != NULL) {
+        button_notify(key, bit);
+    }
+}
+
 /*******************Callback event declaration***************/
 static void on_boot_single_click(Button *btn_handle) {
-    xEventGroupSetBits(BootButtonGroups, set_bit_button(0));
+    button_set_bit(BootButtonGroups, BUTTON_KEY_BOOT, 0);
 }
 
 static void on_boot_double_click(Button *btn_handle) {
@@ -34,23 +46,23 @@ static void on_boot_double_click(Button *btn_handle) {
 }
 
 static void on_boot_long_press_start(Button *btn_handle) {
-    xEventGroupSetBits(BootButtonGroups, set_bit_button(1));
+    button_set_bit(BootButtonGroups, BUTTON_KEY_BOOT, 1);
 }
 
 static void on_boot_press_repeat(Button *btn_handle) {
-    xEventGroupSetBits(BootButtonGroups, set_bit_button(2));
+    button_set_bit(BootButtonGroups, BUTTON_KEY_BOOT, 2);
 }
 
 static void on_boot_press_up(Button *btn_handle) {
-    xEventGroupSetBits(BootButtonGroups, set_bit_button(3));
+    button_set_bit(BootButtonGroups, BUTTON_KEY_BOOT, 3);
 }
 
 static void on_pwr_single_click(Button *btn_handle) {
-    xEventGroupSetBits(PWRButtonGroups, set_bit_button(0));
+    button_set_bit(PWRButtonGroups, BUTTON_KEY_PWR, 0);
 }
 
 static void on_gp4_single_click(Button *btn_handle) {
-    xEventGroupSetBits(GP4ButtonGroups, set_bit_button(0));
+    button_set_bit(GP4ButtonGroups, BUTTON_KEY_GP4, 0);
 }
 
 static void on_gp4_double_click(Button *btn_handle) {
@@ -58,18 +70,15 @@ static void on_gp4_double_click(Button *btn_handle) {
 }
 
 static void on_gp4_long_press_start(Button *btn_handle) {
-    xEventGroupSetBits(GP4ButtonGroups, set_bit_button(1));
+    button_set_bit(GP4ButtonGroups, BUTTON_KEY_GP4, 1);
 }
 
 static void on_gp4_press_up(Button *btn_handle) {
-    xEventGroupSetBits(GP4ButtonGroups, set_bit_button(2));
+    button_set_bit(GP4ButtonGroups, BUTTON_KEY_GP4, 2);
 }
 
 /*********************************************/
 
-static void clock_task_callback(void *arg) {
-    button_ticks();
-}
 
 static uint8_t read_button_GPIO(uint8_t Button_ID) {
     switch (Button_ID) {
@@ -85,6 +94,52 @@ static uint8_t read_button_GPIO(uint8_t Button_ID) {
     return 1;
 }
 
+/*
+ * 按键空闲时不跑定时器: 三个按键都挂电平中断(同时作为light sleep唤醒源),
+ * 中断里关掉该脚中断并启动5ms单次定时器, 定时器每次回调推进multi_button状态机,
+ * 全部回到空闲后停止并重新打开中断.
+ */
+static Button *const button_list[] = {&BootButton, &GP4Button, &PWRButton};
+static const gpio_num_t button_pins[] = {BOOT_KEY_PIN, GP4_KEY_PIN, PWR_KEY_PIN};
+static const uint8_t button_active[]  = {BOOT_Active, GP4_Active, PWR_Active};
+static esp_timer_handle_t button_timer = NULL;
+static bool               button_armed = false;
+static portMUX_TYPE       button_lock  = portMUX_INITIALIZER_UNLOCKED;
+
+static void IRAM_ATTR button_isr_handler(void *arg) {
+    gpio_intr_disable((gpio_num_t) (uintptr_t) arg);     // 剩下的抖动交给定时器去滤
+    taskENTER_CRITICAL_ISR(&button_lock);
+    if (!button_armed) {
+        button_armed = true;
+        esp_timer_start_once(button_timer, TICKS_INTERVAL * 1000);
+    }
+    taskEXIT_CRITICAL_ISR(&button_lock);
+}
+
+static bool button_all_idle(void) {
+    for (int i = 0; i < 3; i++) {
+        Button *btn = button_list[i];
+        if (btn->state != BTN_STATE_IDLE || btn->debounce_cnt || btn->button_level == btn->active_level) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void clock_task_callback(void *arg) {
+    button_ticks();
+    if (!button_all_idle()) {
+        esp_timer_start_once(button_timer, TICKS_INTERVAL * 1000);
+        return;
+    }
+    taskENTER_CRITICAL(&button_lock);
+    button_armed = false;
+    taskEXIT_CRITICAL(&button_lock);
+    for (int i = 0; i < 3; i++) {      /*此时都在松开电平, 打开后若又按下会立刻进中断*/
+        gpio_intr_enable(button_pins[i]);
+    }
+}
+
 static void gpio_init(void) {
     gpio_config_t gpio_conf = {};
     gpio_conf.intr_type     = GPIO_INTR_DISABLE;
@@ -96,6 +151,10 @@ static void gpio_init(void) {
     ESP_ERROR_CHECK_WITHOUT_ABORT(gpio_config(&gpio_conf));
 }
 
+void Custom_ButtonSetNotify(void (*notify)(uint8_t key, uint8_t bit)) {
+    button_notify = notify;
+}
+
 void Custom_ButtonInit(void) {
     BootButtonGroups = xEventGroupCreate();
     PWRButtonGroups = xEventGroupCreate();
@@ -124,12 +183,26 @@ void Custom_ButtonInit(void) {
     clock_tick_timer_args.callback                = &clock_task_callback;
     clock_tick_timer_args.name                    = "clock_task";
     clock_tick_timer_args.arg                     = NULL;
-    esp_timer_handle_t clock_tick_timer           = NULL;
-    ESP_ERROR_CHECK(esp_timer_create(&clock_tick_timer_args, &clock_tick_timer));
-    ESP_ERROR_CHECK(esp_timer_start_periodic(clock_tick_timer, 1000 * 5)); // 5ms
+    ESP_ERROR_CHECK(esp_timer_create(&clock_tick_timer_args, &button_timer));
     button_start(&BootButton);
     button_start(&PWRButton);
     button_start(&GP4Button);
+
+    esp_err_t err = gpio_install_isr_service(0);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {      // PMIC中断可能已经装过
+        ESP_ERROR_CHECK_WITHOUT_ABORT(err);
+    }
+    for (int i = 0; i < 3; i++) {
+        gpio_int_type_t level = button_active[i] ? GPIO_INTR_HIGH_LEVEL : GPIO_INTR_LOW_LEVEL;
+        gpio_set_intr_type(button_pins[i], level);
+        gpio_isr_handler_add(button_pins[i], button_isr_handler, (void *) (uintptr_t) button_pins[i]);
+        gpio_wakeup_enable(button_pins[i], level);
+    }
+    esp_sleep_enable_gpio_wakeup();
+    taskENTER_CRITICAL(&button_lock);
+    button_armed = true;                 /*先扫一轮, 上电时按着的键也能识别*/
+    taskEXIT_CRITICAL(&button_lock);
+    esp_timer_start_once(button_timer, TICKS_INTERVAL * 1000);
 }
 
 uint8_t user_boot_get_repeat_count(void) {
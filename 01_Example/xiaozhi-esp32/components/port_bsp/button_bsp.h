@@ -31,7 +31,13 @@ extern EventGroupHandle_t PWRButtonGroups;
 #define get_bit_data(x,y) ((x>>y) & 0x01)
 #define rset_bit_data(x) ((uint32_t)0x01<<(x))
 
+/*Custom_ButtonSetNotify 回调里的 key, bit 与对应事件组的位相同*/
+#define BUTTON_KEY_BOOT 1
+#define BUTTON_KEY_GP4  2
+#define BUTTON_KEY_PWR  3
+
 void Custom_ButtonInit(void);
+void Custom_ButtonSetNotify(void (*notify)(uint8_t key, uint8_t bit));
 
 #ifdef __cplusplus
 }
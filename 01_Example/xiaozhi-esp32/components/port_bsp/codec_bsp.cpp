@@ -48,7 +48,12 @@ i2cbus_(i2cbus)
 
 }
 
+/*切换到别的模式时释放, 不再重启*/
 CodecPort::~CodecPort() {
+    Codec_ClosePlay();
+    deinit_codec();
+    i2c_master_bus_rm_device(I2c_DevEs8311);
+    i2c_master_bus_rm_device(I2c_DevEs7210);
 }
 
 uint8_t CodecPort::Codec_PlayInfoAudio() {
@@ -1,8 +1,57 @@
 #include <stdio.h>
 #include <string.h>
 #include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_heap_caps.h>
 #include <esp_log.h>
 #include "display_bsp.h"
+#include "bmp_reader.h"
+#include "work_pool.h"
+
+/*Destination of one BMP blit, portrait images use the 480x800 view of DispBuffer*/
+typedef struct EPDBmpBlit {
+    ePaperPort  *port;
+    EPDSprite_t *sprite;                 // Rows go to this sprite instead of DispBuffer
+    bool         portrait;
+    uint8_t      rotation;               // 显示时要用的 Rotation, 由调用者在解码成功后设置
+    int          x;
+    int          y;
+    int          width;
+    int          height;
+    int          rows;                   // 已写入的行数, 用于进度
+    uint8_t      lut[256];               // Palette index -> panel color
+    uint8_t      ink_row[EPD_WIDTH / 2]; // Packed row for non-ink sources
+} EPDBmpBlit_t;
+
+/*原生帧(.epd): 文件头 + DispBuffer 原样保存, 显示时不需要再解码和抖动*/
+#define EPD_FRAME_MAGIC "EPD4"
+
+typedef struct {
+    char     magic[4];
+    uint16_t width;
+    uint16_t height;
+    uint8_t  rotation;
+    uint8_t  reserved[3];
+} EPDFrameHeader_t;
+
+/*后台还没写完的帧数, 图库重新上传或删除前要等它们写完*/
+static int          epd_frame_saves = 0;
+static portMUX_TYPE epd_frame_lock  = portMUX_INITIALIZER_UNLOCKED;
+
+typedef struct {
+    char             path[128];
+    EPDFrameHeader_t header;
+    uint8_t         *data;
+    int              len;
+} EPDFrameSave_t;
+
+/*Decode -> dither -> DispBuffer without an intermediate RGB888 frame*/
+typedef struct EPDDitherTarget {
+    ePaperPort        *port;
+    ImgDitherStream_t  stream;
+    EPDBmpBlit_t       blit;
+    bool               cancelled;      // 解码还会读到最后, 只是不再抖动
+} EPDDitherTarget_t;
 
 ePaperPort::ePaperPort(ImgDecodeDither &dither,int mosi, int scl, int dc, int cs, int rst, int busy, uint16_t width, uint16_t height,uint16_t scale_MaxWidth, uint16_t scale_MaxHeight, spi_host_device_t spihost) : 
 dither_(dither),
@@ -24,8 +73,9 @@ scale_MaxHeight_(scale_MaxHeight) {
     assert(DispBuffer);
     RotationBuffer             = (uint8_t *) heap_caps_malloc(DisplayLen, MALLOC_CAP_SPIRAM);
     assert(RotationBuffer);
-    BmpSrcBuffer              = (uint8_t *) heap_caps_malloc(width_ * height_ * 3, MALLOC_CAP_SPIRAM); 
-    assert(BmpSrcBuffer);
+    assert(width_ == EPD_WIDTH && height_ == EPD_HEIGHT);
+    Canvas.Canvas_Attach(DispBuffer);
+    PortraitCanvas.Canvas_Attach(DispBuffer);
     buscfg.miso_io_num                   = -1;
     buscfg.mosi_io_num                   = mosi;
     buscfg.sclk_io_num                   = scl;
@@ -248,17 +298,47 @@ void ePaperPort::EPD_Init() {
 }
 
 void ePaperPort::EPD_DispClear(uint8_t color) {
-    uint8_t *buffer = DispBuffer;
-    for (int j = 0; j < DisplayLen; j++) {
-        buffer[j] = (color << 4) | color;
-    }
+    Canvas.Canvas_Fill(color);
 }
 
 void ePaperPort::EPD_Display() {
     EPD_PixelRotate();
+    EPD_ReportProgress(EPDStageSpi, 0);
     EPD_SendCommand(0x10);
     EPD_Sendbuffera(RotationBuffer, DisplayLen);
+    EPD_ReportProgress(EPDStageRefresh, 0);
     EPD_TurnOnDisplay();
+    EPD_ReportProgress(EPDStageDone, 100);
+}
+
+void ePaperPort::EPD_SetProgressCallback(EPDProgressCallback_t cb, void *ctx) {
+    ProgressCb   = cb;
+    ProgressCtx  = ctx;
+    ProgressLast = -1;
+}
+
+void ePaperPort::EPD_ReportProgress(EPDProgressStage stage, int percent) {
+    if (ProgressCb == NULL) {
+        return;
+    }
+    if (stage == EPDStageDecode) {
+        if (percent < 100 && ProgressLast >= 0 && percent - ProgressLast < 5) {
+            return;
+        }
+        ProgressLast = percent;
+    } else {
+        ProgressLast = -1;       // 下一张图的解码从头开始报
+    }
+    ProgressCb(stage, percent, ProgressCtx);
+}
+
+void ePaperPort::EPD_SetCancelCheck(EPDCancelCheck_t cb, void *ctx) {
+    CancelCb  = cb;
+    CancelCtx = ctx;
+}
+
+bool ePaperPort::EPD_Cancelled() {
+    return CancelCb != NULL && CancelCb(CancelCtx);
 }
 
 void ePaperPort::EPD_SrcDisplayCopy(uint8_t *buffer,uint32_t len,uint32_t addlen) {
@@ -276,55 +356,12 @@ uint8_t* ePaperPort::EPD_GetIMGBuffer() {
     return DispBuffer;
 }
 
-void ePaperPort::EPD_SetPixel(uint16_t x, uint16_t y, uint16_t color) {
-    if(x >= 800 || y >= 480) {
-        ESP_LOGE("Pixel","Beyond the limit: (%d,%d)",x,y);
-        return;
-    }
-    uint32_t index = (y << 8) + (y << 7) + (y << 4) + (x >> 1);
-    uint8_t px = DispBuffer[index];
-  
-    uint8_t xor_mask = (x & 1) ? 0xF0 : 0x0F;
-    uint8_t shift    = (x & 1) ? 0     : 4;
-
-    DispBuffer[index] = (px & xor_mask) | (color << shift);
+ePaperCanvas<EPD_WIDTH, EPD_HEIGHT> &ePaperPort::EPD_GetCanvas() {
+    return Canvas;
 }
 
-uint8_t* ePaperPort::EPD_ParseBMPImage(const char *path) {
-    FILE *fp;
-    if ((fp = fopen(path, "rb")) == NULL) {
-        ESP_LOGE(TAG, "Cann't open the file!");
-        return NULL;
-    }
-    BMPFILEHEADER bmpFileHeader;
-    BMPINFOHEADER bmpInfoHeader;
-
-    fseek(fp, 0, SEEK_SET);
-    fread(&bmpFileHeader, sizeof(BMPFILEHEADER), 1, fp);  
-    fread(&bmpInfoHeader, sizeof(BMPINFOHEADER), 1, fp);
-
-    ESP_LOGW(TAG, "(WIDTH:HEIGHT) = (%ld:%ld)", bmpInfoHeader.biWidth, bmpInfoHeader.biHeight);
-    src_width  = bmpInfoHeader.biWidth;
-    src_height = bmpInfoHeader.biHeight;
-    int readbyte = bmpInfoHeader.biBitCount;
-    if (readbyte != 24) {
-        ESP_LOGE(TAG, "Bmp image is not 24 bitmap!");
-        fclose(fp);
-        return NULL;
-    }
-
-    fseek(fp, bmpFileHeader.bOffset, SEEK_SET);
-    int rowBytes = src_width * 3;
-    for (int y = src_height - 1; y >= 0; y--) {
-        uint8_t *rowPtr = BmpSrcBuffer + y * rowBytes;
-        fread(rowPtr, 1, rowBytes, fp);
-    }
-    fclose(fp);
-    if(src_width == 480)
-    {Rotation = 3;src_width = 800;src_height = 480;}
-    else 
-    {Rotation = 2;}
-    return BmpSrcBuffer;
+void ePaperPort::EPD_SetPixel(uint16_t x, uint16_t y, uint16_t color) {
+    Canvas.Canvas_SetPixel(x, y, color);
 }
 
 uint8_t ePaperPort::EPD_ColorToePaperColor(uint8_t b,uint8_t g,uint8_t r) {
@@ -349,346 +386,546 @@ uint8_t ePaperPort::EPD_ColorToePaperColor(uint8_t b,uint8_t g,uint8_t r) {
     return ColorWhite;
 }
 
+void ePaperPort::EPD_BmpRowRGB(int y, const uint8_t *row, void *ctx) {
+    EPDBmpBlit_t *blit  = (EPDBmpBlit_t *) ctx;
+    int           width = (blit->width < EPD_WIDTH) ? blit->width : EPD_WIDTH;
+    memset(blit->ink_row, 0, (width + 1) >> 1);
+    for (int x = 0; x < width; x++, row += 3) {
+        uint8_t color = blit->port->EPD_ColorToePaperColor(row[2], row[1], row[0]);
+        blit->ink_row[x >> 1] |= (x & 1) ? color : (color << 4);
+    }
+    EPD_BmpRowInk(y, blit->ink_row, ctx);
+}
+
+void ePaperPort::EPD_BmpRowIndex(int y, const uint8_t *row, void *ctx) {
+    EPDBmpBlit_t *blit  = (EPDBmpBlit_t *) ctx;
+    int           width = (blit->width < EPD_WIDTH) ? blit->width : EPD_WIDTH;
+    memset(blit->ink_row, 0, (width + 1) >> 1);
+    for (int x = 0; x < width; x++) {
+        uint8_t color = blit->lut[row[x]];
+        blit->ink_row[x >> 1] |= (x & 1) ? color : (color << 4);
+    }
+    EPD_BmpRowInk(y, blit->ink_row, ctx);
+}
+
+void ePaperPort::EPD_BmpRowInk(int y, const uint8_t *row, void *ctx) {
+    EPDBmpBlit_t *blit = (EPDBmpBlit_t *) ctx;
+    if (blit->sprite != NULL) {
+        if (y < blit->sprite->height) {
+            int stride = SpriteAtlas::SpriteAtlas_Stride(blit->sprite);
+            memcpy(blit->sprite->data + y * stride, row, stride);
+        }
+    } else {
+        if (blit->portrait) {
+            blit->port->PortraitCanvas.Canvas_BlitInkRow(blit->x, blit->y + y, row, blit->width);
+        } else {
+            blit->port->Canvas.Canvas_BlitInkRow(blit->x, blit->y + y, row, blit->width);
+        }
+        blit->port->EPD_ReportProgress(EPDStageDecode, ++blit->rows * 100 / blit->height);
+    }
+}
+
+void ePaperPort::EPD_BlitSetup(EPDBmpBlit *blit, int x, int y, int w, int h) {
+    blit->port     = this;
+    blit->sprite   = NULL;
+    blit->x        = x;
+    blit->y        = y;
+    blit->width    = w;
+    blit->height   = (h > 0) ? h : 1;
+    blit->rows     = 0;
+    blit->portrait = (w == height_ && h == width_);
+    /*竖屏图片按480宽线性存放,显示时再旋转*/
+    blit->rotation = blit->portrait ? 3 : 2;
+}
+
+esp_err_t ePaperPort::EPD_BmpBlit(const char *path, EPDBmpBlit *blit, int x, int y) {
+    BmpReader reader;
+    if (reader.BmpReader_Open(path) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    EPDSprite_t *sprite = blit->sprite;
+    if (sprite != NULL) {
+        int w = reader.BmpReader_GetWidth();
+        int h = reader.BmpReader_GetHeight();
+        if (w > EPD_WIDTH) {
+            ESP_LOGE(TAG, "Sprite too wide: %s", path);
+            return ESP_ERR_INVALID_SIZE;
+        }
+        sprite->width  = w;
+        sprite->height = h;
+        sprite->data   = (uint8_t *) heap_caps_malloc(SpriteAtlas::SpriteAtlas_Stride(sprite) * h, MALLOC_CAP_SPIRAM);
+        if (sprite->data == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        blit->port  = this;
+        blit->width = w;
+    } else {
+        EPD_BlitSetup(blit, x, y, reader.BmpReader_GetWidth(), reader.BmpReader_GetHeight());
+    }
+
+    esp_err_t ret;
+    if (reader.BmpReader_IsInkPalette()) {
+        ret = reader.BmpReader_ReadRows(BmpRowInk4, EPD_BmpRowInk, blit);
+    } else if (reader.BmpReader_IsPalettized()) {
+        for (int i = 0; i < reader.BmpReader_GetPaletteLen(); i++) {
+            const uint8_t *rgb = reader.BmpReader_GetPaletteColor(i);
+            blit->lut[i]       = EPD_ColorToePaperColor(rgb[2], rgb[1], rgb[0]);
+        }
+        ret = reader.BmpReader_ReadRows(BmpRowIndex8, EPD_BmpRowIndex, blit);
+    } else {
+        ret = reader.BmpReader_ReadRows(BmpRowRGB888, EPD_BmpRowRGB, blit);
+    }
+    if (ret != ESP_OK && sprite != NULL) {
+        heap_caps_free(sprite->data);
+        sprite->data = NULL;
+    }
+    return ret;
+}
+
 void ePaperPort::EPD_SDcardBmpShakingColor(const char *path,uint16_t x_start, uint16_t y_start) {
-    uint8_t r,g,b;
-    uint8_t *buffer = EPD_ParseBMPImage(path);
-    if(NULL == buffer) {
+    EPDBmpBlit_t blit = {};
+    if (EPD_BmpBlit(path, &blit, x_start, y_start) != ESP_OK) {
+        ESP_LOGE(TAG, "BMP display failed: %s", path);
         return;
     }
-    uint8_t* scapeBuffer = (uint8_t*)buffer;
-    for(int y = 0; y < src_height; y++) {
-        for(int x = 0; x < src_width; x++) {
-            int idx = (y * src_width + x) * 3;
-            b = scapeBuffer[idx + 0];
-            g = scapeBuffer[idx + 1];
-            r = scapeBuffer[idx + 2];
-            uint8_t color = EPD_ColorToePaperColor(b, g, r);
-            EPD_SetPixel(x_start + x, y_start + y, color);
-        }
+    Rotation = blit.rotation;
+}
+
+esp_err_t ePaperPort::EPD_SDcardBmpToSprite(const char *path, EPDSprite_t *sprite) {
+    EPDBmpBlit_t blit = {};
+    blit.sprite       = sprite;
+    sprite->data      = NULL;
+    return EPD_BmpBlit(path, &blit, 0, 0);
+}
+
+void ePaperPort::EPD_DrawSprite(const EPDSprite_t *sprite, uint16_t x_start, uint16_t y_start) {
+    int stride = SpriteAtlas::SpriteAtlas_Stride(sprite);
+    if (sprite->width == height_ && sprite->height == width_) {
+        Rotation = 3;
+        PortraitCanvas.Canvas_BlitPacked(x_start, y_start, sprite->data, sprite->width, sprite->height, stride);
+    } else {
+        Rotation = 2;
+        Canvas.Canvas_BlitPacked(x_start, y_start, sprite->data, sprite->width, sprite->height, stride);
+    }
+}
+
+esp_err_t ePaperPort::EPD_DitherHeader(int w, int h, void *ctx) {
+    EPDDitherTarget_t *target = (EPDDitherTarget_t *) ctx;
+    ePaperPort        *port   = target->port;
+    if (!((w == port->height_ && h == port->width_) || (w == port->width_ && h == port->height_))) {
+        return ESP_ERR_INVALID_SIZE;  // 需要先缩放或补白裁剪
+    }
+    port->EPD_BlitSetup(&target->blit, 0, 0, w, h);
+    return port->dither_.ImgDecode_DitherStreamBegin(&target->stream, w, h, DitherOutInk4, EPD_BmpRowInk, &target->blit);
+}
+
+void ePaperPort::EPD_DitherRow(int y, const uint8_t *row, void *ctx) {
+    EPDDitherTarget_t *target = (EPDDitherTarget_t *) ctx;
+    if (target->cancelled || ((y & 15) == 0 && (target->cancelled = target->port->EPD_Cancelled()))) {
+        return;
     }
+    target->port->dither_.ImgDecode_DitherStreamPush(&target->stream, row);
 }
 
-void ePaperPort::EPD_SDcardIMGShakingColor(const char *path,uint16_t x_start, uint16_t y_start) {
+esp_err_t ePaperPort::EPD_SDcardDitherIMG(const char *path, bool allow_scale) {
+    if (strstr(path, ".epd") || strstr(path, ".EPD")) {
+        esp_err_t err = EPD_SDcardLoadFrame(path);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Frame load fail: %s", path);
+        }
+        return err;
+    }
+    EPDDitherTarget_t target = {};
+    target.port              = this;
+
+    /*png/qoi/bmp 全屏尺寸时边解码边抖动,直接写入显存*/
+    esp_err_t ret = dither_.ImgDecode_TFStreamPicture(path, EPD_DitherHeader, EPD_DitherRow, &target);
+    if (target.stream.cur != NULL) {
+        dither_.ImgDecode_DitherStreamEnd(&target.stream);
+    }
+    if (ret == ESP_OK) {
+        if (target.cancelled) {
+            return ESP_ERR_INVALID_STATE;
+        }
+        Rotation = target.blit.rotation;
+        return ESP_OK;
+    }
+    if (ret != ESP_ERR_NOT_SUPPORTED && ret != ESP_ERR_INVALID_SIZE) {
+        ESP_LOGE(TAG, "IMG dec fail: %s", path);
+        return ret;
+    }
+
+    /*RLE8 bmp,或非全屏尺寸的图片: 整图解码到RGB888*/
     uint8_t *decimgbuff = NULL;
     int img_len = 0;
-    uint8_t *floyd_buffer = NULL;
     int s_width;
     int s_height;
-    if(strstr(path, ".jpg") || strstr(path, ".JPG")) {
-        if(dither_.ImgDecode_TFOneJPGPicture(path,&decimgbuff,&img_len,&s_width,&s_height) == ESP_OK) {
-            floyd_buffer = (uint8_t *) malloc(width_ * height_ * 3);       // Store the data after applying the RGB888 jitter algorithm
-            assert(floyd_buffer);
-            ESP_LOGW(TAG,"jpgdecode:(%d,%d)",s_width,s_height);
-            dither_.ImgDecode_DitherRgb888(decimgbuff, floyd_buffer,s_width,s_height);     //The RGB888 data has undergone the jittering algorithm.
-            dither_.ImgDecode_JPGBufferFree(decimgbuff); 
-            if (dither_.ImgDecode_EncodingBmpToSdcard(img_to_bmpName, floyd_buffer, s_width,s_height) == ESP_OK) {
-                free(floyd_buffer);
-                floyd_buffer = NULL;
-                EPD_SDcardBmpShakingColor(img_to_bmpName,0,0);
-            } else {
-                ESP_LOGE(TAG, "bmp to sdcard fill");
-                free(floyd_buffer);
-                floyd_buffer = NULL;
+    bool is_jpg = strstr(path, ".jpg") || strstr(path, ".JPG");
+    if (is_jpg) {
+        ret = dither_.ImgDecode_TFOneJPGPicture(path,&decimgbuff,&img_len,&s_width,&s_height);
+    } else if(strstr(path, ".png") || strstr(path, ".PNG")) {
+        ret = dither_.ImgDecode_TFOnePNGPicture(path,&decimgbuff,&s_width,&s_height);
+    } else if(strstr(path, ".qoi") || strstr(path, ".QOI")) {
+        ret = dither_.ImgDecode_TFOneQOIPicture(path,&decimgbuff,&s_width,&s_height);
+    } else if(strstr(path, ".bmp") || strstr(path, ".BMP")) {
+        ret = dither_.ImgDecodebmp_TFOneBMPPicture(path,&decimgbuff,&s_width,&s_height);
+    } else {
+        ESP_LOGE(TAG, "Unsupported image: %s", path);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "IMG dec fail: %s", path);
+        if (decimgbuff != NULL) {
+            is_jpg ? dither_.ImgDecode_JPGBufferFree(decimgbuff) : dither_.ImgDecode_BMPBufferFree(decimgbuff);
+        }
+        return ret;
+    }
+    ESP_LOGW(TAG,"imgdecode:(%d,%d)",s_width,s_height);
+    if (EPD_Cancelled()) {             /*整图解码很慢, 解完先看一下还要不要*/
+        is_jpg ? dither_.ImgDecode_JPGBufferFree(decimgbuff) : dither_.ImgDecode_BMPBufferFree(decimgbuff);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    uint8_t *src = decimgbuff;
+    uint8_t *scale_buffer = NULL;
+    bool full_frame = (480 == s_width && 800 == s_height) || (800 == s_width && 480 == s_height);
+    if (!full_frame) {
+        if (allow_scale && ((s_width > scale_MaxWidth_) || (s_height > scale_MaxHeight_))) {
+            ESP_LOGE(TAG, "Image size not supported: (%d,%d)", s_width, s_height);
+            is_jpg ? dither_.ImgDecode_JPGBufferFree(decimgbuff) : dither_.ImgDecode_BMPBufferFree(decimgbuff);
+            return ESP_ERR_INVALID_SIZE;
+        }
+        scale_buffer = (uint8_t *) malloc(width_ * height_ * 3);
+        assert(scale_buffer);
+        if (!allow_scale) {
+            /*不缩放: 图片放在左上角, 超出部分裁掉, 不足部分补白*/
+            int dst_w = (s_width > s_height) ? width_ : height_;
+            int dst_h = (s_width > s_height) ? height_ : width_;
+            int copy_w = (s_width < dst_w) ? s_width : dst_w;
+            int copy_h = (s_height < dst_h) ? s_height : dst_h;
+            memset(scale_buffer, 0xff, width_ * height_ * 3);
+            for (int y = 0; y < copy_h; y++) {
+                memcpy(scale_buffer + y * dst_w * 3, decimgbuff + y * s_width * 3, copy_w * 3);
             }
+            s_width = dst_w;
+            s_height = dst_h;
+        } else if(s_width > s_height) {   /*拉伸缩放*/
+            dither_.ImgDecode_ScaleRgb888Nearest(decimgbuff,s_width,s_height,scale_buffer,width_,height_);
+            s_width = width_;
+            s_height = height_;
         } else {
-            ESP_LOGE(TAG, "jpg dec fill");
-            if (decimgbuff != NULL) {
-                dither_.ImgDecode_JPGBufferFree(decimgbuff);
-            }
+            dither_.ImgDecode_ScaleRgb888Nearest(decimgbuff,s_width,s_height,scale_buffer,height_,width_);
+            s_width = height_;
+            s_height = width_;
         }
-    } else if(strstr(path, ".png") || strstr(path, ".PNG")) {
-        if(dither_.ImgDecode_TFOnePNGPicture(path,&decimgbuff,&s_width,&s_height) == ESP_OK) {
-            floyd_buffer = (uint8_t *) malloc(width_ * height_ * 3);       // Store the data after applying the RGB888 jitter algorithm
-            assert(floyd_buffer);
-            ESP_LOGW(TAG,"pngdecode:(%d,%d)",s_width,s_height);
-            dither_.ImgDecode_DitherRgb888(decimgbuff, floyd_buffer,s_width,s_height);     //The RGB888 data has undergone the jittering algorithm.
-            dither_.ImgDecode_PNGBufferFree(decimgbuff); 
-            if (dither_.ImgDecode_EncodingBmpToSdcard(img_to_bmpName, floyd_buffer, s_width,s_height) == ESP_OK) {
-                free(floyd_buffer);
-                floyd_buffer = NULL;
-                EPD_SDcardBmpShakingColor(img_to_bmpName,0,0);
-            } else {
-                ESP_LOGE(TAG, "bmp to sdcard fill");
-                free(floyd_buffer);
-                floyd_buffer = NULL;
-            }
+        is_jpg ? dither_.ImgDecode_JPGBufferFree(decimgbuff) : dither_.ImgDecode_BMPBufferFree(decimgbuff);
+        decimgbuff = NULL;
+        src = scale_buffer;
+    }
+
+    ret = EPD_DitherHeader(s_width, s_height, &target);
+    if (ret == ESP_OK) {
+        for (int y = 0; y < s_height; y++) {
+            EPD_DitherRow(y, src + y * s_width * 3, &target);
+        }
+        dither_.ImgDecode_DitherStreamEnd(&target.stream);
+        if (target.cancelled) {
+            ret = ESP_ERR_INVALID_STATE;
         } else {
-            ESP_LOGE(TAG, "PNG dec fill");
-            if (decimgbuff != NULL) {
-                dither_.ImgDecode_PNGBufferFree(decimgbuff);
-            }
+            Rotation = target.blit.rotation;
         }
-    } else if(strstr(path, ".bmp") || strstr(path, ".BMP")) {
-        if(dither_.ImgDecodebmp_TFOneBMPPicture(path,&decimgbuff,&s_width,&s_height) == ESP_OK) {
-            floyd_buffer = (uint8_t *) malloc(width_ * height_ * 3);       // Store the data after applying the RGB888 jitter algorithm
-            assert(floyd_buffer);
-            ESP_LOGW(TAG,"bmpdecode:(%d,%d)",s_width,s_height);
-            dither_.ImgDecode_DitherRgb888(decimgbuff, floyd_buffer,s_width,s_height);     //The RGB888 data has undergone the jittering algorithm.
-            dither_.ImgDecode_BMPBufferFree(decimgbuff); 
-            if (dither_.ImgDecode_EncodingBmpToSdcard(img_to_bmpName, floyd_buffer, s_width,s_height) == ESP_OK) {
-                free(floyd_buffer);
-                floyd_buffer = NULL;
-                EPD_SDcardBmpShakingColor(img_to_bmpName,0,0);
-            } else {
-                ESP_LOGE(TAG, "bmp to sdcard fill");
-                free(floyd_buffer);
-                floyd_buffer = NULL;
+    }
+    if (decimgbuff != NULL) {
+        is_jpg ? dither_.ImgDecode_JPGBufferFree(decimgbuff) : dither_.ImgDecode_BMPBufferFree(decimgbuff);
+    }
+    if (scale_buffer != NULL) {
+        free(scale_buffer);
+    }
+    return ret;
+}
+
+esp_err_t ePaperPort::EPD_JPGBufferShakingColor(const uint8_t *jpg, int len) {
+    EPDDitherTarget_t target = {};
+    target.port              = this;
+    esp_err_t ret            = dither_.ImgDecode_JPGReadRows(jpg, len, EPD_DitherHeader, EPD_DitherRow, &target);
+    if (target.stream.cur != NULL) {
+        dither_.ImgDecode_DitherStreamEnd(&target.stream);
+    }
+    if (ret == ESP_OK) {
+        if (target.cancelled) {
+            return ESP_ERR_INVALID_STATE;
+        }
+        Rotation = target.blit.rotation;
+    }
+    return ret;
+}
+
+esp_err_t ePaperPort::EPD_SDcardLoadFrame(const char *path) {
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    EPDFrameHeader_t header;
+    esp_err_t        ret = ESP_ERR_INVALID_RESPONSE;
+    if (fread(&header, sizeof(header), 1, fp) == 1 && !memcmp(header.magic, EPD_FRAME_MAGIC, 4) &&
+        header.width == width_ && header.height == height_) {
+        setvbuf(fp, NULL, _IONBF, 0);
+        if (fread(DispBuffer, 1, DisplayLen, fp) == (size_t) DisplayLen) {
+            Rotation = header.rotation;
+            ret      = ESP_OK;
+        }
+    }
+    fclose(fp);
+    return ret;
+}
+
+static void EPD_FrameSaveJob(void *arg) {
+    EPDFrameSave_t *save = (EPDFrameSave_t *) arg;
+    char            tmp[sizeof(save->path) + 4];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", save->path);
+    FILE *fp = fopen(tmp, "wb");
+    bool  ok = false;
+    if (fp != NULL) {
+        ok = fwrite(&save->header, sizeof(save->header), 1, fp) == 1 &&
+             fwrite(save->data, 1, save->len, fp) == (size_t) save->len;
+        fclose(fp);
+    }
+    if (ok) {
+        remove(save->path);   // FAT的rename不能覆盖已有文件
+        ok = rename(tmp, save->path) == 0;
+    } else {
+        remove(tmp);
+    }
+    ESP_LOGI("Display", "Frame archive %s: %s", ok ? "saved" : "failed", save->path);
+    heap_caps_free(save->data);
+    heap_caps_free(save);
+    taskENTER_CRITICAL(&epd_frame_lock);
+    epd_frame_saves--;
+    taskEXIT_CRITICAL(&epd_frame_lock);
+}
+
+esp_err_t ePaperPort::EPD_SaveFrameAsync(const char *path) {
+    EPDFrameSave_t *save = (EPDFrameSave_t *) heap_caps_calloc(1, sizeof(EPDFrameSave_t), MALLOC_CAP_SPIRAM);
+    if (save == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    save->data = (uint8_t *) heap_caps_malloc(DisplayLen, MALLOC_CAP_SPIRAM);
+    if (save->data == NULL) {
+        heap_caps_free(save);
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(save->data, DispBuffer, DisplayLen);
+    save->len = DisplayLen;
+    memcpy(save->header.magic, EPD_FRAME_MAGIC, 4);
+    save->header.width    = width_;
+    save->header.height   = height_;
+    save->header.rotation = Rotation;
+    strncpy(save->path, path, sizeof(save->path) - 1);
+    taskENTER_CRITICAL(&epd_frame_lock);
+    epd_frame_saves++;
+    taskEXIT_CRITICAL(&epd_frame_lock);
+    if (work_pool_submit(EPD_FrameSaveJob, save, 0) != ESP_OK) {
+        taskENTER_CRITICAL(&epd_frame_lock);
+        epd_frame_saves--;
+        taskEXIT_CRITICAL(&epd_frame_lock);
+        heap_caps_free(save->data);
+        heap_caps_free(save);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void ePaperPort::EPD_SaveFrameWait(void) {
+    for (;;) {
+        taskENTER_CRITICAL(&epd_frame_lock);
+        int pending = epd_frame_saves;
+        taskEXIT_CRITICAL(&epd_frame_lock);
+        if (pending == 0) {
+            return;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+}
+
+esp_err_t ePaperPort::EPD_SDcardIMGShakingColor(const char *path,uint16_t x_start, uint16_t y_start) {
+    return EPD_SDcardDitherIMG(path, false);
+}
+
+esp_err_t ePaperPort::EPD_SDcardScaleIMGShakingColor(const char *path,uint16_t x_start, uint16_t y_start) {
+    return EPD_SDcardDitherIMG(path, true);
+}
+
+const char *ePaperPort::EPD_NextGlyphCN(const char **pText, cFONT *font, uint16_t *advance) {
+    const uint8_t *s   = (const uint8_t *) *pText;
+    int            len = 1;
+    if ((s[0] & 0xE0) == 0xC0) {
+        len = 2;
+    } else if ((s[0] & 0xF0) == 0xE0) {
+        len = 3;
+    } else if ((s[0] & 0xF8) == 0xF0) {
+        len = 4;
+    }
+    for (int i = 1; i < len; i++) {   // 截断的UTF-8序列
+        if (s[i] == 0) {
+            len = i;
+            break;
+        }
+    }
+    *pText  += len;
+    *advance = (len == 1) ? font->ASCII_Width : font->Width;
+    if (len > 3) {
+        return NULL;
+    }
+    uint32_t key = (s[0] << 16) | ((len > 1) ? (s[1] << 8) : 0) | ((len > 2) ? s[2] : 0);
+
+    if (font->index == NULL) {   /*没有排序索引的字库,按原方式顺序查找*/
+        for (int Num = 0; Num < font->size; Num++) {
+            const uint8_t *idx = (const uint8_t *) font->table[Num].index;
+            if ((uint32_t) ((idx[0] << 16) | (idx[1] << 8) | idx[2]) == key) {
+                return font->table[Num].matrix;
             }
+        }
+        return NULL;
+    }
+    int lo = 0;
+    int hi = font->size;
+    while (lo < hi) {   // 二分查找第一个 >= key 的字模
+        int            mid = (lo + hi) >> 1;
+        const uint8_t *idx = (const uint8_t *) font->table[font->index[mid]].index;
+        uint32_t       k   = (idx[0] << 16) | (idx[1] << 8) | idx[2];
+        if (k < key) {
+            lo = mid + 1;
         } else {
-            ESP_LOGE(TAG, "BMP dec fill");
-            if (decimgbuff != NULL) {
-                dither_.ImgDecode_BMPBufferFree(decimgbuff);
-            }
+            hi = mid;
         }
     }
+    if (lo < font->size) {
+        const CH_CN *glyph = &font->table[font->index[lo]];
+        const uint8_t *idx = (const uint8_t *) glyph->index;
+        if ((uint32_t) ((idx[0] << 16) | (idx[1] << 8) | idx[2]) == key) {
+            return glyph->matrix;
+        }
+    }
+    return NULL;
 }
 
-void ePaperPort::EPD_SDcardScaleIMGShakingColor(const char *path,uint16_t x_start, uint16_t y_start) {
-    uint8_t *decimgbuff = NULL;
-    int img_len = 0;
-    uint8_t *scale_buffer = NULL;
-    uint8_t *floyd_buffer = NULL;
-    int s_width;
-    int s_height;
-    if(strstr(path, ".jpg") || strstr(path, ".JPG")) {
-        if(dither_.ImgDecode_TFOneJPGPicture(path,&decimgbuff,&img_len,&s_width,&s_height) == ESP_OK) {
-            ESP_LOGW(TAG,"jpgdecode:(%d,%d)",s_width,s_height);
-            if((s_width > scale_MaxWidth_) || (s_height > scale_MaxHeight_)) {
-                dither_.ImgDecode_JPGBufferFree(decimgbuff); 
-                return;
+void ePaperPort::EPD_DrawGlyphCN(int x, int y, const char *matrix, cFONT *font, uint16_t Color_Foreground, uint16_t Color_Background) {
+    uint8_t FONT_BACKGROUND  = 0xff;
+    if (FONT_BACKGROUND != Color_Background) {
+        Canvas.Canvas_FillRect(x, y, font->Width, font->Height, Color_Background);
+    }
+    EPD_DrawBitmap1(x, y, (const uint8_t *) matrix, font->Width, font->Height, (font->Width + 7) / 8, Color_Foreground);
+}
+
+void ePaperPort::EPD_DrawBitmap1(int x, int y, const uint8_t *bitmap, int w, int h, int row_bytes, uint16_t Color_Foreground) {
+    const uint8_t *ptr = bitmap;
+    /*每行按连续的置位区间画横线*/
+    for (int j = 0; j < h; j++, ptr += row_bytes) {
+        int i = 0;
+        while (i < w) {
+            if ((i & 7) == 0 && ptr[i >> 3] == 0) {
+                i += 8;
+                continue;
             }
-            if((480 == s_width && 800 == s_height) || (800 == s_width && 480 == s_height)) {
-                floyd_buffer = (uint8_t *) malloc(width_ * height_ * 3);       // Store the data after applying the RGB888 jitter algorithm
-                assert(floyd_buffer);
-                dither_.ImgDecode_DitherRgb888(decimgbuff, floyd_buffer,s_width,s_height);     //The RGB888 data has undergone the jittering algorithm.
-                dither_.ImgDecode_JPGBufferFree(decimgbuff); 
-                if (dither_.ImgDecode_EncodingBmpToSdcard(img_to_bmpName, floyd_buffer, s_width,s_height) == ESP_OK) {
-                    free(floyd_buffer);
-                    floyd_buffer = NULL;
-                    EPD_SDcardBmpShakingColor(img_to_bmpName,0,0);
-                } else {
-                    ESP_LOGE(TAG, "bmp to sdcard fill");
-                    free(floyd_buffer);
-                    floyd_buffer = NULL;
-                }
-            } else { /*拉伸缩放*/
-                scale_buffer = (uint8_t *) malloc(width_ * height_ * 3);       // Store the data after applying the RGB888 jitter algorithm
-                assert(scale_buffer);
-                if(s_width > s_height) {
-                    dither_.ImgDecode_ScaleRgb888Nearest(decimgbuff,s_width,s_height,scale_buffer,width_,height_);
-                    s_width = width_;
-                    s_height = height_;
-                } else {
-                    dither_.ImgDecode_ScaleRgb888Nearest(decimgbuff,s_width,s_height,scale_buffer,height_,width_);
-                    s_width = height_;
-                    s_height = width_;
-                }
-                dither_.ImgDecode_JPGBufferFree(decimgbuff);
-                floyd_buffer = (uint8_t *) malloc(width_ * height_ * 3);       // Store the data after applying the RGB888 jitter algorithm
-                assert(floyd_buffer);
-                dither_.ImgDecode_DitherRgb888(scale_buffer, floyd_buffer,s_width,s_height);     //The RGB888 data has undergone the jittering algorithm.
-                free(scale_buffer);
-                scale_buffer = NULL;
-                if (dither_.ImgDecode_EncodingBmpToSdcard(img_to_bmpName, floyd_buffer, s_width,s_height) == ESP_OK) {
-                    free(floyd_buffer);
-                    floyd_buffer = NULL;
-                    EPD_SDcardBmpShakingColor(img_to_bmpName,0,0);
-                } else {
-                    ESP_LOGE(TAG, "bmp to sdcard fill");
-                    free(floyd_buffer);
-                    floyd_buffer = NULL;
-                }
+            if (!(ptr[i >> 3] & (0x80 >> (i & 7)))) {
+                i++;
+                continue;
             }
-        } else { /*解码失败*/
-            ESP_LOGE(TAG, "jpg dec fill");
-            if (decimgbuff != NULL) {
-                dither_.ImgDecode_JPGBufferFree(decimgbuff);
+            int start = i;
+            while (i < w && (ptr[i >> 3] & (0x80 >> (i & 7)))) {
+                i++;
             }
+            Canvas.Canvas_HLine(x + start, y + j, i - start, Color_Foreground);
         }
-    } else if(strstr(path, ".png") || strstr(path, ".PNG")) {
-        if(dither_.ImgDecode_TFOnePNGPicture(path,&decimgbuff,&s_width,&s_height) == ESP_OK) {
-            if((s_width > scale_MaxWidth_) || (s_height > scale_MaxHeight_)) {
-                dither_.ImgDecode_PNGBufferFree(decimgbuff);
-                return;
-            }
-            if((480 == s_width && 800 == s_height) || (800 == s_width && 480 == s_height)) { /*正常抖动显示*/
-                floyd_buffer = (uint8_t *) malloc(width_ * height_ * 3);       // Store the data after applying the RGB888 jitter algorithm
-                assert(floyd_buffer);
-                dither_.ImgDecode_DitherRgb888(decimgbuff, floyd_buffer,s_width,s_height);     //The RGB888 data has undergone the jittering algorithm.
-                dither_.ImgDecode_JPGBufferFree(decimgbuff); 
-                if (dither_.ImgDecode_EncodingBmpToSdcard(img_to_bmpName, floyd_buffer, s_width,s_height) == ESP_OK) {
-                    free(floyd_buffer);
-                    floyd_buffer = NULL;
-                    EPD_SDcardBmpShakingColor(img_to_bmpName,0,0);
-                } else {
-                    ESP_LOGE(TAG, "bmp to sdcard fill");
-                    free(floyd_buffer);
-                    floyd_buffer = NULL;
-                }
-            } else {   /*拉伸缩放*/
-                scale_buffer = (uint8_t *) malloc(width_ * height_ * 3);       // Store the data after applying the RGB888 jitter algorithm
-                assert(scale_buffer);
-                if(s_width > s_height) {
-                    dither_.ImgDecode_ScaleRgb888Nearest(decimgbuff,s_width,s_height,scale_buffer,width_,height_);
-                    s_width = width_;
-                    s_height = height_;
-                } else {
-                    dither_.ImgDecode_ScaleRgb888Nearest(decimgbuff,s_width,s_height,scale_buffer,height_,width_);
-                    s_width = height_;
-                    s_height = width_;
-                }
-                dither_.ImgDecode_PNGBufferFree(decimgbuff);
-                floyd_buffer = (uint8_t *) malloc(width_ * height_ * 3);       // Store the data after applying the RGB888 jitter algorithm
-                assert(floyd_buffer);
-                dither_.ImgDecode_DitherRgb888(scale_buffer, floyd_buffer,s_width,s_height);     //The RGB888 data has undergone the jittering algorithm.
-                free(scale_buffer);
-                scale_buffer = NULL;
-                if (dither_.ImgDecode_EncodingBmpToSdcard(img_to_bmpName, floyd_buffer, s_width,s_height) == ESP_OK) {
-                    free(floyd_buffer);
-                    floyd_buffer = NULL;
-                    EPD_SDcardBmpShakingColor(img_to_bmpName,0,0);
-                } else {
-                    ESP_LOGE(TAG, "bmp to sdcard fill");
-                    free(floyd_buffer);
-                    floyd_buffer = NULL;
-                }
-            }
-        } else {      /*解码失败*/
-            ESP_LOGE(TAG, "PNG dec fill");
-            if (decimgbuff != NULL) {
-                dither_.ImgDecode_PNGBufferFree(decimgbuff);
-            }
+    }
+}
+
+PackedFont *ePaperPort::EPD_FindPackedFont(cFONT *font) {
+    for (int i = 0; i < EPD_PACKED_FONT_MAX; i++) {
+        if (PackedKey[i] == font && PackedFonts[i] != NULL && PackedFonts[i]->PackedFont_IsValid()) {
+            return PackedFonts[i];
         }
-    } else if(strstr(path, ".bmp") || strstr(path, ".BMP")) {
-        if(dither_.ImgDecodebmp_TFOneBMPPicture(path,&decimgbuff,&s_width,&s_height) == ESP_OK) {
-            if((s_width > scale_MaxWidth_) || (s_height > scale_MaxHeight_)) {
-                dither_.ImgDecode_BMPBufferFree(decimgbuff);
-                return;
-            }
-            if((480 == s_width && 800 == s_height) || (800 == s_width && 480 == s_height)) { /*正常抖动显示*/
-                floyd_buffer = (uint8_t *) malloc(width_ * height_ * 3);       // Store the data after applying the RGB888 jitter algorithm
-                assert(floyd_buffer);
-                dither_.ImgDecode_DitherRgb888(decimgbuff, floyd_buffer,s_width,s_height);     //The RGB888 data has undergone the jittering algorithm.
-                dither_.ImgDecode_JPGBufferFree(decimgbuff); 
-                if (dither_.ImgDecode_EncodingBmpToSdcard(img_to_bmpName, floyd_buffer, s_width,s_height) == ESP_OK) {
-                    free(floyd_buffer);
-                    floyd_buffer = NULL;
-                    EPD_SDcardBmpShakingColor(img_to_bmpName,0,0);
-                } else {
-                    ESP_LOGE(TAG, "bmp to sdcard fill");
-                    free(floyd_buffer);
-                    floyd_buffer = NULL;
-                }
-            } else {   /*拉伸缩放*/
-                scale_buffer = (uint8_t *) malloc(width_ * height_ * 3);       // Store the data after applying the RGB888 jitter algorithm
-                assert(scale_buffer);
-                if(s_width > s_height) {
-                    dither_.ImgDecode_ScaleRgb888Nearest(decimgbuff,s_width,s_height,scale_buffer,width_,height_);
-                    s_width = width_;
-                    s_height = height_;
-                } else {
-                    dither_.ImgDecode_ScaleRgb888Nearest(decimgbuff,s_width,s_height,scale_buffer,height_,width_);
-                    s_width = height_;
-                    s_height = width_;
-                }
-                dither_.ImgDecode_BMPBufferFree(decimgbuff);
-                floyd_buffer = (uint8_t *) malloc(width_ * height_ * 3);       // Store the data after applying the RGB888 jitter algorithm
-                assert(floyd_buffer);
-                dither_.ImgDecode_DitherRgb888(scale_buffer, floyd_buffer,s_width,s_height);     //The RGB888 data has undergone the jittering algorithm.
-                free(scale_buffer);
-                scale_buffer = NULL;
-                if (dither_.ImgDecode_EncodingBmpToSdcard(img_to_bmpName, floyd_buffer, s_width,s_height) == ESP_OK) {
-                    free(floyd_buffer);
-                    floyd_buffer = NULL;
-                    EPD_SDcardBmpShakingColor(img_to_bmpName,0,0);
-                } else {
-                    ESP_LOGE(TAG, "bmp to sdcard fill");
-                    free(floyd_buffer);
-                    floyd_buffer = NULL;
-                }
-            }
-        } else {
-            ESP_LOGE(TAG, "BMP dec fill");
-            if (decimgbuff != NULL) {
-                dither_.ImgDecode_BMPBufferFree(decimgbuff);
-            }
+    }
+    return NULL;
+}
+
+void ePaperPort::EPD_AttachPackedFont(cFONT *font, PackedFont *packed) {
+    int slot = -1;
+    for (int i = EPD_PACKED_FONT_MAX - 1; i >= 0; i--) {   // 已挂载的优先, 否则取第一个空位
+        if (PackedKey[i] == font) {
+            slot = i;
+            break;
+        }
+        if (PackedKey[i] == NULL) {
+            slot = i;
         }
     }
+    if (slot < 0) {
+        ESP_LOGE(TAG, "Too many packed fonts");
+        return;
+    }
+    PackedKey[slot]   = (packed != NULL) ? font : NULL;
+    PackedFonts[slot] = packed;
+}
+
+uint16_t ePaperPort::EPD_MeasureStringCN(const char *pString, cFONT *font) {
+    PackedFont *packed = EPD_FindPackedFont(font);
+    if (packed != NULL) {
+        return EPD_MeasureStringPacked(pString, packed);
+    }
+    const char *p_text = pString;
+    uint16_t    width  = 0;
+    uint16_t    advance;
+    while (*p_text != 0) {
+        EPD_NextGlyphCN(&p_text, font, &advance);
+        width += advance;
+    }
+    return width;
 }
 
 void ePaperPort::EPD_DrawStringCN(uint16_t Xstart, uint16_t Ystart, const char * pString, cFONT* font,uint16_t Color_Foreground, uint16_t Color_Background) {
+    PackedFont *packed = EPD_FindPackedFont(font);
+    if (packed != NULL) {
+        EPD_DrawStringPacked(Xstart, Ystart, pString, packed, Color_Foreground, Color_Background);
+        return;
+    }
     const char* p_text = pString;
-    int x = Xstart, y = Ystart;
-    int i, j,Num;
-    uint8_t FONT_BACKGROUND = 0xff;
+    int x = Xstart;
+    uint16_t advance;
     /* Send the string character by character on EPD */
     while (*p_text != 0) {
-        if(*p_text <= 0xE0) {  //ASCII < 126
-            for(Num = 0; Num < font->size; Num++) {
-                if(*p_text== font->table[Num].index[0]) {
-                    const char* ptr = &font->table[Num].matrix[0];
-                    for (j = 0; j < font->Height; j++) {
-                        for (i = 0; i < font->Width; i++) {
-                            if (FONT_BACKGROUND == Color_Background) { //this process is to speed up the scan
-                                if (*ptr & (0x80 >> (i % 8))) {
-                                    EPD_SetPixel(x + i, y + j, Color_Foreground);
-                                }
-                            } else {
-                                if (*ptr & (0x80 >> (i % 8))) {
-                                    EPD_SetPixel(x + i, y + j, Color_Foreground);
-                                } else {
-                                    EPD_SetPixel(x + i, y + j, Color_Background);
-                                }
-                            }
-                            if (i % 8 == 7) {
-                                ptr++;
-                            }
-                        }
-                        if (font->Width % 8 != 0) {
-                            ptr++;
-                        }
-                    }
-                    break;
-                }
-            }
-            /* Point on the next character */
-            p_text += 1;
-            /* Decrement the column position by 16 */
-            x += font->ASCII_Width;
-        } else {        //Chinese
-            for(Num = 0; Num < font->size; Num++) {
-                if((*p_text== font->table[Num].index[0]) && (*(p_text+1) == font->table[Num].index[1])  && (*(p_text+2) == font->table[Num].index[2])) {
-                    const char* ptr = &font->table[Num].matrix[0];
-
-                    for (j = 0; j < font->Height; j++) {
-                        for (i = 0; i < font->Width; i++) {
-                            if (FONT_BACKGROUND == Color_Background) { //this process is to speed up the scan
-                                if (*ptr & (0x80 >> (i % 8))) {
-                                    EPD_SetPixel(x + i, y + j, Color_Foreground);
-                                }
-                            } else {
-                                if (*ptr & (0x80 >> (i % 8))) {
-                                    EPD_SetPixel(x + i, y + j, Color_Foreground);
-                                } else {
-                                    EPD_SetPixel(x + i, y + j, Color_Background);
-                                }
-                            }
-                            if (i % 8 == 7) {
-                                ptr++;
-                            }
-                        }
-                        if (font->Width % 8 != 0) {
-                            ptr++;
-                        }
-                    }
-                    break;
-                }
-            }
-            /* Point on the next character */
-            p_text += 3;
-            /* Decrement the column position by 16 */
-            x += font->Width;
+        const char *matrix = EPD_NextGlyphCN(&p_text, font, &advance);
+        if (matrix != NULL) {
+            EPD_DrawGlyphCN(x, Ystart, matrix, font, Color_Foreground, Color_Background);
+        }
+        x += advance;
+    }
+}
+
+uint16_t ePaperPort::EPD_MeasureStringPacked(const char *pString, PackedFont *font) {
+    const char *p_text = pString;
+    uint16_t    width  = 0;
+    while (*p_text != 0) {
+        width += font->PackedFont_Advance(PackedFont::PackedFont_NextCodepoint(&p_text));
+    }
+    return width;
+}
+
+void ePaperPort::EPD_DrawStringPacked(uint16_t Xstart, uint16_t Ystart, const char *pString, PackedFont *font, uint16_t Color_Foreground, uint16_t Color_Background) {
+    const char *p_text = pString;
+    int         x      = Xstart;
+    uint8_t FONT_BACKGROUND = 0xff;
+    while (*p_text != 0) {
+        uint32_t          cp    = PackedFont::PackedFont_NextCodepoint(&p_text);
+        const EPDGlyph_t *glyph = font->PackedFont_GetGlyph(cp);
+        int advance = (glyph != NULL) ? glyph->advance : font->PackedFont_Advance(cp);
+        if (FONT_BACKGROUND != Color_Background) {
+            Canvas.Canvas_FillRect(x, Ystart, advance, font->PackedFont_LineHeight(), Color_Background);
+        }
+        if (glyph != NULL) {
+            EPD_DrawBitmap1(x + glyph->x_off, Ystart + glyph->y_off, glyph->bitmap, glyph->width, glyph->height, glyph->row_bytes, Color_Foreground);
         }
+        x += advance;
     }
 }
 
@@ -4,6 +4,13 @@
 #include <driver/spi_master.h>
 #include "fonts.h"
 #include "imgdecode_app.h"
+#include "epd_canvas.h"
+#include "epd_font.h"
+#include "sprite_atlas.h"
+
+#define EPD_WIDTH  800
+#define EPD_HEIGHT 480
+#define EPD_PACKED_FONT_MAX 4
 
 enum ColorSelection {
     ColorBlack = 0,    
@@ -14,30 +21,17 @@ enum ColorSelection {
     ColorGreen
 };
 
-/*Bitmap file header   14bit*/
-typedef struct BMP_FILE_HEADER {
-    uint16_t bType;                         //File identifier
-    uint32_t bSize;                         //The size of the file
-    uint16_t bReserved1;                    //Reserved value, must be set to 0
-    uint16_t bReserved2;                    //Reserved value, must be set to 0
-    uint32_t bOffset;                       //The offset from the beginning of the file header to the beginning of the image data bit
-} __attribute__((packed)) BMPFILEHEADER;  // 14bit
-
+/*一次显示过程的阶段, 供网页端显示进度*/
+enum EPDProgressStage {
+    EPDStageDecode = 0,   // 解码/抖动写显存, percent 为已写入的行
+    EPDStageSpi,          // 显存发送到屏幕
+    EPDStageRefresh,      // 屏幕刷新中, 等待BUSY
+    EPDStageDone          // BUSY释放, 刷新完成
+};
+typedef void (*EPDProgressCallback_t)(EPDProgressStage stage, int percent, void *ctx);
+typedef bool (*EPDCancelCheck_t)(void *ctx);
 
-/*Bitmap information header  40bit*/
-typedef struct BMP_INFO {
-    uint32_t biInfoSize;       //The size of the header
-    uint32_t biWidth;          //The width of the image
-    uint32_t biHeight;         //The height of the image
-    uint16_t biPlanes;         //The number of planes in the image
-    uint16_t biBitCount;       //The number of bits per pixel
-    uint32_t biCompression;    //Compression type
-    uint32_t bimpImageSize;    //The size of the image, in bytes
-    uint32_t biXPelsPerMeter;  //Horizontal resolution
-    uint32_t biYPelsPerMeter;  //Vertical resolution
-    uint32_t biClrUsed;        //The number of colors used
-    uint32_t biClrImportant;   //The number of important colors
-} __attribute__((packed)) BMPINFOHEADER;
+struct EPDBmpBlit;
 
 class ePaperPort {
   private:
@@ -45,7 +39,6 @@ class ePaperPort {
     uint32_t            i2c_data_pdMS_TICKS = 0;
     uint32_t            i2c_done_pdMS_TICKS = 0;
     const char         *TAG                 = "Display";
-    const char         *img_to_bmpName      = "/sdcard/06_user_foundation_img/sys_decode.bmp";
     ImgDecodeDither &dither_;
     int                 mosi_;
     int                 scl_;
@@ -59,13 +52,19 @@ class ePaperPort {
     uint16_t            scale_MaxHeight_;
     uint8_t            *DispBuffer = NULL;
     uint8_t            *RotationBuffer = NULL;
-    uint8_t            *BmpSrcBuffer = NULL;
+    ePaperCanvas<EPD_WIDTH, EPD_HEIGHT> Canvas;          // Landscape view of DispBuffer
+    ePaperCanvas<EPD_HEIGHT, EPD_WIDTH> PortraitCanvas;  // Same buffer, 480 wide, used with Rotation 3
     int                 DisplayLen;
-    uint16_t            src_width;
-    uint16_t            src_height;
     uint8_t Rotation = 0;                          //0:0 1:90 2:180 3:270
     uint8_t mirrx = 0;                             
     uint8_t mirry = 0;
+    cFONT      *PackedKey[EPD_PACKED_FONT_MAX]  = {};  // 替换这些固定字库的打包字库
+    PackedFont *PackedFonts[EPD_PACKED_FONT_MAX] = {};
+    EPDProgressCallback_t ProgressCb = NULL;
+    void               *ProgressCtx  = NULL;
+    int                 ProgressLast = -1;
+    EPDCancelCheck_t    CancelCb     = NULL;
+    void               *CancelCtx    = NULL;
 
     void    Set_ResetIOLevel(uint8_t level);
     void    Set_CSIOLevel(uint8_t level);
@@ -79,13 +78,26 @@ class ePaperPort {
     void    EPD_Sendbuffera(uint8_t *Data, int len);
     void    EPD_TurnOnDisplay(void);
     uint8_t EPD_ColorToePaperColor(uint8_t b,uint8_t g,uint8_t r);
-    uint8_t* EPD_ParseBMPImage(const char *path);
+    static void EPD_BmpRowRGB(int y, const uint8_t *row, void *ctx);
+    static void EPD_BmpRowIndex(int y, const uint8_t *row, void *ctx);
+    static void EPD_BmpRowInk(int y, const uint8_t *row, void *ctx);
+    static esp_err_t EPD_DitherHeader(int w, int h, void *ctx);
+    static void EPD_DitherRow(int y, const uint8_t *row, void *ctx);
+    void    EPD_BlitSetup(EPDBmpBlit *blit, int x, int y, int w, int h);
+    esp_err_t EPD_BmpBlit(const char *path, EPDBmpBlit *blit, int x, int y);
+    esp_err_t EPD_SDcardDitherIMG(const char *path, bool allow_scale);
+    const char *EPD_NextGlyphCN(const char **pText, cFONT *font, uint16_t *advance);
+    void    EPD_DrawGlyphCN(int x, int y, const char *matrix, cFONT *font, uint16_t Color_Foreground, uint16_t Color_Background);
+    void    EPD_DrawBitmap1(int x, int y, const uint8_t *bitmap, int w, int h, int row_bytes, uint16_t Color_Foreground);
+    PackedFont *EPD_FindPackedFont(cFONT *font);
     uint8_t EPD_GetPixel4(const uint8_t* buf, int width, int x, int y);
     void    EPD_SetPixel4(uint8_t* buf, int width, int x, int y, uint8_t px);
     void EPD_Rotate180_Fast(const uint8_t* src, uint8_t* dst, int width, int height);
     void EPD_Rotate90CCW_Fast(const uint8_t* src, uint8_t* dst, int width, int height);
     void EPD_Rotate90CW_Fast(const uint8_t* src, uint8_t* dst, int width, int height);
     void EPD_PixelRotate();
+    void EPD_ReportProgress(EPDProgressStage stage, int percent);
+    bool EPD_Cancelled();
 
   public:
     ePaperPort(ImgDecodeDither &dither,int mosi, int scl, int dc, int cs, int rst, int busy, uint16_t width, uint16_t height, uint16_t scale_MaxWidth, uint16_t scale_MaxHeight, spi_host_device_t spihost = SPI3_HOST);
@@ -98,9 +110,22 @@ class ePaperPort {
     void Set_Rotation(uint8_t rot); // 0:no 1:90 2:180 3:270
     void Set_Mirror(uint8_t mirr_x,uint8_t mirr_y);
     uint8_t* EPD_GetIMGBuffer();
+    ePaperCanvas<EPD_WIDTH, EPD_HEIGHT> &EPD_GetCanvas();
     void EPD_SetPixel(uint16_t x, uint16_t y, uint16_t color);
     void EPD_SDcardBmpShakingColor(const char *path,uint16_t x_start, uint16_t y_start);        /*只能用于经过抖动之后的 480x800/800x480 BMP图片显示*/
-    void EPD_SDcardIMGShakingColor(const char *path,uint16_t x_start, uint16_t y_start);        /*可以显示jpg,bmp,png格式图片 480x800/800x480*/
-    void EPD_SDcardScaleIMGShakingColor(const char *path,uint16_t x_start, uint16_t y_start);   /*可以显示jpg,bmp,png格式图片,带自动拉伸缩放的*/
+    esp_err_t EPD_SDcardBmpToSprite(const char *path, EPDSprite_t *sprite);                     /*同上的颜色转换,结果存入4bpp精灵(SPIRAM),用 heap_caps_free 释放*/
+    void EPD_DrawSprite(const EPDSprite_t *sprite, uint16_t x_start, uint16_t y_start);
+    esp_err_t EPD_SDcardIMGShakingColor(const char *path,uint16_t x_start, uint16_t y_start);   /*可以显示jpg,bmp,png,qoi格式图片 480x800/800x480, 其他尺寸放在左上角裁剪或补白, 解码失败时显存内容不可用*/
+    esp_err_t EPD_SDcardScaleIMGShakingColor(const char *path,uint16_t x_start, uint16_t y_start); /*可以显示jpg,bmp,png,qoi格式图片,带自动拉伸缩放的*/
+    esp_err_t EPD_JPGBufferShakingColor(const uint8_t *jpg, int len);                          /*内存中的 480x800/800x480 JPG,边解码边抖动写入显存*/
+    esp_err_t EPD_SaveFrameAsync(const char *path);                                            /*拷贝当前显存,在work_pool里写成.epd原生帧,上面两个显示函数可直接读取*/
+    void EPD_SaveFrameWait(void);                                                              /*等后台的帧都写完*/
+    esp_err_t EPD_SDcardLoadFrame(const char *path);                                           /*读取.epd帧到显存,文件不存在或格式不符时返回错误*/
 	void EPD_DrawStringCN(uint16_t Xstart, uint16_t Ystart, const char * pString, cFONT* font,uint16_t Color_Foreground, uint16_t Color_Background);
+    uint16_t EPD_MeasureStringCN(const char *pString, cFONT *font);                           /*字符串绘制宽度(像素),不绘制*/
+    void EPD_AttachPackedFont(cFONT *font, PackedFont *packed);                               /*之后用font绘制时改用packed, packed为NULL时恢复*/
+    void EPD_DrawStringPacked(uint16_t Xstart, uint16_t Ystart, const char *pString, PackedFont *font, uint16_t Color_Foreground, uint16_t Color_Background);
+    uint16_t EPD_MeasureStringPacked(const char *pString, PackedFont *font);
+    void EPD_SetProgressCallback(EPDProgressCallback_t cb, void *ctx);                         /*解码进度每5%回调一次, 之后是发送/刷新/完成; cb为NULL时关闭*/
+    void EPD_SetCancelCheck(EPDCancelCheck_t cb, void *ctx);                                   /*抖动期间每16行查询一次, 返回true后不再写显存(显存内容作废); cb为NULL时关闭*/
 };
\ No newline at end of file
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * 4bpp 帧缓存画布: 两个像素一个字节, 偶数x在高4位.
+ * 所有图元都先裁剪, 再按整字节(memset/memcpy)写入, 只有首尾半字节走读改写.
+ */
+template <uint16_t W, uint16_t H>
+class ePaperCanvas {
+    static_assert((W & 1) == 0, "canvas width must be even");
+
+  public:
+    static constexpr int Width  = W;
+    static constexpr int Height = H;
+    static constexpr int Stride = W / 2;
+
+    explicit ePaperCanvas(uint8_t *buffer = NULL) : buf_(buffer) {}
+
+    void     Canvas_Attach(uint8_t *buffer) { buf_ = buffer; }
+    uint8_t *Canvas_Buffer() { return buf_; }
+    uint8_t *Canvas_Row(int y) { return buf_ + y * Stride; }
+
+    void Canvas_Fill(uint8_t color) {
+        memset(buf_, Pack(color), Stride * H);
+    }
+
+    void Canvas_SetPixel(int x, int y, uint8_t color) {
+        if ((unsigned) x >= W || (unsigned) y >= H) {
+            return;
+        }
+        uint8_t *px = buf_ + y * Stride + (x >> 1);
+        *px         = (x & 1) ? ((*px & 0xF0) | (color & 0x0F)) : ((*px & 0x0F) | (color << 4));
+    }
+
+    uint8_t Canvas_GetPixel(int x, int y) {
+        if ((unsigned) x >= W || (unsigned) y >= H) {
+            return 0;
+        }
+        uint8_t px = buf_[y * Stride + (x >> 1)];
+        return (x & 1) ? (px & 0x0F) : (px >> 4);
+    }
+
+    void Canvas_HLine(int x, int y, int len, uint8_t color) {
+        Canvas_FillRect(x, y, len, 1, color);
+    }
+
+    void Canvas_VLine(int x, int y, int len, uint8_t color) {
+        if ((unsigned) x >= W || !ClipSpan(y, len, H)) {
+            return;
+        }
+        uint8_t *px    = buf_ + y * Stride + (x >> 1);
+        uint8_t  mask  = (x & 1) ? 0xF0 : 0x0F;
+        uint8_t  value = (x & 1) ? (color & 0x0F) : (color << 4);
+        for (int i = 0; i < len; i++, px += Stride) {
+            *px = (*px & mask) | value;
+        }
+    }
+
+    void Canvas_FillRect(int x, int y, int w, int h, uint8_t color) {
+        if (!ClipSpan(x, w, W) || !ClipSpan(y, h, H)) {
+            return;
+        }
+        if (x == 0 && w == W) { /*整行连续,一次写完*/
+            memset(buf_ + y * Stride, Pack(color), h * Stride);
+            return;
+        }
+        for (int j = 0; j < h; j++) {
+            SpanRow(buf_ + (y + j) * Stride, x, x + w, color);
+        }
+    }
+
+    void Canvas_Rect(int x, int y, int w, int h, uint8_t color) {
+        if (w <= 0 || h <= 0) {
+            return;
+        }
+        Canvas_HLine(x, y, w, color);
+        Canvas_HLine(x, y + h - 1, w, color);
+        Canvas_VLine(x, y + 1, h - 2, color);
+        Canvas_VLine(x + w - 1, y + 1, h - 2, color);
+    }
+
+    void Canvas_Line(int x0, int y0, int x1, int y1, uint8_t color) {
+        if (y0 == y1) {
+            Canvas_HLine((x0 < x1) ? x0 : x1, y0, ((x0 < x1) ? (x1 - x0) : (x0 - x1)) + 1, color);
+            return;
+        }
+        if (x0 == x1) {
+            Canvas_VLine(x0, (y0 < y1) ? y0 : y1, ((y0 < y1) ? (y1 - y0) : (y0 - y1)) + 1, color);
+            return;
+        }
+        int dx  = (x1 > x0) ? (x1 - x0) : (x0 - x1);
+        int dy  = (y1 > y0) ? (y0 - y1) : (y1 - y0);
+        int sx  = (x0 < x1) ? 1 : -1;
+        int sy  = (y0 < y1) ? 1 : -1;
+        int err = dx + dy;
+        while (1) {
+            Canvas_SetPixel(x0, y0, color);
+            if (x0 == x1 && y0 == y1) {
+                break;
+            }
+            int e2 = 2 * err;
+            if (e2 >= dy) {
+                err += dy;
+                x0 += sx;
+            }
+            if (e2 <= dx) {
+                err += dx;
+                y0 += sy;
+            }
+        }
+    }
+
+    /*src 为同格式的4bpp数据, src_stride 为每行字节数*/
+    void Canvas_BlitPacked(int x, int y, const uint8_t *src, int w, int h, int src_stride) {
+        int sx = 0;
+        int sy = 0;
+        if (x < 0) {
+            sx = -x;
+        }
+        if (y < 0) {
+            sy = -y;
+        }
+        if (!ClipSpan(x, w, W) || !ClipSpan(y, h, H)) {
+            return;
+        }
+        for (int j = 0; j < h; j++) {
+            BlitRow(buf_ + (y + j) * Stride, x, src + (sy + j) * src_stride, sx, w);
+        }
+    }
+
+    void Canvas_BlitInkRow(int x, int y, const uint8_t *src, int w) {
+        Canvas_BlitPacked(x, y, src, w, 1, (w + 1) >> 1);
+    }
+
+  private:
+    uint8_t *buf_;
+
+    static uint8_t Pack(uint8_t color) {
+        return (color << 4) | (color & 0x0F);
+    }
+
+    /*裁剪 [pos, pos+len) 到 [0, limit), 完全在外返回false*/
+    static bool ClipSpan(int &pos, int &len, int limit) {
+        if (pos < 0) {
+            len += pos;
+            pos = 0;
+        }
+        if (pos + len > limit) {
+            len = limit - pos;
+        }
+        return len > 0;
+    }
+
+    static void SpanRow(uint8_t *row, int x0, int x1, uint8_t color) {
+        if (x0 & 1) {
+            row[x0 >> 1] = (row[x0 >> 1] & 0xF0) | (color & 0x0F);
+            x0++;
+        }
+        int bytes = (x1 - x0) >> 1;
+        if (bytes > 0) {
+            memset(row + (x0 >> 1), Pack(color), bytes);
+            x0 += bytes << 1;
+        }
+        if (x0 < x1) {
+            row[x0 >> 1] = (row[x0 >> 1] & 0x0F) | (color << 4);
+        }
+    }
+
+    static void BlitRow(uint8_t *dst, int dx, const uint8_t *src, int sx, int n) {
+        if (n <= 0) {
+            return;
+        }
+        if (dx & 1) {   // 先补齐目标的奇数半字节
+            uint8_t c     = (sx & 1) ? (src[sx >> 1] & 0x0F) : (src[sx >> 1] >> 4);
+            dst[dx >> 1]  = (dst[dx >> 1] & 0xF0) | c;
+            dx++;
+            sx++;
+            n--;
+        }
+        int      bytes = n >> 1;
+        uint8_t *d     = dst + (dx >> 1);
+        if ((sx & 1) == 0) { /*半字节对齐,整字节拷贝*/
+            memcpy(d, src + (sx >> 1), bytes);
+        } else {
+            const uint8_t *s = src + (sx >> 1);
+            for (int i = 0; i < bytes; i++, s++) {
+                d[i] = (uint8_t) (s[0] << 4) | (s[1] >> 4);
+            }
+        }
+        if (n & 1) {
+            int     last = sx + n - 1;
+            uint8_t c    = (last & 1) ? (src[last >> 1] & 0x0F) : (src[last >> 1] >> 4);
+            d[bytes]     = (d[bytes] & 0x0F) | (c << 4);
+        }
+    }
+};
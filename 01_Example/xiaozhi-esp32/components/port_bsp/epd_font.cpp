@@ -0,0 +1,180 @@
+#include <string.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include "epd_font.h"
+
+#define EPD_FONT_CODE(e)    ((e)->code & 0x00FFFFFF)
+#define EPD_FONT_ADVANCE(e) ((e)->code >> 24)
+
+PackedFont::PackedFont() {
+    memset(&header_, 0, sizeof(header_));
+    memset(slots_, 0, sizeof(slots_));
+}
+
+PackedFont::~PackedFont() {
+    PackedFont_Close();
+}
+
+esp_err_t PackedFont::PackedFont_Open(const void *data, size_t size) {
+    PackedFont_Close();
+    if (data == NULL || size < sizeof(EPDFontHeader_t)) {
+        ESP_LOGE(TAG, "Not a packed font");
+        return ESP_ERR_INVALID_ARG;
+    }
+    EPDFontHeader_t header;
+    memcpy(&header, data, sizeof(header));      /*assets里的偏移不保证4字节对齐*/
+    if (memcmp(header.magic, EPD_FONT_MAGIC, 4) != 0) {
+        ESP_LOGE(TAG, "Not a packed font");
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (header.bitmap_offset < sizeof(EPDFontHeader_t) || header.bitmap_offset > size || header.glyph_count > (header.bitmap_offset - sizeof(EPDFontHeader_t)) / sizeof(EPDFontEntry_t)) {
+        ESP_LOGE(TAG, "Packed font is truncated: %u glyphs, %u bytes", (unsigned) header.glyph_count, (unsigned) size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    slot_bytes_ = ((header.max_width + 7) / 8) * header.max_height;
+    if (slot_bytes_ == 0) {
+        slot_bytes_ = 1;
+    }
+    pool_ = (uint8_t *) heap_caps_malloc(slot_bytes_ * EPD_FONT_CACHE_SLOTS, MALLOC_CAP_INTERNAL);
+    if (pool_ == NULL) {
+        pool_ = (uint8_t *) heap_caps_malloc(slot_bytes_ * EPD_FONT_CACHE_SLOTS, MALLOC_CAP_SPIRAM);
+    }
+    if (pool_ == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate glyph cache");
+        return ESP_ERR_NO_MEM;
+    }
+    header_     = header;
+    valid_      = true;
+    entries_    = (const uint8_t *) data + sizeof(EPDFontHeader_t);
+    bitmaps_    = (const uint8_t *) data + header.bitmap_offset;
+    bitmap_len_ = size - header.bitmap_offset;
+    memset(slots_, 0, sizeof(slots_));
+    for (int i = 0; i < EPD_FONT_CACHE_SLOTS; i++) {
+        slots_[i].codepoint = 0xFFFFFFFF;
+    }
+    tick_ = 0;
+    ESP_LOGI(TAG, "Packed font: %u glyphs, cell height %d", (unsigned) header.glyph_count, header.line_height);
+    return ESP_OK;
+}
+
+void PackedFont::PackedFont_Close() {
+    if (pool_ != NULL) {
+        heap_caps_free(pool_);
+        pool_ = NULL;
+    }
+    valid_   = false;
+    entries_ = NULL;
+    bitmaps_ = NULL;
+}
+
+void PackedFont::PackedFont_Entry(int index, EPDFontEntry_t *entry) {
+    memcpy(entry, entries_ + index * sizeof(EPDFontEntry_t), sizeof(EPDFontEntry_t));
+}
+
+bool PackedFont::PackedFont_Find(uint32_t codepoint, EPDFontEntry_t *entry) {
+    int lo = 0;
+    int hi = header_.glyph_count;
+    while (lo < hi) {
+        int mid = (lo + hi) >> 1;
+        PackedFont_Entry(mid, entry);
+        if (EPD_FONT_CODE(entry) < codepoint) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < (int) header_.glyph_count) {
+        PackedFont_Entry(lo, entry);
+        return EPD_FONT_CODE(entry) == codepoint;
+    }
+    return false;
+}
+
+void PackedFont::PackedFont_Unpack(const EPDFontEntry_t *entry, uint8_t *dst, int row_bytes) {
+    const uint8_t *src = bitmaps_ + entry->offset;
+    uint32_t       bit = 0;
+    memset(dst, 0, row_bytes * entry->height);
+    for (int y = 0; y < entry->height; y++, dst += row_bytes) {
+        for (int x = 0; x < entry->width; x++, bit++) {
+            if (src[bit >> 3] & (0x80 >> (bit & 7))) {
+                dst[x >> 3] |= 0x80 >> (x & 7);
+            }
+        }
+    }
+}
+
+const EPDGlyph_t *PackedFont::PackedFont_GetGlyph(uint32_t codepoint) {
+    if (!valid_) {
+        return NULL;
+    }
+    CacheSlot_t *victim = &slots_[0];
+    tick_++;
+    for (int i = 0; i < EPD_FONT_CACHE_SLOTS; i++) {
+        if (slots_[i].codepoint == codepoint) {
+            slots_[i].age = tick_;
+            return &slots_[i].glyph;
+        }
+        if (slots_[i].age < victim->age) {
+            victim = &slots_[i];
+        }
+    }
+    EPDFontEntry_t found;
+    if (!PackedFont_Find(codepoint, &found)) {
+        return NULL;
+    }
+    const EPDFontEntry_t *entry = &found;
+    int row_bytes = (entry->width + 7) / 8;
+    if (entry->width > header_.max_width || entry->height > header_.max_height ||
+        entry->offset + (entry->width * entry->height + 7) / 8 > bitmap_len_) {
+        ESP_LOGE(TAG, "Corrupt glyph U+%04X", (unsigned) codepoint);
+        return NULL;
+    }
+    uint8_t *bitmap = pool_ + (victim - slots_) * slot_bytes_;
+    PackedFont_Unpack(entry, bitmap, row_bytes);
+    victim->codepoint       = codepoint;
+    victim->age             = tick_;
+    victim->glyph.width     = entry->width;
+    victim->glyph.height    = entry->height;
+    victim->glyph.x_off     = entry->x_off;
+    victim->glyph.y_off     = entry->y_off;
+    victim->glyph.advance   = EPD_FONT_ADVANCE(entry);
+    victim->glyph.row_bytes = row_bytes;
+    victim->glyph.bitmap    = bitmap;
+    return &victim->glyph;
+}
+
+uint8_t PackedFont::PackedFont_Advance(uint32_t codepoint) {
+    EPDFontEntry_t entry;
+    if (PackedFont_Find(codepoint, &entry)) {
+        return EPD_FONT_ADVANCE(&entry);
+    }
+    return (codepoint < 0x80) ? header_.narrow_advance : header_.wide_advance;
+}
+
+uint32_t PackedFont::PackedFont_NextCodepoint(const char **pText) {
+    const uint8_t *s   = (const uint8_t *) *pText;
+    uint32_t       cp  = s[0];
+    int            len = 1;
+    if ((s[0] & 0xE0) == 0xC0) {
+        len = 2;
+        cp  = s[0] & 0x1F;
+    } else if ((s[0] & 0xF0) == 0xE0) {
+        len = 3;
+        cp  = s[0] & 0x0F;
+    } else if ((s[0] & 0xF8) == 0xF0) {
+        len = 4;
+        cp  = s[0] & 0x07;
+    } else if (s[0] & 0x80) {
+        *pText += 1;
+        return 0xFFFD;
+    }
+    for (int i = 1; i < len; i++) {
+        if ((s[i] & 0xC0) != 0x80) {   // 截断或非法的后续字节
+            *pText += i;
+            return 0xFFFD;
+        }
+        cp = (cp << 6) | (s[i] & 0x3F);
+    }
+    *pText += len;
+    return cp;
+}
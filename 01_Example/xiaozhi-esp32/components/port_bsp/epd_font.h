@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <esp_err.h>
+
+/*
+ * 打包字库(EPF1), 由 scripts/epd_font_gen.py 从TTF生成, 放在assets分区里直接mmap使用.
+ * assets里的文件首尾相接不补齐, 文件头和字模表都可能不对齐, 一律memcpy出来再读.
+ *
+ * 小端, 布局:
+ *   EPDFontHeader_t
+ *   EPDFontEntry_t[glyph_count]   按codepoint升序
+ *   bitmap区                       每个字模按包围盒宽x高紧凑排列的1bit位流, 高位在前, 行间不补齐
+ */
+#define EPD_FONT_MAGIC       "EPF1"
+#define EPD_FONT_CACHE_SLOTS 32
+
+typedef struct {
+    char     magic[4];
+    uint32_t glyph_count;
+    uint8_t  line_height;   // 字符单元高度, 背景色按此高度填充
+    uint8_t  ascent;        // 基线到单元顶部的距离
+    uint8_t  max_width;     // 所有字模包围盒的最大宽高
+    uint8_t  max_height;
+    uint8_t  narrow_advance; // 缺字时的步进: ASCII / 其他字符
+    uint8_t  wide_advance;
+    uint16_t reserved;
+    uint32_t bitmap_offset; // bitmap区相对文件头的偏移
+} EPDFontHeader_t;
+
+typedef struct {
+    uint32_t code;          // bit0-23: codepoint, bit24-31: advance
+    uint32_t offset;        // 相对bitmap区的偏移
+    uint8_t  width;
+    uint8_t  height;
+    int8_t   x_off;         // 包围盒相对单元左上角的偏移
+    int8_t   y_off;
+} EPDFontEntry_t;
+
+/*解码后的字模, bitmap按行对齐到字节, 与CH_CN的点阵格式相同*/
+typedef struct {
+    uint8_t        width;
+    uint8_t        height;
+    int8_t         x_off;
+    int8_t         y_off;
+    uint8_t        advance;
+    uint8_t        row_bytes;
+    const uint8_t *bitmap;
+} EPDGlyph_t;
+
+class PackedFont {
+  private:
+    typedef struct {
+        uint32_t   codepoint;
+        uint32_t   age;
+        EPDGlyph_t glyph;
+    } CacheSlot_t;
+
+    const char            *TAG     = "PackedFont";
+    EPDFontHeader_t        header_;         // 从blob拷出的文件头
+    bool                   valid_   = false;
+    const uint8_t         *entries_ = NULL; // EPDFontEntry_t[], 可能不对齐
+    const uint8_t         *bitmaps_ = NULL;
+    size_t                 bitmap_len_ = 0;
+    CacheSlot_t            slots_[EPD_FONT_CACHE_SLOTS];
+    uint8_t               *pool_      = NULL; // 每个slot固定 slot_bytes_ 字节
+    int                    slot_bytes_ = 0;
+    uint32_t               tick_       = 0;
+
+    bool                  PackedFont_Find(uint32_t codepoint, EPDFontEntry_t *entry);
+    void                  PackedFont_Entry(int index, EPDFontEntry_t *entry);
+    void                  PackedFont_Unpack(const EPDFontEntry_t *entry, uint8_t *dst, int row_bytes);
+
+  public:
+    PackedFont();
+    ~PackedFont();
+
+    esp_err_t PackedFont_Open(const void *data, size_t size);
+    void      PackedFont_Close();
+    bool      PackedFont_IsValid() { return valid_; }
+    uint8_t   PackedFont_LineHeight() { return header_.line_height; }
+    /*没有这个字返回NULL; 返回的指针在下一次GetGlyph前有效*/
+    const EPDGlyph_t *PackedFont_GetGlyph(uint32_t codepoint);
+    uint8_t           PackedFont_Advance(uint32_t codepoint);
+
+    /*解码一个UTF-8字符并前移指针, 非法序列返回0xFFFD*/
+    static uint32_t PackedFont_NextCodepoint(const char **pText);
+};
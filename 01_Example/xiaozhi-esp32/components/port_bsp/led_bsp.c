@@ -1,12 +1,82 @@
 #include <driver/gpio.h>
 #include <stdio.h>
+#include <freertos/semphr.h>
+#include <esp_timer.h>
 #include "led_bsp.h"
-#include "button_bsp.h"
 
-EventGroupHandle_t Led_Groups;
+#define LED_COUNT 2
+
+static const uint16_t led_busy_steps[]   = {100, 100};
+static const uint16_t led_error_steps[]  = {400, 400};
+static const uint16_t led_blink_steps[]  = {200, 200};
+static const uint16_t led_slow_steps[]   = {1000, 1000};
+static const uint16_t led_medium_steps[] = {500, 500};
+
+const LedPattern_t LedPatternBusy   = {led_busy_steps, 2, 0, LED_OFF};
+const LedPattern_t LedPatternError  = {led_error_steps, 2, 5, LED_OFF};
+const LedPattern_t LedPatternBlink1 = {led_blink_steps, 1, 1, LED_OFF};
+const LedPattern_t LedPatternBlink2 = {led_blink_steps, 2, 2, LED_OFF};
+const LedPattern_t LedPatternBlink3 = {led_blink_steps, 2, 3, LED_OFF};
+const LedPattern_t LedPatternSlow   = {led_slow_steps, 2, 0, LED_OFF};
+const LedPattern_t LedPatternMedium = {led_medium_steps, 2, 0, LED_OFF};
+
+typedef struct {
+    uint8_t             pin;
+    const LedPattern_t *pattern;
+    uint8_t             index;
+    uint8_t             left;
+    int64_t             deadline;   // 下一步的时刻(us)
+} LedState_t;
+
+static LedState_t        led_state[LED_COUNT] = {{LED_PIN_Red}, {LED_PIN_Green}};
+static esp_timer_handle_t led_timer = NULL;
+static SemaphoreHandle_t  led_lock  = NULL;
+
+static LedState_t *led_find(uint8_t led) {
+    for (int i = 0; i < LED_COUNT; i++) {
+        if (led_state[i].pin == led) {
+            return &led_state[i];
+        }
+    }
+    return NULL;
+}
+
+/*走完到期的步骤, 再按最近的截止时间重新装定时器; 须持有 led_lock*/
+static void led_run(void) {
+    int64_t now  = esp_timer_get_time();
+    int64_t next = INT64_MAX;
+    for (int i = 0; i < LED_COUNT; i++) {
+        LedState_t *s = &led_state[i];
+        while (s->pattern != NULL && s->deadline <= now) {
+            const LedPattern_t *p = s->pattern;
+            if (s->index == p->len) {
+                s->index = 0;
+                if (p->repeat && --s->left == 0) {
+                    gpio_set_level(s->pin, p->end_level);
+                    s->pattern = NULL;
+                    break;
+                }
+            }
+            gpio_set_level(s->pin, (s->index & 1) ? LED_OFF : LED_ON);
+            s->deadline += (int64_t) p->steps[s->index++] * 1000;
+        }
+        if (s->pattern != NULL && s->deadline < next) {
+            next = s->deadline;
+        }
+    }
+    esp_timer_stop(led_timer);
+    if (next != INT64_MAX) {
+        esp_timer_start_once(led_timer, (next > now) ? (next - now) : 0);
+    }
+}
+
+static void led_timer_callback(void *arg) {
+    xSemaphoreTake(led_lock, portMAX_DELAY);
+    led_run();
+    xSemaphoreGive(led_lock);
+}
 
 void Led_init(void) {
-    Led_Groups              = xEventGroupCreate();
     gpio_config_t gpio_conf = {};
     gpio_conf.intr_type     = GPIO_INTR_DISABLE;
     gpio_conf.mode          = GPIO_MODE_OUTPUT;
@@ -17,99 +87,65 @@ void Led_init(void) {
     ESP_ERROR_CHECK_WITHOUT_ABORT(gpio_config(&gpio_conf));
     Led_SetLevel(LED_PIN_Red, LED_OFF);
     Led_SetLevel(LED_PIN_Green, LED_OFF);
+
+    led_lock = xSemaphoreCreateMutex();
+    const esp_timer_create_args_t timer_args = {
+        .callback        = led_timer_callback,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name            = "led",
+        .skip_unhandled_events = true,
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &led_timer));
 }
 
 void Led_SetLevel(uint8_t led, uint8_t mode) {
     gpio_set_level(led, mode);
 }
 
-void Led_RegLoopTask(void *arg) {
-    for (;;) {
-        EventBits_t even = xEventGroupWaitBits(Led_Groups, (0x01UL<<0) | (0x01UL<<1) | (0x01UL<<2), pdFALSE, pdFALSE, 1000);
-        if (even & 0x01) //慢闪
-        {
-            Led_SetLevel(LED_PIN_Red, 0);
-            vTaskDelay(pdMS_TO_TICKS(1000));
-            Led_SetLevel(LED_PIN_Red, 1);
-            vTaskDelay(pdMS_TO_TICKS(1000));
-        } else if ((even>>1) & 0x01) //中闪
-        {
-            Led_SetLevel(LED_PIN_Red, 0);
-            vTaskDelay(pdMS_TO_TICKS(500));
-            Led_SetLevel(LED_PIN_Red, 1);
-            vTaskDelay(pdMS_TO_TICKS(500));
-        } else if ((even>>2) & 0x01) //快闪
-        {
-            Led_SetLevel(LED_PIN_Red, 0);
-            vTaskDelay(pdMS_TO_TICKS(100));
-            Led_SetLevel(LED_PIN_Red, 1);
-            vTaskDelay(pdMS_TO_TICKS(100));
-        } else {
-            Led_SetLevel(LED_PIN_Red, 0);
-        }
+void Led_Play(uint8_t led, const LedPattern_t *pattern) {
+    LedState_t *s = led_find(led);
+    if (s == NULL || led_lock == NULL) {
+        return;
     }
+    xSemaphoreTake(led_lock, portMAX_DELAY);
+    s->pattern  = pattern;
+    s->index    = 0;
+    s->left     = pattern->repeat;
+    s->deadline = esp_timer_get_time();
+    led_run();
+    xSemaphoreGive(led_lock);
 }
 
-
-void Led_GreenLoopTask(void *arg) {
-    for (;;) {
-        EventBits_t even = xEventGroupWaitBits(Led_Groups, (0x01UL<<3) | (0x01UL<<4) | (0x01UL<<5), pdFALSE, pdFALSE, 1000);
-        if ((even>>3) & 0x01) //慢闪
-        {
-            Led_SetLevel(LED_PIN_Green, 0);
-            vTaskDelay(pdMS_TO_TICKS(1000));
-            Led_SetLevel(LED_PIN_Green, 1);
-            vTaskDelay(pdMS_TO_TICKS(1000));
-        } else if ((even>>4) & 0x01) //中闪
-        {
-            Led_SetLevel(LED_PIN_Green, 0);
-            vTaskDelay(pdMS_TO_TICKS(500));
-            Led_SetLevel(LED_PIN_Green, 1);
-            vTaskDelay(pdMS_TO_TICKS(500));
-        } else if ((even>>5) & 0x01) //快闪
-        {
-            Led_SetLevel(LED_PIN_Green, 0);
-            vTaskDelay(pdMS_TO_TICKS(100));
-            Led_SetLevel(LED_PIN_Green, 1);
-            vTaskDelay(pdMS_TO_TICKS(100));
-        } else {
-            Led_SetLevel(LED_PIN_Green, 1);
-        }
+void Led_Stop(uint8_t led, uint8_t level) {
+    LedState_t *s = led_find(led);
+    if (s == NULL || led_lock == NULL) {
+        return;
     }
+    xSemaphoreTake(led_lock, portMAX_DELAY);
+    s->pattern = NULL;
+    gpio_set_level(led, level);
+    led_run();
+    xSemaphoreGive(led_lock);
 }
 
 void Led_SetFlicker(uint8_t led, uint8_t mode) {
-    if (led == LED_PIN_Green) {
-        xEventGroupClearBits(Led_Groups, (0x01UL<<3) | (0x01UL<<4) | (0x01UL<<5));
-        switch (mode) {
-        case 1:
-            xEventGroupSetBits(Led_Groups, (0x01UL<<5));
-            break;
-        case 2:
-            xEventGroupSetBits(Led_Groups, (0x01UL<<4));
-            break;
-        case 3:
-            xEventGroupSetBits(Led_Groups, (0x01UL<<3));
-            break;
-        default:
-            break;
-        }
-    } else if (led == LED_PIN_Red) {
-        xEventGroupClearBits(Led_Groups, (0x01UL<<0) | (0x01UL<<1) | (0x01UL<<2));
-        switch (mode) {
-        case 1:
-            xEventGroupSetBits(Led_Groups, (0x01UL<<2)); //快
-            break;
-        case 2:
-            xEventGroupSetBits(Led_Groups, (0x01UL<<1));
-            break;
-        case 3:
-            xEventGroupSetBits(Led_Groups, (0x01UL<<0));
-            break;
-        default:
-            break;
-        }
-    } else {
-        xEventGroupClearBits(Led_Groups, (0x01UL<<0) | (0x01UL<<1) | (0x01UL<<2) | (0x01UL<<3) | (0x01UL<<4) | (0x01UL<<5));
+    if (led != LED_PIN_Green && led != LED_PIN_Red) {
+        Led_Stop(LED_PIN_Red, LED_OFF);
+        Led_Stop(LED_PIN_Green, LED_OFF);
+        return;
+    }
+    switch (mode) {
+    case 1:
+        Led_Play(led, &LedPatternBusy);
+        break;
+    case 2:
+        Led_Play(led, &LedPatternMedium);
+        break;
+    case 3:
+        Led_Play(led, &LedPatternSlow);
+        break;
+    default:
+        Led_Stop(led, LED_OFF);
+        break;
     }
 }
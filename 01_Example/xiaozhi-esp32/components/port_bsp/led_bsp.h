@@ -1,7 +1,7 @@
 #ifndef LED_BSP_H
 #define LED_BSP_H
 
-#include <freertos/FreeRTOS.h> 
+#include <freertos/FreeRTOS.h>
 
 
 #define LED_PIN_Red   GPIO_NUM_45
@@ -9,7 +9,25 @@
 #define LED_ON  0
 #define LED_OFF 1
 
-extern EventGroupHandle_t Led_Groups;
+/*
+ * 闪灯图案: steps 为交替的亮/灭时长(ms), 从亮开始.
+ * 整张表播放 repeat 次后停在 end_level, repeat 为0时一直循环到 Led_Stop.
+ * 两个灯共用一个 esp_timer, 没有图案在播时定时器不运行.
+ */
+typedef struct {
+    const uint16_t *steps;
+    uint8_t         len;
+    uint8_t         repeat;
+    uint8_t         end_level;
+} LedPattern_t;
+
+extern const LedPattern_t LedPatternBusy;       // 100ms快闪, 忙碌中
+extern const LedPattern_t LedPatternError;      // 400ms闪5次后熄灭
+extern const LedPattern_t LedPatternBlink1;     // 200ms闪1次
+extern const LedPattern_t LedPatternBlink2;
+extern const LedPattern_t LedPatternBlink3;
+extern const LedPattern_t LedPatternSlow;       // 1s慢闪
+extern const LedPattern_t LedPatternMedium;     // 500ms中闪
 
 #ifdef __cplusplus
 extern "C" {
@@ -18,14 +36,13 @@ extern "C" {
 
 void Led_init(void);
 void Led_SetLevel(uint8_t led,uint8_t mode);
-void Led_RegLoopTask(void *arg);
-void Led_GreenLoopTask(void *arg);
-void Led_SetFlicker(uint8_t led, uint8_t mode);
+void Led_Play(uint8_t led, const LedPattern_t *pattern);   // 替换该灯当前的图案
+void Led_Stop(uint8_t led, uint8_t level);                 // 停止图案并保持在 level
+void Led_SetFlicker(uint8_t led, uint8_t mode);            // 1快 2中 3慢, 其他值熄灭; led 不是两个灯之一时全部熄灭
 
 
 #ifdef __cplusplus
 }
 #endif
 
-#endif 
-
+#endif
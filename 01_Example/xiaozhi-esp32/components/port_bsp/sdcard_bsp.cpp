@@ -171,36 +171,82 @@ int CustomSDPort::SDPort_GetScanListValue(void) {
     return Quantity;
 }
 
+static bool sdport_is_image(const char *name) {
+    if(strstr(name,"sys_decode.bmp")) {   //这个文件是jpg或者png转码成bmp的,不需要加入列表
+        return false;
+    }
+    return strstr(name, ".bmp") || strstr(name, ".jpg") || strstr(name, ".png") || strstr(name, ".qoi") \
+        || strstr(name, ".BMP") || strstr(name, ".JPG") || strstr(name, ".PNG") || strstr(name, ".QOI");
+}
+
+bool CustomSDPort::SDPort_ScanListContains(const char *path) {
+    for (list_node_t *node = ScanListHandle->head; node != NULL; node = node->next) {
+        if (!strcmp(((CustomSDPortNode_t *) node->val)->sdcard_name, path)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void CustomSDPort::SDPort_ScanListPush(const char *path, const char *name) {
+    uint16_t       Namestrlen   = strlen(path) + strlen(name) + 1 + 1; 
+    if (Namestrlen >= 80) {
+        ESP_LOGE(TAG, "scan file fill _strlen:%d", Namestrlen);
+        return;
+    }
+    CustomSDPortNode_t *node_data = (CustomSDPortNode_t *) LIST_MALLOC(sizeof(CustomSDPortNode_t));
+    assert(node_data);
+    snprintf(node_data->sdcard_name, sizeof(node_data->sdcard_name), "%s/%s", path, name); 
+    if (SDPort_ScanListContains(node_data->sdcard_name)) {
+        LIST_FREE(node_data);
+        return;
+    }
+    list_rpush(ScanListHandle, list_node_new(node_data)); 
+    ESP_LOGW("Scan_Dir","DirDoc:%s,size:%d",node_data->sdcard_name,strlen(node_data->sdcard_name));
+    ImgValue++;
+}
+
+void CustomSDPort::SDPort_ScanListClear(void) {
+    list_node_t *node;
+    while ((node = list_lpop(ScanListHandle)) != NULL) {
+        LIST_FREE(node->val);
+        LIST_FREE(node);
+    }
+    CurrentlyNode = NULL;
+    ImgValue      = 0;
+}
+
 void CustomSDPort::SDPort_ScanListDir(const char *path) {
     struct dirent *entry;
     DIR           *dir = opendir(path);
+    char           line[80];
 
     if (dir == NULL) {
         ESP_LOGE(TAG, "Failed to open directory: %s", path);
         return;
     }
 
+    /*目录下有 order.txt 时(网页端排序后生成), 先按里面的顺序加入, 其余的排在后面*/
+    snprintf(line, sizeof(line), "%s/" SDPORT_ORDER_FILE, path);
+    FILE *fp = fopen(line, "r");
+    if (fp != NULL) {
+        struct stat st;
+        char        full[96];
+        while (fgets(line, sizeof(line), fp) != NULL) {
+            line[strcspn(line, "\r\n")] = 0;
+            snprintf(full, sizeof(full), "%s/%s", path, line);
+            if (line[0] && sdport_is_image(line) && stat(full, &st) == 0) {
+                SDPort_ScanListPush(path, line);
+            }
+        }
+        fclose(fp);
+    }
+
     while ((entry = readdir(dir)) != NULL) {
         if (entry->d_type == DT_DIR) { 
             ESP_LOGI(TAG, "Directory: %s", entry->d_name);
-        } else {
-            if(strstr(entry->d_name,"sys_decode.bmp")) {   //这个文件是jpg或者png转码成bmp的,不需要加入列表
-                continue;
-            }
-            if (strstr(entry->d_name, ".bmp") || strstr(entry->d_name, ".jpg") || strstr(entry->d_name, ".png") \
-                || strstr(entry->d_name, ".BMP") || strstr(entry->d_name, ".JPG") || strstr(entry->d_name, ".PNG")) {
-                uint16_t       Namestrlen   = strlen(path) + strlen(entry->d_name) + 1 + 1; 
-                if (Namestrlen >= 80) {
-                    ESP_LOGE(TAG, "scan file fill _strlen:%d", Namestrlen);
-                    continue;
-                }
-                CustomSDPortNode_t *node_data = (CustomSDPortNode_t *) LIST_MALLOC(sizeof(CustomSDPortNode_t));
-                assert(node_data);
-                snprintf(node_data->sdcard_name, sizeof(node_data->sdcard_name), "%s/%s", path, entry->d_name); 
-                list_rpush(ScanListHandle, list_node_new(node_data)); 
-                ESP_LOGW("Scan_Dir","DirDoc:%s,size:%d",node_data->sdcard_name,strlen(node_data->sdcard_name));
-                ImgValue++;
-            }                                     
+        } else if (sdport_is_image(entry->d_name)) {
+            SDPort_ScanListPush(path, entry->d_name);
         }
     }
     closedir(dir);
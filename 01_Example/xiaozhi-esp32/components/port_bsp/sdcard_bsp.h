@@ -5,6 +5,8 @@
 #include <driver/sdmmc_host.h>
 #include "list.h"
 
+#define SDPORT_ORDER_FILE "order.txt"   // 图片目录下的播放顺序, 每行一个文件名
+
 
 typedef struct
 {
@@ -22,6 +24,9 @@ private:
 
     list_node_t *CurrentlyNode = NULL; 
     uint16_t ImgValue = 0;
+
+    bool SDPort_ScanListContains(const char *path);
+    void SDPort_ScanListPush(const char *path, const char *name);
 public:
     CustomSDPort(const char *SdName,int clk = 39,int cmd = 41,int d0 = 40,int d1 = 1,int d2 = 2,int d3 = 38,int width = 4);
     ~CustomSDPort();
@@ -32,6 +37,7 @@ public:
     int SDPort_WriteOffset(const char *path, const void *data, size_t len, bool append);
     sdmmc_card_t* SDPort_GetSdMMCHost();
     void SDPort_ScanListDir(const char *path);
+    void SDPort_ScanListClear(void);            // 切换模式前清空扫描结果
     list_t* SDPort_GetListHost();
     int SDPort_GetSdcardInitOK();
     int SDPort_GetScanListValue(); 
@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <string.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include "sprite_atlas.h"
+
+SpriteAtlas::SpriteAtlas() {
+    memset(items_, 0, sizeof(items_));
+}
+
+SpriteAtlas::~SpriteAtlas() {
+    SpriteAtlas_Clear();
+}
+
+void SpriteAtlas::SpriteAtlas_Clear() {
+    for (int i = 0; i < count_; i++) {
+        if (items_[i].owned && items_[i].sprite.data != NULL) {
+            heap_caps_free(items_[i].sprite.data);
+        }
+    }
+    memset(items_, 0, sizeof(items_));
+    count_ = 0;
+    if (blob_ != NULL) {
+        heap_caps_free(blob_);
+        blob_ = NULL;
+    }
+}
+
+esp_err_t SpriteAtlas::SpriteAtlas_Load(const char *path) {
+    SpriteAtlas_Clear();
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (size < (long) sizeof(EPDAtlasHeader_t)) {
+        fclose(fp);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    blob_ = (uint8_t *) heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    if (blob_ == NULL) {
+        fclose(fp);
+        return ESP_ERR_NO_MEM;
+    }
+    setvbuf(fp, NULL, _IONBF, 0);   /*一次读完, 不经过stdio缓冲*/
+    size_t len = fread(blob_, 1, size, fp);
+    fclose(fp);
+
+    const EPDAtlasHeader_t *header = (const EPDAtlasHeader_t *) blob_;
+    if (len != (size_t) size || memcmp(header->magic, EPD_ATLAS_MAGIC, 4) != 0 || header->count > EPD_ATLAS_MAX ||
+        sizeof(EPDAtlasHeader_t) + header->count * sizeof(EPDAtlasEntry_t) > (size_t) size) {
+        ESP_LOGE(TAG, "Invalid atlas: %s", path);
+        SpriteAtlas_Clear();
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    const EPDAtlasEntry_t *entry = (const EPDAtlasEntry_t *) (blob_ + sizeof(EPDAtlasHeader_t));
+    for (uint32_t i = 0; i < header->count; i++, entry++) {
+        uint32_t bytes = ((entry->width + 1) >> 1) * entry->height;
+        if (entry->offset > (uint32_t) size || bytes > (uint32_t) size - entry->offset) {
+            ESP_LOGE(TAG, "Atlas entry %.*s out of range", EPD_ATLAS_NAME_LEN, entry->name);
+            SpriteAtlas_Clear();
+            return ESP_ERR_INVALID_SIZE;
+        }
+        AtlasItem_t *item = &items_[count_++];
+        memcpy(item->name, entry->name, EPD_ATLAS_NAME_LEN);
+        item->name[EPD_ATLAS_NAME_LEN - 1] = 0;
+        item->sprite.width  = entry->width;
+        item->sprite.height = entry->height;
+        item->sprite.data   = blob_ + entry->offset;
+        item->owned         = false;
+    }
+    ESP_LOGI(TAG, "Loaded %d sprites, %ld bytes", count_, size);
+    return ESP_OK;
+}
+
+esp_err_t SpriteAtlas::SpriteAtlas_Save(const char *path) {
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL) {
+        ESP_LOGE(TAG, "Cannot create atlas: %s", path);
+        return ESP_FAIL;
+    }
+    EPDAtlasHeader_t header;
+    memcpy(header.magic, EPD_ATLAS_MAGIC, 4);
+    header.count    = count_;
+    uint32_t offset = sizeof(EPDAtlasHeader_t) + count_ * sizeof(EPDAtlasEntry_t);
+    bool     ok     = fwrite(&header, sizeof(header), 1, fp) == 1;
+    for (int i = 0; i < count_ && ok; i++) {
+        EPDAtlasEntry_t entry;
+        memset(&entry, 0, sizeof(entry));
+        strncpy(entry.name, items_[i].name, EPD_ATLAS_NAME_LEN - 1);
+        entry.width  = items_[i].sprite.width;
+        entry.height = items_[i].sprite.height;
+        entry.offset = offset;
+        offset += SpriteAtlas_Stride(&items_[i].sprite) * entry.height;
+        ok = fwrite(&entry, sizeof(entry), 1, fp) == 1;
+    }
+    for (int i = 0; i < count_ && ok; i++) {
+        size_t bytes = SpriteAtlas_Stride(&items_[i].sprite) * items_[i].sprite.height;
+        ok           = fwrite(items_[i].sprite.data, 1, bytes, fp) == bytes;
+    }
+    fclose(fp);
+    if (!ok) {
+        ESP_LOGE(TAG, "Failed to write atlas: %s", path);
+        remove(path);
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Saved %d sprites to %s", count_, path);
+    return ESP_OK;
+}
+
+esp_err_t SpriteAtlas::SpriteAtlas_Add(const char *name, const EPDSprite_t *sprite) {
+    if (count_ >= EPD_ATLAS_MAX || SpriteAtlas_Find(name) != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    AtlasItem_t *item = &items_[count_++];
+    strncpy(item->name, name, EPD_ATLAS_NAME_LEN - 1);
+    item->name[EPD_ATLAS_NAME_LEN - 1] = 0;
+    item->sprite = *sprite;
+    item->owned  = true;
+    return ESP_OK;
+}
+
+const EPDSprite_t *SpriteAtlas::SpriteAtlas_Find(const char *name) {
+    for (int i = 0; i < count_; i++) {
+        if (!strncmp(items_[i].name, name, EPD_ATLAS_NAME_LEN - 1)) {
+            return &items_[i].sprite;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+#include <esp_err.h>
+
+/*
+ * 4bpp 精灵图集(EPA1), 把背景和天气图标预先转成面板颜色, 显示时整行拷贝.
+ *
+ * 小端, 布局:
+ *   EPDAtlasHeader_t
+ *   EPDAtlasEntry_t[count]
+ *   像素数据, 每个精灵按 (width+1)/2 字节一行, 偶数x在高4位
+ */
+#define EPD_ATLAS_MAGIC    "EPA1"
+#define EPD_ATLAS_MAX      16
+#define EPD_ATLAS_NAME_LEN 24
+
+typedef struct {
+    uint16_t width;
+    uint16_t height;
+    uint8_t *data;
+} EPDSprite_t;
+
+typedef struct {
+    char     magic[4];
+    uint32_t count;
+} EPDAtlasHeader_t;
+
+typedef struct {
+    char     name[EPD_ATLAS_NAME_LEN];
+    uint16_t width;
+    uint16_t height;
+    uint32_t offset;        // 相对文件头
+} EPDAtlasEntry_t;
+
+class SpriteAtlas {
+  private:
+    typedef struct {
+        char        name[EPD_ATLAS_NAME_LEN];
+        EPDSprite_t sprite;
+        bool        owned;  // data 单独分配, 否则指向 blob_
+    } AtlasItem_t;
+
+    const char *TAG    = "SpriteAtlas";
+    uint8_t    *blob_  = NULL;   // 从文件整体读入的数据
+    AtlasItem_t items_[EPD_ATLAS_MAX];
+    int         count_ = 0;
+
+  public:
+    SpriteAtlas();
+    ~SpriteAtlas();
+
+    esp_err_t SpriteAtlas_Load(const char *path);
+    esp_err_t SpriteAtlas_Save(const char *path);
+    /*成功时接管 sprite->data(须由 heap_caps_malloc 分配), 失败时由调用方释放*/
+    esp_err_t SpriteAtlas_Add(const char *name, const EPDSprite_t *sprite);
+    const EPDSprite_t *SpriteAtlas_Find(const char *name);
+    void      SpriteAtlas_Clear();
+    int       SpriteAtlas_Count() { return count_; }
+
+    static int SpriteAtlas_Stride(const EPDSprite_t *sprite) { return (sprite->width + 1) >> 1; }
+};
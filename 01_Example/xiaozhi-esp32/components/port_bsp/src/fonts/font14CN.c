@@ -539,12 +539,24 @@ const CH_CN Font14CN_Table[] =
 
 };
 
+/*<font-index>*/
+/*按UTF-8编码排序的字模下标, 由 scripts/font_index.py 生成, 增删字模后需重新生成*/
+const uint16_t Font14CN_Index[] = {
+  19, 44, 33, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 22, 27, 21,
+  20, 23, 28, 31, 24, 29, 25, 30, 34, 26, 32, 18, 37, 39, 45, 54,
+  2, 38, 7, 41, 50, 42, 48, 46, 40, 6, 3, 43, 0, 53, 58, 35,
+  4, 36, 57, 56, 51, 47, 52, 55, 5, 1, 49,
+};
+_Static_assert(sizeof(Font14CN_Index) / sizeof(uint16_t) == sizeof(Font14CN_Table) / sizeof(CH_CN), "Font14CN_Index is stale, run scripts/font_index.py");
+/*</font-index>*/
+
 cFONT Font14CN = {
   Font14CN_Table,
   sizeof(Font14CN_Table)/sizeof(CH_CN),  /*size of table*/
   14, /* ASCII Width */
   24, /* Width */
   25, /* Height */
+  Font14CN_Index, /* sorted glyph index */
 };
 
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -90,12 +90,21 @@ const CH_CN Font18CN_Table[] =
 
 };
 
+/*<font-index>*/
+/*按UTF-8编码排序的字模下标, 由 scripts/font_index.py 生成, 增删字模后需重新生成*/
+const uint16_t Font18CN_Index[] = {
+  2, 4, 3, 6, 7, 5, 8, 0, 1,
+};
+_Static_assert(sizeof(Font18CN_Index) / sizeof(uint16_t) == sizeof(Font18CN_Table) / sizeof(CH_CN), "Font18CN_Index is stale, run scripts/font_index.py");
+/*</font-index>*/
+
 cFONT Font18CN = {
   Font18CN_Table,
   sizeof(Font18CN_Table)/sizeof(CH_CN),  /*size of table*/
   18, /* ASCII Width */
   24, /* Width */
   31, /* Height */
+  Font18CN_Index, /* sorted glyph index */
 };
 
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
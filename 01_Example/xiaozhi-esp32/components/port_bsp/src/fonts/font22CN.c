@@ -163,12 +163,21 @@ const CH_CN Font22CN_Table[] =
 
 };
 
+/*<font-index>*/
+/*按UTF-8编码排序的字模下标, 由 scripts/font_index.py 生成, 增删字模后需重新生成*/
+const uint16_t Font22CN_Index[] = {
+  10, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9,
+};
+_Static_assert(sizeof(Font22CN_Index) / sizeof(uint16_t) == sizeof(Font22CN_Table) / sizeof(CH_CN), "Font22CN_Index is stale, run scripts/font_index.py");
+/*</font-index>*/
+
 cFONT Font22CN = {
   Font22CN_Table,
   sizeof(Font22CN_Table)/sizeof(CH_CN),  /*size of table*/
   22, /* ASCII Width */
   32, /* Width */
   38, /* Height */
+  Font22CN_Index, /* sorted glyph index */
 };
 
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -76,6 +76,7 @@ typedef struct
   uint16_t ASCII_Width;
   uint16_t Width;
   uint16_t Height;
+  const uint16_t *index;                                    // table下标, 按UTF-8编码升序
   
 }cFONT;
 
@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include "app_core.h"
+#include "button_bsp.h"
+#include "power_bsp.h"
+#include "server_app.h"
+#include "work_pool.h"
+
+#define APP_CORE_QUEUE    16
+#define APP_CORE_HANDLERS 16
+#define APP_CORE_STACK    (4 * 1024)
+#define APP_CORE_PRIORITY 3
+
+static const char *TAG = "AppCore";
+
+typedef struct {
+    uint8_t           type;
+    AppEventHandler_t handler;
+    void             *ctx;
+} AppHandler_t;
+
+static QueueHandle_t      app_queue = NULL;
+static AppHandler_t       app_handlers[APP_CORE_HANDLERS];
+static esp_timer_handle_t app_timers[AppTimerMax];
+static portMUX_TYPE       app_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void app_core_task(void *arg) {
+    AppEvent_t event;
+    for (;;) {
+        if (xQueueReceive(app_queue, &event, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        for (int i = 0; i < APP_CORE_HANDLERS; i++) {
+            taskENTER_CRITICAL(&app_lock);      /*处理函数里可能退订, 先拷一份*/
+            AppHandler_t h = app_handlers[i];
+            taskEXIT_CRITICAL(&app_lock);
+            if (h.handler != NULL && h.type == event.type) {
+                h.handler(&event, h.ctx);
+            }
+        }
+    }
+}
+
+/*按键, 服务器和PMIC的回调都在别的任务里, 只投递不处理*/
+static void app_button_notify(uint8_t key, uint8_t bit) {
+    AppCore_Post(AppEventButton, key, bit, NULL);
+}
+
+static void app_server_notify(uint32_t bits) {
+    AppCore_Post(AppEventServer, 0, (int32_t) bits, NULL);
+}
+
+static void app_power_notify(uint32_t bits) {
+    AppCore_Post(AppEventPower, 0, (int32_t) bits, NULL);
+}
+
+static void app_timer_callback(void *arg) {
+    AppCore_Post(AppEventTimer, (uint8_t) (uintptr_t) arg, 0, NULL);
+}
+
+esp_err_t AppCore_Init(void) {
+    if (app_queue != NULL) {
+        return ESP_OK;
+    }
+    app_queue = xQueueCreate(APP_CORE_QUEUE, sizeof(AppEvent_t));
+    if (app_queue == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreate(app_core_task, "app_core_task", APP_CORE_STACK, NULL, APP_CORE_PRIORITY, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start event loop");
+        return ESP_ERR_NO_MEM;
+    }
+    Custom_ButtonSetNotify(app_button_notify);
+    ServerPort_SetNotify(app_server_notify);
+    Axp2101_SetNotify(app_power_notify);
+    return work_pool_init();
+}
+
+bool AppCore_Post(uint8_t type, uint8_t code, int32_t value, void *ptr) {
+    AppEvent_t event = {type, code, value, ptr};
+    if (app_queue == NULL) {
+        return false;
+    }
+    if (xQueueSend(app_queue, &event, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "queue full, event %d/%d dropped", type, code);
+        return false;
+    }
+    return true;
+}
+
+int AppCore_Subscribe(uint8_t type, AppEventHandler_t handler, void *ctx) {
+    int handle = -1;
+    taskENTER_CRITICAL(&app_lock);
+    for (int i = 0; i < APP_CORE_HANDLERS; i++) {
+        if (app_handlers[i].handler == NULL) {
+            app_handlers[i] = {type, handler, ctx};
+            handle          = i;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&app_lock);
+    if (handle < 0) {
+        ESP_LOGE(TAG, "handler table full");
+    }
+    return handle;
+}
+
+void AppCore_Unsubscribe(int handle) {
+    if (handle < 0 || handle >= APP_CORE_HANDLERS) {
+        return;
+    }
+    taskENTER_CRITICAL(&app_lock);
+    app_handlers[handle].handler = NULL;
+    taskEXIT_CRITICAL(&app_lock);
+}
+
+void AppCore_TimerStart(uint8_t id, uint32_t ms, bool periodic) {
+    if (id >= AppTimerMax) {
+        return;
+    }
+    if (app_timers[id] == NULL) {               /*用到才建, 没用到的模式不占定时器*/
+        esp_timer_create_args_t args = {};
+        args.callback                = app_timer_callback;
+        args.arg                     = (void *) (uintptr_t) id;
+        args.name                    = "app_core";
+        if (esp_timer_create(&args, &app_timers[id]) != ESP_OK) {
+            ESP_LOGE(TAG, "timer %d create failed", id);
+            return;
+        }
+    }
+    esp_timer_stop(app_timers[id]);
+    if (periodic) {
+        esp_timer_start_periodic(app_timers[id], (uint64_t) ms * 1000);
+    } else {
+        esp_timer_start_once(app_timers[id], (uint64_t) ms * 1000);
+    }
+}
+
+void AppCore_TimerStop(uint8_t id) {
+    if (id < AppTimerMax && app_timers[id] != NULL) {
+        esp_timer_stop(app_timers[id]);
+    }
+}
+
+esp_err_t AppCore_RunWork(void (*fn)(void *arg), void *arg) {
+    esp_err_t err = work_pool_submit(fn, arg, 0);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "work submit failed: %s", esp_err_to_name(err));
+    }
+    return err;
+}
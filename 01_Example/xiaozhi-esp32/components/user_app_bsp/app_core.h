@@ -0,0 +1,44 @@
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+#include <esp_err.h>
+
+/*
+ * 各模式共用的事件循环: 按键, 网页服务器, PMIC和定时器都投递成事件,
+ * 由一个任务按订阅分发; 解码刷新这类耗时操作交给 work_pool.
+ * 没有事件时循环任务一直阻塞, 不会为了轮询唤醒CPU.
+ * 处理函数都在循环任务里执行, 不要在里面做耗时或阻塞的事.
+ */
+enum AppEventType {
+    AppEventButton = 0,     // code = BUTTON_KEY_*, value = 该按键事件组的位
+    AppEventServer,         // value = ServerPortGroups 置的位
+    AppEventTimer,          // code = AppTimerId
+    AppEventPower,          // value = PMIC_EVENT_* 的位
+    AppEventUser,           // 各模式自己约定 code
+    AppEventTypeMax,
+};
+
+enum AppTimerId {
+    AppTimerImgLoop = 0,    // 小智模式轮播
+    AppTimerChat,           // 小智模式打断说话后重新开聊
+    AppTimerAudio,          // 模式选择的提示音重播
+    AppTimerWeather,        // 小智模式启动后延时显示天气
+    AppTimerMax,
+};
+
+typedef struct {
+    uint8_t type;
+    uint8_t code;
+    int32_t value;
+    void   *ptr;
+} AppEvent_t;
+
+typedef void (*AppEventHandler_t)(const AppEvent_t *event, void *ctx);
+
+esp_err_t AppCore_Init(void);                                           // 重复调用无副作用
+bool      AppCore_Post(uint8_t type, uint8_t code, int32_t value, void *ptr);   // 不等待, 队列满返回false
+int       AppCore_Subscribe(uint8_t type, AppEventHandler_t handler, void *ctx); // 返回句柄, 表满返回-1
+void      AppCore_Unsubscribe(int handle);
+void      AppCore_TimerStart(uint8_t id, uint32_t ms, bool periodic);   // 已在运行的同名定时器重新计时
+void      AppCore_TimerStop(uint8_t id);
+esp_err_t AppCore_RunWork(void (*fn)(void *arg), void *arg);            // 放到 work_pool 执行, 不等待
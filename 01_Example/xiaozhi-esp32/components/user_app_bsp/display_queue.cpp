@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <esp_log.h>
+#include "display_queue.h"
+#include "app_core.h"
+#include "user_app.h"
+#include "led_bsp.h"
+#include "power_profile.h"
+
+static const char *TAG = "DispQueue";
+
+static DispCmd_t    disp_pending;
+static int          disp_pending_id = 0;        // 0 没有待执行的命令
+static bool         disp_running    = false;    // work_pool 里有执行任务
+static bool         disp_decoding   = false;    // 已拿到显存, 还没开始刷新
+static int          disp_next_id    = 1;
+static portMUX_TYPE disp_lock       = portMUX_INITIALIZER_UNLOCKED;
+
+static void disp_done(const DispCmd_t *cmd, int id, esp_err_t result) {
+    if (cmd->done != NULL) {
+        cmd->done(id, result, cmd->ctx);
+    }
+}
+
+/*只在解码阶段才算取消, 等信号量时不影响别人用显存*/
+static bool disp_cancel_check(void *ctx) {
+    taskENTER_CRITICAL(&disp_lock);
+    bool cancel = disp_decoding && disp_pending_id != 0;
+    taskEXIT_CRITICAL(&disp_lock);
+    return cancel;
+}
+
+bool DispQueue_Superseded(void) {
+    return disp_cancel_check(NULL);
+}
+
+static esp_err_t disp_decode(const DispCmd_t *cmd) {
+    if (cmd->type == DispCmdRender) {
+        return cmd->render(cmd->ctx);
+    }
+    if (strstr(cmd->path, ".epd") || strstr(cmd->path, ".EPD")) {
+        return ePaperDisplay.EPD_SDcardLoadFrame(cmd->path);
+    }
+    return ePaperDisplay.EPD_SDcardScaleIMGShakingColor(cmd->path, 0, 0);
+}
+
+/*一次把待执行的命令做完, 执行期间又来的命令接着做*/
+static void disp_queue_job(void *arg) {
+    for (;;) {
+        DispCmd_t cmd;
+        taskENTER_CRITICAL(&disp_lock);
+        int id = disp_pending_id;
+        cmd    = disp_pending;
+        disp_pending_id = 0;
+        if (id == 0) {
+            disp_running = false;
+        }
+        taskEXIT_CRITICAL(&disp_lock);
+        if (id == 0) {
+            return;
+        }
+
+        xSemaphoreTake(epaper_gui_semapHandle, portMAX_DELAY);     /*图库转码可能正占用显存*/
+        Led_Play(LED_PIN_Green, &LedPatternBusy);
+        taskENTER_CRITICAL(&disp_lock);
+        disp_decoding = true;
+        taskEXIT_CRITICAL(&disp_lock);
+        PowerProfile_Mark(PowerStageDecode);
+        esp_err_t ret = disp_decode(&cmd);
+        taskENTER_CRITICAL(&disp_lock);
+        bool superseded = (disp_pending_id != 0);
+        disp_decoding   = false;
+        taskEXIT_CRITICAL(&disp_lock);
+        if (superseded) {
+            ESP_LOGI(TAG, "cmd %d superseded", id);
+            ret = ESP_ERR_INVALID_STATE;
+        } else if (ret == ESP_OK) {
+            PowerProfile_Mark(PowerStageRefresh);
+            ePaperDisplay.EPD_Display();
+        } else {
+            ESP_LOGE(TAG, "cmd %d failed: %s", id, esp_err_to_name(ret));
+        }
+        PowerProfile_Mark(PowerStageIdle);
+        xSemaphoreGive(epaper_gui_semapHandle);
+        Led_Stop(LED_PIN_Green, LED_OFF);
+        disp_done(&cmd, id, ret);
+    }
+}
+
+void DispQueue_Init(void) {
+    ePaperDisplay.EPD_SetCancelCheck(disp_cancel_check, NULL);
+}
+
+int DispQueue_Post(const DispCmd_t *cmd) {
+    DispCmd_t old;
+    taskENTER_CRITICAL(&disp_lock);
+    int id       = disp_next_id++;
+    int old_id   = disp_pending_id;
+    old          = disp_pending;
+    disp_pending = *cmd;
+    disp_pending_id = id;
+    bool start   = !disp_running;
+    disp_running = true;
+    taskEXIT_CRITICAL(&disp_lock);
+    if (old_id != 0) {
+        disp_done(&old, old_id, ESP_ERR_INVALID_STATE);
+    }
+    if (start && AppCore_RunWork(disp_queue_job, NULL) != ESP_OK) {
+        taskENTER_CRITICAL(&disp_lock);
+        disp_running    = false;
+        bool mine       = (disp_pending_id == id);
+        disp_pending_id = mine ? 0 : disp_pending_id;
+        taskEXIT_CRITICAL(&disp_lock);
+        if (mine) {
+            disp_done(cmd, id, ESP_ERR_NO_MEM);
+        }
+        return -1;
+    }
+    return id;
+}
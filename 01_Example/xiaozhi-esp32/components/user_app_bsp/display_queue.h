@@ -0,0 +1,31 @@
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+#include <esp_err.h>
+
+/*
+ * 显示命令队列: 只保留一条待执行的命令, 新命令直接顶替旧的(最后一次请求为准).
+ * 执行中的命令在解码/抖动阶段发现有新命令就放弃, 开始刷新后不能打断.
+ * 命令在 work_pool 里执行, 执行前拿 epaper_gui_semapHandle.
+ */
+#define DISP_QUEUE_PATH_LEN 128
+
+enum DispCmdType {
+    DispCmdImage = 0,       // path: SD卡图片(.epd帧或jpg/png/bmp/qoi), 解码抖动后刷新
+    DispCmdRender,          // render(ctx) 自己写显存
+};
+
+typedef esp_err_t (*DispRender_t)(void *ctx);
+typedef void (*DispDone_t)(int id, esp_err_t result, void *ctx);
+
+typedef struct {
+    uint8_t      type;
+    char         path[DISP_QUEUE_PATH_LEN];
+    DispRender_t render;
+    void        *ctx;                       // render 和 done 的参数
+    DispDone_t   done;                      // 每条命令恰好回调一次: ESP_OK 已刷新, ESP_ERR_INVALID_STATE 被新命令取代
+} DispCmd_t;
+
+void DispQueue_Init(void);
+int  DispQueue_Post(const DispCmd_t *cmd);  // 返回命令号
+bool DispQueue_Superseded(void);            // render 里查询当前命令是否已被取代
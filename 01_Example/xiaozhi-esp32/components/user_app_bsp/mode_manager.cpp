@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <esp_log.h>
+#include <esp_system.h>
+#include <nvs_flash.h>
+#include "mode_manager.h"
+#include "user_app.h"
+#include "app_core.h"
+#include "application.h"
+
+static const char *TAG = "ModeManager";
+
+typedef struct {
+    const char *name;
+    void (*start)(void);
+    void (*stop)(void);     // NULL: 不能热退出, 切走时重启
+} ModeOps_t;
+
+static void mode_xiaozhi_start(void) {
+    Application::GetInstance().Start();
+}
+
+static const ModeOps_t mode_ops[ModeMax] = {
+    {"none", NULL, NULL},
+    {"Basic", User_Basic_mode_app_init, User_Basic_mode_app_deinit},
+    {"Network", User_Network_mode_app_init, User_Network_mode_app_deinit},
+    {"xiaozhi", mode_xiaozhi_start, NULL},
+    {"Mode Selection", Mode_Selection_Init, Mode_Selection_Deinit},
+};
+
+static uint8_t      mode_current   = ModeNone;
+static uint8_t      mode_flag      = 0;
+static bool         mode_cold      = true;
+static bool         mode_switching = false;
+static portMUX_TYPE mode_lock      = portMUX_INITIALIZER_UNLOCKED;
+
+static void mode_save(uint8_t mode, uint8_t flag) {
+    esp_err_t    ret;
+    nvs_handle_t my_handle;
+    ret = nvs_open("PhotoPainter", NVS_READWRITE, &my_handle);
+    ESP_ERROR_CHECK(ret);
+    ret = nvs_set_u8(my_handle, "PhotPainterMode", mode);
+    ESP_ERROR_CHECK(ret);
+    ret = nvs_set_u8(my_handle, "Mode_Flag", flag);
+    ESP_ERROR_CHECK(ret);
+    ESP_ERROR_CHECK(nvs_commit(my_handle));
+    nvs_close(my_handle);
+}
+
+/*在work_pool里切换: 拿着显存锁停旧模式, 保证没有解码/刷新做到一半*/
+static void mode_switch_job(void *arg) {
+    uint8_t          mode = (uint8_t) (uintptr_t) arg;
+    const ModeOps_t *from = &mode_ops[mode_current];
+    xSemaphoreTake(epaper_gui_semapHandle, portMAX_DELAY);
+    if (from->stop != NULL) {
+        ESP_LOGW(TAG, "Stop %s", from->name);
+        from->stop();
+    }
+    xSemaphoreGive(epaper_gui_semapHandle);
+    if (from->stop == NULL || mode_ops[mode].stop == NULL) {
+        ESP_LOGW(TAG, "Restart into %s", mode_ops[mode].name);
+        esp_restart();
+    }
+    mode_cold    = false;
+    mode_current = mode;
+    ESP_LOGW(TAG, "Enter %s", mode_ops[mode].name);
+    mode_ops[mode].start();
+    taskENTER_CRITICAL(&mode_lock);
+    mode_switching = false;
+    taskEXIT_CRITICAL(&mode_lock);
+}
+
+void Mode_Start(uint8_t mode, uint8_t flag) {
+    if (mode <= ModeNone || mode >= ModeMax) {
+        ESP_LOGE(TAG, "Unknown mode %d", mode);
+        return;
+    }
+    mode_current = mode;
+    mode_flag    = flag;
+    ESP_LOGW(TAG, "Enter %s", mode_ops[mode].name);
+    mode_ops[mode].start();
+}
+
+bool Mode_Switch(uint8_t mode) {
+    if (mode <= ModeNone || mode >= ModeMax) {
+        return false;
+    }
+    taskENTER_CRITICAL(&mode_lock);
+    bool busy      = mode_switching;
+    mode_switching = true;
+    taskEXIT_CRITICAL(&mode_lock);
+    if (busy) {
+        return false;
+    }
+    mode_flag = (mode == ModeSelection) ? 0x00 : 0x01;
+    mode_save(mode, mode_flag);         /*断电或深睡唤醒后还在这个模式*/
+    if (AppCore_RunWork(mode_switch_job, (void *) (uintptr_t) mode) != ESP_OK) {
+        esp_restart();                  /*NVS已经写好, 重启也能进新模式*/
+    }
+    return true;
+}
+
+uint8_t Mode_Current(void) {
+    return mode_current;
+}
+
+bool Mode_IsColdStart(void) {
+    return mode_cold;
+}
+
+bool Mode_Selected(void) {
+    return mode_flag == 0x01;
+}
+
+bool Mode_Switching(void) {
+    taskENTER_CRITICAL(&mode_lock);
+    bool busy = mode_switching;
+    taskEXIT_CRITICAL(&mode_lock);
+    return busy;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+
+/*
+ * 模式管理: 各模式是一组 start/stop, SD卡, 显存和屏幕由 User_Mode_init 持有, 切换时不动.
+ * Basic/Network/模式选择之间直接停旧的起新的, 不再重启;
+ * 小智模式的 Application 没有退出流程(还占着codec和Wi-Fi), 进出小智仍然存NVS后重启.
+ */
+enum ModeId {
+    ModeNone = 0,
+    ModeBasic,              // 和NVS里 PhotPainterMode 的取值一致
+    ModeNetwork,
+    ModeXiaozhi,
+    ModeSelection,
+    ModeMax,
+};
+
+void    Mode_Start(uint8_t mode, uint8_t flag);   // main.cc, 上电后按NVS启动; flag = Mode_Flag
+bool    Mode_Switch(uint8_t mode);                // 存NVS并切换, 不等待; 正在切换时返回false
+uint8_t Mode_Current(void);
+bool    Mode_IsColdStart(void);                   // 当前模式是上电后第一个模式(唤醒原因有效)
+bool    Mode_Selected(void);                      // Mode_Flag: 选过模式, GP4长按回到模式选择
+bool    Mode_Switching(void);
@@ -6,8 +6,13 @@
 #include <esp_sleep.h>
 #include <esp_log.h>
 #include "user_app.h"
+#include "app_core.h"
+#include "mode_manager.h"
 #include "button_bsp.h"
+#include "led_bsp.h"
 #include "ai_app.h"
+#include "library_app.h"
+#include "power_profile.h"
 #include "list.h"
 
 
@@ -17,78 +22,61 @@
 
 static RTC_DATA_ATTR uint32_t sdcard_Basic_count = 0; 
 static RTC_DATA_ATTR int basic_rtc_set_time = 13 * 60;// User sets the wake-up time in seconds. // The default is 60 seconds. It is awakened by a timer.
-static uint8_t           Basic_sleep_arg = 0; // Parameters for low-power tasks
-static SemaphoreHandle_t sleep_Semp;          // Binary call low-power task 
-static uint8_t           wakeup_basic_flag = 0;
+static bool              basic_busy = false;   // 已有一次换图在work_pool里, 忽略重复按键
+static int               basic_button_handle = -1;
 static list_t* ListHost;
 
 
-static void pwr_button_user_Task(void *arg) {
-    for (;;) {
-        EventBits_t even = xEventGroupWaitBits(PWRButtonGroups, set_bit_all, pdTRUE, pdFALSE, pdMS_TO_TICKS(2000));
-        if (get_bit_button(even, 0))
-        {
-            const uint64_t ext_wakeup_pin_1_mask = 1ULL << ext_wakeup_pin_1;
-            const uint64_t ext_wakeup_pin_3_mask = 1ULL << ext_wakeup_pin_3;
-            ESP_ERROR_CHECK(esp_sleep_enable_ext1_wakeup_io(ext_wakeup_pin_1_mask | ext_wakeup_pin_3_mask, ESP_EXT1_WAKEUP_ANY_LOW)); 
-            ESP_ERROR_CHECK(rtc_gpio_pulldown_dis(ext_wakeup_pin_3));
-            ESP_ERROR_CHECK(rtc_gpio_pullup_en(ext_wakeup_pin_3));
-            esp_sleep_enable_timer_wakeup((uint64_t)basic_rtc_set_time * 1000000ULL);
-            //axp_basic_sleep_start();
-            vTaskDelay(pdMS_TO_TICKS(500));
-            esp_deep_sleep_start(); 
-        }
-    }
+static void basic_deep_sleep(void) {
+    const uint64_t ext_wakeup_pin_1_mask = 1ULL << ext_wakeup_pin_1;
+    const uint64_t ext_wakeup_pin_3_mask = 1ULL << ext_wakeup_pin_3;
+    ESP_ERROR_CHECK(esp_sleep_enable_ext1_wakeup_io(ext_wakeup_pin_1_mask | ext_wakeup_pin_3_mask, ESP_EXT1_WAKEUP_ANY_LOW)); 
+    ESP_ERROR_CHECK(rtc_gpio_pulldown_dis(ext_wakeup_pin_3));
+    ESP_ERROR_CHECK(rtc_gpio_pullup_en(ext_wakeup_pin_3));
+    esp_sleep_enable_timer_wakeup((uint64_t)basic_rtc_set_time * 1000000ULL);
+    //axp_basic_sleep_start();
+    PowerProfile_Sleep(basic_rtc_set_time);
+    vTaskDelay(pdMS_TO_TICKS(500));
+    esp_deep_sleep_start(); 
 }
 
-static void boot_button_user_Task(void *arg) {
-    uint8_t *wakeup_arg = (uint8_t *) arg;
-    ePaperDisplay.EPD_Init();
-    for (;;) {
-        EventBits_t even = xEventGroupWaitBits(BootButtonGroups, set_bit_all, pdTRUE, pdFALSE, pdMS_TO_TICKS(2000));
-        if (get_bit_button(even, 0)) {
-            if (*wakeup_arg == 0) {
-                if (pdTRUE == xSemaphoreTake(epaper_gui_semapHandle, 2000)) {                       
-                    list_node_t *sdcard_node = list_at(ListHost, sdcard_Basic_count); 
-                    if (sdcard_node == NULL) {
-                        sdcard_Basic_count = 0;
-                        sdcard_node        = list_at(ListHost, sdcard_Basic_count);
-                    }
-                    ESP_LOGW("node", "%ld", sdcard_Basic_count);
-                    sdcard_Basic_count++;
-                    if (sdcard_node != NULL) {
-                        xEventGroupSetBits(Green_led_Mode_queue,set_bit_button(6));
-                        Green_led_arg                   = 1;
-                        CustomSDPortNode_t *sdcard_Name_node = (CustomSDPortNode_t *) sdcard_node->val;
-                        ePaperDisplay.EPD_SDcardScaleIMGShakingColor(sdcard_Name_node->sdcard_name,0,0);
-                        ePaperDisplay.EPD_Display();
-                        xSemaphoreGive(epaper_gui_semapHandle); 
-                        Green_led_arg = 0;
-                        xSemaphoreGive(sleep_Semp);
-                        Basic_sleep_arg = 1;
-                    }
-                }
+/*在work_pool里换下一张图, 刷完直接深睡*/
+static void basic_render_job(void *arg) {
+    if (pdTRUE == xSemaphoreTake(epaper_gui_semapHandle, 2000)) {                       
+        list_node_t *sdcard_node = list_at(ListHost, sdcard_Basic_count); 
+        if (sdcard_node == NULL) {
+            sdcard_Basic_count = 0;
+            sdcard_node        = list_at(ListHost, sdcard_Basic_count);
+        }
+        ESP_LOGW("node", "%ld", sdcard_Basic_count);
+        sdcard_Basic_count++;
+        if (sdcard_node != NULL) {
+            Led_Play(LED_PIN_Green, &LedPatternBusy);
+            CustomSDPortNode_t *sdcard_Name_node = (CustomSDPortNode_t *) sdcard_node->val;
+            char frame[128];
+            PowerProfile_Mark(PowerStageDecode);
+            if (!Library_FramePath(sdcard_Name_node->sdcard_name, frame, sizeof(frame)) ||
+                ePaperDisplay.EPD_SDcardLoadFrame(frame) != ESP_OK) {   /*网页上传的图已转码成帧, 直接读*/
+                ePaperDisplay.EPD_SDcardScaleIMGShakingColor(sdcard_Name_node->sdcard_name,0,0);
             }
+            PowerProfile_Mark(PowerStageRefresh);
+            ePaperDisplay.EPD_Display();
+            PowerProfile_Mark(PowerStageIdle);
+        }
+        xSemaphoreGive(epaper_gui_semapHandle); 
+        Led_Stop(LED_PIN_Green, LED_OFF);
+        if (sdcard_node != NULL) {
+            basic_deep_sleep();
         }
     }
+    basic_busy = false;
 }
 
-static void default_sleep_user_Task(void *arg) {
-    uint8_t *sleep_arg = (uint8_t *) arg;
-    for (;;) {
-        if (pdTRUE == xSemaphoreTake(sleep_Semp, portMAX_DELAY)) {
-            if (*sleep_arg == 1) {
-                const uint64_t ext_wakeup_pin_1_mask = 1ULL << ext_wakeup_pin_1;
-                const uint64_t ext_wakeup_pin_3_mask = 1ULL << ext_wakeup_pin_3;
-                ESP_ERROR_CHECK(esp_sleep_enable_ext1_wakeup_io(ext_wakeup_pin_1_mask | ext_wakeup_pin_3_mask,ESP_EXT1_WAKEUP_ANY_LOW)); 
-                ESP_ERROR_CHECK(rtc_gpio_pulldown_dis(ext_wakeup_pin_3));
-                ESP_ERROR_CHECK(rtc_gpio_pullup_en(ext_wakeup_pin_3));
-                esp_sleep_enable_timer_wakeup((uint64_t)basic_rtc_set_time * 1000000ULL);
-                //axp_basic_sleep_start(); 
-                vTaskDelay(pdMS_TO_TICKS(500));
-                esp_deep_sleep_start();  
-            }
-        }
+static void basic_button_handler(const AppEvent_t *event, void *ctx) {
+    if (event->code == BUTTON_KEY_PWR && event->value == 0) {
+        basic_deep_sleep();
+    } else if (event->code == BUTTON_KEY_BOOT && event->value == 0 && !basic_busy) {
+        basic_busy = (AppCore_RunWork(basic_render_job, NULL) == ESP_OK);
     }
 }
 
@@ -99,20 +87,20 @@ static void get_wakeup_gpio(void) {
         if (wakeup_pins == 0)
             return;
         if (wakeup_pins & (1ULL << ext_wakeup_pin_1)) {
-            xEventGroupSetBits(BootButtonGroups, set_bit_button(0)); 
+            AppCore_Post(AppEventButton, BUTTON_KEY_BOOT, 0, NULL); 
         } else if (wakeup_pins & (1ULL << ext_wakeup_pin_3)) {
             return;
         }
     } else if (ESP_SLEEP_WAKEUP_TIMER == wakeup_reason) {
-        xEventGroupSetBits(BootButtonGroups, set_bit_button(0)); 
+        AppCore_Post(AppEventButton, BUTTON_KEY_BOOT, 0, NULL); 
     }
 }
 
 void User_Basic_mode_app_init(void) {
     ListHost = SDPort->SDPort_GetListHost();
-    sleep_Semp  = xSemaphoreCreateBinary();
+    PowerProfile_SetMode(PowerModeBasic);
     BaseAIModel model(SDPort,decdither);
-    xEventGroupSetBits(Red_led_Mode_queue, set_bit_button(0));  
+    Led_Stop(LED_PIN_Red, LED_ON);
     BaseAIModelConfig_t *AIModelConfig = NULL;
     AIModelConfig = model.BaseAIModel_SdcardReadAIModelConfig();
     if (AIModelConfig != NULL) {                            
@@ -121,9 +109,18 @@ void User_Basic_mode_app_init(void) {
     }
     SDPort->SDPort_ScanListDir("/sdcard/06_user_foundation_img"); 
     ESP_LOGW("IMG","Values:%d",SDPort->Get_Sdcard_ImgValue());  
-    xTaskCreate(boot_button_user_Task, "boot_button_user_Task", 6 * 1024, &wakeup_basic_flag, 3, NULL);
-    xTaskCreate(pwr_button_user_Task, "pwr_button_user_Task", 4 * 1024, NULL, 3, NULL);
-    xTaskCreate(default_sleep_user_Task, "default_sleep_user_Task", 4 * 1024, &Basic_sleep_arg, 3, NULL); 
-    get_wakeup_gpio();
+    basic_button_handle = AppCore_Subscribe(AppEventButton, basic_button_handler, NULL);
+    if (Mode_IsColdStart()) {                   /*热切换进来时唤醒原因是上一次的*/
+        get_wakeup_gpio();
+    }
+}
+
+/*调用时已持有 epaper_gui_semapHandle, 没有换图在进行*/
+void User_Basic_mode_app_deinit(void) {
+    AppCore_Unsubscribe(basic_button_handle);
+    basic_button_handle = -1;
+    SDPort->SDPort_ScanListClear();
+    ListHost = NULL;
+    Led_Stop(LED_PIN_Red, LED_OFF);
 }
 
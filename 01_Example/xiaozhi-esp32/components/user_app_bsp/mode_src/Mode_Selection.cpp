@@ -4,99 +4,126 @@
 #include <nvs_flash.h>
 #include <driver/rtc_io.h>
 #include "user_app.h"
+#include "app_core.h"
+#include "mode_manager.h"
 #include "button_bsp.h"
 #include "codec_bsp.h"
 
 CodecPort *AudioPort = NULL;
 
-EventGroupHandle_t audio_groups;
+static uint8_t      selection_mode = 0;        // 当前选中的模式, 0 还没选
+static bool         audio_playing  = false;    // 提示音任务在work_pool里
+static bool         audio_replay   = false;    // 播放中又换了模式, 播完马上再播
+static bool         audio_stop     = false;    // 切走模式, 打断播放且不再重播
+static int          selection_handles[2] = {-1, -1};
+static portMUX_TYPE audio_lock     = portMUX_INITIALIZER_UNLOCKED;
 
-static void key1_button_user_Task(void *arg) {
-    esp_err_t ret;
-    uint8_t   Mode = 0;
-    for (;;) {
-        EventBits_t even = xEventGroupWaitBits(GP4ButtonGroups, (0x02) | (0x01), pdTRUE, pdFALSE, pdMS_TO_TICKS(2000));
-        if (get_bit_button(even, 1)) {
-            if (Mode > 0) {
-                nvs_handle_t my_handle;
-                ret = nvs_open("PhotoPainter", NVS_READWRITE, &my_handle);
-                ESP_ERROR_CHECK(ret);
-                vTaskDelay(pdMS_TO_TICKS(2));
-                if (Mode == 1) {
-                    ret = nvs_set_u8(my_handle, "PhotPainterMode", 0x01);
-                    ESP_ERROR_CHECK(ret);
-                    vTaskDelay(pdMS_TO_TICKS(2));
-                } else if (Mode == 2) {
-                    ret = nvs_set_u8(my_handle, "PhotPainterMode", 0x02);
-                    ESP_ERROR_CHECK(ret);
-                    vTaskDelay(pdMS_TO_TICKS(2));
-                } else if (Mode == 3) {
-                    ret = nvs_set_u8(my_handle, "PhotPainterMode", 0x03);
-                    ESP_ERROR_CHECK(ret);
-                    vTaskDelay(pdMS_TO_TICKS(2));
-                }
-                ret = nvs_set_u8(my_handle, "Mode_Flag", 0x01);
-                ESP_ERROR_CHECK(ret);
-                vTaskDelay(pdMS_TO_TICKS(2));
-                ESP_LOGW("Audio","0x%02x,0x%02x",AudioPort->Codec_GetCodecReg("es8311",0x00),AudioPort->Codec_GetCodecReg("es7210",0x00));
-                uint8_t regs = AudioPort->Codec_GetCodecReg("es8311",0xfa);
-                ESP_LOGW("es8311 reg","0x%02x",regs);
-                AudioPort->Codec_SetCodecReg("es8311", 0xfa, regs | 0x01);
-                regs = AudioPort->Codec_GetCodecReg("es7210",0x00);
-                ESP_LOGW("es7210 reg","0x%02x",regs);
-                AudioPort->Codec_SetCodecReg("es7210", 0x00, regs | 0x06);
-                ESP_ERROR_CHECK(nvs_commit(my_handle));
-                nvs_close(my_handle); 
-                vTaskDelay(pdMS_TO_TICKS(300));
-                AudioPort->Codec_SetCodecReg("es8311", 0xfa, 0x00);
-                AudioPort->Codec_SetCodecReg("es7210", 0x00, 0x32);
-                esp_restart();
-            }
-        } else if (get_bit_button(even, 0)) { 
-            Mode++;
-            if (Mode > 3) {
-                Mode = 1;
-            }
-            if (Mode == 1) {
-                xEventGroupSetBits(audio_groups, set_bit_button(1));
-            } else if (Mode == 2) {
-                xEventGroupSetBits(audio_groups, set_bit_button(2));
-            } else if (Mode == 3) {
-                xEventGroupSetBits(audio_groups, set_bit_button(3));
-            }
-        }
+/*播放当前模式的提示音, 按下GP4打断; 播完3s后由 AppTimerAudio 再播一遍*/
+static void audio_play_job(void *arg) {
+    if (arg != NULL) {
+        AudioPort->Codec_PlayInfoAudio();
     }
-}
-
-static void audio_user_Task(void *arg) {
-    AudioPort->Codec_PlayInfoAudio();
-    int value = 0;
     for (;;) {
-        EventBits_t even = xEventGroupWaitBits(audio_groups, set_bit_all, pdTRUE, pdFALSE, pdMS_TO_TICKS(3000));
-        if (get_bit_button(even, 0)) { 
-            value = 0;
-        } else if (get_bit_button(even, 1)) {
-            value = 1;
-        } else if (get_bit_button(even, 2)) {
-            value = 2;
-        } else if (get_bit_button(even, 3)) {
-            value = 3;
-        }
         int      bytes_write = 0;
-        int      bytes_sizt  = AudioPort->Codec_GetMusicSizt(value);
-        uint8_t *Music_ptr   = AudioPort->Codec_GetMusicData(value);
+        int      bytes_sizt  = AudioPort->Codec_GetMusicSizt(selection_mode);
+        uint8_t *Music_ptr   = AudioPort->Codec_GetMusicData(selection_mode);
         do {
             AudioPort->Codec_PlayBackWrite(Music_ptr, 256);
             Music_ptr += 256;
             bytes_write += 256;
-        } while ((bytes_write < bytes_sizt) && (gpio_get_level(GPIO_NUM_4)));
+        } while ((bytes_write < bytes_sizt) && (gpio_get_level(GPIO_NUM_4)) && !audio_stop);
+        taskENTER_CRITICAL(&audio_lock);
+        bool again    = audio_replay && !audio_stop;
+        bool stop     = audio_stop;
+        audio_replay  = false;
+        audio_playing = again;
+        taskEXIT_CRITICAL(&audio_lock);
+        if (!again) {
+            if (!stop) {
+                AppCore_TimerStart(AppTimerAudio, 3000, false);
+            }
+            break;
+        }
+    }
+}
+
+static void audio_play(void *arg) {
+    taskENTER_CRITICAL(&audio_lock);
+    bool start = !audio_playing;
+    if (start) {
+        audio_playing = true;
+    } else {
+        audio_replay = true;
+    }
+    taskEXIT_CRITICAL(&audio_lock);
+    if (start) {
+        AppCore_TimerStop(AppTimerAudio);
+        if (AppCore_RunWork(audio_play_job, arg) != ESP_OK) {
+            audio_playing = false;
+        }
+    }
+}
+
+
+/*GP4单击轮换模式并播报, 长按确认*/
+static void key1_button_user_handler(const AppEvent_t *event, void *ctx) {
+    if (event->code != BUTTON_KEY_GP4) {
+        return;
+    }
+    if (event->value == 1 && selection_mode > 0) {
+        Mode_Switch(selection_mode);
+    } else if (event->value == 0) {
+        selection_mode++;
+        if (selection_mode > 3) {
+            selection_mode = 1;
+        }
+        audio_play(NULL);
+    }
+}
+
+static void audio_timer_handler(const AppEvent_t *event, void *ctx) {
+    if (event->code == AppTimerAudio) {
+        audio_play(NULL);
     }
 }
 
 void Mode_Selection_Init(void) {
+    selection_mode = 0;
+    audio_stop     = false;
     AudioPort    = new CodecPort(I2cBus);
-    audio_groups = xEventGroupCreate();
-    xEventGroupSetBits(audio_groups, set_bit_button(0));
-    xTaskCreate(key1_button_user_Task, "key1_button_user_Task", 4 * 1024, NULL, 3, NULL);
-    xTaskCreate(audio_user_Task, "audio_user_Task", 4 * 1024, NULL, 3, NULL);
-}
\ No newline at end of file
+    selection_handles[0] = AppCore_Subscribe(AppEventButton, key1_button_user_handler, NULL);
+    selection_handles[1] = AppCore_Subscribe(AppEventTimer, audio_timer_handler, NULL);
+    audio_play(AudioPort);                     /*先播说明, 再播当前模式*/
+}
+
+/*等提示音停下再复位codec并释放, 避免切换时的爆音*/
+void Mode_Selection_Deinit(void) {
+    for (int i = 0; i < 2; i++) {
+        AppCore_Unsubscribe(selection_handles[i]);
+        selection_handles[i] = -1;
+    }
+    taskENTER_CRITICAL(&audio_lock);
+    audio_stop = true;
+    taskEXIT_CRITICAL(&audio_lock);
+    for (;;) {
+        taskENTER_CRITICAL(&audio_lock);
+        bool playing = audio_playing;
+        taskEXIT_CRITICAL(&audio_lock);
+        if (!playing) {
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    AppCore_TimerStop(AppTimerAudio);
+    uint8_t regs = AudioPort->Codec_GetCodecReg("es8311",0xfa);
+    ESP_LOGW("es8311 reg","0x%02x",regs);
+    AudioPort->Codec_SetCodecReg("es8311", 0xfa, regs | 0x01);
+    regs = AudioPort->Codec_GetCodecReg("es7210",0x00);
+    ESP_LOGW("es7210 reg","0x%02x",regs);
+    AudioPort->Codec_SetCodecReg("es7210", 0x00, regs | 0x06);
+    vTaskDelay(pdMS_TO_TICKS(300));
+    AudioPort->Codec_SetCodecReg("es8311", 0xfa, 0x00);
+    AudioPort->Codec_SetCodecReg("es7210", 0x00, 0x32);
+    delete AudioPort;
+    AudioPort = NULL;
+}
@@ -6,16 +6,26 @@
 #include <esp_sleep.h>
 #include "display_bsp.h"
 #include "server_app.h"
+#include "library_app.h"
+#include "power_bsp.h"
+#include "power_profile.h"
 #include "button_bsp.h"
+#include "led_bsp.h"
 #include "user_app.h"
+#include "app_core.h"
+#include "mode_manager.h"
 #include "traverse_nvs.h"
 
 #define ext_wakeup_pin_3 GPIO_NUM_4
+#define NETWORK_AP_IDLE_MS   (30 * 1000)    // AP模式定时唤醒后, 30s内没人连接就继续睡
+#define NETWORK_KEY_IDLE_MS  (3 * 60 * 1000) // 按键唤醒或STA模式
 
 TraverseNvs *nvs_viewer = NULL;
 static const char *TAG = "NetWorkMode";
-static EventGroupHandle_t sleep_group;
 static uint8_t NetWorkMode = 0;     /*默认*/
+static int     network_handles[4] = {-1, -1, -1, -1};   // 服务器, PWR, BOOT, PMIC
+static bool    network_running = false;            // 切走模式后, 排在后面的刷新任务直接放弃
+static int     network_render_id = 0;              // 上传触发的第几次显示, 进度事件带上它
 
 uint8_t Get_nvsNetworkMode(void) {
     esp_err_t ret;
@@ -49,135 +59,158 @@ uint8_t Get_CurrentlyNetworkMode(void) {
     return NetWorkMode;
 }
 
-static void Network_user_Task(void *arg) {
-    ePaperDisplay.EPD_Init();
-    for (;;) {
-        EventBits_t even = xEventGroupWaitBits(ServerPortGroups, set_bit_all, pdTRUE, pdFALSE, pdMS_TO_TICKS(2000));
-        if (get_bit_button(even, 0)) {
-            Red_led_arg = 1;                                           
-            xEventGroupSetBits(Red_led_Mode_queue, set_bit_button(6)); 
-        } else if (get_bit_button(even, 1)) {
-            Red_led_arg = 0;                
-        } else if (get_bit_button(even, 2)) {
-            if (pdTRUE == xSemaphoreTake(epaper_gui_semapHandle,2000)) {
-                xEventGroupSetBits(Green_led_Mode_queue, set_bit_button(6));
-                Green_led_arg = 1;
-                ePaperDisplay.EPD_SDcardBmpShakingColor("/sdcard/02_sys_ap_img/user_send.bmp",0,0);
-                ePaperDisplay.EPD_Display();  
-                xSemaphoreGive(epaper_gui_semapHandle); 
-                Green_led_arg = 0;
-                if(NetWorkMode != Get_NetworkMode()) {
-                    NetWorkMode = Get_NetworkMode();
-                    Set_nvsNetworkMode(NetWorkMode);
-                }
-            }
-        } else if (get_bit_button(even, 5)) {
-            const uint64_t ext_wakeup_pin_3_mask = 1ULL << ext_wakeup_pin_3;
-            ESP_ERROR_CHECK(esp_sleep_enable_ext1_wakeup_io(ext_wakeup_pin_3_mask, ESP_EXT1_WAKEUP_ANY_LOW)); 
-            ESP_ERROR_CHECK(rtc_gpio_pulldown_dis(ext_wakeup_pin_3));
-            ESP_ERROR_CHECK(rtc_gpio_pullup_en(ext_wakeup_pin_3));
-            esp_sleep_enable_timer_wakeup(30 * 1000 * 1000); 
-            ServerPort_SetNetworkSleep();                             
-            vTaskDelay(pdMS_TO_TICKS(500));                        
-            esp_deep_sleep_start();                          
-        } else if (get_bit_button(even, 4)) {
-            if(!NetWorkMode) {
-                xEventGroupClearBits(sleep_group, rset_bit_data(0)); 
-                xEventGroupSetBits(sleep_group, set_bit_button(1));  
+/*上传触发的显示进度转发给网页端; 只在 Network_render_job 里挂上, 图库后台转码不推*/
+static void Network_epd_progress(EPDProgressStage stage, int percent, void *ctx) {
+    static const char *const names[] = {"dither", "spi", "refresh", "done"};
+    ServerPort_PushJobEvent(names[stage], percent, 100, (int) (intptr_t) ctx);
+}
+
+static void Network_deep_sleep(void) {
+    const uint64_t ext_wakeup_pin_3_mask = 1ULL << ext_wakeup_pin_3;
+    ESP_ERROR_CHECK(esp_sleep_enable_ext1_wakeup_io(ext_wakeup_pin_3_mask, ESP_EXT1_WAKEUP_ANY_LOW)); 
+    ESP_ERROR_CHECK(rtc_gpio_pulldown_dis(ext_wakeup_pin_3));
+    ESP_ERROR_CHECK(rtc_gpio_pullup_en(ext_wakeup_pin_3));
+    esp_sleep_enable_timer_wakeup(30 * 1000 * 1000); 
+    ServerPort_SetNetworkSleep();                             
+    PowerProfile_Sleep(30);
+    vTaskDelay(pdMS_TO_TICKS(500));                        
+    esp_deep_sleep_start();                          
+}
+
+/*上传完成后在work_pool里解码刷新*/
+static void Network_render_job(void *arg) {
+    if (pdTRUE == xSemaphoreTake(epaper_gui_semapHandle,portMAX_DELAY)) {     /*图库转码可能正占用显存, 等它转完*/
+        if (!network_running) {
+            xSemaphoreGive(epaper_gui_semapHandle);
+            return;
+        }
+        Led_Play(LED_PIN_Green, &LedPatternBusy);
+        const char *upload = ServerPort_GetUploadPath();
+        int         job    = ++network_render_id;
+        ePaperDisplay.EPD_SetProgressCallback(Network_epd_progress, (void *) (intptr_t) job);
+        ServerPort_PushJobEvent("decode", 0, 0, job);
+        PowerProfile_Mark(PowerStageDecode);
+        if (strstr(upload, ".epd")) {       /*网页端已抖动打包, 直接读进显存*/
+            if (ePaperDisplay.EPD_SDcardLoadFrame(upload) != ESP_OK) {
+                ESP_LOGE(TAG, "Bad frame upload: %s", upload);
             }
+        } else {
+            ePaperDisplay.EPD_SDcardBmpShakingColor(upload,0,0);
+        }
+        if (ServerPort_IsCancelled()) {     /*开始刷新后就停不下来了, 只能在发送前取消*/
+            ServerPort_PushJobEvent("cancelled", 0, 0, job);
+        } else {
+            PowerProfile_Mark(PowerStageRefresh);
+            ePaperDisplay.EPD_Display();  
+        }
+        ePaperDisplay.EPD_SetProgressCallback(NULL, NULL);
+        PowerProfile_Mark(PowerStageIdle);
+        xSemaphoreGive(epaper_gui_semapHandle); 
+        Led_Stop(LED_PIN_Green, LED_OFF);
+        if(NetWorkMode != Get_NetworkMode()) {
+            NetWorkMode = Get_NetworkMode();
+            Set_nvsNetworkMode(NetWorkMode);
         }
     }
 }
 
-static void Network_sleep_Task(void *arg) {
-    size_t time = 0;
-    for (;;) {
-        EventBits_t even = xEventGroupWaitBits(sleep_group, (0x01 | 0x02), pdFALSE, pdFALSE, pdMS_TO_TICKS(1000));
-        if (get_bit_button(even, 0)) {
-            vTaskDelay(pdMS_TO_TICKS(500));
-            time++;
-            if (time == 60) {
-                const uint64_t ext_wakeup_pin_3_mask = 1ULL << ext_wakeup_pin_3;
-                ESP_ERROR_CHECK(esp_sleep_enable_ext1_wakeup_io(ext_wakeup_pin_3_mask, ESP_EXT1_WAKEUP_ANY_LOW)); 
-                ESP_ERROR_CHECK(rtc_gpio_pulldown_dis(ext_wakeup_pin_3));
-                ESP_ERROR_CHECK(rtc_gpio_pullup_en(ext_wakeup_pin_3));
-                esp_sleep_enable_timer_wakeup(30 * 1000 * 1000); // 15s
-                ServerPort_SetNetworkSleep();                             
-                vTaskDelay(pdMS_TO_TICKS(500));                        
-                esp_deep_sleep_start();                          
-            }
-        } else if (get_bit_button(even, 1)) {
-            time = 0;
-            xEventGroupClearBits(sleep_group, rset_bit_data(1)); 
-        }
+static void Network_server_handler(const AppEvent_t *event, void *ctx) {
+    uint32_t bits = (uint32_t) event->value;
+    if (get_bit_button(bits, 0)) {
+        Led_Play(LED_PIN_Red, &LedPatternBusy);
+    } else if (get_bit_button(bits, 1)) {
+        Led_Stop(LED_PIN_Red, LED_ON);
+    } else if (get_bit_button(bits, 2)) {
+        AppCore_RunWork(Network_render_job, NULL);
+    } else if (get_bit_button(bits, 5) || (get_bit_button(bits, 7) && !NetWorkMode)) {
+        Network_deep_sleep();
     }
 }
 
-static void get_wakeup_gpio(void) {
+/*按键唤醒说明有人要上传图片, 给更长的空闲时间*/
+static uint32_t get_wakeup_gpio(void) {
     esp_sleep_wakeup_cause_t wakeup_reason = esp_sleep_get_wakeup_cause();
+    if (NetWorkMode || !Mode_IsColdStart()) {     /*从模式选择切过来的也是有人在用*/
+        return NETWORK_KEY_IDLE_MS;
+    }
     if (ESP_SLEEP_WAKEUP_EXT1 == wakeup_reason) {
         uint64_t wakeup_pins = esp_sleep_get_ext1_wakeup_status();
-        if (wakeup_pins == 0)
-            return;
         if (wakeup_pins & (1ULL << ext_wakeup_pin_3)) {
-            if(!NetWorkMode) {xEventGroupClearBits(sleep_group, rset_bit_data(0));} 
+            return NETWORK_KEY_IDLE_MS;
         }
-    } else if (ESP_SLEEP_WAKEUP_TIMER == wakeup_reason) {
     }
+    return NETWORK_AP_IDLE_MS;
 }
 
-static void pwr_button_user_Task(void *arg) {
-    for (;;) {
-        EventBits_t even = xEventGroupWaitBits(PWRButtonGroups, set_bit_all, pdTRUE, pdFALSE, pdMS_TO_TICKS(2000));
-        if (get_bit_button(even, 0)) {
-            const uint64_t ext_wakeup_pin_3_mask = 1ULL << ext_wakeup_pin_3;
-            ESP_ERROR_CHECK(esp_sleep_enable_ext1_wakeup_io(ext_wakeup_pin_3_mask, ESP_EXT1_WAKEUP_ANY_LOW)); 
-            ESP_ERROR_CHECK(rtc_gpio_pulldown_dis(ext_wakeup_pin_3));
-            ESP_ERROR_CHECK(rtc_gpio_pullup_en(ext_wakeup_pin_3));
-            esp_sleep_enable_timer_wakeup(30 * 1000 * 1000);
-            ServerPort_SetNetworkSleep();     
-            vTaskDelay(pdMS_TO_TICKS(500)); 
-            esp_deep_sleep_start();  
-        }
+static void pwr_button_user_handler(const AppEvent_t *event, void *ctx) {
+    if (event->code == BUTTON_KEY_PWR && event->value == 0) {
+        Network_deep_sleep();
     }
 }
 
-static void boot_button_user_Task(void *arg) {
-    for (;;) {
-        EventBits_t even = xEventGroupWaitBits(BootButtonGroups, GroupBit1, pdTRUE, pdFALSE, pdMS_TO_TICKS(2000));
-        if (even & GroupBit1) {
-            Set_nvsNetworkMode(0);
-            esp_restart();
-        }
+/*插上USB: 马上排一次后台补缩略图, 不用等下一次空闲*/
+static void Network_power_handler(const AppEvent_t *event, void *ctx) {
+    if (event->value & PMIC_EVENT_VBUS_INSERT) {
+        Library_SetPowerCheck(Axp2101_isExternalPower);
+    }
+}
+
+/*STA连不上时长按BOOT回到AP模式重新配网*/
+static void boot_button_user_handler(const AppEvent_t *event, void *ctx) {
+    if (event->code == BUTTON_KEY_BOOT && event->value == 1) {
+        Set_nvsNetworkMode(0);
+        Mode_Switch(ModeNetwork);               /*停掉再按AP模式起来*/
     }
 }
 
 void User_Network_mode_app_init(void) {
+    network_running = true;
+    PowerProfile_SetMode(PowerModeNetwork);
+    PowerProfile_Mark(PowerStageWifi);
     if((NetWorkMode = Get_nvsNetworkMode())) {
         ESP_LOGW(TAG,"STA模式");
-        nvs_viewer = new TraverseNvs();
-        wifi_credential_t creden = nvs_viewer->Get_WifiCredentialFromNVS();
+        wifi_credential_t creden = {};
+        if (!ServerPort_GetCachedCredential(&creden)) {
+            nvs_viewer = new TraverseNvs();
+            creden     = nvs_viewer->Get_WifiCredentialFromNVS();
+        }
         if(0 == creden.is_valid) {
-            xEventGroupSetBits(Red_led_Mode_queue,GroupBit1); 
-            xTaskCreate(boot_button_user_Task, "boot_button_user_Task", 6 * 1024, NULL, 3, NULL);
+            Led_Play(LED_PIN_Red, &LedPatternError);
+            network_handles[2] = AppCore_Subscribe(AppEventButton, boot_button_user_handler, NULL);
             return;
         }
         uint8_t res = ServerPort_NetworkSTAInit(creden); 
         if(0 == res) {
-            xTaskCreate(boot_button_user_Task, "boot_button_user_Task", 6 * 1024, NULL, 3, NULL);
+            network_handles[2] = AppCore_Subscribe(AppEventButton, boot_button_user_handler, NULL);
             return;
         }
         Mdns_init_config();
     } else {
         ESP_LOGW(TAG,"AP模式");
-        sleep_group = xEventGroupCreate();
-        xEventGroupSetBits(sleep_group, set_bit_button(0)); 
         ServerPort_NetworkAPInit();
     }
     ServerPort_init(SDPort);                                                      
-    xEventGroupSetBits(Red_led_Mode_queue,set_bit_button(0)); 
-    xTaskCreate(Network_user_Task, "Network_user_Task", 6 * 1024, NULL, 2, NULL);
-    if(!NetWorkMode) {xTaskCreate(Network_sleep_Task, "Network_sleep_Task", 4 * 1024, NULL, 2, NULL);}
-    xTaskCreate(pwr_button_user_Task, "pwr_button_user_Task", 4 * 1024, NULL, 2, NULL);
-    get_wakeup_gpio(); 
+    PowerProfile_Mark(PowerStageIdle);
+    Library_SetPowerCheck(Axp2101_isExternalPower);  /*插着USB时后台补缩略图*/
+    Led_Stop(LED_PIN_Red, LED_ON);
+    network_handles[0] = AppCore_Subscribe(AppEventServer, Network_server_handler, NULL);
+    network_handles[1] = AppCore_Subscribe(AppEventButton, pwr_button_user_handler, NULL);
+    network_handles[3] = AppCore_Subscribe(AppEventPower, Network_power_handler, NULL);
+    ServerPort_StartIdleTimer(get_wakeup_gpio());   /*AP模式超时后深睡, STA模式超时后进入省电监听*/
+}
+
+/*调用时已持有 epaper_gui_semapHandle, 上传的图不会刷到一半*/
+void User_Network_mode_app_deinit(void) {
+    network_running = false;
+    for (int i = 0; i < 4; i++) {
+        AppCore_Unsubscribe(network_handles[i]);
+        network_handles[i] = -1;
+    }
+    ServerPort_Deinit();
+    Library_Stop();
+    if (nvs_viewer != NULL) {
+        delete nvs_viewer;
+        nvs_viewer = NULL;
+    }
+    Led_Stop(LED_PIN_Red, LED_OFF);
 }
@@ -0,0 +1,227 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include "ai_job_queue.h"
+
+static const char *TAG = "AiJob";
+
+typedef struct {
+    int          id;
+    uint32_t     key;
+    AiJobState_t state;
+    bool         cached;
+    int64_t      submit_us;
+    int64_t      finish_us;
+    char        *prompt;
+    char         path[AI_JOB_PATH_LEN];
+} AiJob_t;
+
+static AiJob_t           s_jobs[AI_JOB_MAX];
+static int               s_next_id       = 1;
+static SemaphoreHandle_t s_lock          = NULL;
+static SemaphoreHandle_t s_pending       = NULL;  // 排队的任务数
+static SemaphoreHandle_t s_display_free  = NULL;  // 显示槽空闲
+static AiJobDisplay_t    s_display       = {};
+static BaseAIModel      *s_model         = NULL;
+static void            (*s_on_ready)(void) = NULL;
+
+static bool ai_job_active(const AiJob_t *job) {
+    return job->state == AiJobQueued || job->state == AiJobGenerating || job->state == AiJobDisplaying;
+}
+
+static AiJob_t *ai_job_find(int id) {
+    for (int i = 0; i < AI_JOB_MAX; i++) {
+        if (s_jobs[i].id == id && s_jobs[i].state != AiJobIdle) {
+            return &s_jobs[i];
+        }
+    }
+    return NULL;
+}
+
+static void ai_job_finish(AiJob_t *job, AiJobState_t state) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    job->state     = state;
+    job->finish_us = esp_timer_get_time();
+    xSemaphoreGive(s_lock);
+    ESP_LOGI(TAG, "Job %d %s in %d ms", job->id, AiJob_StateName(state), (int) ((job->finish_us - job->submit_us) / 1000));
+}
+
+/*结果交给显示任务; 上一个结果还没被取走时等待, 不丢弃*/
+static void ai_job_hand_over(AiJob_t *job, uint8_t *jpg, int jpg_len) {
+    xSemaphoreTake(s_display_free, portMAX_DELAY);
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_display.id      = job->id;
+    s_display.jpg     = jpg;
+    s_display.jpg_len = jpg_len;
+    strlcpy(s_display.path, job->path, sizeof(s_display.path));
+    job->state = AiJobDisplaying;
+    xSemaphoreGive(s_lock);
+    if (s_on_ready != NULL) {
+        s_on_ready();
+    }
+}
+
+static void ai_job_task(void *arg) {
+    for (;;) {
+        xSemaphoreTake(s_pending, portMAX_DELAY);
+        AiJob_t *job = NULL;
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        for (int i = 0; i < AI_JOB_MAX; i++) {   // 先提交的先处理
+            if (s_jobs[i].state == AiJobQueued && (job == NULL || s_jobs[i].id < job->id)) {
+                job = &s_jobs[i];
+            }
+        }
+        if (job != NULL) {
+            job->state = AiJobGenerating;
+        }
+        xSemaphoreGive(s_lock);
+        if (job == NULL) {
+            continue;
+        }
+
+        struct stat st;
+        if (stat(job->path, &st) == 0) {
+            job->cached = true;
+            ai_job_hand_over(job, NULL, 0);
+            continue;
+        }
+        s_model->BaseAIModel_SetChat(job->prompt);
+        if (s_model->BaseAIModel_GenerateImg() != ESP_OK) {
+            ai_job_finish(job, AiJobFailed);
+            continue;
+        }
+        int      len = 0;
+        uint8_t *jpg = s_model->BaseAIModel_TakeImg(&len);
+        ai_job_hand_over(job, jpg, len);
+    }
+}
+
+void AiJob_Init(BaseAIModel *model, void (*on_ready)(void)) {
+    s_model        = model;
+    s_on_ready     = on_ready;
+    s_lock         = xSemaphoreCreateMutex();
+    s_pending      = xSemaphoreCreateCounting(AI_JOB_MAX, 0);
+    s_display_free = xSemaphoreCreateBinary();
+    xSemaphoreGive(s_display_free);
+    xTaskCreate(ai_job_task, "ai_job_task", 6 * 1024, NULL, 2, NULL);
+}
+
+int AiJob_Submit(const char *prompt) {
+    if (s_lock == NULL || prompt == NULL || prompt[0] == '\0') {
+        return -1;
+    }
+    uint32_t key = s_model->BaseAIModel_PromptKey(prompt);
+    int      id  = -1;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    AiJob_t *slot = NULL;
+    for (int i = 0; i < AI_JOB_MAX; i++) {
+        if (ai_job_active(&s_jobs[i]) && s_jobs[i].key == key) {
+            id = s_jobs[i].id;   // 相同提示词已在处理中
+            break;
+        }
+        /*空槽优先, 其次替换最早结束的任务*/
+        if (!ai_job_active(&s_jobs[i]) && (slot == NULL || s_jobs[i].state == AiJobIdle ||
+                                           (slot->state != AiJobIdle && s_jobs[i].id < slot->id))) {
+            slot = &s_jobs[i];
+        }
+    }
+    if (id < 0 && slot != NULL) {
+        char *copy = slot->prompt;
+        if (copy == NULL) {
+            copy = (char *) heap_caps_malloc(AI_JOB_PROMPT_LEN, MALLOC_CAP_SPIRAM);
+        }
+        if (copy != NULL) {
+            memset(slot, 0, sizeof(AiJob_t));
+            slot->prompt = copy;
+            strlcpy(slot->prompt, prompt, AI_JOB_PROMPT_LEN);
+            slot->id        = s_next_id++;
+            slot->key       = key;
+            slot->state     = AiJobQueued;
+            slot->submit_us = esp_timer_get_time();
+            snprintf(slot->path, sizeof(slot->path), AI_JOB_CACHE_DIR "/ai_%08lx.epd", (unsigned long) key);
+            id = slot->id;
+            xSemaphoreGive(s_pending);
+        }
+    }
+    xSemaphoreGive(s_lock);
+    ESP_LOGI(TAG, "Submit \"%s\" -> job %d", prompt, id);
+    return id;
+}
+
+bool AiJob_GetInfo(int id, AiJobInfo_t *info) {
+    if (s_lock == NULL) {
+        return false;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    AiJob_t *job = NULL;
+    if (id > 0) {
+        job = ai_job_find(id);
+    } else {
+        for (int i = 0; i < AI_JOB_MAX; i++) {
+            if (s_jobs[i].state != AiJobIdle && (job == NULL || s_jobs[i].id > job->id)) {
+                job = &s_jobs[i];
+            }
+        }
+    }
+    if (job != NULL) {
+        int64_t end      = ai_job_active(job) ? esp_timer_get_time() : job->finish_us;
+        info->id         = job->id;
+        info->state      = job->state;
+        info->cached     = job->cached;
+        info->elapsed_ms = (uint32_t) ((end - job->submit_us) / 1000);
+        strlcpy(info->path, job->path, sizeof(info->path));
+    }
+    xSemaphoreGive(s_lock);
+    return job != NULL;
+}
+
+const char *AiJob_StateName(AiJobState_t state) {
+    switch (state) {
+    case AiJobQueued:
+        return "queued";
+    case AiJobGenerating:
+        return "generating";
+    case AiJobDisplaying:
+        return "displaying";
+    case AiJobDone:
+        return "done";
+    case AiJobSuperseded:
+        return "superseded";
+    case AiJobFailed:
+        return "failed";
+    default:
+        return "idle";
+    }
+}
+
+bool AiJob_TakeDisplay(AiJobDisplay_t *out) {
+    if (s_lock == NULL) {
+        return false;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool ok = s_display.id != 0;
+    if (ok) {
+        *out = s_display;
+        memset(&s_display, 0, sizeof(s_display));
+    }
+    xSemaphoreGive(s_lock);
+    if (ok) {
+        xSemaphoreGive(s_display_free);
+    }
+    return ok;
+}
+
+void AiJob_DisplayDone(int id, AiJobState_t state) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    AiJob_t *job = ai_job_find(id);
+    xSemaphoreGive(s_lock);
+    if (job != NULL) {
+        ai_job_finish(job, state);
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "ai_app.h"
+
+#define AI_JOB_MAX        4       // 同时保留的任务数(含已完成, 供查询进度)
+#define AI_JOB_PROMPT_LEN 1024
+#define AI_JOB_PATH_LEN   48
+#define AI_JOB_CACHE_DIR  "/sdcard/04_sys_ai_img"
+
+typedef enum {
+    AiJobIdle = 0,
+    AiJobQueued,
+    AiJobGenerating,    // 请求方舟生成并下载JPG
+    AiJobDisplaying,    // 等待显示任务解码刷新
+    AiJobDone,
+    AiJobSuperseded,    // 显示前被别的显示命令取代, 帧已存进缓存
+    AiJobFailed,
+} AiJobState_t;
+
+typedef struct {
+    int          id;
+    AiJobState_t state;
+    bool         cached;                   // 结果来自SD卡缓存, 不经过网络
+    uint32_t     elapsed_ms;               // 提交到现在(完成时为总耗时)
+    char         path[AI_JOB_PATH_LEN];    // 结果帧(.epd)
+} AiJobInfo_t;
+
+/*交给显示任务的结果: jpg 非空时解码新图并把帧存到 path, 否则直接显示 path*/
+typedef struct {
+    int      id;
+    uint8_t *jpg;
+    int      jpg_len;
+    char     path[AI_JOB_PATH_LEN];
+} AiJobDisplay_t;
+
+void AiJob_Init(BaseAIModel *model, void (*on_ready)(void));    /*on_ready: 有结果等待显示时调用*/
+int  AiJob_Submit(const char *prompt);                          /*返回任务号, 相同提示词已在处理中时返回原任务号, 队列满返回-1*/
+bool AiJob_GetInfo(int id, AiJobInfo_t *info);                  /*id<=0 查询最近一个任务*/
+const char *AiJob_StateName(AiJobState_t state);
+bool AiJob_TakeDisplay(AiJobDisplay_t *out);                    /*显示任务取结果, jpg 由调用方 heap_caps_free*/
+void AiJob_DisplayDone(int id, AiJobState_t state);             /*state: Done, Superseded 或 Failed*/
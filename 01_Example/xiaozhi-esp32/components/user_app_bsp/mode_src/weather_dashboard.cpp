@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include "user_app.h"
+#include "weather_dashboard.h"
+
+static const char *TAG = "dashboard";
+
+#define DASH_IMG_DIR    "/sdcard/01_sys_init_img/"
+#define DASH_ATLAS_PATH DASH_IMG_DIR "sys_atlas.epa"
+
+typedef enum {
+    DashSprite = 0,  // 图集里的固定精灵, name 指定
+    DashIcon,        // 天气图标, 由 field 的天气类型选择
+    DashText,        // 黑字白底
+    DashTextCenter,  // 同上, x 为列起点, 按字数居中
+    DashAqi,         // 空气质量, field 为 int, 白字彩底
+} DashItemType_t;
+
+typedef struct {
+    DashItemType_t type;
+    int16_t        x;
+    int16_t        y;
+    uint16_t       field;  // WeatherData_t 内的偏移
+    cFONT         *font;
+    const char    *name;
+} DashItem_t;
+
+#define DASH_FIELD(f) offsetof(WeatherData_t, f)
+#define DASH_DAY(d, x)                                                 \
+    {DashIcon, (x) + 12, 92, DASH_FIELD(d##_type), NULL, NULL},        \
+    {DashText, (x) + 8, 34, DASH_FIELD(d##_weather), &Font14CN, NULL}, \
+    {DashText, (x) + 10, 58, DASH_FIELD(d##_week), &Font14CN, NULL},   \
+    {DashText, (x), 176, DASH_FIELD(d##_Temp), &Font14CN, NULL},       \
+    {DashTextCenter, (x), 208, DASH_FIELD(d##_type), &Font14CN, NULL}, \
+    {DashTextCenter, (x), 234, DASH_FIELD(d##_fx), &Font14CN, NULL},   \
+    {DashAqi, (x), 264, DASH_FIELD(d##_aqi), &Font14CN, NULL}
+
+/*天气界面布局, 按顺序绘制*/
+static const DashItem_t DashLayout[] = {
+    {DashSprite, 0, 0, 0, NULL, "00_init"},
+    DASH_DAY(td, 74),
+    DASH_DAY(tmr, 262),
+    DASH_DAY(tdat, 450),
+    DASH_DAY(stdat, 638),
+    {DashText, 44, 367, DASH_FIELD(calendar), &Font22CN, NULL},
+    {DashText, 118, 410, DASH_FIELD(td_week), &Font18CN, NULL},
+};
+
+/*打进图集的图片, 与 WeatherPort_GetSdCardImageName 的文件名一致*/
+static const char *const DashSprites[] = {
+    "00_init", "01_dayu", "02_duoyun", "03_leiyu", "04_qin",
+    "05_xiaoyu", "06_xiaxue", "07_zhongyu", "08_yin",
+};
+#define DASH_SPRITE_COUNT (sizeof(DashSprites) / sizeof(DashSprites[0]))
+
+static SpriteAtlas DashAtlas;
+static bool        DashAtlasReady = false;
+
+/*任一源图比图集新, 就需要重新生成*/
+static bool dashboard_atlas_stale(void) {
+    struct stat atlas_st;
+    struct stat src_st;
+    char        path[64];
+    if (stat(DASH_ATLAS_PATH, &atlas_st) != 0) {
+        return true;
+    }
+    for (int i = 0; i < (int) DASH_SPRITE_COUNT; i++) {
+        snprintf(path, sizeof(path), DASH_IMG_DIR "%s.bmp", DashSprites[i]);
+        if (stat(path, &src_st) == 0 && src_st.st_mtime > atlas_st.st_mtime) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void WeatherDashboard_Prepare(void) {
+    if (DashAtlasReady) {
+        return;
+    }
+    if (!dashboard_atlas_stale() && DashAtlas.SpriteAtlas_Load(DASH_ATLAS_PATH) == ESP_OK &&
+        DashAtlas.SpriteAtlas_Count() == (int) DASH_SPRITE_COUNT) {
+        DashAtlasReady = true;
+        return;
+    }
+    /*没有图集或已过期: 逐张转换一次并写回SD卡*/
+    DashAtlas.SpriteAtlas_Clear();
+    bool complete = true;
+    char path[64];
+    for (int i = 0; i < (int) DASH_SPRITE_COUNT; i++) {
+        EPDSprite_t sprite;
+        snprintf(path, sizeof(path), DASH_IMG_DIR "%s.bmp", DashSprites[i]);
+        if (ePaperDisplay.EPD_SDcardBmpToSprite(path, &sprite) != ESP_OK) {
+            complete = false;
+            continue;
+        }
+        if (DashAtlas.SpriteAtlas_Add(DashSprites[i], &sprite) != ESP_OK) {
+            heap_caps_free(sprite.data);
+            complete = false;
+        }
+    }
+    if (complete) {
+        DashAtlas.SpriteAtlas_Save(DASH_ATLAS_PATH);
+    }
+    DashAtlasReady = true;
+}
+
+/*图集里没有时退回直接读BMP*/
+static void dashboard_draw_sprite(const char *name, int x, int y) {
+    const EPDSprite_t *sprite = DashAtlas.SpriteAtlas_Find(name);
+    if (sprite != NULL) {
+        ePaperDisplay.EPD_DrawSprite(sprite, x, y);
+        return;
+    }
+    char path[64];
+    snprintf(path, sizeof(path), DASH_IMG_DIR "%s.bmp", name);
+    ePaperDisplay.EPD_SDcardBmpShakingColor(path, x, y);
+}
+
+void WeatherDashboard_Render(WeatherPort *port, const WeatherData_t *data) {
+    TickType_t  start = xTaskGetTickCount();
+    const char *base  = (const char *) data;
+    char        name[EPD_ATLAS_NAME_LEN];
+    WeatherDashboard_Prepare();
+    for (int i = 0; i < (int) (sizeof(DashLayout) / sizeof(DashLayout[0])); i++) {
+        const DashItem_t *item = &DashLayout[i];
+        const char       *str  = base + item->field;
+        switch (item->type) {
+            case DashSprite:
+                dashboard_draw_sprite(item->name, item->x, item->y);
+                break;
+            case DashIcon: {
+                const char *path = strrchr(port->WeatherPort_GetSdCardImageName(str), '/') + 1;
+                int         len  = strcspn(path, ".");
+                snprintf(name, sizeof(name), "%.*s", len, path);
+                dashboard_draw_sprite(name, item->x, item->y);
+                break;
+            }
+            case DashText:
+                ePaperDisplay.EPD_DrawStringCN(item->x, item->y, str, item->font, ColorBlack, ColorWhite);
+                break;
+            case DashTextCenter:
+                ePaperDisplay.EPD_DrawStringCN(port->WeatherPort_ReassignCoordinates(item->x, str), item->y, str, item->font, ColorBlack, ColorWhite);
+                break;
+            case DashAqi: {
+                WeatherAqi_t aqi = port->WeatherPort_GetWeatherAQI(*(const int *) str);
+                ePaperDisplay.EPD_DrawStringCN(port->WeatherPort_ReassignCoordinates(item->x, aqi.str), item->y, aqi.str, item->font, ColorWhite, aqi.color);
+                break;
+            }
+        }
+    }
+    ESP_LOGI(TAG, "Dashboard composed in %lu ms", (unsigned long) pdTICKS_TO_MS(xTaskGetTickCount() - start));
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+#include "weather_app.h"
+
+void WeatherDashboard_Prepare(void);                                        /*载入或生成精灵图集, 首次绘制前调用*/
+void WeatherDashboard_Render(WeatherPort *port, const WeatherData_t *data); /*按布局表绘制天气界面到显存, 不刷新屏幕*/
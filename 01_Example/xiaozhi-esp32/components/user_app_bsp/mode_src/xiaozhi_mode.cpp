@@ -1,16 +1,26 @@
 #include <stdio.h>
 #include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include <esp_heap_caps.h>
 #include <nvs_flash.h>
 #include <driver/rtc_io.h>
 #include "user_app.h"
+#include "app_core.h"
+#include "display_queue.h"
 #include "ai_app.h"
+#include "ai_job_queue.h"
 #include "application.h"
+#include "board.h"
+#include "assets.h"
 #include "client_app.h"
 #include "weather_app.h"
+#include "weather_dashboard.h"
 #include "button_bsp.h"
+#include "led_bsp.h"
 #include "list.h"
 #include "i2c_equipment.h"
+#include "power_profile.h"
 
 //#include "esp_mac.h"
 
@@ -23,21 +33,27 @@ Shtc3Port *PeraPort = NULL;
 
 char THData[40];
 int                sdcard_bmp_Quantity = 0; // The number of images in the sdcard directory  // Used in Xiaozhi main code
-int                sdcard_doc_count    = 0; // The index of the image  // Used in Xiaozhi main code
-int                is_ai_img           = 1; // If the current process is refreshing, then the AI-generated images cannot be generated
-EventGroupHandle_t ai_IMG_Group;            // Task group for ai_IMG
 
 char   *str_ai_chat_buff = NULL; // This is a text-to-image conversion. The default text length is 1024.
 list_t *sdcard_score     = NULL; // The high-score list requires memory allocation and deallocation
 
-char sleep_buff[18]; 
+enum XiaozhiVoiceState {
+    XiaozhiVoiceUnknown = 0,
+    XiaozhiVoiceIdle,
+    XiaozhiVoiceListening,
+    XiaozhiVoiceSpeaking,
+};
+static volatile uint8_t xiaozhi_voice = XiaozhiVoiceUnknown;   // 由 application 的状态回调更新
 
-SemaphoreHandle_t ai_img_while_semap; 
-
-EventGroupHandle_t ai_IMG_LoopGroup;  // AI image loop event group
-int img_loopTimer = 1 * 60 * 1000;    // Default 1 minute
-int img_loopCount = 0;                // Loop count
+static int  img_loopTimer = 1 * 60 * 1000;    // Default 1 minute
+static bool img_looping   = false;            // 轮播开关, 由 AppTimerImgLoop 驱动
+static int  img_loopCount = 0;                // Loop count
 
+/*每条AI显示命令消耗AI队列里的一个结果*/
+typedef struct {
+    AiJobDisplay_t job;
+    bool           taken;
+} XiaozhiAiCmd_t;
 
 void xiaozhi_init_received(const char *arg1) 
 {
@@ -48,7 +64,7 @@ void xiaozhi_init_received(const char *arg1)
         Oneime          = 1;
         const char *str = auto_get_weather_json();
         ESP_LOGW("xiaozhi_init","received arg:%s",arg1);
-        xEventGroupSetBits(Red_led_Mode_queue, set_bit_button(0));
+        Led_Stop(LED_PIN_Red, LED_ON);
         if(str == NULL) {
             ESP_LOGE("xiaozhi_init","json decoding failed");
             return;
@@ -58,20 +74,28 @@ void xiaozhi_init_received(const char *arg1)
             ESP_LOGE("xiaozhi_init","WeatherData is NULL");
             return;
         }     
-        xEventGroupSetBits(epaper_groups, set_bit_button(0));
+        AppCore_TimerStart(AppTimerWeather, 3000, false);   /*延时放在定时器里, 不占着显存和工作任务*/
     }
 }
 
 void xiaozhi_application_received(const char *str) {
     static bool is_led_flag = false;
-    strcpy(sleep_buff, str);
+    if (strstr(str, "idle") != NULL) {
+        xiaozhi_voice = XiaozhiVoiceIdle;
+    } else if (strstr(str, "listening") != NULL) {
+        xiaozhi_voice = XiaozhiVoiceListening;
+    } else if (strstr(str, "speaking") != NULL) {
+        xiaozhi_voice = XiaozhiVoiceSpeaking;
+    } else {
+        xiaozhi_voice = XiaozhiVoiceUnknown;
+    }
     if (is_led_flag) {
-        if (strstr(sleep_buff, "idle") != NULL) {
+        if (xiaozhi_voice == XiaozhiVoiceIdle) {
             gpio_set_level((gpio_num_t) 45, 1);
             is_led_flag = false;
         }
     } else {
-        if ((strstr(sleep_buff, "listening") != NULL) || (strstr(sleep_buff, "speaking") != NULL)) {
+        if (xiaozhi_voice == XiaozhiVoiceListening || xiaozhi_voice == XiaozhiVoiceSpeaking) {
             gpio_set_level((gpio_num_t) 45, 0);
             is_led_flag = true;
         }
@@ -85,166 +109,214 @@ void xiaozhi_ai_Message(const char *arg1, const char *arg2) //ai chat
     }
 }
 
-static void gui_user_Task(void *arg) {
-    int *sdcard_doc = (int *) arg;
-    ePaperDisplay.EPD_Init();
-    for (;;) {
-        EventBits_t even = xEventGroupWaitBits(epaper_groups, set_bit_all, pdTRUE, pdFALSE, portMAX_DELAY); 
-        if (pdTRUE == xSemaphoreTake(epaper_gui_semapHandle, 2000)) {
-            xEventGroupSetBits(Green_led_Mode_queue, set_bit_button(6));
-            Green_led_arg = 1;
-            is_ai_img     = 0;           
-            if (get_bit_button(even, 0)) {
-                vTaskDelay(pdMS_TO_TICKS(3000));  
-                char      *strURL = NULL;
-                WeatherAqi_t aqi_data;
-                uint16_t   x_or = 0;
-                ePaperDisplay.EPD_SDcardBmpShakingColor("/sdcard/01_sys_init_img/00_init.bmp",0,0);
-                strURL = WeaPort.WeatherPort_GetSdCardImageName(WeatherData->td_type);
-                ePaperDisplay.EPD_SDcardBmpShakingColor(strURL, 86, 92);
-                strURL = WeaPort.WeatherPort_GetSdCardImageName(WeatherData->tmr_type);
-                ePaperDisplay.EPD_SDcardBmpShakingColor(strURL, 274, 92);
-                strURL = WeaPort.WeatherPort_GetSdCardImageName(WeatherData->tdat_type);
-                ePaperDisplay.EPD_SDcardBmpShakingColor(strURL, 462, 92);
-                strURL = WeaPort.WeatherPort_GetSdCardImageName(WeatherData->stdat_type);
-                ePaperDisplay.EPD_SDcardBmpShakingColor(strURL, 650, 92);
-                
-                ePaperDisplay.EPD_DrawStringCN(82, 34, WeatherData->td_weather, &Font14CN, ColorBlack, ColorWhite);
-                ePaperDisplay.EPD_DrawStringCN(84, 58, WeatherData->td_week, &Font14CN, ColorBlack, ColorWhite);
-                ePaperDisplay.EPD_DrawStringCN(74, 176, WeatherData->td_Temp, &Font14CN, ColorBlack, ColorWhite);
-                x_or = WeaPort.WeatherPort_ReassignCoordinates(74, WeatherData->td_type);
-                ePaperDisplay.EPD_DrawStringCN(x_or, 208, WeatherData->td_type, &Font14CN, ColorBlack, ColorWhite);
-                x_or = WeaPort.WeatherPort_ReassignCoordinates(74, WeatherData->td_fx);
-                ePaperDisplay.EPD_DrawStringCN(x_or, 234, WeatherData->td_fx, &Font14CN, ColorBlack, ColorWhite);
-                aqi_data = WeaPort.WeatherPort_GetWeatherAQI(WeatherData->td_aqi);
-                x_or     = WeaPort.WeatherPort_ReassignCoordinates(74, aqi_data.str);
-                ePaperDisplay.EPD_DrawStringCN(x_or, 264, aqi_data.str, &Font14CN, ColorWhite, aqi_data.color);
-                
-                ePaperDisplay.EPD_DrawStringCN(270, 34, WeatherData->tmr_weather, &Font14CN, ColorBlack, ColorWhite);
-                ePaperDisplay.EPD_DrawStringCN(272, 58, WeatherData->tmr_week, &Font14CN, ColorBlack, ColorWhite);
-                ePaperDisplay.EPD_DrawStringCN(262, 176, WeatherData->tmr_Temp, &Font14CN, ColorBlack, ColorWhite);
-                x_or = WeaPort.WeatherPort_ReassignCoordinates(262, WeatherData->tmr_type);
-                ePaperDisplay.EPD_DrawStringCN(x_or, 208, WeatherData->tmr_type, &Font14CN, ColorBlack, ColorWhite);
-                x_or = WeaPort.WeatherPort_ReassignCoordinates(262, WeatherData->tmr_fx);
-                ePaperDisplay.EPD_DrawStringCN(x_or, 234, WeatherData->tmr_fx, &Font14CN, ColorBlack, ColorWhite);
-                aqi_data = WeaPort.WeatherPort_GetWeatherAQI(WeatherData->tmr_aqi);
-                x_or     = WeaPort.WeatherPort_ReassignCoordinates(262, aqi_data.str);
-                ePaperDisplay.EPD_DrawStringCN(x_or, 264, aqi_data.str, &Font14CN, ColorWhite, aqi_data.color);
-                
-                ePaperDisplay.EPD_DrawStringCN(458, 34, WeatherData->tdat_weather, &Font14CN, ColorBlack, ColorWhite);
-                ePaperDisplay.EPD_DrawStringCN(460, 58, WeatherData->tdat_week, &Font14CN, ColorBlack, ColorWhite);
-                ePaperDisplay.EPD_DrawStringCN(450, 176, WeatherData->tdat_Temp, &Font14CN, ColorBlack, ColorWhite);
-                x_or = WeaPort.WeatherPort_ReassignCoordinates(450, WeatherData->tdat_type);
-                ePaperDisplay.EPD_DrawStringCN(x_or, 208, WeatherData->tdat_type, &Font14CN, ColorBlack, ColorWhite);
-                x_or = WeaPort.WeatherPort_ReassignCoordinates(450, WeatherData->tdat_fx);
-                ePaperDisplay.EPD_DrawStringCN(x_or, 234, WeatherData->tdat_fx, &Font14CN, ColorBlack, ColorWhite);
-                aqi_data = WeaPort.WeatherPort_GetWeatherAQI(WeatherData->tdat_aqi);
-                x_or     = WeaPort.WeatherPort_ReassignCoordinates(450, aqi_data.str);
-                ePaperDisplay.EPD_DrawStringCN(x_or, 264, aqi_data.str, &Font14CN, ColorWhite, aqi_data.color);
-                
-                ePaperDisplay.EPD_DrawStringCN(646, 34, WeatherData->stdat_weather, &Font14CN, ColorBlack, ColorWhite);
-                ePaperDisplay.EPD_DrawStringCN(648, 58, WeatherData->stdat_week, &Font14CN, ColorBlack, ColorWhite);
-                ePaperDisplay.EPD_DrawStringCN(638, 176, WeatherData->stdat_Temp, &Font14CN, ColorBlack, ColorWhite);
-                x_or = WeaPort.WeatherPort_ReassignCoordinates(638, WeatherData->stdat_type);
-                ePaperDisplay.EPD_DrawStringCN(x_or, 208, WeatherData->stdat_type, &Font14CN, ColorBlack, ColorWhite);
-                x_or = WeaPort.WeatherPort_ReassignCoordinates(638, WeatherData->stdat_fx);
-                ePaperDisplay.EPD_DrawStringCN(x_or, 234, WeatherData->stdat_fx, &Font14CN, ColorBlack, ColorWhite);
-                aqi_data = WeaPort.WeatherPort_GetWeatherAQI(WeatherData->stdat_aqi);
-                x_or     = WeaPort.WeatherPort_ReassignCoordinates(638, aqi_data.str);
-                ePaperDisplay.EPD_DrawStringCN(x_or, 264, aqi_data.str, &Font14CN, ColorWhite, aqi_data.color);
+/*assets分区里有 epd_font_<size>.bin 时替换对应的固定字库*/
+static void xiaozhi_load_packed_fonts() {
+    static PackedFont packed[3];
+    static cFONT     *fonts[3] = {&Font14CN, &Font18CN, &Font22CN};
+    static const char *names[3] = {"epd_font_14.bin", "epd_font_18.bin", "epd_font_22.bin"};
+    Assets *assets = Board::GetInstance().GetAssets();
+    if (assets == NULL || !assets->checksum_valid()) {
+        return;
+    }
+    for (int i = 0; i < 3; i++) {
+        void  *ptr  = NULL;
+        size_t size = 0;
+        if (packed[i].PackedFont_IsValid() || !assets->GetAssetData(names[i], ptr, size)) {
+            continue;
+        }
+        if (packed[i].PackedFont_Open(ptr, size) == ESP_OK) {
+            ePaperDisplay.EPD_AttachPackedFont(fonts[i], &packed[i]);
+            ESP_LOGI(TAG, "Using %s", names[i]);
+        }
+    }
+}
 
-                ePaperDisplay.EPD_DrawStringCN(44, 367, WeatherData->calendar, &Font22CN, ColorBlack, ColorWhite);
-                ePaperDisplay.EPD_DrawStringCN(118, 410, WeatherData->td_week, &Font18CN, ColorBlack, ColorWhite);
+/*以下 render/done 都在显示队列的任务里执行*/
+static esp_err_t xiaozhi_weather_render(void *ctx) {
+    xiaozhi_load_packed_fonts();
+    WeatherDashboard_Render(&WeaPort, WeatherData);
+    //heap_caps_free(WeatherData);
+    return ESP_OK;
+}
 
-                ePaperDisplay.EPD_Display();
-                //heap_caps_free(WeatherData);
-            } else if (get_bit_button(even, 1)) {
-                xEventGroupClearBits(ai_IMG_LoopGroup, 0x01);  
-                *sdcard_doc -= 1;
-                list_node_t *sdcard_node = list_at(ListHost, *sdcard_doc); 
-                if (sdcard_node != NULL) {
-                    CustomSDPortNode_t *sdcard_Name_node = (CustomSDPortNode_t *) sdcard_node->val;
-                    SDPort->SDPort_SetCurrentlyNode(sdcard_node);
-                    ESP_LOGW(TAG,"voice_Sort:%d,list_Sort:%d,path:%s",(*sdcard_doc+1),*sdcard_doc,sdcard_Name_node->sdcard_name);
-                    ePaperDisplay.EPD_SDcardScaleIMGShakingColor(sdcard_Name_node->sdcard_name,0,0);
-                    ePaperDisplay.EPD_Display();
-                }
-            } else if (get_bit_button(even, 2)) {                     
-                ePaperDisplay.EPD_SDcardBmpShakingColor(AiModel->Get_AiTFImgName(),0,0);
-                ePaperDisplay.EPD_Display();
-            } else if (get_bit_button(even, 3)) {
-                img_loopCount--;                  
-                list_node_t *node = list_at(ListHost, img_loopCount);
-                if (node != NULL) {
-                    CustomSDPortNode_t *sdcard_Name_node_ai = (CustomSDPortNode_t *) node->val;
-                    SDPort->SDPort_SetCurrentlyNode(node);
-                    ESP_LOGW(TAG,"loop_Sort:%d,list_Sort:%d,path:%s",(img_loopCount+1),img_loopCount,sdcard_Name_node_ai->sdcard_name);
-                    ePaperDisplay.EPD_SDcardScaleIMGShakingColor(sdcard_Name_node_ai->sdcard_name,0,0);
-                    ePaperDisplay.EPD_Display();
-                }
-                if(img_loopCount == 0) {
-                    img_loopCount = sdcard_bmp_Quantity;
-                }
-            }
-            xSemaphoreGive(epaper_gui_semapHandle); 
-            Green_led_arg = 0;                      
-            is_ai_img     = 1;                      
+static esp_err_t xiaozhi_ai_render(void *ctx) {
+    XiaozhiAiCmd_t *ai = (XiaozhiAiCmd_t *) ctx;
+    esp_err_t       err;
+    if (!AiJob_TakeDisplay(&ai->job)) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    ai->taken = true;
+    if (ai->job.jpg != NULL) {
+        err = ePaperDisplay.EPD_JPGBufferShakingColor(ai->job.jpg, ai->job.jpg_len);
+        if (err == ESP_OK) {
+            ePaperDisplay.EPD_SaveFrameAsync(ai->job.path);   // 刷新屏幕的同时后台写SD卡, 下次同样的提示词直接用; 被取代也照样存
+            heap_caps_free(ai->job.jpg);
+            ai->job.jpg = NULL;
         }
+    } else if ((err = ePaperDisplay.EPD_SDcardLoadFrame(ai->job.path)) != ESP_OK) {
+        remove(ai->job.path);   // 缓存帧损坏, 下次重新生成
     }
+    return err;
 }
 
-static void ai_IMG_Task(void *arg) {
-    char *chatStr = (char *) arg;
-    for (;;) {
-        EventBits_t even = xEventGroupWaitBits(ai_IMG_Group, (0x01) | (0x02) | (0x08), pdTRUE, pdFALSE, portMAX_DELAY);
-        if (get_bit_button(even, 0)) {
-            ESP_LOGW("chat", "%s", chatStr);
-            xEventGroupClearBits(ai_IMG_LoopGroup, 0x01);  /*退出轮播*/
-            AiModel->BaseAIModel_SetChat(chatStr);         
-            char *str = AiModel->BaseAIModel_GetImgName();
-            if (str != NULL) {
-                ESP_LOGW("ai_IMG_Task", "Generated image path: %s", str); 
-                xEventGroupSetBits(epaper_groups, set_bit_button(2));                
-            }
-        } else if (get_bit_button(even, 1)) {
-            sdcard_bmp_Quantity = SDPort->SDPort_GetScanListValue(); 
-            xSemaphoreGive(ai_img_while_semap);    
-        } else if (get_bit_button(even, 3)) {              
-            auto &app = Application::GetInstance();
-            if (strstr(sleep_buff, "idle") != NULL) {
+static void xiaozhi_ai_finish(XiaozhiAiCmd_t *ai, esp_err_t result) {
+    heap_caps_free(ai->job.jpg);
+    if (result == ESP_OK) {
+        AiJob_DisplayDone(ai->job.id, AiJobDone);
+    } else if (result == ESP_ERR_INVALID_STATE) {
+        AiJob_DisplayDone(ai->job.id, AiJobSuperseded);
+    } else {
+        ESP_LOGE(TAG, "AI image job %d display failed: %s", ai->job.id, esp_err_to_name(result));
+        AiJob_DisplayDone(ai->job.id, AiJobFailed);
+    }
+    heap_caps_free(ai);
+}
 
-            } else if (strstr(sleep_buff, "listening") != NULL) {
-                app.ToggleChatState();
-            } else if (strstr(sleep_buff, "speaking") != NULL) {
-                app.ToggleChatState();
-                vTaskDelay(pdMS_TO_TICKS(500));
-                app.ToggleChatState();
-            }
-        }
+/*被取代的AI图只解码存帧, 不刷新; 之后的显示命令会重写整个显存*/
+static void xiaozhi_ai_cache_job(void *arg) {
+    XiaozhiAiCmd_t *ai = (XiaozhiAiCmd_t *) arg;
+    xSemaphoreTake(epaper_gui_semapHandle, portMAX_DELAY);
+    esp_err_t err = ePaperDisplay.EPD_JPGBufferShakingColor(ai->job.jpg, ai->job.jpg_len);
+    if (err == ESP_OK) {
+        err = ePaperDisplay.EPD_SaveFrameAsync(ai->job.path);
     }
-    vTaskDelete(NULL);
+    xSemaphoreGive(epaper_gui_semapHandle);
+    xiaozhi_ai_finish(ai, err == ESP_OK ? ESP_ERR_INVALID_STATE : err);
 }
 
-void key_wakeUp_user_Task(void *arg) {
-    for (;;) {
-        EventBits_t even = xEventGroupWaitBits(GP4ButtonGroups, (0x01), pdTRUE, pdFALSE, pdMS_TO_TICKS(2000));
-        if (even & 0x01) {
-            if (strstr(sleep_buff, "idle") != NULL) {
-                gpio_set_level((gpio_num_t) 45, 0);
-                std::string wake_word = "你好小智";
-                Application::GetInstance().WakeWordInvoke(wake_word);
-            }
-        }
+/*没执行就被取代的命令也要把结果取走结掉, 不然任务一直停在displaying; 下载好的图存进缓存, 不丢*/
+static void xiaozhi_ai_done(int id, esp_err_t result, void *ctx) {
+    XiaozhiAiCmd_t *ai = (XiaozhiAiCmd_t *) ctx;
+    if (!ai->taken) {
+        ai->taken = AiJob_TakeDisplay(&ai->job);
+    }
+    if (!ai->taken) {
+        heap_caps_free(ai);
+        return;
+    }
+    if (result == ESP_ERR_INVALID_STATE && ai->job.jpg != NULL && AppCore_RunWork(xiaozhi_ai_cache_job, ai) == ESP_OK) {
+        return;
+    }
+    xiaozhi_ai_finish(ai, result);
+}
+
+static void xiaozhi_loop_done(int id, esp_err_t result, void *ctx) {
+    if (result == ESP_OK) {
+        PowerProfile_Flush();      // 该模式不深睡, 每轮换图写一次
+    }
+}
+
+static int xiaozhi_post_image(int index, DispDone_t done) {
+    list_node_t *node = list_at(ListHost, index);
+    if (node == NULL) {
+        return -1;
+    }
+    CustomSDPortNode_t *sdcard_Name_node = (CustomSDPortNode_t *) node->val;
+    SDPort->SDPort_SetCurrentlyNode(node);
+    ESP_LOGW(TAG,"Sort:%d,list_Sort:%d,path:%s",(index+1),index,sdcard_Name_node->sdcard_name);
+    DispCmd_t cmd = {};
+    cmd.type      = DispCmdImage;
+    cmd.done      = done;
+    snprintf(cmd.path, sizeof(cmd.path), "%s", sdcard_Name_node->sdcard_name);
+    return DispQueue_Post(&cmd);
+}
+
+int xiaozhi_show_image(int number) {
+    xiaozhi_img_loop_stop();
+    return xiaozhi_post_image(number - 1, NULL);
+}
+
+/*AI任务队列有结果等待显示*/
+static void ai_img_ready(void) {
+    xiaozhi_img_loop_stop();  /*退出轮播*/
+    XiaozhiAiCmd_t *ai = (XiaozhiAiCmd_t *) heap_caps_calloc(1, sizeof(XiaozhiAiCmd_t), MALLOC_CAP_DEFAULT);
+    if (ai == NULL) {
+        ESP_LOGE(TAG, "AI display cmd alloc failed");
+        return;
+    }
+    DispCmd_t cmd = {};
+    cmd.type      = DispCmdRender;
+    cmd.render    = xiaozhi_ai_render;
+    cmd.ctx       = ai;
+    cmd.done      = xiaozhi_ai_done;
+    DispQueue_Post(&cmd);
+}
+
+int xiaozhi_ai_img_submit(void) {
+    ESP_LOGW("chat", "%s", str_ai_chat_buff);
+    return AiJob_Submit(str_ai_chat_buff);
+}
+
+int xiaozhi_ai_img_status(int id, char *buf, int len) {
+    AiJobInfo_t info;
+    if (!AiJob_GetInfo(id, &info)) {
+        return snprintf(buf, len, "{\"state\":\"none\"}");
     }
+    return snprintf(buf, len, "{\"job\":%d,\"state\":\"%s\",\"cached\":%s,\"elapsed_ms\":%lu}", info.id,
+                    AiJob_StateName(info.state), info.cached ? "true" : "false", (unsigned long) info.elapsed_ms);
 }
 
-void pwr_sleep_user_Task(void *arg) {
-    for (;;) {
-        EventBits_t even = xEventGroupWaitBits(PWRButtonGroups, (0x01), pdTRUE, pdFALSE, pdMS_TO_TICKS(2000));
-        if (even & 0x01) {
-            xEventGroupSetBits(ai_IMG_Group, 0x08);
-            gpio_set_level((gpio_num_t) 45, 1); 
+int xiaozhi_img_count(void) {
+    sdcard_bmp_Quantity = SDPort->SDPort_GetScanListValue(); 
+    return sdcard_bmp_Quantity;
+}
+
+/*GP4单击: 空闲时唤醒小智*/
+static void key_wakeUp_user_handler(const AppEvent_t *event, void *ctx) {
+    if (event->code == BUTTON_KEY_GP4 && event->value == 0 && xiaozhi_voice == XiaozhiVoiceIdle) {
+        gpio_set_level((gpio_num_t) 45, 0);
+        std::string wake_word = "你好小智";
+        Application::GetInstance().WakeWordInvoke(wake_word);
+    }
+}
+
+/*PWR单击: 打断聆听, 说话中则打断后500ms再开始聆听*/
+static void pwr_sleep_user_handler(const AppEvent_t *event, void *ctx) {
+    if (event->code != BUTTON_KEY_PWR || event->value != 0) {
+        return;
+    }
+    auto &app = Application::GetInstance();
+    if (xiaozhi_voice == XiaozhiVoiceListening) {
+        app.ToggleChatState();
+    } else if (xiaozhi_voice == XiaozhiVoiceSpeaking) {
+        app.ToggleChatState();
+        AppCore_TimerStart(AppTimerChat, 500, false);
+    }
+    gpio_set_level((gpio_num_t) 45, 1); 
+}
+
+static void xiaozhi_timer_handler(const AppEvent_t *event, void *ctx) {
+    if (event->code == AppTimerChat) {
+        Application::GetInstance().ToggleChatState();
+    } else if (event->code == AppTimerWeather) {
+        DispCmd_t cmd = {};
+        cmd.type      = DispCmdRender;
+        cmd.render    = xiaozhi_weather_render;
+        DispQueue_Post(&cmd);
+    } else if (event->code == AppTimerImgLoop && img_looping) {
+        img_loopCount--;                  
+        xiaozhi_post_image(img_loopCount, xiaozhi_loop_done);
+        if(img_loopCount <= 0) {
+            img_loopCount = sdcard_bmp_Quantity;
         }
+        AppCore_TimerStart(AppTimerImgLoop, img_loopTimer, false);
+    }
+}
+
+void xiaozhi_img_loop_start(void) {
+    img_looping = true;
+    AppCore_TimerStart(AppTimerImgLoop, 1000, false);
+}
+
+void xiaozhi_img_loop_stop(void) {
+    img_looping = false;
+    AppCore_TimerStop(AppTimerImgLoop);
+}
+
+void xiaozhi_img_loop_set_interval(int ms) {
+    img_loopTimer = ms;
+    if (img_looping) {
+        AppCore_TimerStart(AppTimerImgLoop, img_loopTimer, false);
     }
 }
 
@@ -257,21 +329,12 @@ char* Get_TemperatureHumidity(void) {
     return NULL;
 }
 
-void ai_IMG_LoopTask(void *arg) {
-    for (;;) {
-        EventBits_t even = xEventGroupWaitBits(ai_IMG_LoopGroup, (0x01), pdFALSE, pdFALSE, portMAX_DELAY);
-        if (get_bit_button(even, 0)) {
-            vTaskDelay(pdMS_TO_TICKS(1000));
-            xEventGroupSetBits(epaper_groups, set_bit_button(3)); 
-        }
-        vTaskDelay(pdMS_TO_TICKS(img_loopTimer));
-    }
-}
-
 void User_xiaozhi_app_init(void)                        // Initialization in the Xiaozhi mode
 {
     PeraPort = new Shtc3Port(I2cBus);
+    PowerProfile_SetMode(PowerModeXiaozhi);
     ListHost = SDPort->SDPort_GetListHost();
+    AppCore_Subscribe(AppEventTimer, xiaozhi_timer_handler, NULL);     // 没有AI配置时也要显示天气
     AiModel = new BaseAIModel(SDPort,decdither,800,480);
     BaseAIModelConfig_t* AIconfig = AiModel->BaseAIModel_SdcardReadAIModelConfig();
     if (AIconfig != NULL) {                             //Obtain key, url, model
@@ -281,16 +344,13 @@ void User_xiaozhi_app_init(void)                        // Initialization in the
     }
     AiModel->BaseAIModel_AIModelInit(AIconfig->model,AIconfig->url,AIconfig->key);
     gpio_set_level((gpio_num_t) 45, 0);
-    ai_img_while_semap = xSemaphoreCreateBinary();
     str_ai_chat_buff   = (char *) heap_caps_malloc(1024, MALLOC_CAP_SPIRAM);
-    ai_IMG_Group       = xEventGroupCreate();
-    ai_IMG_LoopGroup       = xEventGroupCreate();
     SDPort->SDPort_ScanListDir("/sdcard/05_user_ai_img");       // Place the image data under the linked list
     sdcard_bmp_Quantity = SDPort->SDPort_GetScanListValue();    // Traverse the linked list to count the number of images
     img_loopCount = sdcard_bmp_Quantity;
-    xTaskCreate(gui_user_Task, "gui_user_Task", 6 * 1024, &sdcard_doc_count, 2, NULL);
-    xTaskCreate(ai_IMG_Task, "ai_IMG_Task", 6 * 1024, str_ai_chat_buff, 2, NULL);
-    xTaskCreate(ai_IMG_LoopTask, "ai_IMG_LoopTask", 4 * 1024, NULL, 2, NULL);
-    xTaskCreate(key_wakeUp_user_Task, "key_wakeUp_user_Task", 4 * 1024, NULL, 3, NULL); 
-    xTaskCreate(pwr_sleep_user_Task, "pwr_sleep_user_Task", 4 * 1024, NULL, 3, NULL); 
+    DispQueue_Init();
+    str_ai_chat_buff[0] = '\0';
+    AiJob_Init(AiModel, ai_img_ready);
+    AppCore_Subscribe(AppEventButton, key_wakeUp_user_handler, NULL);
+    AppCore_Subscribe(AppEventButton, pwr_sleep_user_handler, NULL);
 }
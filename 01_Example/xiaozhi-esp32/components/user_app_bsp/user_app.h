@@ -13,14 +13,7 @@ extern I2cMasterBus I2cBus;
 
 uint8_t User_Mode_init(void);       // main.cc
 
-extern EventGroupHandle_t Green_led_Mode_queue; 
-extern EventGroupHandle_t Red_led_Mode_queue; 
 extern SemaphoreHandle_t epaper_gui_semapHandle;
-extern uint8_t Green_led_arg;           
-extern uint8_t Red_led_arg;
-extern int img_loopTimer;            
-extern EventGroupHandle_t epaper_groups;
-extern EventGroupHandle_t ai_IMG_LoopGroup;
 
 void User_xiaozhi_app_init(void); // init
 void xiaozhi_init_received(const char *arg1);
@@ -28,12 +21,18 @@ void xiaozhi_ai_Message(const char *arg1, const char *arg2);
 void xiaozhi_application_received(const char *str);
 char* Get_TemperatureHumidity(void);
 extern int sdcard_bmp_Quantity;
-extern int sdcard_doc_count; 
-extern int is_ai_img;        
-extern EventGroupHandle_t ai_IMG_Group;
-extern SemaphoreHandle_t ai_img_while_semap;
+int xiaozhi_ai_img_submit(void);                        // 用最近一句语音提交生图任务, 返回任务号, 队列满返回-1
+int xiaozhi_ai_img_status(int id, char *buf, int len);  // 任务状态(JSON), id<=0 为最近一个任务
+int xiaozhi_img_count(void);                            // 重新统计SD卡里的图片数
+int xiaozhi_show_image(int number);                     // 显示第 number 张(从1开始), 退出轮播, 返回显示命令号
+void xiaozhi_img_loop_start(void);                      // 1s后开始按 img_loopTimer 轮播
+void xiaozhi_img_loop_stop(void);
+void xiaozhi_img_loop_set_interval(int ms);
 
 void User_Basic_mode_app_init(void);
+void User_Basic_mode_app_deinit(void);
 void User_Network_mode_app_init(void);
+void User_Network_mode_app_deinit(void);
 void Mode_Selection_Init(void);
+void Mode_Selection_Deinit(void);
 uint8_t Get_CurrentlyNetworkMode(void);
\ No newline at end of file
@@ -43,6 +43,8 @@ public:
     inline bool partition_valid() const { return partition_valid_; }
     inline bool checksum_valid() const { return checksum_valid_; }
     inline std::string default_assets_url() const { return default_assets_url_; }
+    // The returned pointer is mmap'd flash and stays valid until the next Download()
+    bool GetAssetData(const std::string& name, void*& ptr, size_t& size);
 
 private:
     Assets(const Assets&) = delete;
@@ -50,7 +52,6 @@ private:
 
     bool InitializePartition();
     uint32_t CalculateChecksum(const char* data, uint32_t length);
-    bool GetAssetData(const std::string& name, void*& ptr, size_t& size);
 
     const esp_partition_t* partition_ = nullptr;
     esp_partition_mmap_handle_t mmap_handle_ = 0;
@@ -38,39 +38,40 @@ class waveshare_PhotoPainter : public WifiBoard {
         auto &mcp_server = McpServer::GetInstance();
         mcp_server.AddTool("self.disp.SwitchPictures", "切换本地或 SD 卡中的图片，通过整数参数指定图片序号（如 “显示第 1 张图片”）", PropertyList({Property("value", kPropertyTypeInteger, 1, sdcard_bmp_Quantity)}), [this](const PropertyList &properties) -> ReturnValue {
             int value = properties["value"].value<int>();
-            sdcard_doc_count = value;
-            xEventGroupSetBits(epaper_groups, 0x02);        //  0000  0010
-            return true;
+            return xiaozhi_show_image(value) > 0;       //Latest request wins, queued ones are dropped
         });
 
         mcp_server.AddTool("self.disp.getNumberimages", "获取 SD 卡中存储的图片文件总数，无输入参数，返回整数类型的图片数量", PropertyList(), [this](const PropertyList &) -> ReturnValue {
-            xEventGroupSetBits(ai_IMG_Group, 0x02);       //Retrieve the images from the SD card
-            if (xSemaphoreTake(ai_img_while_semap, pdMS_TO_TICKS(2000)) == pdTRUE) {
-                return sdcard_bmp_Quantity;
-            } else {
-                return false;
-            }
+            return xiaozhi_img_count();       //Retrieve the images from the SD card
         });
 
-        mcp_server.AddTool("self.disp.aiIMG", "这个是用户可以根据语音生成图片的(图片生成大概需要10-20s时间),比如：帮我生成一张动漫图片,直接生成就好，不要回复乱七八糟的东西", PropertyList(), [this](const PropertyList &) -> ReturnValue {
+        mcp_server.AddTool("self.disp.aiIMG", "这个是用户可以根据语音生成图片的(图片生成大概需要10-20s时间),比如：帮我生成一张动漫图片,直接生成就好，不要回复乱七八糟的东西。返回任务号和状态,cached为true表示之前生成过,直接显示", PropertyList(), [this](const PropertyList &) -> ReturnValue {
             ESP_LOGI("MCP", "进入MCP aiIMG");
-            if (!is_ai_img) { //Indicates that the image is being refreshed
-                ESP_LOGE("MCP", "is_ai_img fill %d", is_ai_img);
+            int  id = xiaozhi_ai_img_submit();      //Queued, the screen refresh no longer blocks new requests
+            char buf[96];
+            if (id < 0) {
+                ESP_LOGE("MCP", "ai img queue full");
                 return false;
             }
-            xEventGroupSetBits(ai_IMG_Group, 0x01);         //Indicates that access to the volcano is permitted to obtain IMG.
-            return true;
+            xiaozhi_ai_img_status(id, buf, sizeof(buf));
+            return std::string(buf);
+        });
+
+        mcp_server.AddTool("self.disp.aiIMGStatus", "查询AI生图任务进度(queued排队/generating生成中/displaying刷新屏幕/done完成/superseded被其他显示取代,图已缓存/failed失败),job为aiIMG返回的任务号,不填查询最近一个", PropertyList({Property("job", kPropertyTypeInteger, 0, 0, 1000000)}), [this](const PropertyList &properties) -> ReturnValue {
+            char buf[96];
+            xiaozhi_ai_img_status(properties["job"].value<int>(), buf, sizeof(buf));
+            return std::string(buf);
         });
 
         mcp_server.AddTool("self.disp.imgloop", "进入轮询播放图片模式,循环sd卡里面的图片", PropertyList(), [this](const PropertyList &) -> ReturnValue {
             ESP_LOGI("MCP", "进入imgloop");
-            xEventGroupSetBits(ai_IMG_LoopGroup, 0x01); 
+            xiaozhi_img_loop_start(); 
             return true;
         });
 
         mcp_server.AddTool("self.disp.imgloopEit", "退出轮询播放图片模式,不在循环sd卡里面的图片", PropertyList(), [this](const PropertyList &) -> ReturnValue {
             ESP_LOGI("MCP", "进入imgloopEit");
-            xEventGroupClearBits(ai_IMG_LoopGroup, 0x01); 
+            xiaozhi_img_loop_stop(); 
             return true;
         });
 
@@ -78,7 +79,7 @@ class waveshare_PhotoPainter : public WifiBoard {
             ESP_LOGI("MCP", "进入imgsetTimerloop");
             int value = properties["timer"].value<int>();
             ESP_LOGE("min timer", "%d", value);
-            img_loopTimer = value * 60 * 1000;
+            xiaozhi_img_loop_set_interval(value * 60 * 1000);
             return true;
         });
 
@@ -86,7 +87,7 @@ class waveshare_PhotoPainter : public WifiBoard {
             ESP_LOGI("MCP", "进入imgsetTimerloop");
             int value = properties["timer"].value<int>();
             ESP_LOGE("h timer", "%d", value);
-            img_loopTimer = value * 3600 * 1000;
+            xiaozhi_img_loop_set_interval(value * 3600 * 1000);
             return true;
         });
 
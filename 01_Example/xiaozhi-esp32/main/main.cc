@@ -11,6 +11,7 @@
 #include "system_info.h"
 
 #include "user_app.h"
+#include "mode_manager.h"
 
 #define TAG "main"
 
@@ -59,18 +60,5 @@ extern "C" void app_main(void) {
         return;
     }
 
-    if (read_value == 0x03) {
-        ESP_LOGW("main","Enter xiaozhi mode");
-        auto &app = Application::GetInstance();
-        app.Start();
-    } else if (read_value == 0x01) {
-        ESP_LOGW("main","Enter Basic mode");
-        User_Basic_mode_app_init();
-    } else if (read_value == 0x02) {
-        ESP_LOGW("main","Enter Network mode");
-        User_Network_mode_app_init();
-    } else if (read_value == 0x04) {
-        ESP_LOGW("main","Enter Mode Selection");
-        Mode_Selection_Init();
-    }
+    Mode_Start(read_value, Mode_value);   /*之后的模式切换不再重启, 进出小智模式除外*/
 }
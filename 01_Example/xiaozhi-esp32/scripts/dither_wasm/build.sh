@@ -0,0 +1,18 @@
+#!/bin/sh
+# Build dither.wasm for the web UI from the firmware's dither core.
+# Needs emscripten (emcc) on PATH.
+#
+#   scripts/dither_wasm/build.sh [output]
+#
+# The default output is the SD card image's 03_sys_ap_html directory; copy
+# dither.wasm to the card next to script.min.js. Without it the page falls
+# back to a JavaScript port of the same integer kernel.
+set -e
+HERE=$(cd "$(dirname "$0")" && pwd)
+CORE="$HERE/../../components/app_bsp"
+OUT="${1:-$HERE/../../../../02_SDCARD/03_sys_ap_html/dither.wasm}"
+
+emcc -O3 --no-entry -sSTANDALONE_WASM -sINITIAL_MEMORY=4MB -sALLOW_MEMORY_GROWTH=0 \
+    -sEXPORTED_FUNCTIONS=_dither_input,_dither_output,_dither_run \
+    -I"$CORE" "$HERE/dither_wasm.c" "$CORE/dither_core.c" -o "$OUT"
+echo "$OUT: $(wc -c < "$OUT") bytes"
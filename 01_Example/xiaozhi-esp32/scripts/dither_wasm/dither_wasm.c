@@ -0,0 +1,62 @@
+/*
+ * WebAssembly entry points for the web UI (02_SDCARD/03_sys_ap_html).
+ *
+ * The page copies an RGBA canvas into dither_input(), calls dither_run()
+ * and reads back packed panel ink codes from dither_output(). The kernel
+ * is components/app_bsp/dither_core.c, the same code the firmware runs,
+ * so the uploaded frame matches what the device would have produced.
+ *
+ * No allocator and no imports: buffers are sized for one 800x480 frame.
+ */
+#include <stdint.h>
+#include <string.h>
+#include "dither_core.h"
+
+#define DITHER_MAX_W      800
+#define DITHER_MAX_PIXELS (800 * 480)
+
+#define EXPORT __attribute__((used, visibility("default")))
+
+static uint8_t rgba_in[DITHER_MAX_PIXELS * 4];
+static uint8_t ink_out[DITHER_MAX_PIXELS / 2];
+static uint8_t rows[3][DITHER_MAX_W * 3];
+
+EXPORT uint8_t *dither_input(void) {
+    return rgba_in;
+}
+
+EXPORT uint8_t *dither_output(void) {
+    return ink_out;
+}
+
+static void load_row(uint8_t *dst, const uint8_t *rgba, int w) {
+    for (int x = 0; x < w; x++) {
+        dst[x * 3 + 0] = rgba[x * 4 + 0];
+        dst[x * 3 + 1] = rgba[x * 4 + 1];
+        dst[x * 3 + 2] = rgba[x * 4 + 2];
+    }
+}
+
+/*Rows are handled exactly like ImgDecode_DitherStreamPush: the next row is loaded fresh before the current one diffuses into it*/
+EXPORT int dither_run(int w, int h) {
+    if (w <= 0 || h <= 0 || w > DITHER_MAX_W || w * h > DITHER_MAX_PIXELS) {
+        return -1;
+    }
+    int      stride = (w + 1) / 2;
+    uint8_t *cur    = rows[0];
+    uint8_t *next   = rows[1];
+    uint8_t *out    = rows[2];
+    load_row(cur, rgba_in, w);
+    for (int y = 0; y < h; y++) {
+        bool has_next = y + 1 < h;
+        if (has_next) {
+            load_row(next, rgba_in + (y + 1) * w * 4, w);
+        }
+        dither_core_row(cur, next, out, w, has_next, DitherOutInk4);
+        memcpy(ink_out + y * stride, out, stride);
+        uint8_t *tmp = cur;
+        cur          = next;
+        next         = tmp;
+    }
+    return 0;
+}
@@ -0,0 +1,82 @@
+#!/usr/bin/env python3
+"""
+Pack already-dithered images into an e-paper sprite atlas (EPA1).
+
+The layout matches components/port_bsp/sprite_atlas.h. Pixels are mapped
+to panel colors the same way as ePaperPort::EPD_ColorToePaperColor: exact
+black/white/red/green/blue/yellow, anything else becomes white.
+
+The weather screen looks for /sdcard/01_sys_init_img/sys_atlas.epa and
+builds it on the device when it is missing or older than the BMPs, so
+this tool is only needed to ship the atlas pre-built:
+
+    python3 scripts/epd_atlas_gen.py -o sys_atlas.epa 01_sys_init_img/0*.bmp
+
+Sprite names are the file names without extension (at most 23 bytes).
+"""
+import argparse
+import os
+import struct
+import sys
+
+MAGIC = b"EPA1"
+HEADER = struct.Struct("<4sI")
+ENTRY = struct.Struct("<24sHHI")
+MAX_SPRITES = 16
+
+# ColorSelection in display_bsp.h
+INK = {
+    (0, 0, 0): 0,
+    (255, 255, 255): 1,
+    (255, 255, 0): 2,
+    (255, 0, 0): 3,
+    (0, 0, 255): 5,
+    (0, 255, 0): 6,
+}
+
+
+def pack_image(path):
+    from PIL import Image
+
+    img = Image.open(path).convert("RGB")
+    w, h = img.size
+    px = img.load()
+    stride = (w + 1) // 2
+    data = bytearray(stride * h)
+    for y in range(h):
+        for x in range(w):
+            c = INK.get(px[x, y], 1)
+            data[y * stride + (x >> 1)] |= c if x & 1 else c << 4
+    return w, h, bytes(data)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Pack images into an EPA1 sprite atlas")
+    parser.add_argument("images", nargs="+")
+    parser.add_argument("-o", "--output", required=True)
+    args = parser.parse_args()
+    if len(args.images) > MAX_SPRITES:
+        raise SystemExit("at most %d sprites per atlas" % MAX_SPRITES)
+
+    sprites = []
+    for path in args.images:
+        name = os.path.splitext(os.path.basename(path))[0].encode("utf-8")
+        if len(name) > 23:
+            raise SystemExit("sprite name too long: %s" % name.decode())
+        sprites.append((name,) + pack_image(path))
+
+    offset = HEADER.size + ENTRY.size * len(sprites)
+    table = bytearray()
+    for name, w, h, data in sprites:
+        table += ENTRY.pack(name, w, h, offset)
+        offset += len(data)
+    with open(args.output, "wb") as f:
+        f.write(HEADER.pack(MAGIC, len(sprites)))
+        f.write(table)
+        for sprite in sprites:
+            f.write(sprite[3])
+    print("%s: %d sprites, %d bytes" % (args.output, len(sprites), offset))
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,191 @@
+#!/usr/bin/env python3
+"""
+Generate a packed e-paper font (EPF1) for the assets partition.
+
+The layout matches components/port_bsp/epd_font.h: a header, a glyph table
+sorted by codepoint, then tight 1-bit bitmaps (one bounding box per glyph,
+MSB first, rows not padded).
+
+From a TTF/OTF font (needs Pillow, fontTools is used to skip missing glyphs
+when installed):
+
+    python3 scripts/epd_font_gen.py --ttf NotoSansSC-Regular.otf --size 20 \\
+        --cell-height 25 --ranges ascii,cjk -o epd_font_14.bin
+
+From one of the existing CH_CN tables, keeping the same glyphs and metrics:
+
+    python3 scripts/epd_font_gen.py --cfont components/port_bsp/src/fonts/font14CN.c \\
+        -o epd_font_14.bin
+
+Copy the result into the assets directory as epd_font_<14|18|22>.bin
+(see spiffs_assets/build.py --epd_fonts) and it replaces the built-in
+Font14CN/Font18CN/Font22CN tables at runtime.
+"""
+import argparse
+import re
+import struct
+import sys
+
+MAGIC = b"EPF1"
+HEADER = struct.Struct("<4sIBBBBBBHI")
+ENTRY = struct.Struct("<IIBBbb")
+
+RANGES = {
+    "ascii": [(0x20, 0x7E)],
+    "punct": [(0x2000, 0x206F), (0x3000, 0x303F), (0xFF00, 0xFFEF)],
+    "cjk": [(0x4E00, 0x9FA5)],
+    "cjk-ext": [(0x3400, 0x4DBF), (0x4E00, 0x9FFF), (0xF900, 0xFAFF)],
+}
+
+
+class Glyph:
+    def __init__(self, code, advance, rows=None, x_off=0, y_off=0):
+        self.code = code
+        self.advance = advance
+        # rows: list of lists of 0/1, already cropped to the bounding box
+        self.rows = rows or []
+        self.x_off = x_off
+        self.y_off = y_off
+
+
+def crop(rows):
+    """Crop a 0/1 matrix to its bounding box, returns (rows, x, y)"""
+    ys = [y for y, r in enumerate(rows) if any(r)]
+    if not ys:
+        return [], 0, 0
+    xs = [x for r in rows for x, v in enumerate(r) if v]
+    x0, x1 = min(xs), max(xs) + 1
+    y0, y1 = ys[0], ys[-1] + 1
+    return [r[x0:x1] for r in rows[y0:y1]], x0, y0
+
+
+def pack(glyphs, line_height, ascent, narrow, wide):
+    glyphs = sorted(glyphs, key=lambda g: g.code)
+    for a, b in zip(glyphs, glyphs[1:]):
+        if a.code == b.code:
+            raise SystemExit("duplicate glyph U+%04X" % a.code)
+    table = bytearray()
+    bitmaps = bytearray()
+    max_w = max_h = 0
+    for g in glyphs:
+        h = len(g.rows)
+        w = len(g.rows[0]) if h else 0
+        if w > 255 or h > 255 or g.advance > 255 or g.code > 0xFFFFFF:
+            raise SystemExit("glyph U+%04X is too large" % g.code)
+        max_w, max_h = max(max_w, w), max(max_h, h)
+        bits = [v for r in g.rows for v in r]
+        data = bytearray((len(bits) + 7) // 8)
+        for i, v in enumerate(bits):
+            if v:
+                data[i >> 3] |= 0x80 >> (i & 7)
+        table += ENTRY.pack(g.code | (g.advance << 24), len(bitmaps), w, h, g.x_off, g.y_off)
+        bitmaps += data
+    bitmap_offset = HEADER.size + len(table)
+    header = HEADER.pack(MAGIC, len(glyphs), line_height, ascent, max_w, max_h, narrow, wide, 0, bitmap_offset)
+    return bytes(header + table + bitmaps)
+
+
+def codepoints(spec, charset_file):
+    cps = set()
+    if charset_file:
+        with open(charset_file, encoding="utf-8") as f:
+            cps.update(ord(c) for c in f.read() if c >= " ")
+    for name in (spec or "").split(","):
+        name = name.strip()
+        if not name:
+            continue
+        if name not in RANGES:
+            raise SystemExit("unknown range %s, choose from %s" % (name, ", ".join(RANGES)))
+        for lo, hi in RANGES[name]:
+            cps.update(range(lo, hi + 1))
+    return sorted(cps)
+
+
+def from_ttf(path, size, cps, cell_height, threshold):
+    from PIL import Image, ImageDraw, ImageFont
+
+    font = ImageFont.truetype(path, size)
+    ascent, descent = font.getmetrics()
+    line_height = cell_height or (ascent + descent)
+    baseline = ascent + (line_height - ascent - descent) // 2
+    try:
+        from fontTools.ttLib import TTFont
+        cmap = TTFont(path, fontNumber=0).getBestCmap()
+    except ImportError:
+        print("fontTools not installed, missing glyphs are not filtered")
+        cmap = None
+
+    glyphs = []
+    for cp in cps:
+        if cmap is not None and cp not in cmap:
+            continue
+        ch = chr(cp)
+        advance = int(round(font.getlength(ch)))
+        left, top, right, bottom = font.getbbox(ch, anchor="ls")
+        w, h = right - left, bottom - top
+        if w <= 0 or h <= 0:
+            glyphs.append(Glyph(cp, advance))
+            continue
+        img = Image.new("L", (w, h), 0)
+        ImageDraw.Draw(img).text((-left, -top), ch, font=font, fill=255, anchor="ls")
+        px = img.load()
+        rows = [[1 if px[x, y] >= threshold else 0 for x in range(w)] for y in range(h)]
+        rows, x0, y0 = crop(rows)
+        glyphs.append(Glyph(cp, advance, rows, left + x0, baseline + top + y0))
+    # advance used for characters missing from the font
+    narrow = int(round(font.getlength(" ")))
+    wide = int(round(font.getlength("\u4e00"))) if cmap is None or 0x4E00 in cmap else size
+    return glyphs, line_height, baseline, narrow, wide
+
+
+def from_cfont(path):
+    with open(path, encoding="utf-8") as f:
+        source = f.read()
+    m = re.search(r"cFONT\s+\w+\s*=\s*\{(.*?)\};", source, re.S)
+    if not m:
+        raise SystemExit("%s: cFONT initializer not found" % path)
+    # table, size, ASCII_Width, Width, Height[, index]
+    fields = [v.strip() for v in re.sub(r"/\*.*?\*/", "", m.group(1), flags=re.S).split(",")]
+    ascii_width, width, height = (int(v) for v in fields[2:5])
+    row_bytes = (width + 7) // 8
+    glyphs = []
+    for m in re.finditer(r'^\{\{"((?:[^"\\]|\\.)*)"\},\{([^}]*)\}\}', source, re.M):
+        text = m.group(1).encode("utf-8").decode("unicode_escape").encode("latin-1").decode("utf-8")
+        data = [int(v, 16) for v in re.findall(r"0x[0-9A-Fa-f]{2}", m.group(2))]
+        rows = []
+        for y in range(height):
+            line = data[y * row_bytes:(y + 1) * row_bytes]
+            line += [0] * (row_bytes - len(line))
+            rows.append([(line[x >> 3] >> (7 - (x & 7))) & 1 for x in range(width)])
+        rows, x0, y0 = crop(rows)
+        advance = ascii_width if ord(text[0]) < 0x80 else width
+        glyphs.append(Glyph(ord(text[0]), advance, rows, x0, y0))
+    return glyphs, height, height, ascii_width, width
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Generate a packed e-paper font (EPF1)")
+    src = parser.add_mutually_exclusive_group(required=True)
+    src.add_argument("--ttf", help="TTF/OTF font file")
+    src.add_argument("--cfont", help="Existing CH_CN font table (.c)")
+    parser.add_argument("--size", type=int, default=20, help="Pixel size for --ttf")
+    parser.add_argument("--cell-height", type=int, default=0, help="Character cell height, default ascent+descent")
+    parser.add_argument("--ranges", default="ascii,punct,cjk", help="Comma separated: " + ",".join(RANGES))
+    parser.add_argument("--charset", help="UTF-8 text file, every character in it is included")
+    parser.add_argument("--threshold", type=int, default=128, help="Gray level treated as ink (0-255)")
+    parser.add_argument("-o", "--output", required=True)
+    args = parser.parse_args()
+
+    if args.ttf:
+        cps = codepoints(args.ranges if not args.charset else "", args.charset)
+        glyphs, line_height, ascent, narrow, wide = from_ttf(args.ttf, args.size, cps, args.cell_height, args.threshold)
+    else:
+        glyphs, line_height, ascent, narrow, wide = from_cfont(args.cfont)
+    data = pack(glyphs, line_height, ascent, narrow, wide)
+    with open(args.output, "wb") as f:
+        f.write(data)
+    print("%s: %d glyphs, cell height %d, %d bytes" % (args.output, len(glyphs), line_height, len(data)))
+
+
+if __name__ == "__main__":
+    sys.exit(main())
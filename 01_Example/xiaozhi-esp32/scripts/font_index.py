@@ -0,0 +1,64 @@
+#!/usr/bin/env python3
+"""
+Regenerate the sorted glyph index of the CH_CN font tables.
+
+EPD_DrawStringCN binary-searches <Name>_Index[], which lists the table
+positions ordered by the UTF-8 bytes of each glyph (padded to 3 bytes).
+Run this after adding or removing glyphs:
+
+    python3 scripts/font_index.py components/port_bsp/src/fonts/font*CN.c
+"""
+import re
+import sys
+
+BEGIN = "/*<font-index>*/"
+END = "/*</font-index>*/"
+
+
+def glyph_keys(source):
+    keys = []
+    for m in re.finditer(r'^\{\{"((?:[^"\\]|\\.)*)"\}', source, re.M):
+        raw = m.group(1).encode("utf-8").decode("unicode_escape").encode("latin-1")
+        keys.append(raw[:3].ljust(3, b"\0"))
+    return keys
+
+
+def build_block(name, keys):
+    order = sorted(range(len(keys)), key=lambda i: (keys[i], i))
+    lines = [BEGIN,
+             "/*按UTF-8编码排序的字模下标, 由 scripts/font_index.py 生成, 增删字模后需重新生成*/",
+             "const uint16_t %s_Index[] = {" % name]
+    for i in range(0, len(order), 16):
+        lines.append("  " + ", ".join(str(v) for v in order[i:i + 16]) + ",")
+    lines.append("};")
+    lines.append('_Static_assert(sizeof(%s_Index) / sizeof(uint16_t) == sizeof(%s_Table) / sizeof(CH_CN), '
+                 '"%s_Index is stale, run scripts/font_index.py");' % (name, name, name))
+    lines.append(END)
+    return "\n".join(lines)
+
+
+def process(path):
+    with open(path, encoding="utf-8") as f:
+        source = f.read()
+    m = re.search(r"const CH_CN (\w+)_Table\[\]", source)
+    if not m:
+        print("%s: no CH_CN table found" % path)
+        return
+    name = m.group(1)
+    block = build_block(name, glyph_keys(source))
+    if BEGIN in source:
+        source = re.sub(re.escape(BEGIN) + ".*?" + re.escape(END), lambda _: block, source, flags=re.S)
+    else:
+        anchor = "cFONT %s = {" % name
+        source = source.replace(anchor, block + "\n\n" + anchor)
+    with open(path, "w", encoding="utf-8") as f:
+        f.write(source)
+    print("%s: %s_Index updated" % (path, name))
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        print(__doc__)
+        sys.exit(1)
+    for p in sys.argv[1:]:
+        process(p)
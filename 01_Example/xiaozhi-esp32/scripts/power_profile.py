@@ -0,0 +1,184 @@
+#!/usr/bin/env python3
+"""
+Turn the per-wake power log written by components/pmicpower/power_profile.cpp
+into charge per refresh and projected battery life per mode.
+
+The AXP2101 has no battery current ADC, so each record only carries the
+battery voltage and the fuel-gauge percentage. Charge is therefore modelled
+from how long each wake spends in every stage, times the power measured for
+that stage on the bench (04_PowerConsumptionTest: ~6.7 mW in deep sleep,
+~166 mW average and ~404 mW peak while refreshing, both at the 5 V input).
+Wi-Fi was not measured separately and defaults to the refresh peak.
+Override any stage with --power, e.g. --power wifi=350 --power sleep=5.
+
+When the log covers enough time on battery, the fuel-gauge drop is used as
+a second, measured estimate next to the model:
+
+    python3 scripts/power_profile.py /path/to/sdcard/power_profile.bin --capacity 1500
+"""
+import argparse
+import struct
+import sys
+from collections import OrderedDict, defaultdict
+
+MAGIC = b"PWR1"
+HEADER = struct.Struct("<4sHHII")
+RECORD = struct.Struct("<HBBIHBBI")
+
+# PowerStage / PowerMode in power_profile.h
+STAGES = ["boot", "sdmount", "decode", "refresh", "wifi", "idle", "sleep"]
+MODES = ["unknown", "basic", "network", "xiaozhi"]
+
+# mW at the 5 V input, see the module docstring
+DEFAULT_POWER = {
+    "boot": 166.0,
+    "sdmount": 166.0,
+    "decode": 166.0,
+    "refresh": 166.0,
+    "wifi": 404.0,
+    "idle": 166.0,
+    "sleep": 6.7,
+}
+
+FLAG_VBUS = 0x01
+
+
+def load(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    if len(data) < HEADER.size:
+        raise SystemExit("%s: too short" % path)
+    magic, rec_size, _, capacity, nxt = HEADER.unpack_from(data)
+    if magic != MAGIC or rec_size != RECORD.size:
+        raise SystemExit("%s: not a PWR1 log" % path)
+    count = min((len(data) - HEADER.size) // rec_size, capacity)
+    start = nxt if count == capacity else 0     # full ring: next is the oldest record
+    records = []
+    for i in range(count):
+        off = HEADER.size + ((start + i) % count) * rec_size
+        wake, mode, stage, t_ms, mv, pct, flags, arg = RECORD.unpack_from(data, off)
+        records.append({
+            "wake": wake,
+            "mode": MODES[mode] if mode < len(MODES) else "mode%d" % mode,
+            "stage": STAGES[stage] if stage < len(STAGES) else "stage%d" % stage,
+            "t": t_ms / 1000.0,
+            "mv": mv,
+            "pct": None if pct == 0xFF else pct,
+            "vbus": bool(flags & FLAG_VBUS),
+            "arg": arg,
+        })
+    return records
+
+
+def split_wakes(records):
+    """Consecutive records with the same wake number form one wake."""
+    wakes = []
+    for rec in records:
+        if not wakes or wakes[-1][0]["wake"] != rec["wake"] or rec["t"] < wakes[-1][-1]["t"]:
+            wakes.append([])
+        wakes[-1].append(rec)
+    return wakes
+
+
+def stage_seconds(wake):
+    """Time spent in each stage; a stage lasts until the next mark, sleep lasts its timer."""
+    spent = defaultdict(float)
+    spent["boot"] += wake[0]["t"]               # ROM/bootloader time before the first mark
+    for cur, nxt in zip(wake, wake[1:]):
+        spent[cur["stage"]] += nxt["t"] - cur["t"]
+    last = wake[-1]
+    if last["stage"] == "sleep":
+        spent["sleep"] += last["arg"]
+    return spent
+
+
+def mah(mw, seconds, battery_mv):
+    return mw * seconds / 3600.0 / (battery_mv / 1000.0)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Summarise a PWR1 power log")
+    parser.add_argument("log")
+    parser.add_argument("--capacity", type=float, default=1500.0, help="battery capacity in mAh")
+    parser.add_argument("--battery-mv", type=float, default=3700.0,
+                        help="nominal battery voltage when a record has none")
+    parser.add_argument("--power", action="append", default=[], metavar="STAGE=MW",
+                        help="override the modelled power of one stage")
+    parser.add_argument("--wakes", action="store_true", help="also print every wake")
+    args = parser.parse_args()
+
+    power = dict(DEFAULT_POWER)
+    for item in args.power:
+        stage, _, mw = item.partition("=")
+        if stage not in power:
+            raise SystemExit("unknown stage %s, one of: %s" % (stage, ", ".join(STAGES)))
+        power[stage] = float(mw)
+
+    wakes = split_wakes(load(args.log))
+    if not wakes:
+        print("no records")
+        return 0
+
+    per_mode = OrderedDict()
+    for wake in wakes:
+        mode = wake[0]["mode"]
+        spent = stage_seconds(wake)
+        mvs = [r["mv"] for r in wake if r["mv"]]
+        battery_mv = sum(mvs) / len(mvs) if mvs else args.battery_mv
+        charge = {s: mah(power[s], sec, battery_mv) for s, sec in spent.items() if s in power}
+        refreshes = sum(1 for r in wake if r["stage"] == "refresh")
+        m = per_mode.setdefault(mode, {
+            "wakes": 0, "refreshes": 0, "seconds": 0.0, "awake": 0.0,
+            "mah": 0.0, "refresh_mah": 0.0, "battery_s": 0.0, "gauge": [],
+        })
+        total_s = sum(spent.values())
+        m["wakes"] += 1
+        m["refreshes"] += refreshes
+        m["seconds"] += total_s
+        m["awake"] += total_s - spent.get("sleep", 0.0)
+        m["mah"] += sum(charge.values())
+        m["refresh_mah"] += charge.get("decode", 0.0) + charge.get("refresh", 0.0)
+        on_battery = not any(r["vbus"] for r in wake)
+        if on_battery:
+            m["battery_s"] += total_s
+            m["gauge"].append((m["battery_s"], wake[0]["pct"], wake[0]["mv"]))
+        if args.wakes:
+            print("wake %5d %-8s awake %6.1fs sleep %6ds %6.3f mAh %4dmV %s%s" % (
+                wake[0]["wake"], mode, total_s - spent.get("sleep", 0.0), spent.get("sleep", 0),
+                sum(charge.values()), wake[0]["mv"],
+                "%d%%" % wake[0]["pct"] if wake[0]["pct"] is not None else "-",
+                "" if on_battery else " usb"))
+
+    if args.wakes:
+        print()
+    print("%-8s %6s %6s %9s %11s %9s %10s %10s" % (
+        "mode", "wakes", "draws", "awake/s", "mAh/draw", "avg mA", "model d", "gauge d"))
+    for mode, m in per_mode.items():
+        avg_ma = m["mah"] / (m["seconds"] / 3600.0) if m["seconds"] else 0.0
+        model_days = args.capacity / avg_ma / 24.0 if avg_ma else float("inf")
+        per_draw = m["refresh_mah"] / m["refreshes"] if m["refreshes"] else 0.0
+        print("%-8s %6d %6d %9.1f %11.3f %9.3f %10.1f %10s" % (
+            mode, m["wakes"], m["refreshes"], m["awake"] / m["wakes"], per_draw, avg_ma,
+            model_days, gauge_days(m["gauge"])))
+    print()
+    print("model: %s, %.0f mAh" % (", ".join("%s=%gmW" % kv for kv in power.items()), args.capacity))
+    return 0
+
+
+def gauge_days(points):
+    """Fuel-gauge percentage drop per day on battery, projected to 100%."""
+    pts = [(s, pct) for s, pct, _ in points if pct is not None]
+    if len(pts) < 2 or pts[-1][0] - pts[0][0] < 3600:
+        return "-"
+    n = len(pts)
+    mean_s = sum(s for s, _ in pts) / n
+    mean_p = sum(p for _, p in pts) / n
+    var = sum((s - mean_s) ** 2 for s, _ in pts)
+    slope = sum((s - mean_s) * (p - mean_p) for s, p in pts) / var     # % per second
+    if slope >= 0:
+        return "-"
+    return "%.1f" % (100.0 / -slope / 86400.0)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -5,7 +5,8 @@ Build the spiffs assets partition
 Usage:
     ./build.py --wakenet_model <wakenet_model_dir> \
         --text_font <text_font_file> \
-        --emoji_collection <emoji_collection_dir>
+        --emoji_collection <emoji_collection_dir> \
+        --epd_fonts <epd_font_dir>
 
 Example:
     ./build.py --wakenet_model ../../managed_components/espressif__esp-sr/model/wakenet_model/wn9_nihaoxiaozhi_tts \
@@ -114,6 +115,19 @@ def process_emoji_collection(emoji_collection_dir, assets_dir):
     return emoji_list
 
 
+def process_epd_fonts(epd_font_dir, assets_dir):
+    """Process epd_fonts parameter, files come from scripts/epd_font_gen.py"""
+    if not epd_font_dir:
+        return []
+
+    fonts = []
+    for file in sorted(os.listdir(epd_font_dir)):
+        if file.startswith("epd_font_") and file.endswith(".bin"):
+            copy_file(os.path.join(epd_font_dir, file), os.path.join(assets_dir, file))
+            fonts.append(file)
+    return fonts
+
+
 def generate_index_json(assets_dir, srmodels, text_font, emoji_collection):
     """Generate index.json file"""
     index_data = {
@@ -174,6 +188,7 @@ def main():
     parser.add_argument('--wakenet_model', help='Path to wakenet model directory')
     parser.add_argument('--text_font', help='Path to text font file')
     parser.add_argument('--emoji_collection', help='Path to emoji collection directory')
+    parser.add_argument('--epd_fonts', help='Path to directory with epd_font_<size>.bin packed fonts')
     
     args = parser.parse_args()
     
@@ -196,6 +211,7 @@ def main():
     srmodels = process_wakenet_model(args.wakenet_model, build_dir, assets_dir)
     text_font = process_text_font(args.text_font, assets_dir)
     emoji_collection = process_emoji_collection(args.emoji_collection, assets_dir)
+    process_epd_fonts(args.epd_fonts, assets_dir)
     
     # Generate index.json
     generate_index_json(assets_dir, srmodels, text_font, emoji_collection)
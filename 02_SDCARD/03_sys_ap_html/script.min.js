@@ -4,6 +4,198 @@ let currentMode = 'AP';
 let rotateAngle = 0;
 let processedBase64 = "";
 let fileFlag = 0; 
+let eventSocket = null;
+let modeKnown = false;
+let sending = false;
+let renderJob = 0;
+let ditherWasm = null;
+
+const DITHER_PALETTE = [[0, 0, 0], [255, 255, 255], [255, 0, 0], [0, 255, 0], [0, 0, 255], [255, 255, 0]];
+const DITHER_TO_INK = [0, 1, 3, 6, 5, 2];
+const INK_RGB = { 0: [0, 0, 0], 1: [255, 255, 255], 2: [255, 255, 0], 3: [255, 0, 0], 5: [0, 0, 255], 6: [0, 255, 0] };
+
+function loadDitherWasm() {
+    if (!('WebAssembly' in window)) return;
+    fetch('dither.wasm')
+        .then(res => res.ok ? res.arrayBuffer() : Promise.reject(new Error(`status ${res.status}`)))
+        .then(buf => WebAssembly.instantiate(buf, {}))
+        .then(result => { ditherWasm = result.instance.exports; })
+        .catch(err => console.warn('dither.wasm unavailable, using the JavaScript dither:', err));
+}
+
+function ditherNearest(r, g, b) {
+    let best = 0, bestDist = 999999;
+    for (let i = 0; i < DITHER_PALETTE.length; i++) {
+        const dr = r - DITHER_PALETTE[i][0], dg = g - DITHER_PALETTE[i][1], db = b - DITHER_PALETTE[i][2];
+        const dist = dr * dr + dg * dg + db * db;
+        if (dist < bestDist) {
+            bestDist = dist;
+            best = i;
+        }
+    }
+    return best;
+}
+
+function ditherDiffuse(row, n, err, weight) {
+    for (let c = 0; c < 3; c++) {
+        const v = row[n + c] + ((err[c] * weight / 16) | 0);
+        row[n + c] = v < 0 ? 0 : (v > 255 ? 255 : v);
+    }
+}
+
+function ditherRowJs(work, next, out, w, hasNext) {
+    out.fill(0);
+    for (let x = 0; x < w; x++) {
+        const idx = x * 3;
+        const ci = ditherNearest(work[idx], work[idx + 1], work[idx + 2]);
+        const p = DITHER_PALETTE[ci];
+        out[x >> 1] |= (x & 1) ? DITHER_TO_INK[ci] : (DITHER_TO_INK[ci] << 4);
+        const err = [work[idx] - p[0], work[idx + 1] - p[1], work[idx + 2] - p[2]];
+        if (x + 1 < w) ditherDiffuse(work, idx + 3, err, 7);
+        if (hasNext) {
+            if (x > 0) ditherDiffuse(next, idx - 3, err, 3);
+            ditherDiffuse(next, idx, err, 5);
+            if (x + 1 < w) ditherDiffuse(next, idx + 3, err, 1);
+        }
+    }
+}
+
+function ditherToInk(rgba, w, h) {
+    const stride = (w + 1) >> 1;
+    if (ditherWasm) {
+        const mem = new Uint8Array(ditherWasm.memory.buffer);
+        mem.set(rgba, ditherWasm.dither_input());
+        if (ditherWasm.dither_run(w, h) === 0) {
+            const out = ditherWasm.dither_output();
+            return mem.slice(out, out + stride * h);
+        }
+    }
+    const ink = new Uint8Array(stride * h);
+    let cur = new Uint8Array(w * 3), next = new Uint8Array(w * 3);
+    const out = new Uint8Array(stride);
+    const loadRow = (dst, y) => {
+        for (let x = 0; x < w; x++) {
+            const i = (y * w + x) * 4;
+            dst[x * 3] = rgba[i];
+            dst[x * 3 + 1] = rgba[i + 1];
+            dst[x * 3 + 2] = rgba[i + 2];
+        }
+    };
+    loadRow(cur, 0);
+    for (let y = 0; y < h; y++) {
+        const hasNext = y + 1 < h;
+        if (hasNext) loadRow(next, y + 1);
+        ditherRowJs(cur, next, out, w, hasNext);
+        ink.set(out, y * stride);
+        [cur, next] = [next, cur];
+    }
+    return ink;
+}
+
+function inkOfPixel(r, g, b) {
+    for (const code in INK_RGB) {
+        const c = INK_RGB[code];
+        if (c[0] === r && c[1] === g && c[2] === b) return Number(code);
+    }
+    return 1;
+}
+
+function createFrame(rgba, width, height) {
+    const stride = (width + 1) >> 1;
+    const frame = new Uint8Array(12 + stride * height);
+    const view = new DataView(frame.buffer);
+    frame.set([0x45, 0x50, 0x44, 0x34], 0);
+    view.setUint16(4, 800, true);
+    view.setUint16(6, 480, true);
+    frame[8] = width === 480 ? 3 : 2;
+    for (let y = 0; y < height; y++) {
+        for (let x = 0; x < width; x++) {
+            const i = (y * width + x) * 4;
+            const code = inkOfPixel(rgba[i], rgba[i + 1], rgba[i + 2]);
+            frame[12 + y * stride + (x >> 1)] |= (x & 1) ? code : (code << 4);
+        }
+    }
+    return frame;
+}
+
+function setSendState(text) {
+    sending = text !== null;
+    SendButton.textContent = sending ? `${text} (Cancel)` : "Send";
+}
+
+function handleDeviceEvent(msg) {
+    const pct = msg.total ? Math.floor(msg.value * 100 / msg.total) : msg.value;
+    const mine = sending && msg.job === renderJob;
+    switch (msg.event) {
+        case "mode":
+            modeKnown = true;
+            updateModeByValue(msg.value === 1 ? 'STA' : 'AP');
+            break;
+        case "recv":    setSendState(`Uploading ${pct}%`); break;
+        case "decode":  renderJob = msg.job; setSendState("Decoding"); break;
+        case "dither":  if (mine) setSendState(`Dithering ${pct}%`); break;
+        case "spi":     if (mine) setSendState("Sending to panel"); break;
+        case "refresh": if (mine) setSendState("Refreshing"); break;
+        case "done":
+            if (mine) {
+                setSendState(null);
+                alert('Display updated!');
+            }
+            break;
+        case "cancelled":
+            setSendState(null);
+            alert('Cancelled');
+            break;
+        case "error":
+            setSendState(null);
+            break;
+    }
+}
+
+function connectDeviceEvents() {
+    eventSocket = new WebSocket(`ws://${location.host}/ws`);
+    eventSocket.onmessage = e => {
+        try {
+            handleDeviceEvent(JSON.parse(e.data));
+        } catch (err) {
+            console.error('Bad device event:', err);
+        }
+    };
+    eventSocket.onclose = () => {
+        eventSocket = null;
+        if (!modeKnown) {
+            fetchNetworkStatus();
+        }
+        setTimeout(connectDeviceEvents, 3000);
+    };
+}
+
+function deviceEventsOpen() {
+    return eventSocket !== null && eventSocket.readyState === WebSocket.OPEN;
+}
+
+function fetchNetworkStatus() {
+    modeKnown = true;
+    fetch('/NetWorkStatus')
+        .then(response => {
+            if (!response.ok) {
+                throw new Error(`Request failed, status code:${response.status}`);
+            }
+            return response.text();
+        })
+        .then(data => {
+            let serverMode = 'AP';
+            const serverCode = parseInt(data);
+            if (!isNaN(serverCode)) {
+                serverMode = serverCode === 1 ? 'STA' : 'AP';
+            }
+            updateModeByValue(serverMode);
+        })
+        .catch(error => {
+            console.error('Failed to obtain network status. Using default AP mode:', error);
+            initializeMode();
+        });
+}
 
 function updateModeByValue(targetMode) {
     const validModes = ['AP', 'STA'];
@@ -64,68 +256,17 @@ function Even_init() {
         ctx.drawImage(img, 0, 0, targetW, targetH);
 
         const imageData = ctx.getImageData(0, 0, canvas.width, canvas.height);
-        const data = imageData.data;
-        const palette = [
-            [0, 0, 0],
-            [255, 255, 255], 
-            [255, 255, 0],
-            [255, 0, 0], 
-            null,
-            [0, 0, 255], 
-            [0, 255, 0]
-        ];
-
-        function findNearestColorIndex(r, g, b) {
-            let minDist = Infinity, nearestIdx = 0;
-            for (let i = 0; i < palette.length; i++) {
-                if (palette[i] === null) continue;
-                const pr = palette[i][0], pg = palette[i][1], pb = palette[i][2];
-                const dist = (r - pr) ** 2 + (g - pg) ** 2 + (b - pb) ** 2;
-                if (dist < minDist) {
-                    minDist = dist;
-                    nearestIdx = i;
-                }
-            }
-            return nearestIdx;
-        }
-        const idxArr = new Uint8Array(canvas.width * canvas.height);
+        const ink = ditherToInk(imageData.data, canvas.width, canvas.height);
+        const stride = (canvas.width + 1) >> 1;
         for (let y = 0; y < canvas.height; y++) {
             for (let x = 0; x < canvas.width; x++) {
+                const code = (ink[y * stride + (x >> 1)] >> ((x & 1) ? 0 : 4)) & 0x0F;
                 const i = (y * canvas.width + x) * 4;
-                const oldR = data[i], oldG = data[i + 1], oldB = data[i + 2];
-                const idx = findNearestColorIndex(oldR, oldG, oldB);
-                const [newR, newG, newB] = palette[idx];
-                data[i] = newR;
-                data[i + 1] = newG;
-                data[i + 2] = newB;
-                idxArr[y * canvas.width + x] = idx;
-                const errR = oldR - newR;
-                const errG = oldG - newG;
-                const errB = oldB - newB;
-                if (x + 1 < canvas.width) {
-                    let j = i + 4;
-                    data[j] = Math.max(0, Math.min(255, data[j] + errR * 7 / 16));
-                    data[j + 1] = Math.max(0, Math.min(255, data[j + 1] + errG * 7 / 16));
-                    data[j + 2] = Math.max(0, Math.min(255, data[j + 2] + errB * 7 / 16));
-                }
-                if (x > 0 && y + 1 < canvas.height) {
-                    let j = i + (canvas.width - 1) * 4;
-                    data[j] = Math.max(0, Math.min(255, data[j] + errR * 3 / 16));
-                    data[j + 1] = Math.max(0, Math.min(255, data[j + 1] + errG * 3 / 16));
-                    data[j + 2] = Math.max(0, Math.min(255, data[j + 2] + errB * 3 / 16));
-                }
-                if (y + 1 < canvas.height) {
-                    let j = i + canvas.width * 4;
-                    data[j] = Math.max(0, Math.min(255, data[j] + errR * 5 / 16));
-                    data[j + 1] = Math.max(0, Math.min(255, data[j + 1] + errG * 5 / 16));
-                    data[j + 2] = Math.max(0, Math.min(255, data[j + 2] + errB * 5 / 16));
-                }
-                if (x + 1 < canvas.width && y + 1 < canvas.height) {
-                    let j = i + (canvas.width + 1) * 4;
-                    data[j] = Math.max(0, Math.min(255, data[j] + errR * 1 / 16));
-                    data[j + 1] = Math.max(0, Math.min(255, data[j + 1] + errG * 1 / 16));
-                    data[j + 2] = Math.max(0, Math.min(255, data[j + 2] + errB * 1 / 16));
-                }
+                const rgb = INK_RGB[code] || INK_RGB[1];
+                imageData.data[i] = rgb[0];
+                imageData.data[i + 1] = rgb[1];
+                imageData.data[i + 2] = rgb[2];
+                imageData.data[i + 3] = 255;
             }
         }
 
@@ -135,7 +276,6 @@ function Even_init() {
             processedBase64 = canvas.toDataURL();
             processedImg.src = processedBase64;
         }
-        window._lastImageIndexArray = idxArr;
     };
 }
 
@@ -199,6 +339,12 @@ function RotateButton_Even() {
 
 function SendButton_Even() {
     let modeByte = 0;
+    if (sending) {
+        if (deviceEventsOpen()) {
+            eventSocket.send("cancel");
+        }
+        return;
+    }
     if (!fileFlag) {
         alert("Please select the picture file");
         return;
@@ -223,6 +369,7 @@ function SendButton_Even() {
             tempCanvas.height = w;
         }
         const ctx = tempCanvas.getContext('2d');
+        ctx.imageSmoothingEnabled = false;
         ctx.save();
         ctx.translate(tempCanvas.width / 2, tempCanvas.height / 2);
         ctx.rotate(rotateAngle * Math.PI / 180);
@@ -291,14 +438,16 @@ function SendButton_Even() {
             return bmpData;
         }
 
-        const pureBmpData = createBMPUint8Array(imageData, width, height);
+        const isPanelSize = (width === 800 && height === 480) || (width === 480 && height === 800);
+        const payload = isPanelSize ? createFrame(rgbaData, width, height) : createBMPUint8Array(imageData, width, height);
 
-        const totalDataSize = 1 + pureBmpData.length;
+        const totalDataSize = 1 + payload.length;
         const finalData = new Uint8Array(totalDataSize);
         finalData[0] = modeByte & 0xFF;
-        finalData.set(pureBmpData, 1);
+        finalData.set(payload, 1);
 
         const finalBlob = new Blob([finalData], { type: 'application/octet-stream' });
+        setSendState("Uploading 0%");
 
         fetch("/dataUP", {
             method: "POST",
@@ -310,8 +459,13 @@ function SendButton_Even() {
         .then(res => {
             if (res.ok && res.status === 200) {
                 return res.text().then(msg => {
-                    alert('Upload successful!');
+                    if (!deviceEventsOpen()) {
+                        setSendState(null);
+                        alert('Upload successful!');
+                    }
                 });
+            } else if (res.status === 409) {
+                setSendState(null);
             } else {
                 return res.text().then(errorMsg => {
                     throw new Error(`Upload failed! ${res.status})${errorMsg ? `: ${errorMsg}` : ''}`);
@@ -321,6 +475,7 @@ function SendButton_Even() {
             }
         }).catch(err => {
             console.error("Upload error:", err);
+            setSendState(null);
             alert("Upload failed!");
         });
     };
@@ -344,24 +499,11 @@ document.addEventListener('DOMContentLoaded', function() {
     bindModeButtonEvents();
 
     Even_init();
+    loadDitherWasm();
 
-    fetch('/NetWorkStatus')
-        .then(response => {
-            if (!response.ok) {
-                throw new Error(`Request failed, status code:${response.status}`);
-            }
-            return response.text();
-        })
-        .then(data => {
-            let serverMode = 'AP';
-            const serverCode = parseInt(data);
-            if (!isNaN(serverCode)) {
-                serverMode = serverCode === 1 ? 'STA' : 'AP';
-            }
-            updateModeByValue(serverMode);
-        })
-        .catch(error => {
-            console.error('Failed to obtain network status. Using default AP mode:', error);
-            initializeMode();
-        });
+    if ('WebSocket' in window) {
+        connectDeviceEvents();
+    } else {
+        fetchNetworkStatus();
+    }
 });
\ No newline at end of file